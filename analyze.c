@@ -0,0 +1,604 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <openssl/crypto.h>
+#include "engine.h"
+#include "arena.h"
+#include "keyring.h"
+#include "pack.h"
+#include "pool.h"
+#include "replay.h"
+
+#define ARENA_BLOCK_SIZE (256 * 1024)
+#define PASSWORD_SIZE 256
+
+// Натрупана статистика за един играч (по име и дали е компютър)
+typedef struct {
+    char name[32];
+    int is_ai;
+    int used;
+    long long games;
+    long long wins;
+    long long incomplete;
+    long long shots;
+    long long hits;
+    long long win_shots;
+    int win_min, win_max;
+    long long win_histogram[BOARD_CELLS + 1];
+    long long think_seconds;
+    long long think_moves;
+    long long cell_shots[BOARD_CELLS];
+    long long cell_hits[BOARD_CELLS];
+} PlayerStats;
+
+// Хеш таблица с отворено адресиране - расте само при нов играч, не при нов файл
+typedef struct {
+    PlayerStats* entries;
+    int capacity;
+    int count;
+} StatsTable;
+
+// Всяка нишка събира статистиката си отделно и държи своя арена за индексите на записите.
+// Последният отворен пакет остава показан, докато нишката взима игри от него.
+// Криптираните записи се разкриптират в буфера на reader, който нишката преизползва.
+typedef struct {
+    Arena arena;
+    ReplayPack pack;
+    int pack_file;
+    KeyringReader reader;
+    StatsTable players;
+    PlayerStats kinds[2];
+    long long analyzed;
+    long long failed;
+    long long moves;
+    char padding[64];
+} AnalyzeWorker;
+
+// Една задача е отделен файл (id -1), криптиран файл (TASK_ENCRYPTED) или една игра от пакет
+#define TASK_ENCRYPTED -2
+
+typedef struct {
+    int file;
+    int id;
+} AnalyzeTask;
+
+typedef struct {
+    char** names;
+    int count;
+    AnalyzeTask* tasks;
+    int task_count;
+    const char* input_dir;
+    const char* password;
+    AnalyzeWorker* workers;
+} AnalyzeJob;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned int stats_hash(const char* name, int is_ai) {
+    unsigned int hash = 2166136261u;
+    for(int i = 0; i < 32 && name[i]; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return (hash ^ (unsigned int)is_ai) * 16777619u;
+}
+
+static void stats_init(PlayerStats* stats, const char* name, int is_ai) {
+    memset(stats, 0, sizeof(PlayerStats));
+    strncpy(stats->name, name, sizeof(stats->name) - 1);
+    stats->is_ai = is_ai;
+    stats->used = 1;
+    stats->win_min = BOARD_CELLS + 1;
+}
+
+static PlayerStats* table_slot(PlayerStats* entries, int capacity, const char* name, int is_ai) {
+    int slot = stats_hash(name, is_ai) & (capacity - 1);
+    while(entries[slot].used &&
+          (entries[slot].is_ai != is_ai || strncmp(entries[slot].name, name, sizeof(entries[slot].name)) != 0)) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    return &entries[slot];
+}
+
+static int table_grow(StatsTable* table) {
+    int capacity = table->capacity ? table->capacity * 2 : 16;
+    PlayerStats* entries = calloc(capacity, sizeof(PlayerStats));
+    if(!entries) return 0;
+    
+    for(int i = 0; i < table->capacity; i++) {
+        if(table->entries[i].used) {
+            *table_slot(entries, capacity, table->entries[i].name, table->entries[i].is_ai) = table->entries[i];
+        }
+    }
+    free(table->entries);
+    table->entries = entries;
+    table->capacity = capacity;
+    return 1;
+}
+
+static PlayerStats* table_find(StatsTable* table, const char* name, int is_ai) {
+    if((table->count + 1) * 2 > table->capacity && !table_grow(table)) {
+        return NULL;
+    }
+    
+    PlayerStats* stats = table_slot(table->entries, table->capacity, name, is_ai);
+    if(!stats->used) {
+        stats_init(stats, name, is_ai);
+        table->count++;
+    }
+    return stats;
+}
+
+static void stats_merge(PlayerStats* into, const PlayerStats* from) {
+    into->games += from->games;
+    into->wins += from->wins;
+    into->incomplete += from->incomplete;
+    into->shots += from->shots;
+    into->hits += from->hits;
+    into->win_shots += from->win_shots;
+    if(from->win_min < into->win_min) into->win_min = from->win_min;
+    if(from->win_max > into->win_max) into->win_max = from->win_max;
+    into->think_seconds += from->think_seconds;
+    into->think_moves += from->think_moves;
+    for(int i = 0; i <= BOARD_CELLS; i++) {
+        into->win_histogram[i] += from->win_histogram[i];
+    }
+    for(int i = 0; i < BOARD_CELLS; i++) {
+        into->cell_shots[i] += from->cell_shots[i];
+        into->cell_hits[i] += from->cell_hits[i];
+    }
+}
+
+// Резултатът на един играч в една игра
+typedef struct {
+    Bitboard shots;
+    Bitboard hits;
+    int shot_count;
+    int hit_count;
+    long long think_seconds;
+    int think_moves;
+} GameSide;
+
+static void stats_add_game(PlayerStats* stats, const GameSide* side, int complete, int won) {
+    if(complete) {
+        stats->games++;
+    } else {
+        stats->incomplete++;
+    }
+    if(won) {
+        stats->wins++;
+        stats->win_shots += side->shot_count;
+        stats->win_histogram[side->shot_count < BOARD_CELLS ? side->shot_count : BOARD_CELLS]++;
+        if(side->shot_count < stats->win_min) stats->win_min = side->shot_count;
+        if(side->shot_count > stats->win_max) stats->win_max = side->shot_count;
+    }
+    stats->shots += side->shot_count;
+    stats->hits += side->hit_count;
+    stats->think_seconds += side->think_seconds;
+    stats->think_moves += side->think_moves;
+    
+    Bitboard shots = side->shots;
+    while(shots) {
+        int cell = bitboard_first(shots);
+        shots &= shots - 1;
+        stats->cell_shots[cell]++;
+    }
+    Bitboard hits = side->hits;
+    while(hits) {
+        int cell = bitboard_first(hits);
+        hits &= hits - 1;
+        stats->cell_hits[cell]++;
+    }
+}
+
+// Изстрелите се четат направо от файла; попаденията се вземат от корабите на противника.
+// Времето за ход е разликата до предишния ход - първият ход включва и разполагането, затова се пропуска.
+static int analyze_replay(AnalyzeJob* job, AnalyzeWorker* worker, const AnalyzeTask* task) {
+    char path[1024];
+    ReplayMap map;
+    
+    snprintf(path, sizeof(path), "%s/%s", job->input_dir, job->names[task->file]);
+    arena_reset(&worker->arena);
+    if(task->id == TASK_ENCRYPTED) {
+        const unsigned char* data;
+        size_t size;
+        if(!keyring_read_file(&worker->reader, path, job->password, &data, &size) ||
+           !replay_map_view(&map, data, size, &worker->arena)) {
+            return 0;
+        }
+    } else if(task->id < 0) {
+        if(!replay_map_open_in(&map, path, &worker->arena)) {
+            return 0;
+        }
+    } else {
+        if(worker->pack_file != task->file) {
+            pack_close(&worker->pack);
+            worker->pack_file = -1;
+            if(!pack_open(&worker->pack, path, 0)) {
+                return 0;
+            }
+            worker->pack_file = task->file;
+        }
+        if(!pack_map(&worker->pack, task->id, &map, &worker->arena)) {
+            return 0;
+        }
+    }
+    
+    const Player* players[2] = {&map.player1_initial, &map.player2_initial};
+    GameSide sides[2];
+    memset(sides, 0, sizeof(sides));
+    
+    for(int i = 0; i < map.move_count; i++) {
+        int cell = replay_map_cell(&map, i);
+        int player = replay_map_player(&map, i);
+        GameSide* side = &sides[player];
+        
+        side->shots |= (Bitboard)1 << cell;
+        side->shot_count++;
+        if(players[!player]->ship_at[cell]) {
+            side->hits |= (Bitboard)1 << cell;
+            side->hit_count++;
+        }
+        if(map.has_start && i > 0) {
+            side->think_seconds += map.moves[i].time - map.moves[i - 1].time;
+            side->think_moves++;
+        }
+    }
+    
+    int ok = 1;
+    for(int p = 0; p < 2; p++) {
+        int is_ai = players[p]->is_ai != 0;
+        PlayerStats* stats = table_find(&worker->players, players[p]->name, is_ai);
+        if(!stats) {
+            ok = 0;
+            break;
+        }
+        int won = map.winner_index == p + 1;
+        stats_add_game(stats, &sides[p], map.complete, won);
+        stats_add_game(&worker->kinds[is_ai], &sides[p], map.complete, won);
+    }
+    worker->moves += map.move_count;
+    
+    replay_map_close(&map);
+    return ok;
+}
+
+static void analyze_one(int task, int worker, void* arg) {
+    AnalyzeJob* job = arg;
+    AnalyzeWorker* state = &job->workers[worker];
+    
+    const AnalyzeTask* item = &job->tasks[task];
+    
+    if(analyze_replay(job, state, item)) {
+        state->analyzed++;
+    } else if(item->id < 0) {
+        state->failed++;
+        fprintf(stderr, "Неуспешен анализ: %s\n", job->names[item->file]);
+    } else {
+        state->failed++;
+        fprintf(stderr, "Неуспешен анализ: %s#%d\n", job->names[item->file], item->id);
+    }
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int has_suffix(const char* name, size_t length, const char* suffix) {
+    size_t suffix_length = strlen(suffix);
+    return length > suffix_length && strcmp(name + length - suffix_length, suffix) == 0;
+}
+
+// Събира имената на всички .replay и .pack файлове в директорията (с encrypted - и .encrypted),
+// подредени по азбучен ред
+static char** list_replays(const char* directory, int encrypted, int* count) {
+    DIR* dir = opendir(directory);
+    if(!dir) {
+        return NULL;
+    }
+    
+    int capacity = 64;
+    char** names = malloc(capacity * sizeof(char*));
+    struct dirent* entry;
+    *count = 0;
+    
+    while(names && (entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if(!has_suffix(entry->d_name, length, ".replay") && !has_suffix(entry->d_name, length, ".pack") &&
+           !(encrypted && has_suffix(entry->d_name, length, ".encrypted"))) continue;
+        
+        if(*count == capacity) {
+            capacity *= 2;
+            char** grown = realloc(names, capacity * sizeof(char*));
+            if(!grown) break;
+            names = grown;
+        }
+        names[*count] = malloc(length + 1);
+        if(!names[*count]) break;
+        memcpy(names[*count], entry->d_name, length + 1);
+        (*count)++;
+    }
+    closedir(dir);
+    
+    if(names) {
+        qsort(names, *count, sizeof(char*), compare_names);
+    }
+    return names;
+}
+
+// Всеки отделен файл е една задача, а пакетът се разгръща на по една задача за игра
+static int build_tasks(AnalyzeJob* job) {
+    int capacity = job->count ? job->count : 1;
+    job->tasks = malloc(capacity * sizeof(AnalyzeTask));
+    job->task_count = 0;
+    
+    for(int file = 0; job->tasks && file < job->count; file++) {
+        int games = 1;
+        ReplayPack pack;
+        if(has_suffix(job->names[file], strlen(job->names[file]), ".pack")) {
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/%s", job->input_dir, job->names[file]);
+            if(!pack_open(&pack, path, 0)) {
+                fprintf(stderr, "Неуспешен анализ: %s\n", job->names[file]);
+                continue;
+            }
+            games = pack.count;
+            pack_close(&pack);
+        }
+        
+        if(job->task_count + games > capacity) {
+            while(job->task_count + games > capacity) capacity *= 2;
+            AnalyzeTask* grown = realloc(job->tasks, capacity * sizeof(AnalyzeTask));
+            if(!grown) break;
+            job->tasks = grown;
+        }
+        int packed = has_suffix(job->names[file], strlen(job->names[file]), ".pack");
+        int encrypted = has_suffix(job->names[file], strlen(job->names[file]), ".encrypted");
+        for(int id = 0; id < games; id++) {
+            job->tasks[job->task_count].file = file;
+            job->tasks[job->task_count].id = packed ? id : encrypted ? TASK_ENCRYPTED : -1;
+            job->task_count++;
+        }
+    }
+    return job->tasks != NULL;
+}
+
+// Играчите с повече игри са първи, при равенство - по име
+static int compare_stats(const void* a, const void* b) {
+    const PlayerStats* first = a;
+    const PlayerStats* second = b;
+    long long games_a = first->games + first->incomplete;
+    long long games_b = second->games + second->incomplete;
+    if(games_a != games_b) return games_a < games_b ? 1 : -1;
+    int order = strncmp(first->name, second->name, sizeof(first->name));
+    return order ? order : first->is_ai - second->is_ai;
+}
+
+static void write_json_string(FILE* out, const char* text, size_t limit) {
+    fputc('"', out);
+    for(size_t i = 0; i < limit && text[i]; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if(c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if(c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static double ratio(long long part, long long whole) {
+    return whole ? (double)part / whole : 0.0;
+}
+
+static void write_stats(FILE* out, const PlayerStats* stats, const char* indent) {
+    fprintf(out, "\"games\": %lld, \"incomplete\": %lld, \"wins\": %lld, \"win_rate\": %.4f,\n",
+            stats->games, stats->incomplete, stats->wins, ratio(stats->wins, stats->games));
+    fprintf(out, "%s\"shots\": %lld, \"hits\": %lld, \"hit_rate\": %.4f, \"seconds_per_move\": %.3f,\n", indent,
+            stats->shots, stats->hits, ratio(stats->hits, stats->shots),
+            ratio(stats->think_seconds, stats->think_moves));
+    
+    fprintf(out, "%s\"shots_to_win\": {\"mean\": %.2f, \"min\": %d, \"max\": %d, \"histogram\": {", indent,
+            ratio(stats->win_shots, stats->wins), stats->wins ? stats->win_min : 0, stats->win_max);
+    int first = 1;
+    for(int i = 0; i <= BOARD_CELLS; i++) {
+        if(!stats->win_histogram[i]) continue;
+        fprintf(out, "%s\"%d\": %lld", first ? "" : ", ", i, stats->win_histogram[i]);
+        first = 0;
+    }
+    fprintf(out, "}},\n");
+    
+    // Процент попадения по клетки - ред по ред (A-J), по колони (1-10)
+    fprintf(out, "%s\"cell_shots\": [", indent);
+    for(int row = 0; row < BOARD_SIZE; row++) {
+        fprintf(out, "%s[", row ? ", " : "");
+        for(int col = 0; col < BOARD_SIZE; col++) {
+            fprintf(out, "%s%lld", col ? ", " : "", stats->cell_shots[row * BOARD_SIZE + col]);
+        }
+        fprintf(out, "]");
+    }
+    fprintf(out, "],\n%s\"cell_hit_rate\": [", indent);
+    for(int row = 0; row < BOARD_SIZE; row++) {
+        fprintf(out, "%s[", row ? ", " : "");
+        for(int col = 0; col < BOARD_SIZE; col++) {
+            int cell = row * BOARD_SIZE + col;
+            fprintf(out, "%s%.4f", col ? ", " : "", ratio(stats->cell_hits[cell], stats->cell_shots[cell]));
+        }
+        fprintf(out, "]");
+    }
+    fprintf(out, "]");
+}
+
+static void write_report(FILE* out, const AnalyzeJob* job, long long analyzed, long long failed, long long moves,
+                         double elapsed, const PlayerStats* kinds, const PlayerStats* players, int player_count) {
+    fprintf(out, "{\n  \"input\": ");
+    write_json_string(out, job->input_dir, strlen(job->input_dir));
+    fprintf(out, ",\n  \"files\": %d, \"replays\": %d, \"analyzed\": %lld, \"failed\": %lld, \"moves\": %lld, \"seconds\": %.3f,\n",
+            job->count, job->task_count, analyzed, failed, moves, elapsed);
+    
+    fprintf(out, "  \"computer\": {");
+    write_stats(out, &kinds[1], "    ");
+    fprintf(out, "},\n  \"human\": {");
+    write_stats(out, &kinds[0], "    ");
+    fprintf(out, "},\n  \"players\": [");
+    
+    for(int i = 0; i < player_count; i++) {
+        fprintf(out, "%s\n    {\"name\": ", i ? "," : "");
+        write_json_string(out, players[i].name, sizeof(players[i].name));
+        fprintf(out, ", \"ai\": %s,\n      ", players[i].is_ai ? "true" : "false");
+        write_stats(out, &players[i], "      ");
+        fprintf(out, "}");
+    }
+    fprintf(out, "%s]\n}\n", player_count ? "\n  " : "");
+}
+
+static void print_usage(const char* program) {
+    printf("Употреба: %s [-i входна_директория] [-o изходен_файл] [-t нишки] [-p файл_с_парола]\n", program);
+    printf("  Обхожда всички .replay файлове и игрите в пакетите (.pack) паралелно\n");
+    printf("  и извежда статистика по играчи в JSON\n");
+    printf("  (процент победи, изстрели до победа, попадения по клетки, време за ход)\n");
+    printf("  -p  разкриптира и анализира и криптираните записи (.encrypted); паролата е на първия\n");
+    printf("      ред на файла (- за стандартния вход)\n");
+}
+
+int main(int argc, char** argv) {
+    AnalyzeJob job;
+    memset(&job, 0, sizeof(job));
+    job.input_dir = "replays";
+    const char* output = NULL;
+    int workers = pool_default_workers();
+    const char* password_source = NULL;
+    char password[PASSWORD_SIZE];
+    
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            job.input_dir = argv[++i];
+        } else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            password_source = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if(workers < 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    
+    // Паролата се проверява веднъж по файла на директорията, преди нишките да тръгнат
+    if(password_source) {
+        if(!keyring_read_password(password_source, password, sizeof(password))) {
+            printf("Не може да се прочете паролата от %s!\n", password_source);
+            return 1;
+        }
+        if(!keyring_unlock_directory(job.input_dir, password)) {
+            printf("Грешна парола за %s!\n", job.input_dir);
+            return 1;
+        }
+        job.password = password;
+    }
+    
+    job.names = list_replays(job.input_dir, password_source != NULL, &job.count);
+    if(!job.names) {
+        printf("Не може да се отвори директорията %s!\n", job.input_dir);
+        return 1;
+    }
+    
+    job.workers = calloc(workers, sizeof(AnalyzeWorker));
+    if(!job.workers || !build_tasks(&job)) {
+        printf("Грешка при алокиране на памет!\n");
+        return 1;
+    }
+    for(int w = 0; w < workers; w++) {
+        arena_init(&job.workers[w].arena, ARENA_BLOCK_SIZE);
+        job.workers[w].pack_file = -1;
+        if(!keyring_reader_init(&job.workers[w].reader)) {
+            printf("Грешка при алокиране на памет!\n");
+            return 1;
+        }
+        stats_init(&job.workers[w].kinds[0], "", 0);
+        stats_init(&job.workers[w].kinds[1], "", 1);
+    }
+    
+    double start = now_seconds();
+    pool_run(workers, job.task_count, analyze_one, &job);
+    
+    // Сливане на таблиците на нишките
+    StatsTable players = {NULL, 0, 0};
+    PlayerStats kinds[2];
+    stats_init(&kinds[0], "", 0);
+    stats_init(&kinds[1], "", 1);
+    long long analyzed = 0, failed = 0, moves = 0;
+    for(int w = 0; w < workers; w++) {
+        AnalyzeWorker* worker = &job.workers[w];
+        analyzed += worker->analyzed;
+        failed += worker->failed;
+        moves += worker->moves;
+        stats_merge(&kinds[0], &worker->kinds[0]);
+        stats_merge(&kinds[1], &worker->kinds[1]);
+        for(int i = 0; i < worker->players.capacity; i++) {
+            const PlayerStats* from = &worker->players.entries[i];
+            if(!from->used) continue;
+            PlayerStats* into = table_find(&players, from->name, from->is_ai);
+            if(into) {
+                stats_merge(into, from);
+            }
+        }
+        free(worker->players.entries);
+        pack_close(&worker->pack);
+        keyring_reader_free(&worker->reader);
+        arena_free(&worker->arena);
+    }
+    if(job.password) {
+        OPENSSL_cleanse(password, sizeof(password));
+        keyring_clear();
+    }
+    free(job.workers);
+    
+    // Плътен подреден списък на играчите за изхода
+    int player_count = 0;
+    for(int i = 0; i < players.capacity; i++) {
+        if(players.entries[i].used) {
+            players.entries[player_count++] = players.entries[i];
+        }
+    }
+    qsort(players.entries, player_count, sizeof(PlayerStats), compare_stats);
+    double elapsed = now_seconds() - start;
+    
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if(!out) {
+        printf("Не може да се създаде файлът %s!\n", output);
+        return 1;
+    }
+    write_report(out, &job, analyzed, failed, moves, elapsed, kinds, players.entries, player_count);
+    if(output) {
+        fclose(out);
+        printf("=== АНАЛИЗ НА ЗАПИСИ ===\n");
+        printf("Записи: %lld, неуспешни: %lld, нишки: %d\n", analyzed, failed, workers);
+        printf("Играчи: %d, ходове: %lld\n", player_count, moves);
+        printf("Време: %.3f s (%.0f записа/сек)\n", elapsed, elapsed > 0 ? analyzed / elapsed : 0.0);
+        printf("Изход: %s\n", output);
+    }
+    
+    free(players.entries);
+    for(int i = 0; i < job.count; i++) {
+        free(job.names[i]);
+    }
+    free(job.names);
+    free(job.tasks);
+    return failed ? 1 : 0;
+}
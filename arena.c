@@ -0,0 +1,77 @@
+#include <stdlib.h>
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+
+struct ArenaBlock {
+    ArenaBlock* next;
+    size_t size;
+    size_t used;
+    unsigned char* data;
+};
+
+void arena_init(Arena* arena, size_t block_size) {
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->block_size = block_size ? block_size : 64 * 1024;
+}
+
+static ArenaBlock* arena_block(size_t size) {
+    ArenaBlock* block = malloc(sizeof(ArenaBlock) + ARENA_ALIGN + size);
+    if(!block) return NULL;
+    
+    // Данните започват след заглавието, подравнени на 16 байта
+    size_t start = (size_t)(block + 1);
+    start = (start + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    block->data = (unsigned char*)start;
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    
+    // Търси място в текущия блок и в вече заделените след него
+    while(arena->current) {
+        ArenaBlock* block = arena->current;
+        if(block->size - block->used >= size) {
+            void* result = block->data + block->used;
+            block->used += size;
+            return result;
+        }
+        if(!block->next) break;
+        arena->current = block->next;
+        arena->current->used = 0;
+    }
+    
+    ArenaBlock* block = arena_block(size > arena->block_size ? size : arena->block_size);
+    if(!block) return NULL;
+    if(arena->current) {
+        arena->current->next = block;
+    } else {
+        arena->first = block;
+    }
+    arena->current = block;
+    block->used = size;
+    return block->data;
+}
+
+void arena_reset(Arena* arena) {
+    arena->current = arena->first;
+    if(arena->current) {
+        arena->current->used = 0;
+    }
+}
+
+void arena_free(Arena* arena) {
+    ArenaBlock* block = arena->first;
+    while(block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first = NULL;
+    arena->current = NULL;
+}
@@ -0,0 +1,324 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include "catalog.h"
+#include "pack.h"
+#include "replay.h"
+
+// Файлът започва с "BSCT" и байт версия, следват записи от по CATALOG_RECORD байта:
+// низовете са с фиксирана ширина (допълнени с нули), броят ходове - 4 байта little-endian,
+// последният байт е 1 за криптиран запис.
+#define CATALOG_MAGIC "BSCT"
+#define CATALOG_VERSION 1
+#define CATALOG_HEADER 5
+#define CATALOG_RECORD (64 + 32 * 3 + 30 * 2 + 4 + 1)
+
+static void copy_field(char* to, const char* from, size_t size) {
+    strncpy(to, from, size - 1);
+    to[size - 1] = '\0';
+}
+
+void catalog_entry_from_replay(CatalogEntry* entry, const char* filename, const GameReplay* replay, int encrypted) {
+    memset(entry, 0, sizeof(CatalogEntry));
+    
+    // В каталога се пази само името на файла, без директорията
+    const char* base = strrchr(filename, '/');
+    copy_field(entry->filename, base ? base + 1 : filename, sizeof(entry->filename));
+    copy_field(entry->player1, replay->player1_initial.name, sizeof(entry->player1));
+    copy_field(entry->player2, replay->player2_initial.name, sizeof(entry->player2));
+    copy_field(entry->winner, replay->winner, sizeof(entry->winner));
+    copy_field(entry->start_time, replay->start_time, sizeof(entry->start_time));
+    copy_field(entry->end_time, replay->end_time, sizeof(entry->end_time));
+    entry->move_count = replay->move_count;
+    entry->encrypted = encrypted;
+}
+
+static void encode_entry(unsigned char* record, const CatalogEntry* entry) {
+    unsigned char* p = record;
+    memcpy(p, entry->filename, sizeof(entry->filename)); p += sizeof(entry->filename);
+    memcpy(p, entry->player1, sizeof(entry->player1)); p += sizeof(entry->player1);
+    memcpy(p, entry->player2, sizeof(entry->player2)); p += sizeof(entry->player2);
+    memcpy(p, entry->winner, sizeof(entry->winner)); p += sizeof(entry->winner);
+    memcpy(p, entry->start_time, sizeof(entry->start_time)); p += sizeof(entry->start_time);
+    memcpy(p, entry->end_time, sizeof(entry->end_time)); p += sizeof(entry->end_time);
+    for(int i = 0; i < 4; i++) {
+        *p++ = (unsigned char)((unsigned int)entry->move_count >> (8 * i));
+    }
+    *p = entry->encrypted ? 1 : 0;
+}
+
+static void decode_entry(const unsigned char* record, CatalogEntry* entry) {
+    const unsigned char* p = record;
+    memcpy(entry->filename, p, sizeof(entry->filename)); p += sizeof(entry->filename);
+    memcpy(entry->player1, p, sizeof(entry->player1)); p += sizeof(entry->player1);
+    memcpy(entry->player2, p, sizeof(entry->player2)); p += sizeof(entry->player2);
+    memcpy(entry->winner, p, sizeof(entry->winner)); p += sizeof(entry->winner);
+    memcpy(entry->start_time, p, sizeof(entry->start_time)); p += sizeof(entry->start_time);
+    memcpy(entry->end_time, p, sizeof(entry->end_time)); p += sizeof(entry->end_time);
+    unsigned int moves = 0;
+    for(int i = 0; i < 4; i++) {
+        moves |= (unsigned int)*p++ << (8 * i);
+    }
+    entry->move_count = (int)moves;
+    entry->encrypted = *p == 1;
+    
+    // Повреден файл не бива да остави низ без край
+    entry->filename[sizeof(entry->filename) - 1] = '\0';
+    entry->player1[sizeof(entry->player1) - 1] = '\0';
+    entry->player2[sizeof(entry->player2) - 1] = '\0';
+    entry->winner[sizeof(entry->winner) - 1] = '\0';
+    entry->start_time[sizeof(entry->start_time) - 1] = '\0';
+    entry->end_time[sizeof(entry->end_time) - 1] = '\0';
+}
+
+static int write_header(FILE* file) {
+    unsigned char header[CATALOG_HEADER];
+    memcpy(header, CATALOG_MAGIC, 4);
+    header[4] = CATALOG_VERSION;
+    return fwrite(header, 1, CATALOG_HEADER, file) == CATALOG_HEADER;
+}
+
+static void catalog_path(char* path, size_t size, const char* directory) {
+    snprintf(path, size, "%s/%s", directory, CATALOG_FILE);
+}
+
+static CatalogEntry* read_catalog(const char* path, int* count) {
+    *count = 0;
+    FILE* file = fopen(path, "rb");
+    if(!file) {
+        return NULL;
+    }
+    
+    // Целият файл се чете с едно четене
+    unsigned char* data = NULL;
+    long size = -1;
+    if(fseek(file, 0, SEEK_END) == 0) {
+        size = ftell(file);
+    }
+    if(size >= CATALOG_HEADER && fseek(file, 0, SEEK_SET) == 0) {
+        data = malloc(size);
+    }
+    if(!data || fread(data, 1, size, file) != (size_t)size ||
+       memcmp(data, CATALOG_MAGIC, 4) != 0 || data[4] != CATALOG_VERSION) {
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    
+    // Непълен последен запис (прекъснат запис във файла) се пропуска
+    int records = (int)((size - CATALOG_HEADER) / CATALOG_RECORD);
+    CatalogEntry* entries = malloc((records ? records : 1) * sizeof(CatalogEntry));
+    if(entries) {
+        for(int i = 0; i < records; i++) {
+            decode_entry(data + CATALOG_HEADER + (size_t)i * CATALOG_RECORD, &entries[i]);
+        }
+        *count = records;
+    }
+    free(data);
+    return entries;
+}
+
+static int has_suffix(const char* name, const char* suffix) {
+    size_t length = strlen(name);
+    size_t suffix_length = strlen(suffix);
+    return length > suffix_length && strcmp(name + length - suffix_length, suffix) == 0;
+}
+
+// Игрите от един пакет се подреждат по номер, а не по азбучен ред
+static int compare_entries(const void* a, const void* b) {
+    const char* first = ((const CatalogEntry*)a)->filename;
+    const char* second = ((const CatalogEntry*)b)->filename;
+    const char* first_mark = strrchr(first, '#');
+    const char* second_mark = strrchr(second, '#');
+    if(first_mark && second_mark && first_mark - first == second_mark - second &&
+       strncmp(first, second, first_mark - first) == 0) {
+        return atoi(first_mark + 1) - atoi(second_mark + 1);
+    }
+    return strcmp(first, second);
+}
+
+static CatalogEntry* next_entry(CatalogEntry** entries, int* count, int* capacity) {
+    if(*count == *capacity) {
+        CatalogEntry* grown = realloc(*entries, *capacity * 2 * sizeof(CatalogEntry));
+        if(!grown) return NULL;
+        *entries = grown;
+        *capacity *= 2;
+    }
+    CatalogEntry* item = &(*entries)[*count];
+    memset(item, 0, sizeof(CatalogEntry));
+    return item;
+}
+
+static void describe(CatalogEntry* item, const ReplayMap* map) {
+    copy_field(item->player1, map->player1_initial.name, sizeof(item->player1));
+    copy_field(item->player2, map->player2_initial.name, sizeof(item->player2));
+    copy_field(item->winner, map->winner, sizeof(item->winner));
+    copy_field(item->start_time, map->start_time, sizeof(item->start_time));
+    copy_field(item->end_time, map->end_time, sizeof(item->end_time));
+    item->move_count = map->move_count;
+}
+
+// Всяка игра от пакет е отделен ред с име "пакет#номер"
+static void rebuild_pack(CatalogEntry** entries, int* count, int* capacity,
+                         const char* directory, const char* name, const char* skip) {
+    char file_path[1024];
+    ReplayPack pack;
+    snprintf(file_path, sizeof(file_path), "%s/%s", directory, name);
+    if(!pack_open(&pack, file_path, 0)) return;
+    
+    for(int id = 0; id < pack.count; id++) {
+        char ref[sizeof((*entries)->filename)];
+        ReplayMap map;
+        snprintf(ref, sizeof(ref), "%s#%d", name, id);
+        if(skip && strcmp(ref, skip) == 0) continue;
+        if(!pack_map(&pack, id, &map, NULL)) continue;
+        
+        CatalogEntry* item = next_entry(entries, count, capacity);
+        if(item) {
+            copy_field(item->filename, ref, sizeof(item->filename));
+            describe(item, &map);
+            (*count)++;
+        }
+        replay_map_close(&map);
+    }
+    pack_close(&pack);
+}
+
+// skip е файлът, който извикващият ще добави сам след това
+static int rebuild(const char* path, const char* directory, const char* skip) {
+    DIR* dir = opendir(directory);
+    if(!dir) {
+        return 0;
+    }
+    
+    int capacity = 64, count = 0;
+    CatalogEntry* entries = malloc(capacity * sizeof(CatalogEntry));
+    struct dirent* entry;
+    
+    while(entries && (entry = readdir(dir)) != NULL) {
+        // Мястото за номера на игрите в пакета остава в името
+        if(has_suffix(entry->d_name, ".pack") && strlen(entry->d_name) + 12 < sizeof(entries->filename)) {
+            rebuild_pack(&entries, &count, &capacity, directory, entry->d_name, skip);
+            continue;
+        }
+        
+        int encrypted = has_suffix(entry->d_name, ".encrypted");
+        if(!encrypted && !has_suffix(entry->d_name, ".replay")) continue;
+        if(strlen(entry->d_name) >= sizeof(entries->filename)) continue;
+        if(skip && strcmp(entry->d_name, skip) == 0) continue;
+        
+        CatalogEntry* item = next_entry(&entries, &count, &capacity);
+        if(!item) break;
+        copy_field(item->filename, entry->d_name, sizeof(item->filename));
+        item->encrypted = encrypted;
+        
+        if(!encrypted) {
+            char file_path[1024];
+            ReplayMap map;
+            snprintf(file_path, sizeof(file_path), "%s/%s", directory, entry->d_name);
+            if(!replay_map_open(&map, file_path)) continue;
+            describe(item, &map);
+            replay_map_close(&map);
+        }
+        count++;
+    }
+    closedir(dir);
+    if(!entries) {
+        return 0;
+    }
+    qsort(entries, count, sizeof(CatalogEntry), compare_entries);
+    
+    // Новият каталог се пише встрани и замества стария наведнъж
+    char temp[1024];
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    FILE* file = fopen(temp, "wb");
+    int ok = file != NULL && write_header(file);
+    unsigned char record[CATALOG_RECORD];
+    for(int i = 0; ok && i < count; i++) {
+        encode_entry(record, &entries[i]);
+        ok = fwrite(record, 1, CATALOG_RECORD, file) == CATALOG_RECORD;
+    }
+    if(file && fclose(file) != 0) {
+        ok = 0;
+    }
+    free(entries);
+    
+    if(ok) {
+        remove(path);
+        ok = rename(temp, path) == 0;
+    }
+    if(!ok) {
+        remove(temp);
+    }
+    return ok;
+}
+
+// Краят на последния цял запис; -1, ако каталогът е повреден
+static long records_end(FILE* file) {
+    unsigned char header[CATALOG_HEADER];
+    if(fread(header, 1, CATALOG_HEADER, file) != CATALOG_HEADER || memcmp(header, CATALOG_MAGIC, 4) != 0 ||
+       header[4] != CATALOG_VERSION || fseek(file, 0, SEEK_END) != 0) {
+        return -1;
+    }
+    long size = ftell(file);
+    if(size < CATALOG_HEADER) return -1;
+    return CATALOG_HEADER + (size - CATALOG_HEADER) / CATALOG_RECORD * CATALOG_RECORD;
+}
+
+int catalog_add(const char* directory, const CatalogEntry* entry) {
+    char path[1024];
+    catalog_path(path, sizeof(path), directory);
+    
+    // Без каталог (или с повреден) първо се описват записите, които вече са в директорията
+    FILE* file = fopen(path, "r+b");
+    long end = file ? records_end(file) : -1;
+    if(end < 0) {
+        if(file) fclose(file);
+        if(!rebuild(path, directory, entry->filename)) {
+            return 0;
+        }
+        file = fopen(path, "r+b");
+        end = file ? records_end(file) : -1;
+        if(end < 0) {
+            if(file) fclose(file);
+            return 0;
+        }
+    }
+    
+    // Непълен последен запис от прекъснато добавяне се отрязва - иначе новият
+    // и всички следващи записи биха се изместили спрямо границите на редовете
+    if(fseek(file, end, SEEK_SET) != 0 || ftruncate(fileno(file), end) != 0) {
+        fclose(file);
+        return 0;
+    }
+    unsigned char record[CATALOG_RECORD];
+    encode_entry(record, entry);
+    int ok = fwrite(record, 1, CATALOG_RECORD, file) == CATALOG_RECORD;
+    return fclose(file) == 0 && ok;
+}
+
+CatalogEntry* catalog_load(const char* directory, int* count) {
+    char path[1024];
+    catalog_path(path, sizeof(path), directory);
+    
+    CatalogEntry* entries = read_catalog(path, count);
+    if(!entries && rebuild(path, directory, NULL)) {
+        entries = read_catalog(path, count);
+    }
+    return entries;
+}
+
+int catalog_rebuild(const char* directory) {
+    char path[1024];
+    catalog_path(path, sizeof(path), directory);
+    return rebuild(path, directory, NULL);
+}
+
+int catalog_match(const CatalogEntry* entry, const char* text) {
+    return !text[0] || strstr(entry->player1, text) || strstr(entry->player2, text);
+}
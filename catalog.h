@@ -0,0 +1,36 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include "engine.h"
+
+// Каталог на записите в директорията (catalog.idx в нея).
+// Всеки запазен запис добавя един ред с фиксиран размер в края на файла, затова
+// списъкът и търсенето са едно последователно четене, без обхождане на директорията.
+// Данните за криптираните записи (имена, победител, време) също се пазят некриптирани.
+#define CATALOG_FILE "catalog.idx"
+
+typedef struct {
+    char filename[64];
+    char player1[32];
+    char player2[32];
+    char winner[32];
+    char start_time[30];
+    char end_time[30];
+    int move_count;
+    int encrypted;
+} CatalogEntry;
+
+void catalog_entry_from_replay(CatalogEntry* entry, const char* filename, const GameReplay* replay, int encrypted);
+
+// Ако каталогът липсва, add и load първо го създават от файловете в директорията -
+// така се описват и записите отпреди каталога. Игрите от пакет са с име "пакет#номер". Имената на играчите на криптираните
+// записи тогава не се знаят и остават празни.
+int catalog_add(const char* directory, const CatalogEntry* entry);
+// Връща всички записи от каталога (освобождават се с free), NULL при грешка
+CatalogEntry* catalog_load(const char* directory, int* count);
+int catalog_rebuild(const char* directory);
+
+// Името на играча съдържа text (празен text отговаря на всички)
+int catalog_match(const CatalogEntry* entry, const char* text);
+
+#endif
@@ -0,0 +1,347 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <openssl/crypto.h>
+#include "catalog.h"
+#include "engine.h"
+#include "keyring.h"
+#include "pack.h"
+#include "pool.h"
+#include "replay.h"
+
+#define PASSWORD_SIZE 256
+
+// Криптираните записи се разкриптират паралелно - всяка нишка със свой KeyringReader,
+// а в пакета се добавят после по реда на имената
+typedef struct {
+    const char* directory;
+    const char* password;
+    char** names;
+    GameReplay* replays;
+    int* decoded;
+    KeyringReader* readers;
+} DecryptJob;
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Събира имената на всички файлове с окончание suffix в директорията, подредени по азбучен ред
+static char** list_replays(const char* directory, const char* suffix, int* count) {
+    DIR* dir = opendir(directory);
+    if(!dir) {
+        return NULL;
+    }
+    
+    int capacity = 64;
+    char** names = malloc(capacity * sizeof(char*));
+    struct dirent* entry;
+    size_t suffix_length = strlen(suffix);
+    *count = 0;
+    
+    while(names && (entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if(length <= suffix_length || strcmp(entry->d_name + length - suffix_length, suffix) != 0) continue;
+        
+        if(*count == capacity) {
+            capacity *= 2;
+            char** grown = realloc(names, capacity * sizeof(char*));
+            if(!grown) break;
+            names = grown;
+        }
+        names[*count] = malloc(length + 1);
+        if(!names[*count]) break;
+        memcpy(names[*count], entry->d_name, length + 1);
+        (*count)++;
+    }
+    closedir(dir);
+    
+    if(names) {
+        qsort(names, *count, sizeof(char*), compare_names);
+    }
+    return names;
+}
+
+static void free_names(char** names, int count) {
+    for(int i = 0; names && i < count; i++) free(names[i]);
+    free(names);
+}
+
+static void decrypt_one(int task, int worker, void* arg) {
+    DecryptJob* job = arg;
+    char path[1024];
+    const unsigned char* data;
+    size_t size;
+    
+    snprintf(path, sizeof(path), "%s/%s", job->directory, job->names[task]);
+    job->decoded[task] = keyring_read_file(&job->readers[worker], path, job->password, &data, &size) &&
+                         replay_decode(data, size, &job->replays[task]);
+}
+
+// Разкриптира и проверява всички файлове от names; replays[i] е попълнен, ако decoded[i]
+static int decrypt_replays(const char* directory, const char* password, char** names, int count,
+                           GameReplay* replays, int* decoded) {
+    int workers = pool_default_workers();
+    if(workers > count) workers = count > 0 ? count : 1;
+    DecryptJob job = {directory, password, names, replays, decoded, calloc(workers, sizeof(KeyringReader))};
+    if(!job.readers) return 0;
+    
+    int ok = 1;
+    for(int w = 0; w < workers; w++) {
+        ok = keyring_reader_init(&job.readers[w]) && ok;
+    }
+    if(ok) {
+        pool_run(workers, count, decrypt_one, &job);
+    }
+    for(int w = 0; w < workers; w++) {
+        keyring_reader_free(&job.readers[w]);
+    }
+    free(job.readers);
+    return ok;
+}
+
+// Отделните записи се добавят в пакета и се изтриват едва след като индексът е записан.
+// С парола (само заедно с -d) се добавят и криптираните записи - в пакета те са некриптирани,
+// а криптираните файлове остават.
+static int compact_directory(const char* directory, const char* pack_path, int keep, int compress,
+                             const char* password) {
+    int count;
+    char** names = list_replays(directory, ".replay", &count);
+    if(!names) {
+        printf("Не може да се отвори директорията %s!\n", directory);
+        return 0;
+    }
+    
+    ReplayPack pack;
+    if(!pack_open(&pack, pack_path, 1)) {
+        printf("Не може да се отвори пакетът %s!\n", pack_path);
+        free_names(names, count);
+        return 0;
+    }
+    int first = pack.count;
+    int failed = 0;
+    
+    int encrypted_count = 0;
+    char** encrypted = NULL;
+    GameReplay* replays = NULL;
+    int* decoded = NULL;
+    if(password) {
+        encrypted = list_replays(directory, ".encrypted", &encrypted_count);
+        replays = calloc(encrypted_count ? encrypted_count : 1, sizeof(GameReplay));
+        decoded = calloc(encrypted_count ? encrypted_count : 1, sizeof(int));
+        if(!encrypted || !replays || !decoded ||
+           !decrypt_replays(directory, password, encrypted, encrypted_count, replays, decoded)) {
+            printf("Грешка при разкриптиране на записите!\n");
+            failed++;
+            for(int i = 0; decoded && replays && i < encrypted_count; i++) {
+                if(decoded[i]) free_replay(&replays[i]);
+            }
+            free(decoded);
+            decoded = NULL;
+        }
+    }
+    
+    int* packed = calloc(count ? count : 1, sizeof(int));
+    for(int i = 0; packed && i < count; i++) {
+        char path[1024];
+        GameReplay replay;
+        snprintf(path, sizeof(path), "%s/%s", directory, names[i]);
+        if(!replay_load(path, &replay)) {
+            printf("%s: не е запис на игра, пропуска се\n", names[i]);
+            failed++;
+            continue;
+        }
+        packed[i] = pack_append_replay(&pack, names[i], &replay, compress) >= 0;
+        free_replay(&replay);
+        if(!packed[i]) {
+            printf("%s: грешка при запис в пакета\n", names[i]);
+            failed++;
+        }
+    }
+    int plaintext = 0;
+    for(int i = 0; decoded && i < encrypted_count; i++) {
+        if(!decoded[i]) {
+            printf("%s: не може да се разкриптира, пропуска се\n", encrypted[i]);
+            failed++;
+            continue;
+        }
+        if(pack_append_replay(&pack, encrypted[i], &replays[i], compress) < 0) {
+            printf("%s: грешка при запис в пакета\n", encrypted[i]);
+            failed++;
+        } else {
+            plaintext++;
+        }
+        free_replay(&replays[i]);
+    }
+    
+    int total = pack.count;
+    int ok = pack_close(&pack) && packed;
+    if(ok && !keep) {
+        for(int i = 0; i < count; i++) {
+            if(!packed[i]) continue;
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/%s", directory, names[i]);
+            remove(path);
+        }
+    }
+    
+    // Каталогът на директорията вече сочи към пакета
+    char catalog[1024];
+    snprintf(catalog, sizeof(catalog), "%s/%s", directory, CATALOG_FILE);
+    FILE* file = fopen(catalog, "rb");
+    if(file) {
+        fclose(file);
+        if(ok && !catalog_rebuild(directory)) {
+            printf("Каталогът %s не е обновен!\n", catalog);
+        }
+    }
+    
+    if(ok && total == first) {
+        printf("%s: няма отделни записи за добавяне\n", pack_path);
+    } else if(ok) {
+        printf("%s: добавени %d записа (игри %d-%d), неуспешни: %d\n", pack_path, total - first,
+               first, total - 1, failed);
+    } else {
+        printf("%s: грешка при запис на индекса, отделните файлове са запазени\n", pack_path);
+    }
+    if(ok && plaintext) {
+        printf("Внимание: %d криптирани записа са в %s некриптирани - всеки с достъп до пакета може да ги чете.\n",
+               plaintext, pack_path);
+    }
+    
+    free(packed);
+    free_names(names, count);
+    free_names(encrypted, encrypted_count);
+    free(replays);
+    free(decoded);
+    return ok && !failed;
+}
+
+static int list_pack(const char* pack_path) {
+    ReplayPack pack;
+    if(!pack_open(&pack, pack_path, 0)) {
+        printf("Не може да се отвори пакетът %s!\n", pack_path);
+        return 0;
+    }
+    
+    for(int id = 0; id < pack.count; id++) {
+        ReplayMap map;
+        printf("%d\t%s\t%u", id, pack.entries[id].name, pack.entries[id].size);
+        if(pack_map(&pack, id, &map, NULL)) {
+            printf("\t%s - %s\t%d хода", map.player1_initial.name, map.player2_initial.name, map.move_count);
+            replay_map_close(&map);
+        }
+        printf("\n");
+    }
+    printf("Игри: %d\n", pack.count);
+    pack_close(&pack);
+    return 1;
+}
+
+static int extract_game(const char* pack_path, int id, const char* output) {
+    ReplayPack pack;
+    unsigned char* data;
+    size_t size;
+    if(!pack_open(&pack, pack_path, 0) || !pack_read(&pack, id, &data, &size)) {
+        printf("В %s няма игра с номер %d!\n", pack_path, id);
+        pack_close(&pack);
+        return 0;
+    }
+    pack_close(&pack);
+    
+    FILE* file = fopen(output, "wb");
+    int ok = file && fwrite(data, 1, size, file) == size;
+    if(file && fclose(file) != 0) ok = 0;
+    free(data);
+    
+    printf(ok ? "Игра %d е записана в %s\n" : "Игра %d не може да се запише в %s!\n", id, output);
+    return ok;
+}
+
+static void print_usage(const char* program) {
+    printf("Употреба: %s [-k] [-z] [-p файл_с_парола -d] [-o пакет] директория\n", program);
+    printf("          %s -l пакет\n", program);
+    printf("          %s -x пакет номер изходен_файл\n", program);
+    printf("  Премества отделните .replay файлове от директорията в пакет (по подразбиране директория/%s)\n",
+           PACK_FILE);
+    printf("  -k  запазва и отделните файлове\n");
+    printf("  -z  компресира игрите (формат BSRZ) - около три пъти по-малко място\n");
+    printf("  -p  паролата за криптираните записи (.encrypted) е на първия ред на файла (- за стандартния вход)\n");
+    printf("  -d  разкриптира паралелно криптираните записи и ги добавя в пакета НЕКРИПТИРАНИ;\n");
+    printf("      изисква -p. Криптираните файлове не се изтриват.\n");
+    printf("  -l  показва игрите в пакета, -x извлича една игра като отделен .replay файл\n");
+}
+
+int main(int argc, char** argv) {
+    const char* pack_path = NULL;
+    const char* directory = NULL;
+    int keep = 0;
+    int compress = 0;
+    int decrypt = 0;
+    const char* password_source = NULL;
+    char password[PASSWORD_SIZE];
+    
+    if(argc == 3 && strcmp(argv[1], "-l") == 0) {
+        return list_pack(argv[2]) ? 0 : 1;
+    }
+    if(argc == 5 && strcmp(argv[1], "-x") == 0) {
+        return extract_game(argv[2], atoi(argv[3]), argv[4]) ? 0 : 1;
+    }
+    
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-k") == 0) {
+            keep = 1;
+        } else if(strcmp(argv[i], "-z") == 0) {
+            compress = 1;
+        } else if(strcmp(argv[i], "-d") == 0) {
+            decrypt = 1;
+        } else if(strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            password_source = argv[++i];
+        } else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            pack_path = argv[++i];
+        } else if(argv[i][0] != '-' && !directory) {
+            directory = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if(!directory) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    // Пакетът не е криптиран - разкриптираните записи влизат в него само при изрично -d
+    if(password_source && !decrypt) {
+        printf("С -p криптираните записи се добавят в пакета некриптирани. Добавете -d, ако това е желаното.\n");
+        return 1;
+    }
+    if(decrypt && !password_source) {
+        printf("-d изисква паролата на записите (-p)!\n");
+        return 1;
+    }
+    
+    char default_path[1024];
+    if(!pack_path) {
+        snprintf(default_path, sizeof(default_path), "%s/%s", directory, PACK_FILE);
+        pack_path = default_path;
+    }
+    if(password_source) {
+        if(!keyring_read_password(password_source, password, sizeof(password))) {
+            printf("Не може да се прочете паролата от %s!\n", password_source);
+            return 1;
+        }
+        if(!keyring_unlock_directory(directory, password)) {
+            printf("Грешна парола за %s!\n", directory);
+            return 1;
+        }
+    }
+    int ok = compact_directory(directory, pack_path, keep, compress, password_source ? password : NULL);
+    if(password_source) {
+        OPENSSL_cleanse(password, sizeof(password));
+        keyring_clear();
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,631 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "engine.h"
+#include "montecarlo.h"
+#include "replay.h"
+
+static Placement placement_table[MAX_SHIP_LENGTH + 1][2 * BOARD_CELLS];
+static int placement_count[MAX_SHIP_LENGTH + 1];
+
+// Брой кораби от всяка дължина във флота
+static const int fleet_composition[MAX_SHIP_LENGTH + 1] = {0, 0, 4, 3, 2, 0, 1};
+
+static int density_target(AIState* ai_state, Player* ai_player, Rng* rng);
+static int random_free_cell(AIState* ai_state, Player* ai_player, Rng* rng);
+static void remove_free_cell(AIState* ai_state, int cell);
+static void mark_sunk(AIState* ai_state, Player* ai_player, int row, int col, int length);
+
+__attribute__((constructor))
+static void init_placement_table(void) {
+    for(int length = 1; length <= MAX_SHIP_LENGTH; length++) {
+        int count = 0;
+        
+        for(int row = 0; row < BOARD_SIZE; row++) {
+            for(int col = 0; col < BOARD_SIZE; col++) {
+                Direction dirs[] = {RIGHT, DOWN};
+                int options = (length == 1) ? 1 : 2;
+                
+                for(int d = 0; d < options; d++) {
+                    Bitboard mask = ship_cells(row, col, length, dirs[d]);
+                    if(!mask) continue;
+                    
+                    Placement* placement = &placement_table[length][count++];
+                    placement->mask = mask;
+                    placement->halo = bitboard_halo(mask);
+                    placement->row = row;
+                    placement->col = col;
+                    placement->length = length;
+                    placement->direction = dirs[d];
+                }
+            }
+        }
+        
+        placement_count[length] = count;
+    }
+}
+
+const Placement* engine_placements(int length, int* count) {
+    if(length < 1 || length > MAX_SHIP_LENGTH) {
+        *count = 0;
+        return NULL;
+    }
+    
+    *count = placement_count[length];
+    return placement_table[length];
+}
+
+void init_game_context(GameContext* ctx) {
+    memset(ctx, 0, sizeof(GameContext));
+    ctx->last_row = -1;
+    ctx->last_col = -1;
+    engine_seed(ctx, 0);
+}
+
+void engine_seed(GameContext* ctx, unsigned long long seed) {
+    ctx->seed = seed;
+    rng_seed(&ctx->rng, seed, 0);
+}
+
+Player* engine_player(GameContext* ctx, int index) {
+    return index == 0 ? &ctx->player1 : &ctx->player2;
+}
+
+Bitboard ship_cells(int row, int col, int length, Direction dir) {
+    if(row < 0 || row >= BOARD_SIZE || col < 0 || col >= BOARD_SIZE) {
+        return 0;
+    }
+    
+    int end_row = row, end_col = col;
+    
+    switch(dir) {
+        case UP:
+            end_row = row - length + 1;
+            break;
+        case DOWN:
+            end_row = row + length - 1;
+            break;
+        case LEFT:
+            end_col = col - length + 1;
+            break;
+        case RIGHT:
+            end_col = col + length - 1;
+            break;
+    }
+    
+    if(end_row < 0 || end_row >= BOARD_SIZE || end_col < 0 || end_col >= BOARD_SIZE) {
+        return 0;
+    }
+    
+    int min_row = (row < end_row) ? row : end_row;
+    int min_col = (col < end_col) ? col : end_col;
+    
+    if(dir == LEFT || dir == RIGHT) {
+        return ((((Bitboard)1) << length) - 1) << CELL_INDEX(min_row, min_col);
+    }
+    
+    Bitboard mask = 0;
+    for(int i = 0; i < length; i++) {
+        mask |= CELL_BIT(min_row + i, min_col);
+    }
+    return mask;
+}
+
+int is_valid_position(Player* player, int row, int col, int length, Direction dir) {
+    Bitboard mask = ship_cells(row, col, length, dir);
+    if(!mask) {
+        return 0;
+    }
+    
+    return (bitboard_halo(mask) & player->ship_mask) == 0;
+}
+
+PlaceResult engine_place(Player* player, int row, int col, int length, Direction dir) {
+    if(player->ship_count >= MAX_SHIPS) {
+        return PLACE_FLEET_FULL;
+    }
+    
+    Bitboard mask = ship_cells(row, col, length, dir);
+    if(!mask) {
+        return PLACE_OUT_OF_BOUNDS;
+    }
+    if(bitboard_halo(mask) & player->ship_mask) {
+        return PLACE_TOUCHING;
+    }
+    
+    Ship* ship = &player->ships[player->ship_count];
+    ship->row = row;
+    ship->col = col;
+    ship->length = length;
+    ship->direction = dir;
+    ship->hits = 0;
+    ship->sunk = 0;
+    ship->mask = mask;
+    
+    player->ship_mask |= mask;
+    
+    while(mask) {
+        player->ship_at[bitboard_first(mask)] = player->ship_count + 1;
+        mask &= mask - 1;
+    }
+    
+    player->ship_count++;
+    return PLACE_OK;
+}
+
+void engine_remove(Player* player, int ship_index) {
+    if(ship_index < 0 || ship_index >= player->ship_count) {
+        return;
+    }
+    
+    player->ship_mask &= ~player->ships[ship_index].mask;
+    
+    for(int i = ship_index; i < player->ship_count - 1; i++) {
+        player->ships[i] = player->ships[i + 1];
+    }
+    player->ship_count--;
+    
+    for(int cell = 0; cell < BOARD_CELLS; cell++) {
+        if(player->ship_at[cell] == ship_index + 1) {
+            player->ship_at[cell] = 0;
+        } else if(player->ship_at[cell] > ship_index + 1) {
+            player->ship_at[cell]--;
+        }
+    }
+}
+
+void engine_clear_fleet(Player* player) {
+    player->ship_mask = 0;
+    memset(player->ship_at, 0, sizeof(player->ship_at));
+    player->ship_count = 0;
+}
+
+// Бърз конструктивен генератор: всеки кораб се избира равномерно сред положенията, които
+// още са свободни, но самата флота не е равномерна сред всички допустими - ранните дълги
+// кораби определят колко място остава за късите. Точно равномерна флота дава fleet_counter_sample.
+int engine_random_fleet(Player* player, Rng* rng) {
+    int ship_sizes[] = {2, 2, 2, 2, 3, 3, 3, 4, 4, 6};
+    const Placement* chosen[MAX_SHIPS];
+    
+    for(int attempt = 0; attempt < 1000; attempt++) {
+        Bitboard blocked = 0;
+        int complete = 1;
+        
+        // Най-дългите кораби се поставят първи - така почти никога не остава кораб без място
+        for(int i = MAX_SHIPS - 1; i >= 0 && complete; i--) {
+            int count;
+            const Placement* options = engine_placements(ship_sizes[i], &count);
+            int legal = 0;
+            
+            for(int p = 0; p < count; p++) {
+                if(!(options[p].mask & blocked)) legal++;
+            }
+            if(legal == 0) {
+                complete = 0;
+                break;
+            }
+            
+            int pick = rng_below(rng, legal);
+            for(int p = 0; p < count; p++) {
+                if(!(options[p].mask & blocked) && pick-- == 0) {
+                    chosen[i] = &options[p];
+                    blocked |= options[p].halo;
+                    break;
+                }
+            }
+        }
+        
+        if(!complete) continue;
+        
+        engine_clear_fleet(player);
+        for(int i = 0; i < MAX_SHIPS; i++) {
+            engine_place(player, chosen[i]->row, chosen[i]->col, chosen[i]->length, chosen[i]->direction);
+        }
+        return 1;
+    }
+    
+    return 0;
+}
+
+// Стратегията и броят флоти на ход влизат в записа - с тях и seed-а играта се повтаря
+static void record_ai(const AIState* ai_state, const Player* player, AISettings* settings) {
+    memset(settings, 0, sizeof(AISettings));
+    if(!player->is_ai) return;
+    settings->recorded = 1;
+    settings->strategy = ai_state->strategy;
+    if(ai_state->strategy == AI_MONTE_CARLO) {
+        settings->move_samples = montecarlo_move_samples(ai_state);
+    }
+}
+
+void engine_start(GameContext* ctx) {
+    memcpy(&ctx->replay.player1_initial, &ctx->player1, sizeof(Player));
+    memcpy(&ctx->replay.player2_initial, &ctx->player2, sizeof(Player));
+    ctx->replay.seed = ctx->seed;
+    record_ai(&ctx->ai_state[0], &ctx->player1, &ctx->replay.ai[0]);
+    record_ai(&ctx->ai_state[1], &ctx->player2, &ctx->replay.ai[1]);
+    ctx->turn = 0;
+    if(ctx->stream) {
+        replay_writer_begin(ctx->stream, &ctx->replay);
+    }
+}
+
+FireResult engine_fire(GameContext* ctx, int row, int col) {
+    FireResult result;
+    memset(&result, 0, sizeof(result));
+    result.row = row;
+    result.col = col;
+    
+    if(fleet_destroyed(&ctx->player1) || fleet_destroyed(&ctx->player2)) {
+        result.outcome = FIRE_GAME_OVER;
+        result.game_over = 1;
+        return result;
+    }
+    
+    if(row < 0 || row >= BOARD_SIZE || col < 0 || col >= BOARD_SIZE) {
+        result.outcome = FIRE_OUT_OF_BOUNDS;
+        return result;
+    }
+    
+    Player* attacker = engine_player(ctx, ctx->turn);
+    Player* defender = engine_player(ctx, 1 - ctx->turn);
+    Bitboard bit = CELL_BIT(row, col);
+    
+    if((attacker->hit_mask | attacker->miss_mask) & bit) {
+        result.outcome = FIRE_REPEAT;
+        result.ships_remaining = MAX_SHIPS - defender->ships_sunk;
+        return result;
+    }
+    
+    if(defender->ship_mask & bit) {
+        attacker->hit_mask |= bit;
+        defender->damage_mask |= bit;
+        
+        Ship* ship = &defender->ships[defender->ship_at[CELL_INDEX(row, col)] - 1];
+        ship->hits++;
+        result.outcome = FIRE_HIT;
+        result.ship_length = ship->length;
+        
+        if(ship->hits == ship->length) {
+            ship->sunk = 1;
+            defender->ships_sunk++;
+            result.outcome = FIRE_SUNK;
+        }
+        
+        add_move_to_replay(ctx, attacker->name, row, col, 1, result.outcome == FIRE_SUNK, ship->length);
+    } else {
+        attacker->miss_mask |= bit;
+        result.outcome = FIRE_MISS;
+        
+        add_move_to_replay(ctx, attacker->name, row, col, 0, 0, 0);
+        
+        ctx->turn = 1 - ctx->turn;
+    }
+    
+    result.ships_remaining = MAX_SHIPS - defender->ships_sunk;
+    result.game_over = fleet_destroyed(defender);
+    
+    if(result.game_over && ctx->recording) {
+        strcpy(ctx->replay.winner, attacker->name);
+        ctx->replay.winner_index = ctx->turn + 1;
+        get_current_time(ctx->replay.end_time);
+        if(ctx->stream) {
+            replay_writer_finish(ctx->stream, &ctx->replay);
+        }
+    }
+    
+    return result;
+}
+
+GameStatus engine_status(GameContext* ctx) {
+    GameStatus status;
+    
+    status.turn = ctx->turn;
+    status.winner = -1;
+    if(fleet_destroyed(&ctx->player1)) {
+        status.winner = 1;
+    } else if(fleet_destroyed(&ctx->player2)) {
+        status.winner = 0;
+    }
+    status.game_over = status.winner != -1;
+    status.ships_remaining[0] = MAX_SHIPS - ctx->player1.ships_sunk;
+    status.ships_remaining[1] = MAX_SHIPS - ctx->player2.ships_sunk;
+    status.move_count = ctx->replay.move_count;
+    
+    return status;
+}
+
+FireResult ai_make_move(GameContext* ctx) {
+    AIState* ai_state = &ctx->ai_state[ctx->turn];
+    Player* ai_player = engine_player(ctx, ctx->turn);
+    int row, col;
+    
+    if(ai_state->strategy == AI_DENSITY || ai_state->strategy == AI_MONTE_CARLO) {
+        int cell = -1;
+        if(ai_state->strategy == AI_MONTE_CARLO) {
+            cell = montecarlo_target(ai_state, ai_player, rng_next(&ctx->rng));
+        }
+        if(cell < 0) {
+            cell = density_target(ai_state, ai_player, &ctx->rng);
+        }
+        row = cell / BOARD_SIZE;
+        col = cell % BOARD_SIZE;
+    } else if(!ai_state->hunting) {
+        int cell = random_free_cell(ai_state, ai_player, &ctx->rng);
+        row = cell / BOARD_SIZE;
+        col = cell % BOARD_SIZE;
+    } else {
+        int found = 0;
+        
+        if(ai_state->hunt_direction != -1) {
+            row = ai_state->hunt_row;
+            col = ai_state->hunt_col;
+            
+            switch(ai_state->hunt_direction) {
+                case 0: row--; break;
+                case 1: row++; break;
+                case 2: col--; break;
+                case 3: col++; break;
+            }
+            
+            if(row >= 0 && row < BOARD_SIZE && col >= 0 && col < BOARD_SIZE &&
+               !cell_attacked(ai_player, row, col)) {
+                found = 1;
+            }
+        }
+        
+        if(!found) {
+            for(int dir = 0; dir < 4 && !found; dir++) {
+                row = ai_state->hunt_row;
+                col = ai_state->hunt_col;
+                
+                switch(dir) {
+                    case 0: row--; break;
+                    case 1: row++; break;
+                    case 2: col--; break;
+                    case 3: col++; break;
+                }
+                
+                if(row >= 0 && row < BOARD_SIZE && col >= 0 && col < BOARD_SIZE &&
+                   !cell_attacked(ai_player, row, col)) {
+                    ai_state->hunt_direction = dir;
+                    found = 1;
+                }
+            }
+        }
+        
+        if(!found) {
+            ai_state->hunting = 0;
+            ai_state->hunt_direction = -1;
+            int cell = random_free_cell(ai_state, ai_player, &ctx->rng);
+            row = cell / BOARD_SIZE;
+            col = cell % BOARD_SIZE;
+        }
+    }
+    
+    FireResult result = engine_fire(ctx, row, col);
+    
+    if(result.outcome == FIRE_HIT || result.outcome == FIRE_SUNK || result.outcome == FIRE_MISS) {
+        remove_free_cell(ai_state, CELL_INDEX(row, col));
+    }
+    
+    if(result.outcome == FIRE_HIT) {
+        if(!ai_state->hunting) {
+            ai_state->hunting = 1;
+            ai_state->hunt_row = row;
+            ai_state->hunt_col = col;
+            ai_state->hunt_direction = -1;
+            ai_state->hunt_hit_count = 1;
+            ai_state->hunt_hits[0][0] = row;
+            ai_state->hunt_hits[0][1] = col;
+        } else {
+            ai_state->hunt_row = row;
+            ai_state->hunt_col = col;
+            if(ai_state->hunt_hit_count < 10) {
+                ai_state->hunt_hits[ai_state->hunt_hit_count][0] = row;
+                ai_state->hunt_hits[ai_state->hunt_hit_count][1] = col;
+                ai_state->hunt_hit_count++;
+            }
+        }
+    } else if(result.outcome == FIRE_SUNK) {
+        mark_sunk(ai_state, ai_player, row, col, result.ship_length);
+        ai_state->hunting = 0;
+        ai_state->hunt_direction = -1;
+        ai_state->hunt_hit_count = 0;
+    } else if(result.outcome == FIRE_MISS) {
+        if(ai_state->hunting && ai_state->hunt_direction != -1) {
+            ai_state->hunt_direction = -1;
+        }
+    }
+    
+    return result;
+}
+
+// Случайна неатакувана клетка за O(1) - масивът се строи при първия ход и после само намалява
+static int random_free_cell(AIState* ai_state, Player* ai_player, Rng* rng) {
+    if(!ai_state->free_ready) {
+        Bitboard shots = ai_player->hit_mask | ai_player->miss_mask;
+        ai_state->free_count = 0;
+        for(int cell = 0; cell < BOARD_CELLS; cell++) {
+            if(shots & ((Bitboard)1 << cell)) continue;
+            ai_state->free_slot[cell] = (unsigned char)ai_state->free_count;
+            ai_state->free_cells[ai_state->free_count++] = (unsigned char)cell;
+        }
+        ai_state->free_ready = 1;
+    }
+    
+    if(ai_state->free_count == 0) {
+        return 0;
+    }
+    return ai_state->free_cells[rng_below(rng, ai_state->free_count)];
+}
+
+static void remove_free_cell(AIState* ai_state, int cell) {
+    if(!ai_state->free_ready) return;
+    
+    int slot = ai_state->free_slot[cell];
+    if(slot >= ai_state->free_count || ai_state->free_cells[slot] != cell) return;
+    
+    int last = ai_state->free_cells[--ai_state->free_count];
+    ai_state->free_cells[slot] = (unsigned char)last;
+    ai_state->free_slot[last] = (unsigned char)slot;
+}
+
+// Дължините на неутопените кораби, от най-дългия към най-късия
+int ai_remaining_ships(const AIState* ai_state, int lengths[MAX_SHIPS]) {
+    int count = 0;
+    
+    for(int length = MAX_SHIP_LENGTH; length >= 1; length--) {
+        for(int i = ai_state->sunk_count[length]; i < fleet_composition[length] && count < MAX_SHIPS; i++) {
+            lengths[count++] = length;
+        }
+    }
+    return count;
+}
+
+// Корабите не се допират, затова потопеният кораб е свързаната група попадения около последния изстрел
+static void mark_sunk(AIState* ai_state, Player* ai_player, int row, int col, int length) {
+    Bitboard ship = CELL_BIT(row, col);
+    Bitboard grown = ship;
+    
+    do {
+        ship = grown;
+        grown = bitboard_halo(ship) & ai_player->hit_mask;
+    } while(grown != ship);
+    
+    ai_state->sunk_mask |= ship;
+    if(length >= 1 && length <= MAX_SHIP_LENGTH) {
+        ai_state->sunk_count[length]++;
+    }
+}
+
+// Брои за всяка клетка колко положения на оставащите кораби минават през нея
+// и връща клетката с най-голям брой
+static int density_target(AIState* ai_state, Player* ai_player, Rng* rng) {
+    Bitboard shots = ai_player->hit_mask | ai_player->miss_mask;
+    Bitboard open_hits = ai_player->hit_mask & ~ai_state->sunk_mask;
+    Bitboard blocked = ai_player->miss_mask | bitboard_halo(ai_state->sunk_mask) | bitboard_diagonals(open_hits);
+    int weight[BOARD_CELLS] = {0};
+    
+    for(int length = 1; length <= MAX_SHIP_LENGTH; length++) {
+        int remaining = fleet_composition[length] - ai_state->sunk_count[length];
+        if(remaining <= 0) continue;
+        
+        int count;
+        const Placement* options = engine_placements(length, &count);
+        
+        for(int p = 0; p < count; p++) {
+            if(options[p].mask & blocked) continue;
+            if(options[p].halo & ~options[p].mask & open_hits) continue;
+            
+            // Докато има неутопен ударен кораб, се броят само положенията през него
+            int covered = bitboard_count(options[p].mask & open_hits);
+            if(open_hits && !covered) continue;
+            
+            int w = remaining * (covered ? covered : 1);
+            for(Bitboard cells = options[p].mask & ~shots; cells; cells &= cells - 1) {
+                weight[bitboard_first(cells)] += w;
+            }
+        }
+    }
+    
+    int best = -1, best_weight = 0, ties = 0;
+    for(int cell = 0; cell < BOARD_CELLS; cell++) {
+        if(weight[cell] > best_weight) {
+            best = cell;
+            best_weight = weight[cell];
+            ties = 1;
+        } else if(weight[cell] == best_weight && best_weight > 0 && rng_below(rng, ++ties) == 0) {
+            best = cell;
+        }
+    }
+    
+    if(best < 0) {
+        Bitboard free_cells = FULL_BOARD & ~shots;
+        best = free_cells ? bitboard_first(free_cells) : 0;
+    }
+    return best;
+}
+
+int cell_attacked(Player* player, int row, int col) {
+    return ((player->hit_mask | player->miss_mask) & CELL_BIT(row, col)) != 0;
+}
+
+int fleet_destroyed(Player* player) {
+    return player->ship_mask && (player->ship_mask & ~player->damage_mask) == 0;
+}
+
+// Симулациите записват игри от много нишки, затова localtime се вика в реентрантния си вариант
+void get_current_time(char* buffer) {
+    time_t rawtime;
+    struct tm timeinfo;
+    
+    time(&rawtime);
+    #ifdef _WIN32
+        localtime_s(&timeinfo, &rawtime);
+    #else
+        localtime_r(&rawtime, &timeinfo);
+    #endif
+    
+    strftime(buffer, 30, "%Y-%m-%d %H:%M:%S", &timeinfo);
+}
+
+void init_replay(GameContext* ctx) {
+    free_replay(&ctx->replay);
+    get_current_time(ctx->replay.start_time);
+    ctx->replay.move_count = 0;
+    ctx->recording = 1;
+}
+
+void free_replay(GameReplay* replay) {
+    for(int i = 0; i < replay->moves.chunk_count; i++) {
+        free(replay->moves.chunks[i]);
+    }
+    free(replay->moves.chunks);
+    memset(replay, 0, sizeof(GameReplay));
+}
+
+// Добавя празен ход в края на записа; NULL при липса на памет
+Move* replay_new_move(GameReplay* replay) {
+    MoveLog* log = &replay->moves;
+    int index = replay->move_count;
+    
+    if((index >> MOVE_CHUNK_SHIFT) == log->chunk_count) {
+        if(log->chunk_count == log->chunk_capacity) {
+            int capacity = log->chunk_capacity ? log->chunk_capacity * 2 : 4;
+            Move** chunks = realloc(log->chunks, capacity * sizeof(Move*));
+            if(!chunks) return NULL;
+            log->chunks = chunks;
+            log->chunk_capacity = capacity;
+        }
+        Move* chunk = malloc(MOVE_CHUNK_SIZE * sizeof(Move));
+        if(!chunk) return NULL;
+        log->chunks[log->chunk_count++] = chunk;
+    }
+    
+    Move* move = replay_move(replay, index);
+    memset(move, 0, sizeof(Move));
+    replay->move_count++;
+    return move;
+}
+
+void add_move_to_replay(GameContext* ctx, const char* player_name, int row, int col, int hit, int ship_sunk, int ship_length) {
+    if(!ctx->recording) return;
+    
+    Move* move = replay_new_move(&ctx->replay);
+    if(!move) return;
+    strcpy(move->player_name, player_name);
+    move->player = ctx->turn;
+    move->row = row;
+    move->col = col;
+    move->hit = hit;
+    move->ship_sunk = ship_sunk;
+    move->ship_length = ship_length;
+    get_current_time(move->timestamp);
+    
+    if(ctx->stream) {
+        replay_writer_append(ctx->stream, move);
+    }
+}
@@ -0,0 +1,244 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <time.h>
+#include "pool.h"
+#include "rng.h"
+
+#define BOARD_SIZE 10
+#define MAX_SHIPS 10
+#define MOVE_CHUNK_SHIFT 6
+#define MOVE_CHUNK_SIZE (1 << MOVE_CHUNK_SHIFT)
+#define MAX_SHIP_LENGTH 6
+
+#define BOARD_CELLS (BOARD_SIZE * BOARD_SIZE)
+#define CELL_INDEX(row, col) ((row) * BOARD_SIZE + (col))
+#define CELL_BIT(row, col) ((Bitboard)1 << CELL_INDEX(row, col))
+#define FULL_BOARD ((((Bitboard)1) << BOARD_CELLS) - 1)
+#define FIRST_COLUMN (FULL_BOARD / ((((Bitboard)1) << BOARD_SIZE) - 1))
+#define LAST_COLUMN (FIRST_COLUMN << (BOARD_SIZE - 1))
+
+typedef unsigned __int128 Bitboard;
+
+typedef enum {
+    EMPTY = 0,
+    SHIP = 1,
+    HIT = 2,
+    MISS = 3
+} CellState;
+
+typedef enum {
+    UP = 0,
+    DOWN = 1,
+    LEFT = 2,
+    RIGHT = 3
+} Direction;
+
+typedef struct {
+    int row, col;
+    int length;
+    Direction direction;
+    int hits;
+    int sunk;
+    Bitboard mask;
+} Ship;
+
+// Едно възможно положение на кораб заедно с клетките около него, които то забранява
+typedef struct {
+    Bitboard mask;
+    Bitboard halo;
+    int row, col;
+    int length;
+    Direction direction;
+} Placement;
+
+typedef struct {
+    Bitboard ship_mask;
+    Bitboard damage_mask;
+    Bitboard hit_mask;
+    Bitboard miss_mask;
+    Ship ships[MAX_SHIPS];
+    unsigned char ship_at[BOARD_CELLS];
+    int ship_count;
+    int ships_sunk;
+    char name[32];
+    int is_ai;
+} Player;
+
+// player е мястото на стрелящия (0 - първият играч, 1 - вторият) - имената може да съвпадат
+typedef struct {
+    char player_name[32];
+    int player;
+    int row, col;
+    int hit;
+    int ship_sunk;
+    int ship_length;
+    char timestamp[30];
+} Move;
+
+// Ходовете се пазят на парчета по MOVE_CHUNK_SIZE - при растеж се добавя ново парче,
+// а вече записаните ходове не се местят. Расте само масивът с указатели към парчетата.
+typedef struct {
+    Move** chunks;
+    int chunk_count;
+    int chunk_capacity;
+} MoveLog;
+
+typedef enum {
+    AI_HUNT = 0,
+    AI_DENSITY,
+    AI_MONTE_CARLO
+} AIStrategy;
+
+// Как е играл компютърът на едно място - пази се в записа, за да може играта да се
+// изиграе отново от seed-а. recorded е 0 за човек и за записите отпреди това поле.
+// move_samples е броят флоти на ход при AI_MONTE_CARLO (0 - по време, без точно повторение).
+typedef struct {
+    int recorded;
+    AIStrategy strategy;
+    int move_samples;
+} AISettings;
+
+// winner_index е 0, докато няма победител, иначе 1 или 2 - мястото на winner
+typedef struct {
+    Player player1_initial;
+    Player player2_initial;
+    MoveLog moves;
+    int move_count;
+    char winner[32];
+    int winner_index;
+    char start_time[30];
+    char end_time[30];
+    unsigned long long seed;
+    AISettings ai[2];
+} GameReplay;
+
+// sunk_mask и sunk_count описват потопените кораби така, както ги вижда компютърът.
+// sample_workers, move_samples и move_budget_ms управляват AI_MONTE_CARLO (0 - стойности по
+// подразбиране). Ходът тегли точно move_samples флота и зависи само от seed-а, а не от броя
+// нишки; само с move_budget_ms > 0 се тегли до изтичане на времето и играта не се повтаря точно.
+// sample_pool са нишките, които теглят флотите - създават се веднъж извън играта и се
+// ползват за всеки ход; без пул и при повече от една нишка всеки ход пуска свои нишки.
+// free_cells държи неатакуваните клетки плътно, а free_slot - мястото на всяка от тях в масива.
+typedef struct {
+    AIStrategy strategy;
+    int sample_workers;
+    int move_samples;
+    int move_budget_ms;
+    WorkerPool* sample_pool;
+    long long samples;
+    int hunting;
+    int hunt_row, hunt_col;
+    int hunt_direction;
+    int hunt_hits[10][2];
+    int hunt_hit_count;
+    Bitboard sunk_mask;
+    int sunk_count[MAX_SHIP_LENGTH + 1];
+    unsigned char free_cells[BOARD_CELLS];
+    unsigned char free_slot[BOARD_CELLS];
+    int free_count;
+    int free_ready;
+} AIState;
+
+typedef struct ReplayWriter ReplayWriter;
+
+// Всички случайни решения в играта идват от rng - с един и същ seed играта се повтаря точно.
+// Ако stream е зададен, записът се пише във файла ход по ход (виж replay.h).
+typedef struct {
+    Player player1, player2;
+    GameReplay replay;
+    ReplayWriter* stream;
+    AIState ai_state[2];
+    unsigned long long seed;
+    Rng rng;
+    int turn;
+    int recording;
+    int last_row, last_col;
+} GameContext;
+
+typedef enum {
+    PLACE_OK = 0,
+    PLACE_OUT_OF_BOUNDS,
+    PLACE_TOUCHING,
+    PLACE_FLEET_FULL
+} PlaceResult;
+
+typedef enum {
+    FIRE_MISS = 0,
+    FIRE_HIT,
+    FIRE_SUNK,
+    FIRE_REPEAT,
+    FIRE_OUT_OF_BOUNDS,
+    FIRE_GAME_OVER
+} FireOutcome;
+
+// Резултат от един изстрел - попълва се от engine_fire и ai_make_move
+typedef struct {
+    FireOutcome outcome;
+    int row, col;
+    int ship_length;
+    int ships_remaining;
+    int game_over;
+} FireResult;
+
+typedef struct {
+    int game_over;
+    int turn;
+    int winner;
+    int ships_remaining[2];
+    int move_count;
+} GameStatus;
+
+static inline int bitboard_count(Bitboard b) {
+    return __builtin_popcountll((unsigned long long)b) +
+           __builtin_popcountll((unsigned long long)(b >> 64));
+}
+
+static inline int bitboard_first(Bitboard b) {
+    unsigned long long low = (unsigned long long)b;
+    if(low) return __builtin_ctzll(low);
+    return 64 + __builtin_ctzll((unsigned long long)(b >> 64));
+}
+
+static inline Bitboard bitboard_halo(Bitboard b) {
+    Bitboard h = b | (b << BOARD_SIZE) | (b >> BOARD_SIZE);
+    h |= ((h << 1) & ~FIRST_COLUMN) | ((h >> 1) & ~LAST_COLUMN);
+    return h & FULL_BOARD;
+}
+
+static inline Bitboard bitboard_diagonals(Bitboard b) {
+    Bitboard d = ((b << (BOARD_SIZE + 1)) & ~FIRST_COLUMN) | ((b << (BOARD_SIZE - 1)) & ~LAST_COLUMN) |
+                 ((b >> (BOARD_SIZE - 1)) & ~FIRST_COLUMN) | ((b >> (BOARD_SIZE + 1)) & ~LAST_COLUMN);
+    return d & FULL_BOARD;
+}
+
+static inline Move* replay_move(const GameReplay* replay, int index) {
+    return &replay->moves.chunks[index >> MOVE_CHUNK_SHIFT][index & (MOVE_CHUNK_SIZE - 1)];
+}
+
+// Функциите по-долу не правят вход/изход - UI слоят отпечатва резултатите им
+void init_game_context(GameContext* ctx);
+void engine_seed(GameContext* ctx, unsigned long long seed);
+Player* engine_player(GameContext* ctx, int index);
+Bitboard ship_cells(int row, int col, int length, Direction dir);
+const Placement* engine_placements(int length, int* count);
+int is_valid_position(Player* player, int row, int col, int length, Direction dir);
+PlaceResult engine_place(Player* player, int row, int col, int length, Direction dir);
+void engine_remove(Player* player, int ship_index);
+void engine_clear_fleet(Player* player);
+int engine_random_fleet(Player* player, Rng* rng);
+void engine_start(GameContext* ctx);
+FireResult engine_fire(GameContext* ctx, int row, int col);
+GameStatus engine_status(GameContext* ctx);
+FireResult ai_make_move(GameContext* ctx);
+int ai_remaining_ships(const AIState* ai_state, int lengths[MAX_SHIPS]);
+int cell_attacked(Player* player, int row, int col);
+int fleet_destroyed(Player* player);
+
+void get_current_time(char* buffer);
+void init_replay(GameContext* ctx);
+void free_replay(GameReplay* replay);
+Move* replay_new_move(GameReplay* replay);
+void add_move_to_replay(GameContext* ctx, const char* player_name, int row, int col, int hit, int ship_sunk, int ship_length);
+
+#endif
@@ -0,0 +1,382 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "engine.h"
+#include "pool.h"
+#include "replay.h"
+
+#define CAST_WIDTH 48
+#define CAST_HEIGHT 20
+#define MIN_FRAME_DELAY 0.4
+#define DEFAULT_IDLE_LIMIT 2.0
+
+// Растящ буфер в паметта - в него се рисуват кадрите и се събира целият .cast файл
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} TextBuffer;
+
+// Буферите на всяка нишка се преизползват за всички записи, които тя обработва
+typedef struct {
+    TextBuffer frame;
+    TextBuffer cast;
+    long long exported;
+    long long failed;
+    long long frames;
+    char padding[64];
+} ExportWorker;
+
+typedef struct {
+    char** names;
+    int count;
+    const char* input_dir;
+    const char* output_dir;
+    double idle_limit;
+    ExportWorker* workers;
+} ExportJob;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int buffer_reserve(TextBuffer* buffer, size_t extra) {
+    if(buffer->size + extra + 1 <= buffer->capacity) {
+        return 1;
+    }
+    
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while(buffer->size + extra + 1 > capacity) {
+        capacity *= 2;
+    }
+    
+    char* grown = realloc(buffer->data, capacity);
+    if(!grown) {
+        return 0;
+    }
+    buffer->data = grown;
+    buffer->capacity = capacity;
+    return 1;
+}
+
+static void buffer_append(TextBuffer* buffer, const char* text, size_t length) {
+    if(!buffer_reserve(buffer, length)) return;
+    memcpy(buffer->data + buffer->size, text, length);
+    buffer->size += length;
+    buffer->data[buffer->size] = '\0';
+}
+
+static void buffer_printf(TextBuffer* buffer, const char* format, ...) {
+    va_list args;
+    
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if(length < 0 || !buffer_reserve(buffer, length)) return;
+    
+    va_start(args, format);
+    vsnprintf(buffer->data + buffer->size, length + 1, format, args);
+    va_end(args);
+    buffer->size += length;
+}
+
+static void buffer_append_json(TextBuffer* buffer, const char* text, size_t length) {
+    for(size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)text[i];
+        
+        if(c == '"' || c == '\\') {
+            char escaped[2] = {'\\', (char)c};
+            buffer_append(buffer, escaped, 2);
+        } else if(c == '\n') {
+            buffer_append(buffer, "\\n", 2);
+        } else if(c == '\r') {
+            buffer_append(buffer, "\\r", 2);
+        } else if(c < 0x20) {
+            buffer_printf(buffer, "\\u%04x", c);
+        } else {
+            buffer_append(buffer, (const char*)&text[i], 1);
+        }
+    }
+}
+
+// Същото като print_board в играта, но в буфер и с \r\n, както го очаква терминалът при възпроизвеждане
+static void render_board(TextBuffer* frame, Bitboard ships, Bitboard hits, Bitboard misses, int show_ships) {
+    buffer_printf(frame, "   ");
+    for(int i = 1; i <= BOARD_SIZE; i++) {
+        buffer_printf(frame, "%2d ", i);
+    }
+    buffer_printf(frame, "\r\n");
+    
+    for(int i = 0; i < BOARD_SIZE; i++) {
+        buffer_printf(frame, "%c  ", 'A' + i);
+        for(int j = 0; j < BOARD_SIZE; j++) {
+            Bitboard bit = CELL_BIT(i, j);
+            
+            if(hits & bit) {
+                buffer_append(frame, " X ", 3);
+            } else if(misses & bit) {
+                buffer_append(frame, " O ", 3);
+            } else if((ships & bit) && show_ships) {
+                buffer_append(frame, " # ", 3);
+            } else {
+                buffer_append(frame, " . ", 3);
+            }
+        }
+        buffer_printf(frame, "\r\n");
+    }
+}
+
+static void append_event(TextBuffer* cast, double time, TextBuffer* frame) {
+    buffer_printf(cast, "[%.3f, \"o\", \"\\u001b[2J\\u001b[H", time);
+    buffer_append_json(cast, frame->data, frame->size);
+    buffer_printf(cast, "\"]\n");
+    frame->size = 0;
+}
+
+static int export_replay(ExportJob* job, ExportWorker* worker, const char* name) {
+    char path[1024];
+    GameReplay replay;
+    
+    snprintf(path, sizeof(path), "%s/%s", job->input_dir, name);
+    if(!replay_load(path, &replay)) {
+        return 0;
+    }
+    
+    TextBuffer* frame = &worker->frame;
+    TextBuffer* cast = &worker->cast;
+    frame->size = 0;
+    cast->size = 0;
+    
+    buffer_printf(cast, "{\"version\": 2, \"width\": %d, \"height\": %d, \"idle_time_limit\": %.1f, \"title\": \"",
+                  CAST_WIDTH, CAST_HEIGHT, job->idle_limit);
+    buffer_append_json(cast, replay.player1_initial.name, strnlen(replay.player1_initial.name, 32));
+    buffer_append(cast, " - ", 3);
+    buffer_append_json(cast, replay.player2_initial.name, strnlen(replay.player2_initial.name, 32));
+    buffer_printf(cast, "\"}\n");
+    
+    buffer_printf(frame, "=== ЗАПИС НА ИГРА ===\r\n");
+    buffer_printf(frame, "Играч 1: %.32s\r\n", replay.player1_initial.name);
+    buffer_printf(frame, "Играч 2: %.32s\r\n", replay.player2_initial.name);
+    buffer_printf(frame, "Начало: %.30s\r\n", replay.start_time);
+    buffer_printf(frame, "Общо ходове: %d\r\n", replay.move_count);
+    buffer_printf(frame, "Seed: %llu\r\n", replay.seed);
+    append_event(cast, 0.0, frame);
+    
+    Player p1 = replay.player1_initial;
+    Player p2 = replay.player2_initial;
+    p1.hit_mask = p1.miss_mask = p1.damage_mask = 0;
+    p2.hit_mask = p2.miss_mask = p2.damage_mask = 0;
+    
+    double elapsed = 0.0;
+    long long previous = replay_parse_time(replay.start_time);
+    
+    for(int i = 0; i < replay.move_count; i++) {
+        Move* move = replay_move(&replay, i);
+        int first = move->player == 0;
+        Player* attacker = first ? &p1 : &p2;
+        Player* defender = first ? &p2 : &p1;
+        
+        // Времената са с точност до секунда - паузите се ограничават отдолу и отгоре, за да се вижда всеки ход
+        long long stamp = replay_parse_time(move->timestamp);
+        double delay = (stamp >= 0 && previous >= 0) ? (double)(stamp - previous) : MIN_FRAME_DELAY;
+        if(delay < MIN_FRAME_DELAY) delay = MIN_FRAME_DELAY;
+        if(delay > job->idle_limit) delay = job->idle_limit;
+        elapsed += delay;
+        if(stamp >= 0) previous = stamp;
+        
+        buffer_printf(frame, "=== ХОД %d ===\r\n", i + 1);
+        buffer_printf(frame, "Играч: %.32s\r\n", move->player_name);
+        buffer_printf(frame, "Цел: %c%d\r\n", 'A' + move->row, move->col + 1);
+        
+        if(move->row >= 0 && move->row < BOARD_SIZE && move->col >= 0 && move->col < BOARD_SIZE) {
+            Bitboard bit = CELL_BIT(move->row, move->col);
+            if(move->hit) {
+                attacker->hit_mask |= bit;
+                defender->damage_mask |= bit;
+            } else {
+                attacker->miss_mask |= bit;
+            }
+        }
+        
+        if(move->hit && move->ship_sunk) {
+            buffer_printf(frame, "Резултат: ПОТОПЕН КОРАБ! (дължина %d)\r\n", move->ship_length);
+        } else {
+            buffer_printf(frame, "Резултат: %s\r\n", move->hit ? "ПОПАДЕНИЕ!" : "ПРОПУСК!");
+        }
+        
+        buffer_printf(frame, "\r\nАтаки на %.32s:\r\n", move->player_name);
+        render_board(frame, 0, attacker->hit_mask, attacker->miss_mask, 0);
+        append_event(cast, elapsed, frame);
+    }
+    
+    buffer_printf(frame, "=== КРАЙ НА ИГРАТА ===\r\n");
+    buffer_printf(frame, "Победител: %.32s\r\n\r\n", replay.winner);
+    buffer_printf(frame, "%.32s:\r\n", replay.player1_initial.name);
+    render_board(frame, replay.player1_initial.ship_mask, replay.player1_initial.damage_mask, 0, 1);
+    append_event(cast, elapsed + job->idle_limit, frame);
+    
+    buffer_printf(frame, "=== КРАЙ НА ИГРАТА ===\r\n");
+    buffer_printf(frame, "Победител: %.32s\r\n\r\n", replay.winner);
+    buffer_printf(frame, "%.32s:\r\n", replay.player2_initial.name);
+    render_board(frame, replay.player2_initial.ship_mask, replay.player2_initial.damage_mask, 0, 1);
+    append_event(cast, elapsed + 2 * job->idle_limit, frame);
+    
+    int frames = replay.move_count + 3;
+    free_replay(&replay);
+    if(!cast->data) {
+        return 0;
+    }
+    
+    size_t stem = strlen(name);
+    if(stem > 7 && strcmp(name + stem - 7, ".replay") == 0) {
+        stem -= 7;
+    }
+    snprintf(path, sizeof(path), "%s/%.*s.cast", job->output_dir, (int)stem, name);
+    
+    FILE* file = fopen(path, "wb");
+    if(!file) {
+        return 0;
+    }
+    int ok = fwrite(cast->data, 1, cast->size, file) == cast->size;
+    if(fclose(file) != 0) {
+        ok = 0;
+    }
+    
+    worker->frames += frames;
+    return ok;
+}
+
+static void export_one(int task, int worker, void* arg) {
+    ExportJob* job = arg;
+    ExportWorker* state = &job->workers[worker];
+    
+    if(export_replay(job, state, job->names[task])) {
+        state->exported++;
+    } else {
+        state->failed++;
+        fprintf(stderr, "Неуспешен експорт: %s\n", job->names[task]);
+    }
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Събира имената на всички .replay файлове в директорията, подредени по азбучен ред
+static char** list_replays(const char* directory, int* count) {
+    DIR* dir = opendir(directory);
+    if(!dir) {
+        return NULL;
+    }
+    
+    int capacity = 64;
+    char** names = malloc(capacity * sizeof(char*));
+    struct dirent* entry;
+    *count = 0;
+    
+    while(names && (entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if(length <= 7 || strcmp(entry->d_name + length - 7, ".replay") != 0) continue;
+        
+        if(*count == capacity) {
+            capacity *= 2;
+            char** grown = realloc(names, capacity * sizeof(char*));
+            if(!grown) break;
+            names = grown;
+        }
+        names[*count] = malloc(length + 1);
+        if(!names[*count]) break;
+        memcpy(names[*count], entry->d_name, length + 1);
+        (*count)++;
+    }
+    closedir(dir);
+    
+    if(names) {
+        qsort(names, *count, sizeof(char*), compare_names);
+    }
+    return names;
+}
+
+static void print_usage(const char* program) {
+    printf("Употреба: %s [-i входна_директория] [-o изходна_директория] [-t нишки] [-l макс_пауза]\n", program);
+    printf("  Превръща всеки .replay файл в asciicast запис (.cast), който се пуска с asciinema play\n");
+}
+
+int main(int argc, char** argv) {
+    ExportJob job;
+    memset(&job, 0, sizeof(job));
+    job.input_dir = "replays";
+    job.output_dir = NULL;
+    job.idle_limit = DEFAULT_IDLE_LIMIT;
+    int workers = pool_default_workers();
+    
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            job.input_dir = argv[++i];
+        } else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            job.output_dir = argv[++i];
+        } else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            job.idle_limit = atof(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if(workers < 1 || job.idle_limit < MIN_FRAME_DELAY) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if(!job.output_dir) {
+        job.output_dir = job.input_dir;
+    }
+    mkdir(job.output_dir, 0755);
+    
+    job.names = list_replays(job.input_dir, &job.count);
+    if(!job.names) {
+        printf("Не може да се отвори директорията %s!\n", job.input_dir);
+        return 1;
+    }
+    
+    job.workers = calloc(workers, sizeof(ExportWorker));
+    if(!job.workers) {
+        printf("Грешка при алокиране на памет!\n");
+        return 1;
+    }
+    
+    double start = now_seconds();
+    pool_run(workers, job.count, export_one, &job);
+    double elapsed = now_seconds() - start;
+    
+    long long exported = 0, failed = 0, frames = 0;
+    for(int w = 0; w < workers; w++) {
+        exported += job.workers[w].exported;
+        failed += job.workers[w].failed;
+        frames += job.workers[w].frames;
+        free(job.workers[w].frame.data);
+        free(job.workers[w].cast.data);
+    }
+    free(job.workers);
+    for(int i = 0; i < job.count; i++) {
+        free(job.names[i]);
+    }
+    free(job.names);
+    
+    printf("=== ЕКСПОРТ КЪМ ASCIICAST ===\n");
+    printf("Записи: %lld, неуспешни: %lld, нишки: %d\n", exported, failed, workers);
+    printf("Кадри: %lld\n", frames);
+    printf("Време: %.3f s (%.0f записа/сек)\n", elapsed, elapsed > 0 ? exported / elapsed : 0.0);
+    printf("Изход: %s\n", job.output_dir);
+    
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,764 @@
+#include <stdlib.h>
+#include <string.h>
+#include "fleetcount.h"
+
+// Профилът описва предишния ред - по 3 бита за колона:
+// 0 - празна клетка, 1 - заета клетка, под която корабът свършва,
+// 2..6 - вертикален кораб, който продължава още (стойност - 1) клетки надолу.
+// Клетката в реда е заета точно когато стойността й в профила не е 0.
+#define PROFILE_BITS 3
+#define PROFILE_MASK 7
+#define NO_PROFILE 0xffffffffU
+#define SHIP_KINDS 4
+#define FLEET_STATES 120
+#define FULL_FLEET 119
+#define EDGE_BLOCK 16
+
+// Оставащите кораби се кодират като едно число: брой двойки * 24 + тройки * 6 + четворки * 2 + шестици
+static const int kind_length[SHIP_KINDS] = {2, 3, 4, 6};
+static const int kind_limit[SHIP_KINDS] = {5, 4, 3, 2};
+static const int kind_stride[SHIP_KINDS] = {24, 6, 2, 1};
+
+// fleet_add[a][b] - остатък a плюс използвани b, fleet_sub[a][b] - остатък a минус b; -1 ако излиза извън флота
+static signed char fleet_add[FLEET_STATES][FLEET_STATES];
+static signed char fleet_sub[FLEET_STATES][FLEET_STATES];
+
+typedef unsigned long long FleetMask[2];
+
+// Едно ниво отговаря на профила след даден брой редове.
+// За всеки профил се пазят преходите към следващото ниво и броят на довършванията
+// само за достижимите отгоре остатъци с ненулев брой - mask отбелязва кои са.
+// passed пази за всеки остатък колко довършвания минават през първите 64, 128, ... прехода
+// на профила, за да може unrank да прескача цели блокове преходи с двоично търсене.
+typedef struct {
+    unsigned int* profiles;
+    FleetMask* mask;
+    unsigned int* offsets;
+    FleetCount* counts;
+    int profile_count;
+    size_t count_size;
+    
+    unsigned int* passed_offsets;
+    FleetCount* passed;
+    size_t passed_size;
+    
+    unsigned int* edge_start;
+    unsigned int* edge_next;
+    unsigned char* edge_used;
+    size_t edge_count;
+    size_t edge_capacity;
+} CountLevel;
+
+struct FleetCounter {
+    CountLevel levels[BOARD_SIZE + 1];
+    FleetCount* first_row;
+    FleetCount total;
+};
+
+typedef int (*RowVisitor)(void* data, unsigned int profile, int fleet);
+
+typedef struct {
+    int row;
+    int forced[BOARD_SIZE];
+    int blocked[BOARD_SIZE];
+    unsigned int next;
+    RowVisitor visit;
+    void* data;
+    int stop;
+} RowWalk;
+
+typedef struct {
+    unsigned int* keys;
+    FleetMask* mask;
+    size_t capacity;
+    size_t used;
+} ProfileSet;
+
+static int fleet_remaining(int fleet, int kind) {
+    return (fleet / kind_stride[kind]) % kind_limit[kind];
+}
+
+static void __attribute__((constructor)) init_fleet_tables(void) {
+    for(int a = 0; a < FLEET_STATES; a++) {
+        for(int b = 0; b < FLEET_STATES; b++) {
+            int sum = 0, difference = 0;
+            for(int kind = 0; kind < SHIP_KINDS; kind++) {
+                int x = fleet_remaining(a, kind), y = fleet_remaining(b, kind);
+                if(sum >= 0) sum = x + y < kind_limit[kind] ? sum + (x + y) * kind_stride[kind] : -1;
+                if(difference >= 0) difference = x >= y ? difference + (x - y) * kind_stride[kind] : -1;
+            }
+            fleet_add[a][b] = (signed char)sum;
+            fleet_sub[a][b] = (signed char)difference;
+        }
+    }
+}
+
+static void walk_columns(RowWalk* walk, int col, int left_occupied, int fleet) {
+    if(walk->stop) return;
+    
+    if(col == BOARD_SIZE) {
+        walk->stop = walk->visit(walk->data, walk->next, fleet);
+        return;
+    }
+    
+    int shift = col * PROFILE_BITS;
+    if(walk->forced[col]) {
+        walk->next |= (unsigned int)(walk->forced[col] - 1) << shift;
+        walk_columns(walk, col + 1, 1, fleet);
+        walk->next &= ~((unsigned int)PROFILE_MASK << shift);
+        return;
+    }
+    
+    walk_columns(walk, col + 1, 0, fleet);
+    
+    if(left_occupied || walk->blocked[col]) return;
+    
+    for(int kind = 0; kind < SHIP_KINDS; kind++) {
+        if(fleet_remaining(fleet, kind) == 0) continue;
+        int length = kind_length[kind];
+        
+        if(walk->row + length <= BOARD_SIZE) {
+            walk->next |= (unsigned int)length << shift;
+            walk_columns(walk, col + 1, 1, fleet - kind_stride[kind]);
+            walk->next &= ~((unsigned int)PROFILE_MASK << shift);
+        }
+        
+        if(col + length <= BOARD_SIZE) {
+            int free_run = 1;
+            for(int c = col; c < col + length; c++) {
+                if(walk->blocked[c] || walk->forced[c]) {
+                    free_run = 0;
+                    break;
+                }
+            }
+            if(!free_run) continue;
+            
+            unsigned int run = 0;
+            for(int c = col; c < col + length; c++) run |= 1U << (c * PROFILE_BITS);
+            walk->next |= run;
+            walk_columns(walk, col + length, 1, fleet - kind_stride[kind]);
+            walk->next &= ~run;
+        }
+    }
+}
+
+// Обхожда всички начини да се попълни ред row при даден профил на предишния ред
+static void walk_row(int row, unsigned int previous, int fleet, RowVisitor visit, void* data) {
+    RowWalk walk;
+    memset(&walk, 0, sizeof(walk));
+    walk.row = row;
+    walk.visit = visit;
+    walk.data = data;
+    
+    for(int c = 0; c < BOARD_SIZE; c++) {
+        unsigned int value = (previous >> (c * PROFILE_BITS)) & PROFILE_MASK;
+        if(value >= 2) walk.forced[c] = value;
+        if(value >= 1) {
+            walk.blocked[c] = 1;
+            if(c > 0) walk.blocked[c - 1] = 1;
+            if(c + 1 < BOARD_SIZE) walk.blocked[c + 1] = 1;
+        }
+    }
+    
+    walk_columns(&walk, 0, 0, fleet);
+}
+
+static Bitboard profile_cells(int row, unsigned int profile) {
+    Bitboard cells = 0;
+    for(int c = 0; c < BOARD_SIZE; c++) {
+        if((profile >> (c * PROFILE_BITS)) & PROFILE_MASK) cells |= CELL_BIT(row, c);
+    }
+    return cells;
+}
+
+// Корабите на флота, събрани по дължина в реда, в който започват по редове и колони
+typedef struct {
+    int cell[MAX_SHIP_LENGTH + 1][MAX_SHIPS];
+    Direction direction[MAX_SHIP_LENGTH + 1][MAX_SHIPS];
+    int count[MAX_SHIP_LENGTH + 1];
+} RowShips;
+
+static void add_row_ship(RowShips* ships, int length, int row, int col, Direction direction) {
+    if(length > MAX_SHIP_LENGTH || ships->count[length] == MAX_SHIPS) return;
+    ships->cell[length][ships->count[length]] = CELL_INDEX(row, col);
+    ships->direction[length][ships->count[length]++] = direction;
+}
+
+// Събира корабите, които започват на ред row
+static void collect_row_ships(RowShips* ships, int row, unsigned int previous, unsigned int next) {
+    int c = 0;
+    while(c < BOARD_SIZE) {
+        unsigned int before = (previous >> (c * PROFILE_BITS)) & PROFILE_MASK;
+        unsigned int value = (next >> (c * PROFILE_BITS)) & PROFILE_MASK;
+        
+        if(before >= 2 || value == 0) {
+            c++;
+        } else if(value >= 2) {
+            add_row_ship(ships, (int)value, row, c, DOWN);
+            c++;
+        } else {
+            int start = c;
+            while(c < BOARD_SIZE && ((next >> (c * PROFILE_BITS)) & PROFILE_MASK) == 1) c++;
+            add_row_ship(ships, c - start, row, start, RIGHT);
+        }
+    }
+}
+
+static unsigned int profile_hash(unsigned int key) {
+    key ^= key >> 16;
+    key *= 0x7feb352dU;
+    key ^= key >> 15;
+    key *= 0x846ca68bU;
+    key ^= key >> 16;
+    return key;
+}
+
+static int set_init(ProfileSet* set, size_t capacity) {
+    set->keys = malloc(capacity * sizeof(unsigned int));
+    set->mask = calloc(capacity, sizeof(FleetMask));
+    set->capacity = capacity;
+    set->used = 0;
+    if(!set->keys || !set->mask) {
+        free(set->keys);
+        free(set->mask);
+        return 0;
+    }
+    memset(set->keys, 0xff, capacity * sizeof(unsigned int));
+    return 1;
+}
+
+static int set_add(ProfileSet* set, unsigned int key, const FleetMask mask) {
+    if((set->used + 1) * 2 > set->capacity) {
+        ProfileSet bigger;
+        if(!set_init(&bigger, set->capacity * 2)) return 0;
+        for(size_t i = 0; i < set->capacity; i++) {
+            if(set->keys[i] != NO_PROFILE) set_add(&bigger, set->keys[i], set->mask[i]);
+        }
+        free(set->keys);
+        free(set->mask);
+        *set = bigger;
+    }
+    
+    size_t slot = profile_hash(key) & (set->capacity - 1);
+    while(set->keys[slot] != NO_PROFILE && set->keys[slot] != key) {
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    if(set->keys[slot] == NO_PROFILE) {
+        set->keys[slot] = key;
+        set->used++;
+    }
+    set->mask[slot][0] |= mask[0];
+    set->mask[slot][1] |= mask[1];
+    return 1;
+}
+
+static void set_free(ProfileSet* set) {
+    free(set->keys);
+    free(set->mask);
+    set->keys = NULL;
+    set->mask = NULL;
+}
+
+static int level_find(const CountLevel* level, unsigned int profile) {
+    int low = 0, high = level->profile_count - 1;
+    while(low <= high) {
+        int mid = (low + high) / 2;
+        if(level->profiles[mid] == profile) return mid;
+        if(level->profiles[mid] < profile) low = mid + 1;
+        else high = mid - 1;
+    }
+    return -1;
+}
+
+static int mask_rank(const FleetMask mask, int fleet) {
+    int word = fleet >> 6, bit = fleet & 63;
+    if(!(mask[word] >> bit & 1)) return -1;
+    
+    int rank = __builtin_popcountll(mask[word] & ((1ULL << bit) - 1));
+    if(word) rank += __builtin_popcountll(mask[0]);
+    return rank;
+}
+
+static FleetCount level_count(const CountLevel* level, int index, int fleet) {
+    int rank = mask_rank(level->mask[index], fleet);
+    return rank < 0 ? 0 : level->counts[level->offsets[index] + rank];
+}
+
+// after_cache пази остатъците след всеки вид използвани кораби за текущия профил -
+// много преходи на един профил използват едни и същи кораби.
+typedef struct {
+    CountLevel* level;
+    ProfileSet* next;
+    const unsigned long long* reach;
+    FleetMask after_cache[FLEET_STATES];
+    unsigned char cached[FLEET_STATES];
+    int failed;
+} ReachState;
+
+// Запомня прехода и отбелязва остатъците, с които се стига до новия профил
+static int collect_edge(void* data, unsigned int profile, int fleet) {
+    ReachState* state = data;
+    CountLevel* level = state->level;
+    int used = FULL_FLEET - fleet;
+    unsigned long long* after = state->after_cache[used];
+    
+    if(!state->cached[used]) {
+        after[0] = after[1] = 0;
+        for(int word = 0; word < 2; word++) {
+            for(unsigned long long bits = state->reach[word]; bits; bits &= bits - 1) {
+                int left = fleet_sub[word * 64 + __builtin_ctzll(bits)][used];
+                if(left >= 0) after[left >> 6] |= 1ULL << (left & 63);
+            }
+        }
+        state->cached[used] = 1;
+    }
+    if(!(after[0] | after[1])) return 0;
+    
+    if(level->edge_count == level->edge_capacity) {
+        size_t capacity = level->edge_capacity ? level->edge_capacity * 2 : 1024;
+        unsigned int* next = realloc(level->edge_next, capacity * sizeof(unsigned int));
+        if(next) level->edge_next = next;
+        unsigned char* used_kinds = realloc(level->edge_used, capacity);
+        if(used_kinds) level->edge_used = used_kinds;
+        if(!next || !used_kinds) {
+            state->failed = 1;
+            return 1;
+        }
+        level->edge_capacity = capacity;
+    }
+    
+    level->edge_next[level->edge_count] = profile;
+    level->edge_used[level->edge_count] = (unsigned char)used;
+    level->edge_count++;
+    
+    if(!set_add(state->next, profile, after)) state->failed = 1;
+    return state->failed;
+}
+
+typedef struct {
+    unsigned int profile;
+    FleetMask mask;
+} SortedProfile;
+
+static int compare_profiles(const void* a, const void* b) {
+    unsigned int x = ((const SortedProfile*)a)->profile, y = ((const SortedProfile*)b)->profile;
+    return (x > y) - (x < y);
+}
+
+static int level_from_set(CountLevel* level, ProfileSet* set) {
+    size_t size = set->used ? set->used : 1;
+    SortedProfile* sorted = malloc(size * sizeof(SortedProfile));
+    level->profiles = malloc(size * sizeof(unsigned int));
+    level->mask = malloc(size * sizeof(FleetMask));
+    if(!sorted || !level->profiles || !level->mask) {
+        free(sorted);
+        return 0;
+    }
+    
+    level->profile_count = 0;
+    for(size_t i = 0; i < set->capacity; i++) {
+        if(set->keys[i] == NO_PROFILE) continue;
+        sorted[level->profile_count].profile = set->keys[i];
+        sorted[level->profile_count].mask[0] = set->mask[i][0];
+        sorted[level->profile_count].mask[1] = set->mask[i][1];
+        level->profile_count++;
+    }
+    qsort(sorted, level->profile_count, sizeof(SortedProfile), compare_profiles);
+    
+    for(int i = 0; i < level->profile_count; i++) {
+        level->profiles[i] = sorted[i].profile;
+        level->mask[i][0] = sorted[i].mask[0];
+        level->mask[i][1] = sorted[i].mask[1];
+    }
+    free(sorted);
+    return 1;
+}
+
+// Обхожда всички преходи от ред row и подготвя профилите на следващото ниво
+static int expand_level(FleetCounter* counter, int row) {
+    CountLevel* level = &counter->levels[row];
+    ProfileSet set;
+    if(!set_init(&set, 1024)) return 0;
+    
+    level->edge_start = malloc((level->profile_count + 1) * sizeof(unsigned int));
+    if(!level->edge_start) {
+        set_free(&set);
+        return 0;
+    }
+    
+    ReachState state;
+    state.level = level;
+    state.next = &set;
+    state.failed = 0;
+    for(int i = 0; i < level->profile_count && !state.failed; i++) {
+        level->edge_start[i] = (unsigned int)level->edge_count;
+        state.reach = level->mask[i];
+        memset(state.cached, 0, sizeof(state.cached));
+        walk_row(row, level->profiles[i], FULL_FLEET, collect_edge, &state);
+    }
+    level->edge_start[level->profile_count] = (unsigned int)level->edge_count;
+    
+    int ok = !state.failed && level_from_set(&counter->levels[row + 1], &set);
+    set_free(&set);
+    
+    for(size_t e = 0; e < level->edge_count && ok; e++) {
+        level->edge_next[e] = (unsigned int)level_find(&counter->levels[row + 1], level->edge_next[e]);
+    }
+    return ok;
+}
+
+static int edge_blocks(const CountLevel* level, int index) {
+    unsigned int edges = level->edge_start[index + 1] - level->edge_start[index];
+    return edges ? (int)((edges - 1) / EDGE_BLOCK) : 0;
+}
+
+// Прибавя натрупаните броеве на запазените остатъци след всеки пълен блок преходи
+static int keep_passed(CountLevel* level, int index, FleetCount (*snapshots)[FLEET_STATES], int blocks,
+                       size_t* capacity) {
+    int kept = __builtin_popcountll(level->mask[index][0]) + __builtin_popcountll(level->mask[index][1]);
+    level->passed_offsets[index] = (unsigned int)level->passed_size;
+    if(level->passed_size + (size_t)blocks * kept > *capacity) {
+        while(level->passed_size + (size_t)blocks * kept > *capacity) *capacity *= 2;
+        FleetCount* grown = realloc(level->passed, *capacity * sizeof(FleetCount));
+        if(!grown) return 0;
+        level->passed = grown;
+    }
+    
+    for(int word = 0; word < 2; word++) {
+        for(unsigned long long bits = level->mask[index][word]; bits; bits &= bits - 1) {
+            for(int b = 0; b < blocks; b++) {
+                level->passed[level->passed_size++] = snapshots[b][word * 64 + __builtin_ctzll(bits)];
+            }
+        }
+    }
+    return 1;
+}
+
+// Смята довършванията за достижимите състояния на реда и оставя в mask само ненулевите
+static int build_level(FleetCounter* counter, int row) {
+    CountLevel* level = &counter->levels[row];
+    const CountLevel* next = row < BOARD_SIZE ? &counter->levels[row + 1] : NULL;
+    size_t capacity = 1024, passed_capacity = 1024;
+    FleetCount sums[FLEET_STATES];
+    int max_blocks = 1;
+    for(int i = 0; next && i < level->profile_count; i++) {
+        if(edge_blocks(level, i) > max_blocks) max_blocks = edge_blocks(level, i);
+    }
+    
+    FleetCount (*snapshots)[FLEET_STATES] = malloc(max_blocks * sizeof(*snapshots));
+    level->offsets = malloc(level->profile_count * sizeof(unsigned int));
+    level->counts = malloc(capacity * sizeof(FleetCount));
+    level->passed_offsets = malloc((level->profile_count + 1) * sizeof(unsigned int));
+    level->passed = malloc(passed_capacity * sizeof(FleetCount));
+    if(!snapshots || !level->offsets || !level->counts || !level->passed_offsets || !level->passed) {
+        free(snapshots);
+        return 0;
+    }
+    
+    for(int i = 0; i < level->profile_count; i++) {
+        int blocks = next ? edge_blocks(level, i) : 0;
+        memset(sums, 0, sizeof(sums));
+        if(!next) sums[0] = 1;
+        
+        for(unsigned int e = next ? level->edge_start[i] : 0; next && e < level->edge_start[i + 1]; e++) {
+            int target = level->edge_next[e];
+            int used = level->edge_used[e];
+            const FleetCount* counts = next->counts + next->offsets[target];
+            
+            for(int word = 0; word < 2; word++) {
+                for(unsigned long long bits = next->mask[target][word]; bits; bits &= bits - 1) {
+                    int before = fleet_add[word * 64 + __builtin_ctzll(bits)][used];
+                    if(before >= 0) sums[before] += *counts;
+                    counts++;
+                }
+            }
+            
+            unsigned int done = e + 1 - level->edge_start[i];
+            if(done % EDGE_BLOCK == 0 && (int)(done / EDGE_BLOCK) <= blocks) {
+                memcpy(snapshots[done / EDGE_BLOCK - 1], sums, sizeof(sums));
+            }
+        }
+        
+        level->offsets[i] = (unsigned int)level->count_size;
+        for(int word = 0; word < 2; word++) {
+            unsigned long long kept = 0;
+            for(unsigned long long bits = level->mask[i][word]; bits; bits &= bits - 1) {
+                int fleet = word * 64 + __builtin_ctzll(bits);
+                if(!sums[fleet]) continue;
+                if(level->count_size == capacity) {
+                    capacity *= 2;
+                    FleetCount* grown = realloc(level->counts, capacity * sizeof(FleetCount));
+                    if(!grown) {
+                        free(snapshots);
+                        return 0;
+                    }
+                    level->counts = grown;
+                }
+                kept |= bits & -bits;
+                level->counts[level->count_size++] = sums[fleet];
+            }
+            level->mask[i][word] = kept;
+        }
+        
+        if(!keep_passed(level, i, snapshots, blocks, &passed_capacity)) {
+            free(snapshots);
+            return 0;
+        }
+    }
+    level->passed_offsets[level->profile_count] = (unsigned int)level->passed_size;
+    
+    free(snapshots);
+    return 1;
+}
+
+FleetCounter* fleet_counter_create(void) {
+    FleetCounter* counter = calloc(1, sizeof(FleetCounter));
+    if(!counter) return NULL;
+    
+    // Отгоре надолу се намират достижимите профили и остатъци, после броевете се смятат отдолу нагоре
+    ProfileSet set;
+    FleetMask start = {0, 1ULL << (FULL_FLEET - 64)};
+    int ok = set_init(&set, 16) && set_add(&set, 0, start) && level_from_set(&counter->levels[0], &set);
+    set_free(&set);
+    
+    for(int row = 0; row < BOARD_SIZE && ok; row++) {
+        ok = expand_level(counter, row);
+    }
+    for(int row = BOARD_SIZE; row >= 0 && ok; row--) {
+        ok = build_level(counter, row);
+    }
+    
+    // Първият ред има хиляди възможности, затова за него се пазят натрупаните броеве
+    const CountLevel* first = &counter->levels[0];
+    if(ok) {
+        counter->first_row = malloc((first->edge_count + 1) * sizeof(FleetCount));
+        ok = counter->first_row != NULL;
+    }
+    for(size_t e = 0; e < first->edge_count && ok; e++) {
+        counter->first_row[e] = counter->total;
+        counter->total += level_count(&counter->levels[1], first->edge_next[e], FULL_FLEET - first->edge_used[e]);
+    }
+    
+    if(!ok) {
+        fleet_counter_free(counter);
+        return NULL;
+    }
+    return counter;
+}
+
+void fleet_counter_free(FleetCounter* counter) {
+    if(!counter) return;
+    for(int row = 0; row <= BOARD_SIZE; row++) {
+        CountLevel* level = &counter->levels[row];
+        free(level->profiles);
+        free(level->mask);
+        free(level->offsets);
+        free(level->counts);
+        free(level->passed_offsets);
+        free(level->passed);
+        free(level->edge_start);
+        free(level->edge_next);
+        free(level->edge_used);
+    }
+    free(counter->first_row);
+    free(counter);
+}
+
+FleetCount fleet_counter_total(FleetCounter* counter) {
+    return counter->total;
+}
+
+int fleet_counter_unrank(FleetCounter* counter, FleetCount index, Player* player) {
+    if(index >= counter->total) return 0;
+    
+    const CountLevel* first = &counter->levels[0];
+    int low = 0, high = (int)first->edge_count - 1;
+    while(low < high) {
+        int mid = (low + high + 1) / 2;
+        if(counter->first_row[mid] <= index) low = mid;
+        else high = mid - 1;
+    }
+    
+    unsigned int profiles[BOARD_SIZE + 1];
+    int state = first->edge_next[low];
+    int fleet = FULL_FLEET - first->edge_used[low];
+    index -= counter->first_row[low];
+    profiles[0] = 0;
+    profiles[1] = counter->levels[1].profiles[state];
+    
+    for(int row = 1; row < BOARD_SIZE; row++) {
+        const CountLevel* level = &counter->levels[row];
+        const CountLevel* next = &counter->levels[row + 1];
+        unsigned int e = level->edge_start[state];
+        
+        // Двоично търсене на блока от 64 прехода, в който попада index, после преходите един по един
+        int rank = mask_rank(level->mask[state], fleet);
+        int blocks = edge_blocks(level, state);
+        if(rank < 0) return 0;
+        const FleetCount* passed = level->passed + level->passed_offsets[state] + (size_t)rank * blocks;
+        int low = 0, high = blocks;
+        while(low < high) {
+            int mid = (low + high) / 2;
+            if(passed[mid] <= index) low = mid + 1;
+            else high = mid;
+        }
+        if(low > 0) {
+            index -= passed[low - 1];
+            e += (unsigned int)low * EDGE_BLOCK;
+        }
+        
+        for(; e < level->edge_start[state + 1]; e++) {
+            int after = fleet_sub[fleet][level->edge_used[e]];
+            if(after < 0) continue;
+            
+            FleetCount ways = level_count(next, level->edge_next[e], after);
+            if(index < ways) {
+                fleet = after;
+                break;
+            }
+            index -= ways;
+        }
+        if(e == level->edge_start[state + 1]) return 0;
+        
+        state = level->edge_next[e];
+        profiles[row + 1] = next->profiles[state];
+    }
+    if(fleet != 0) return 0;
+    
+    // Корабите се слагат в реда на ship_sizes, за да съвпада номерацията с ръчното разполагане
+    RowShips ships;
+    memset(ships.count, 0, sizeof(ships.count));
+    for(int row = 0; row < BOARD_SIZE; row++) {
+        collect_row_ships(&ships, row, profiles[row], profiles[row + 1]);
+    }
+    engine_clear_fleet(player);
+    for(int kind = 0; kind < SHIP_KINDS; kind++) {
+        int length = kind_length[kind];
+        for(int i = 0; i < ships.count[length]; i++) {
+            int cell = ships.cell[length][i];
+            engine_place(player, cell / BOARD_SIZE, cell % BOARD_SIZE, length, ships.direction[length][i]);
+        }
+    }
+    
+    return player->ship_count == MAX_SHIPS;
+}
+
+// Профилът на ред row според корабите на играча (виж началото на файла)
+static unsigned int player_profile(const Player* player, int row) {
+    unsigned int profile = 0;
+    for(int i = 0; i < player->ship_count; i++) {
+        const Ship* ship = &player->ships[i];
+        for(int k = 0; k < ship->length; k++) {
+            int r = ship->direction == DOWN ? ship->row + k : ship->row;
+            int c = ship->direction == DOWN ? ship->col : ship->col + k;
+            if(r != row || c < 0 || c >= BOARD_SIZE) continue;
+            unsigned int value = ship->direction == DOWN ? (unsigned int)(ship->length - k) : 1;
+            profile |= value << (c * PROFILE_BITS);
+        }
+    }
+    return profile;
+}
+
+// Обратното на fleet_counter_unrank: номерът на флота на играча сред всички допустими
+int fleet_counter_rank(FleetCounter* counter, const Player* player, FleetCount* index) {
+    const CountLevel* first = &counter->levels[0];
+    int target = level_find(&counter->levels[1], player_profile(player, 0));
+    unsigned int e = 0;
+    while(e < first->edge_count && (int)first->edge_next[e] != target) e++;
+    if(target < 0 || e == first->edge_count) return 0;
+    
+    int state = target;
+    int fleet = FULL_FLEET - first->edge_used[e];
+    *index = counter->first_row[e];
+    
+    for(int row = 1; row < BOARD_SIZE; row++) {
+        const CountLevel* level = &counter->levels[row];
+        const CountLevel* next = &counter->levels[row + 1];
+        target = level_find(next, player_profile(player, row));
+        if(target < 0) return 0;
+        
+        for(e = level->edge_start[state]; e < level->edge_start[state + 1]; e++) {
+            int after = fleet_sub[fleet][level->edge_used[e]];
+            if((int)level->edge_next[e] == target) {
+                if(after < 0) return 0;
+                fleet = after;
+                break;
+            }
+            if(after >= 0) *index += level_count(next, level->edge_next[e], after);
+        }
+        if(e == level->edge_start[state + 1]) return 0;
+        state = target;
+    }
+    return fleet == 0 && level_count(&counter->levels[BOARD_SIZE], state, 0) == 1;
+}
+
+int fleet_counter_sample(FleetCounter* counter, Player* player, Rng* rng) {
+    if(counter->total == 0) return 0;
+    
+    int bits = 0;
+    for(FleetCount t = counter->total - 1; t; t >>= 1) bits++;
+    
+    // Отхвърляне: средно под два опита, а изборът остава точно равномерен
+    FleetCount index;
+    do {
+        index = rng_next(rng);
+        if(bits < 64) index &= (1ULL << bits) - 1;
+    } while(index >= counter->total);
+    
+    return fleet_counter_unrank(counter, index, player);
+}
+
+int fleet_counter_occupancy(FleetCounter* counter, double probability[BOARD_CELLS]) {
+    FleetCount occupied[BOARD_CELLS];
+    memset(occupied, 0, sizeof(occupied));
+    
+    // Броят на пътищата до всяко състояние се пази в същия ред като броевете на довършванията
+    FleetCount* reach = malloc(sizeof(FleetCount));
+    if(!reach) return 0;
+    reach[0] = 1;
+    
+    for(int row = 0; row < BOARD_SIZE; row++) {
+        const CountLevel* level = &counter->levels[row];
+        const CountLevel* next_level = &counter->levels[row + 1];
+        FleetCount* next = calloc(next_level->count_size ? next_level->count_size : 1, sizeof(FleetCount));
+        if(!next) {
+            free(reach);
+            return 0;
+        }
+        
+        for(int i = 0; i < level->profile_count; i++) {
+            for(unsigned int e = level->edge_start[i]; e < level->edge_start[i + 1]; e++) {
+                int target = level->edge_next[e];
+                int used = level->edge_used[e];
+                const FleetCount* arrived = reach + level->offsets[i];
+                FleetCount through = 0;
+                
+                for(int word = 0; word < 2; word++) {
+                    for(unsigned long long bits = level->mask[i][word]; bits; bits &= bits - 1) {
+                        FleetCount paths = *arrived++;
+                        int after = fleet_sub[word * 64 + __builtin_ctzll(bits)][used];
+                        int rank = after < 0 ? -1 : mask_rank(next_level->mask[target], after);
+                        if(rank < 0) continue;
+                        
+                        through += paths * next_level->counts[next_level->offsets[target] + rank];
+                        next[next_level->offsets[target] + rank] += paths;
+                    }
+                }
+                
+                Bitboard cells = through ? profile_cells(row, next_level->profiles[target]) : 0;
+                for(; cells; cells &= cells - 1) {
+                    occupied[bitboard_first(cells)] += through;
+                }
+            }
+        }
+        
+        free(reach);
+        reach = next;
+    }
+    free(reach);
+    
+    for(int cell = 0; cell < BOARD_CELLS; cell++) {
+        probability[cell] = counter->total ? (double)occupied[cell] / (double)counter->total : 0.0;
+    }
+    return 1;
+}
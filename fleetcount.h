@@ -0,0 +1,22 @@
+#ifndef FLEETCOUNT_H
+#define FLEETCOUNT_H
+
+#include "engine.h"
+
+// Броят на всички допустими флоти е около 1.1e13 - събира се в 64 бита
+typedef unsigned long long FleetCount;
+
+typedef struct FleetCounter FleetCounter;
+
+// Изгражда таблицата с броя на допустимите довършвания ред по ред.
+// След създаването броячът само се чете и може да се ползва от много нишки.
+FleetCounter* fleet_counter_create(void);
+void fleet_counter_free(FleetCounter* counter);
+
+FleetCount fleet_counter_total(FleetCounter* counter);
+int fleet_counter_unrank(FleetCounter* counter, FleetCount index, Player* player);
+int fleet_counter_rank(FleetCounter* counter, const Player* player, FleetCount* index);
+int fleet_counter_sample(FleetCounter* counter, Player* player, Rng* rng);
+int fleet_counter_occupancy(FleetCounter* counter, double probability[BOARD_CELLS]);
+
+#endif
@@ -0,0 +1,428 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include "keyring.h"
+
+// Файлът на директорията: "BSKR" байт версия, алгоритъм (байт) и брой итерации (4 байта,
+// от версия 2), salt на главния ключ и 16 байта проверка (началото на SHA-256 от "BSKR" и
+// главния ключ) - по нея се познава грешна парола
+#define KEYRING_MAGIC "BSKR"
+#define KEYRING_VERSION 2
+#define KEYRING_CHECK_SIZE 16
+#define KEYRING_FILE_V1 (4 + 1 + SEAL_SALT_SIZE + KEYRING_CHECK_SIZE)
+#define KEYRING_FILE_SIZE (KEYRING_FILE_V1 + 5)
+#define KEYRING_SLOTS 8
+// Итерациите при калибриране се мерят, докато пробата не отнеме поне толкова
+#define CALIBRATE_MIN_SECONDS 0.05
+
+typedef struct {
+    SealKdf kdf;
+    unsigned char key[SEAL_KEY_SIZE];
+    int used;
+} CachedKey;
+
+// Цялата структура е в заключената памет, включително ключът, който още се проверява
+typedef struct {
+    CachedKey slots[KEYRING_SLOTS];
+    unsigned char scratch[SEAL_KEY_SIZE];
+    int next;
+} KeyCache;
+
+static KeyCache* cache;
+static size_t cache_size;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Параметрите идват от файла, затова непознат алгоритъм и абсурден брой итерации се отказват
+int keyring_derive(const char* password, const SealKdf* kdf, unsigned char* key) {
+    if(kdf->algorithm != SEAL_KDF_PBKDF2_SHA256 || kdf->iterations < 1 ||
+       kdf->iterations > KEYRING_MAX_ITERATIONS) {
+        return 0;
+    }
+    return PKCS5_PBKDF2_HMAC(password, (int)strlen(password), kdf->salt, SEAL_SALT_SIZE,
+                             (int)kdf->iterations, EVP_sha256(), SEAL_KEY_SIZE, key);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Пробата се удвоява, докато не стане достатъчно дълга за точно мерене, и после се мащабира
+unsigned int keyring_calibrate(int target_ms) {
+    SealKdf kdf = {SEAL_KDF_PBKDF2_SHA256, 1000, {0}};
+    unsigned char key[SEAL_KEY_SIZE];
+    double elapsed = 0;
+    
+    while(kdf.iterations < KEYRING_MAX_ITERATIONS) {
+        double start = now_seconds();
+        if(keyring_derive("calibrate", &kdf, key) != 1) break;
+        elapsed = now_seconds() - start;
+        if(elapsed >= CALIBRATE_MIN_SECONDS) break;
+        kdf.iterations *= 2;
+    }
+    
+    double iterations = elapsed > 0 ? kdf.iterations * (target_ms / 1000.0) / elapsed : KEYRING_ITERATIONS;
+    if(iterations < KEYRING_ITERATIONS) iterations = KEYRING_ITERATIONS;
+    if(iterations > KEYRING_MAX_ITERATIONS) iterations = KEYRING_MAX_ITERATIONS;
+    return (unsigned int)iterations;
+}
+
+// Паметта се заключва, ако системата позволява - иначе кешът работи и без това
+static KeyCache* cache_get(void) {
+    if(cache) return cache;
+    
+    #ifdef _WIN32
+        cache_size = sizeof(KeyCache);
+        cache = calloc(1, cache_size);
+    #else
+        long page = sysconf(_SC_PAGESIZE);
+        if(page <= 0) page = 4096;
+        cache_size = (sizeof(KeyCache) + (size_t)page - 1) / (size_t)page * (size_t)page;
+        void* memory;
+        if(posix_memalign(&memory, (size_t)page, cache_size) != 0) return NULL;
+        memset(memory, 0, cache_size);
+        mlock(memory, cache_size);
+        cache = memory;
+    #endif
+    static int registered;
+    if(cache && !registered) {
+        atexit(keyring_clear);
+        registered = 1;
+    }
+    return cache;
+}
+
+// Ключът се търси по всички параметри - същият salt с други итерации е друг ключ
+static CachedKey* cache_find(KeyCache* keys, const SealKdf* kdf) {
+    for(int i = 0; i < KEYRING_SLOTS; i++) {
+        const SealKdf* slot = &keys->slots[i].kdf;
+        if(keys->slots[i].used && slot->algorithm == kdf->algorithm && slot->iterations == kdf->iterations &&
+           memcmp(slot->salt, kdf->salt, SEAL_SALT_SIZE) == 0) {
+            return &keys->slots[i];
+        }
+    }
+    return NULL;
+}
+
+// Проверен ключ от scratch влиза в кеша на мястото на най-стария
+static void cache_store(KeyCache* keys, const SealKdf* kdf) {
+    CachedKey* slot = &keys->slots[keys->next];
+    keys->next = (keys->next + 1) % KEYRING_SLOTS;
+    slot->kdf = *kdf;
+    memcpy(slot->key, keys->scratch, SEAL_KEY_SIZE);
+    slot->used = 1;
+    OPENSSL_cleanse(keys->scratch, SEAL_KEY_SIZE);
+}
+
+static void keyring_check(const unsigned char* master, unsigned char* check) {
+    unsigned char data[4 + SEAL_KEY_SIZE];
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int size;
+    memcpy(data, KEYRING_MAGIC, 4);
+    memcpy(data + 4, master, SEAL_KEY_SIZE);
+    EVP_Digest(data, sizeof(data), digest, &size, EVP_sha256(), NULL);
+    memcpy(check, digest, KEYRING_CHECK_SIZE);
+    OPENSSL_cleanse(data, sizeof(data));
+}
+
+// AES key wrap (RFC 3394): 32 байта ключ стават 40 байта със собствена проверка.
+// shared е контекст на извикващия или NULL за временен.
+static int wrap_key(EVP_CIPHER_CTX* shared, const unsigned char* master, const unsigned char* in, unsigned char* out,
+                    int wrap) {
+    EVP_CIPHER_CTX* ctx = shared ? shared : EVP_CIPHER_CTX_new();
+    int in_size = wrap ? SEAL_KEY_SIZE : SEAL_WRAPPED_SIZE;
+    int len = 0, final = 0;
+    int ok = ctx != NULL;
+    
+    if(ok) {
+        EVP_CIPHER_CTX_set_flags(ctx, EVP_CIPHER_CTX_FLAG_WRAP_ALLOW);
+        ok = EVP_CipherInit_ex(ctx, EVP_aes_256_wrap(), NULL, master, NULL, wrap) == 1 &&
+             EVP_CipherUpdate(ctx, out, &len, in, in_size) == 1 &&
+             EVP_CipherFinal_ex(ctx, out + len, &final) == 1 &&
+             len + final == (wrap ? SEAL_WRAPPED_SIZE : SEAL_KEY_SIZE);
+    }
+    if(!shared) {
+        EVP_CIPHER_CTX_free(ctx);
+    }
+    return ok;
+}
+
+static void keyring_path(const char* directory, char* path, size_t size) {
+    snprintf(path, size, "%s/%s", directory, KEYRING_FILE);
+}
+
+static void put_u32(unsigned char* data, unsigned int value) {
+    for(int i = 0; i < 4; i++) {
+        data[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static unsigned int get_u32(const unsigned char* data) {
+    unsigned int value = 0;
+    for(int i = 0; i < 4; i++) {
+        value |= (unsigned int)data[i] << (8 * i);
+    }
+    return value;
+}
+
+// Версия 1 е без параметри - главният ключ е с PBKDF2-SHA256 и SEAL_LEGACY_ITERATIONS
+static int read_keyring(const char* directory, SealKdf* kdf, unsigned char* check) {
+    char path[1024];
+    unsigned char data[KEYRING_FILE_SIZE + 1];
+    keyring_path(directory, path, sizeof(path));
+    
+    FILE* file = fopen(path, "rb");
+    if(!file) return 0;
+    size_t size = fread(data, 1, sizeof(data), file);
+    fclose(file);
+    if(size < 5 || memcmp(data, KEYRING_MAGIC, 4) != 0 ||
+       size != (data[4] == 1 ? KEYRING_FILE_V1 : data[4] == KEYRING_VERSION ? KEYRING_FILE_SIZE : 0)) {
+        return 0;
+    }
+    
+    const unsigned char* fields = data + 5;
+    kdf->algorithm = SEAL_KDF_PBKDF2_SHA256;
+    kdf->iterations = SEAL_LEGACY_ITERATIONS;
+    if(data[4] >= 2) {
+        kdf->algorithm = fields[0];
+        kdf->iterations = get_u32(fields + 1);
+        fields += 5;
+    }
+    memcpy(kdf->salt, fields, SEAL_SALT_SIZE);
+    memcpy(check, fields + SEAL_SALT_SIZE, KEYRING_CHECK_SIZE);
+    return 1;
+}
+
+// Новият файл се пише встрани и замества стария наведнъж
+static int write_keyring(const char* directory, const SealKdf* kdf, const unsigned char* check) {
+    char path[1024];
+    char temp[1040];
+    unsigned char data[KEYRING_FILE_SIZE];
+    keyring_path(directory, path, sizeof(path));
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    memcpy(data, KEYRING_MAGIC, 4);
+    data[4] = KEYRING_VERSION;
+    data[5] = (unsigned char)kdf->algorithm;
+    put_u32(data + 6, kdf->iterations);
+    memcpy(data + 10, kdf->salt, SEAL_SALT_SIZE);
+    memcpy(data + 10 + SEAL_SALT_SIZE, check, KEYRING_CHECK_SIZE);
+    
+    FILE* file = fopen(temp, "wb");
+    if(!file) return 0;
+    int ok = fwrite(data, 1, sizeof(data), file) == sizeof(data);
+    ok = fclose(file) == 0 && ok;
+    if(ok) {
+        remove(path);
+        ok = rename(temp, path) == 0;
+    }
+    if(!ok) {
+        remove(temp);
+    }
+    return ok;
+}
+
+int keyring_has_directory_key(const char* directory) {
+    SealKdf kdf;
+    unsigned char check[KEYRING_CHECK_SIZE];
+    if(!read_keyring(directory, &kdf, check)) return 0;
+    
+    pthread_mutex_lock(&cache_lock);
+    int found = cache && cache_find(cache, &kdf) != NULL;
+    pthread_mutex_unlock(&cache_lock);
+    return found;
+}
+
+// Нов главен ключ с параметрите kdf (salt се избира тук) - записва се файлът на директорията
+static CachedKey* create_directory_key(KeyCache* keys, const char* directory, const char* password, SealKdf* kdf) {
+    unsigned char check[KEYRING_CHECK_SIZE];
+    if(RAND_bytes(kdf->salt, SEAL_SALT_SIZE) != 1 || keyring_derive(password, kdf, keys->scratch) != 1) {
+        return NULL;
+    }
+    keyring_check(keys->scratch, check);
+    if(!write_keyring(directory, kdf, check)) {
+        OPENSSL_cleanse(keys->scratch, SEAL_KEY_SIZE);
+        return NULL;
+    }
+    cache_store(keys, kdf);
+    return cache_find(keys, kdf);
+}
+
+// Главният ключ на директорията (вика се под cache_lock). Първото извикване в сесията го извежда
+// от паролата и я сверява с файла на директорията; с create директория без файл получава нов.
+static CachedKey* directory_key(KeyCache* keys, const char* directory, const char* password, SealKdf* kdf,
+                                int create) {
+    unsigned char check[KEYRING_CHECK_SIZE];
+    unsigned char expected[KEYRING_CHECK_SIZE];
+    if(!read_keyring(directory, kdf, expected)) {
+        if(!create || !password) return NULL;
+        kdf->algorithm = SEAL_KDF_PBKDF2_SHA256;
+        kdf->iterations = KEYRING_ITERATIONS;
+        return create_directory_key(keys, directory, password, kdf);
+    }
+    
+    CachedKey* master = cache_find(keys, kdf);
+    if(master || !password || keyring_derive(password, kdf, keys->scratch) != 1) {
+        return master;
+    }
+    
+    keyring_check(keys->scratch, check);
+    if(CRYPTO_memcmp(check, expected, KEYRING_CHECK_SIZE) != 0) {
+        OPENSSL_cleanse(keys->scratch, SEAL_KEY_SIZE);
+        return NULL;
+    }
+    cache_store(keys, kdf);
+    return cache_find(keys, kdf);
+}
+
+int keyring_new_key(const char* directory, const char* password, unsigned char* key, SealKdf* kdf,
+                    unsigned char* wrapped) {
+    pthread_mutex_lock(&cache_lock);
+    KeyCache* keys = cache_get();
+    CachedKey* master = keys ? directory_key(keys, directory, password, kdf, 1) : NULL;
+    int ok = master && RAND_bytes(key, SEAL_KEY_SIZE) == 1 && wrap_key(NULL, master->key, key, wrapped, 1);
+    pthread_mutex_unlock(&cache_lock);
+    return ok;
+}
+
+int keyring_unlock_directory(const char* directory, const char* password) {
+    SealKdf kdf;
+    unsigned char check[KEYRING_CHECK_SIZE];
+    if(!read_keyring(directory, &kdf, check)) return 1;
+    
+    pthread_mutex_lock(&cache_lock);
+    KeyCache* keys = cache_get();
+    int ok = keys && directory_key(keys, directory, password, &kdf, 0) != NULL;
+    pthread_mutex_unlock(&cache_lock);
+    return ok;
+}
+
+int keyring_rekey(const char* directory, const char* password, unsigned int iterations) {
+    SealKdf kdf;
+    pthread_mutex_lock(&cache_lock);
+    KeyCache* keys = cache_get();
+    
+    // Сегашната парола на директорията трябва да съвпада - иначе записите биха се разделили
+    unsigned char check[KEYRING_CHECK_SIZE];
+    int ok = keys != NULL;
+    if(ok && read_keyring(directory, &kdf, check)) {
+        ok = directory_key(keys, directory, password, &kdf, 0) != NULL;
+    }
+    kdf.algorithm = SEAL_KDF_PBKDF2_SHA256;
+    kdf.iterations = iterations;
+    ok = ok && create_directory_key(keys, directory, password, &kdf) != NULL;
+    pthread_mutex_unlock(&cache_lock);
+    return ok;
+}
+
+static int open_key(const SealedFile* sealed, const char* password, unsigned char* key, EVP_CIPHER_CTX* unwrap) {
+    // Версия 1 - ключът на файла е изведен направо от паролата и собствения му salt
+    if(sealed->version == 1) {
+        return password && keyring_derive(password, &sealed->kdf, key) == 1;
+    }
+    
+    pthread_mutex_lock(&cache_lock);
+    KeyCache* keys = cache_get();
+    CachedKey* master = keys ? cache_find(keys, &sealed->kdf) : NULL;
+    int ok = master && wrap_key(unwrap, master->key, sealed->wrapped, key, 0);
+    
+    // Успешното разопаковане доказва паролата - едва тогава ключът влиза в кеша
+    if(!ok && keys && password && keyring_derive(password, &sealed->kdf, keys->scratch) == 1) {
+        ok = wrap_key(unwrap, keys->scratch, sealed->wrapped, key, 0);
+        if(ok) {
+            cache_store(keys, &sealed->kdf);
+        } else {
+            OPENSSL_cleanse(keys->scratch, SEAL_KEY_SIZE);
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return ok;
+}
+
+int keyring_open_key(const SealedFile* sealed, const char* password, unsigned char* key) {
+    return open_key(sealed, password, key, NULL);
+}
+
+int keyring_reader_init(KeyringReader* reader) {
+    memset(reader, 0, sizeof(KeyringReader));
+    reader->cipher = EVP_CIPHER_CTX_new();
+    reader->unwrap = EVP_CIPHER_CTX_new();
+    return reader->cipher && reader->unwrap;
+}
+
+int keyring_read_file(KeyringReader* reader, const char* path, const char* password, const unsigned char** data,
+                      size_t* size) {
+    SealedFile* sealed = &reader->sealed;
+    unsigned char key[SEAL_KEY_SIZE];
+    if(!reader->cipher || !reader->unwrap || !seal_open(sealed, path)) return 0;
+    
+    int ok = open_key(sealed, password, key, reader->unwrap) && seal_unlock_with(sealed, key, reader->cipher);
+    OPENSSL_cleanse(key, sizeof(key));
+    
+    // Буферът расте само при по-голям файл; старият се изчиства, вместо да се остави на realloc
+    if(ok && sealed->size > reader->capacity) {
+        unsigned char* grown = malloc((size_t)sealed->size);
+        if(grown) {
+            if(reader->data) {
+                OPENSSL_cleanse(reader->data, reader->capacity);
+                free(reader->data);
+            }
+            reader->data = grown;
+            reader->capacity = (size_t)sealed->size;
+        } else {
+            ok = 0;
+        }
+    }
+    ok = ok && seal_read(sealed, 0, reader->data, (size_t)sealed->size) == sealed->size;
+    *data = reader->data;
+    *size = ok ? (size_t)sealed->size : 0;
+    seal_close(sealed);
+    return ok;
+}
+
+void keyring_reader_free(KeyringReader* reader) {
+    if(reader->data) {
+        OPENSSL_cleanse(reader->data, reader->capacity);
+        free(reader->data);
+    }
+    EVP_CIPHER_CTX_free(reader->cipher);
+    EVP_CIPHER_CTX_free(reader->unwrap);
+    memset(reader, 0, sizeof(KeyringReader));
+}
+
+int keyring_read_password(const char* source, char* password, size_t size) {
+    FILE* file = strcmp(source, "-") == 0 ? stdin : fopen(source, "r");
+    if(!file) return 0;
+    int ok = fgets(password, (int)size, file) != NULL;
+    if(file != stdin) {
+        fclose(file);
+    }
+    if(ok) {
+        password[strcspn(password, "\r\n")] = '\0';
+    }
+    return ok && password[0] != '\0';
+}
+
+void keyring_clear(void) {
+    pthread_mutex_lock(&cache_lock);
+    if(cache) {
+        OPENSSL_cleanse(cache, cache_size);
+        #ifndef _WIN32
+            munlock(cache, cache_size);
+        #endif
+        free(cache);
+        cache = NULL;
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
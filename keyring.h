@@ -0,0 +1,67 @@
+#ifndef KEYRING_H
+#define KEYRING_H
+
+#include <stddef.h>
+#include "seal.h"
+
+// Ключове за криптираните записи. От паролата с PBKDF2 се извежда главен ключ - веднъж
+// за сесия, след което той се пази в заключена памет (mlock - не отива в swap) и се
+// намира по salt. Всеки запис има собствен случаен ключ, опакован с главния (AES key wrap),
+// затова разкриптирането на много записи струва едно извеждане на ключ.
+// Salt-ът и броят итерации на главния ключ са общи за директорията и са във файла
+// KEYRING_FILE заедно със стойност, по която се проверява паролата при запис.
+// Всеки криптиран файл пази в заглавната си част параметрите, с които е създаден.
+#define KEYRING_FILE "keyring.key"
+#define KEYRING_ITERATIONS 100000
+#define KEYRING_MAX_ITERATIONS 100000000u
+
+// Ключ от паролата с параметрите kdf; 0 при непознат алгоритъм или невалиден брой итерации
+int keyring_derive(const char* password, const SealKdf* kdf, unsigned char* key);
+
+// Колко итерации на PBKDF2-SHA256 отнемат около target_ms милисекунди на тази машина
+// (не по-малко от KEYRING_ITERATIONS)
+unsigned int keyring_calibrate(int target_ms);
+// Нов главен ключ за directory с iterations итерации. Ако директорията вече има ключ,
+// password трябва да е неговата парола. Старите записи пазят своите параметри и се четат както досега.
+int keyring_rekey(const char* directory, const char* password, unsigned int iterations);
+
+// Дали главният ключ на директорията вече е в кеша (тогава паролата не трябва)
+int keyring_has_directory_key(const char* directory);
+// Нов случаен ключ за запис в directory, опакован с главния ключ. password може да е NULL,
+// ако главният ключ е в кеша. Връща 0 при грешка или парола, различна от тази на директорията.
+int keyring_new_key(const char* directory, const char* password, unsigned char* key, SealKdf* kdf,
+                    unsigned char* wrapped);
+
+// Проверява паролата по файла на директорията и слага главния ключ в кеша - преди обхождане
+// на много записи, за да не се извежда ключ за всеки файл с грешна парола.
+// Връща 1 и когато директорията няма KEYRING_FILE.
+int keyring_unlock_directory(const char* directory, const char* password);
+
+// Ключът на отворения за четене файл. С password NULL се пробва само кешът.
+// Връща 0, ако ключът не може да се получи (липсва в кеша или паролата е грешна).
+int keyring_open_key(const SealedFile* sealed, const char* password, unsigned char* key);
+
+// Разкриптиране на много файлове от една нишка: контекстите на шифрите, SealedFile и
+// буферът за данните се заделят веднъж и се преизползват за всеки файл.
+typedef struct {
+    EVP_CIPHER_CTX* cipher;
+    EVP_CIPHER_CTX* unwrap;
+    SealedFile sealed;
+    unsigned char* data;
+    size_t capacity;
+} KeyringReader;
+
+int keyring_reader_init(KeyringReader* reader);
+// Разкриптира и проверява целия файл. data сочи в reader и е валидно до следващото четене.
+int keyring_read_file(KeyringReader* reader, const char* path, const char* password, const unsigned char** data,
+                      size_t* size);
+// Изчиства разкриптираните данни и освобождава контекстите
+void keyring_reader_free(KeyringReader* reader);
+
+// Паролата от първия ред на файл ("-" е стандартният вход) - за работа без въпроси
+int keyring_read_password(const char* source, char* password, size_t size);
+
+// Изтрива кеша (вика се и автоматично при изход от програмата)
+void keyring_clear(void);
+
+#endif
@@ -0,0 +1,233 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "montecarlo.h"
+#include "pool.h"
+#include "rng.h"
+
+#define CHECK_INTERVAL 32
+#define SAMPLE_BLOCK 1024
+
+typedef struct {
+    const Placement* list[2 * BOARD_CELLS];
+    int count;
+} Candidates;
+
+typedef struct {
+    unsigned int counts[BOARD_CELLS];
+    long long samples;
+    char padding[64];
+} SampleTally;
+
+// Общите данни за хода - задачите само ги четат, а броят в собствен SampleTally.
+// С deadline 0 задачата е блок от attempts и не зависи от това коя нишка я изпълнява.
+typedef struct {
+    Candidates candidates[MAX_SHIP_LENGTH + 1];
+    int lengths[MAX_SHIPS];
+    int ship_count;
+    Bitboard open_hits;
+    Bitboard shots;
+    double deadline;
+    long long attempts;
+    unsigned long long seed;
+    SampleTally* tallies;
+} SampleJob;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const Placement* pick_placement(const Candidates* candidates, Bitboard taken, Rng* rng) {
+    int legal = 0;
+    for(int p = 0; p < candidates->count; p++) {
+        const Placement* option = candidates->list[p];
+        if(!(option->mask & taken)) legal++;
+    }
+    if(legal == 0) {
+        return NULL;
+    }
+    
+    int pick = rng_below(rng, legal);
+    for(int p = 0; p < candidates->count; p++) {
+        const Placement* option = candidates->list[p];
+        if(!(option->mask & taken) && pick-- == 0) {
+            return option;
+        }
+    }
+    return NULL;
+}
+
+// Строи един флот от оставащите кораби: първо покрива неутопените попадения, после слага останалите
+static int sample_fleet(const SampleJob* job, Rng* rng, Bitboard* fleet) {
+    int used[MAX_SHIPS] = {0};
+    Bitboard taken = 0;
+    Bitboard uncovered = job->open_hits;
+    *fleet = 0;
+    
+    while(uncovered) {
+        Bitboard target = uncovered & -uncovered;
+        int options[MAX_SHIPS], option_count = 0, total = 0;
+        
+        // Еднаквите кораби са взаимозаменяеми - пробва се само първият неизползван от всяка дължина
+        for(int i = 0; i < job->ship_count; i++) {
+            if(used[i] || (i > 0 && job->lengths[i] == job->lengths[i - 1] && !used[i - 1])) continue;
+            
+            const Candidates* candidates = &job->candidates[job->lengths[i]];
+            int legal = 0;
+            for(int p = 0; p < candidates->count; p++) {
+                if(!(candidates->list[p]->mask & taken) && (candidates->list[p]->mask & target)) legal++;
+            }
+            if(legal) {
+                options[option_count++] = i;
+                total += legal;
+            }
+        }
+        if(total == 0) {
+            return 0;
+        }
+        
+        int pick = rng_below(rng, total);
+        int ship = -1;
+        for(int o = 0; o < option_count && ship < 0; o++) {
+            const Candidates* candidates = &job->candidates[job->lengths[options[o]]];
+            for(int p = 0; p < candidates->count; p++) {
+                if(!(candidates->list[p]->mask & taken) && (candidates->list[p]->mask & target) && pick-- == 0) {
+                    ship = options[o];
+                    used[ship] = 1;
+                    taken |= candidates->list[p]->halo;
+                    uncovered &= ~candidates->list[p]->mask;
+                    *fleet |= candidates->list[p]->mask;
+                    break;
+                }
+            }
+        }
+    }
+    
+    for(int i = 0; i < job->ship_count; i++) {
+        if(used[i]) continue;
+        
+        const Placement* option = pick_placement(&job->candidates[job->lengths[i]], taken, rng);
+        if(!option) {
+            return 0;
+        }
+        taken |= option->halo;
+        *fleet |= option->mask;
+    }
+    return 1;
+}
+
+static void sample_fleets(const SampleJob* job, Rng* rng, SampleTally* tally, int count) {
+    for(int i = 0; i < count; i++) {
+        Bitboard fleet;
+        if(!sample_fleet(job, rng, &fleet)) continue;
+        
+        tally->samples++;
+        for(Bitboard cells = fleet & ~job->shots; cells; cells &= cells - 1) {
+            tally->counts[bitboard_first(cells)]++;
+        }
+    }
+}
+
+static void sample_worker(int task, int worker __attribute__((unused)), void* arg) {
+    SampleJob* job = arg;
+    SampleTally* tally = &job->tallies[task];
+    Rng rng;
+    
+    rng_seed(&rng, job->seed, task);
+    
+    if(job->deadline == 0) {
+        long long left = job->attempts - (long long)task * SAMPLE_BLOCK;
+        sample_fleets(job, &rng, tally, left < SAMPLE_BLOCK ? (int)left : SAMPLE_BLOCK);
+        return;
+    }
+    do {
+        sample_fleets(job, &rng, tally, CHECK_INTERVAL);
+    } while(now_seconds() < job->deadline);
+}
+
+int montecarlo_move_samples(const AIState* ai_state) {
+    if(ai_state->move_budget_ms > 0) {
+        return 0;
+    }
+    return ai_state->move_samples > 0 ? ai_state->move_samples : MONTE_CARLO_SAMPLES;
+}
+
+int montecarlo_target(AIState* ai_state, const Player* ai_player, unsigned long long seed) {
+    SampleJob* job = calloc(1, sizeof(SampleJob));
+    if(!job) {
+        return -1;
+    }
+    
+    job->open_hits = ai_player->hit_mask & ~ai_state->sunk_mask;
+    job->shots = ai_player->hit_mask | ai_player->miss_mask;
+    job->seed = seed;
+    job->ship_count = ai_remaining_ships(ai_state, job->lengths);
+    
+    // Положения, които не противоречат на нищо известно досега - пресяват се веднъж за целия ход
+    Bitboard blocked = ai_player->miss_mask | bitboard_halo(ai_state->sunk_mask) | bitboard_diagonals(job->open_hits);
+    for(int length = 1; length <= MAX_SHIP_LENGTH; length++) {
+        int count;
+        const Placement* options = engine_placements(length, &count);
+        Candidates* candidates = &job->candidates[length];
+        
+        for(int p = 0; p < count; p++) {
+            if(options[p].mask & blocked) continue;
+            if(options[p].halo & ~options[p].mask & job->open_hits) continue;
+            candidates->list[candidates->count++] = &options[p];
+        }
+    }
+    
+    // По време всяка нишка е една задача; иначе задачите са блоковете с флоти
+    int workers = ai_state->sample_workers > 0 ? ai_state->sample_workers : 1;
+    int move_samples = montecarlo_move_samples(ai_state);
+    int tasks = workers;
+    if(move_samples > 0) {
+        job->attempts = move_samples;
+        tasks = (move_samples + SAMPLE_BLOCK - 1) / SAMPLE_BLOCK;
+    } else {
+        job->deadline = now_seconds() + ai_state->move_budget_ms / 1000.0;
+    }
+    job->tallies = calloc(tasks, sizeof(SampleTally));
+    if(!job->tallies) {
+        free(job);
+        return -1;
+    }
+    
+    if(ai_state->sample_pool || workers == 1) {
+        pool_dispatch(ai_state->sample_pool, tasks, sample_worker, job);
+    } else {
+        pool_run(workers, tasks, sample_worker, job);
+    }
+    
+    unsigned int counts[BOARD_CELLS] = {0};
+    long long samples = 0;
+    for(int t = 0; t < tasks; t++) {
+        samples += job->tallies[t].samples;
+        for(int cell = 0; cell < BOARD_CELLS; cell++) {
+            counts[cell] += job->tallies[t].counts[cell];
+        }
+    }
+    ai_state->samples += samples;
+    
+    Rng rng;
+    rng_seed(&rng, seed, tasks);
+    int best = -1, ties = 0;
+    unsigned int best_count = 0;
+    for(int cell = 0; cell < BOARD_CELLS; cell++) {
+        if(counts[cell] > best_count) {
+            best = cell;
+            best_count = counts[cell];
+            ties = 1;
+        } else if(counts[cell] == best_count && best_count > 0 && rng_below(&rng, ++ties) == 0) {
+            best = cell;
+        }
+    }
+    
+    free(job->tallies);
+    free(job);
+    return best;
+}
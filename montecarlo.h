@@ -0,0 +1,19 @@
+#ifndef MONTECARLO_H
+#define MONTECARLO_H
+
+#include "engine.h"
+
+// Флоти на ход по подразбиране - степен на 2, за да се побере в записа (replay.c)
+#define MONTE_CARLO_SAMPLES 16384
+#define MONTE_CARLO_MAX_SAMPLES (1 << 30)
+
+// Тегли случайни флоти, съвместими с попаденията, пропуските и потопените кораби,
+// и връща клетката, заета в най-много от тях. Флотите са ai_state->move_samples на
+// блокове от по 1024 - всеки блок със собствен поток от seed, затова изборът е един и
+// същ при всеки брой нишки. С move_budget_ms > 0 вместо това се тегли до изтичане на времето.
+// Връща -1, ако не е намерен нито един флот.
+int montecarlo_target(AIState* ai_state, const Player* ai_player, unsigned long long seed);
+// Колко флота на ход ще тегли ai_state (0 - по време)
+int montecarlo_move_samples(const AIState* ai_state);
+
+#endif
@@ -3,270 +3,216 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 #include <time.h>
 #include <openssl/evp.h>
 #include <openssl/rand.h>
 #include <openssl/sha.h>
 #include <openssl/err.h>
+#include "catalog.h"
+#include "engine.h"
+#include "keyring.h"
+#include "montecarlo.h"
+#include "pack.h"
+#include "pool.h"
+#include "replay.h"
+#include "saver.h"
+#include "seal.h"
 
-#define BOARD_SIZE 10
-#define MAX_SHIPS 10
-#define MAX_MOVES 200
 #define REPLAY_DIR "replays"
 #define SALT_SIZE 16
 #define IV_SIZE 16
 #define KEY_SIZE 32
-#define PBKDF2_ITERATIONS 100000
-
-typedef enum {
-    EMPTY = 0,
-    SHIP = 1,
-    HIT = 2,
-    MISS = 3
-} CellState;
-
-typedef enum {
-    UP = 0,
-    DOWN = 1,
-    LEFT = 2,
-    RIGHT = 3
-} Direction;
-
-typedef struct {
-    int row, col;
-    int length;
-    Direction direction;
-    int hits;
-    int sunk;
-} Ship;
-
-typedef struct {
-    CellState board[BOARD_SIZE][BOARD_SIZE];
-    CellState attacks[BOARD_SIZE][BOARD_SIZE];
-    Ship ships[MAX_SHIPS];
-    int ship_count;
-    int ships_sunk;
-    char name[32];
-    int is_ai;
-} Player;
-
-typedef struct {
-    char player_name[32];
-    int row, col;
-    int hit;
-    int ship_sunk;
-    int ship_length;
-    char timestamp[30];
-} Move;
+#define PASSWORD_ATTEMPTS 3
 
+// Запис, подаден на фоновата нишка (saver.h). Задачата притежава записа на играта и поточния
+// файл; filename, error и catalog_failed се попълват от нея и се съобщават в save_done.
 typedef struct {
-    Player player1_initial;
-    Player player2_initial;
-    Move moves[MAX_MOVES];
-    int move_count;
-    char winner[32];
-    char start_time[30];
-    char end_time[30];
-} GameReplay;
-
-typedef struct {
-    int hunting; 
-    int hunt_row, hunt_col;
-    int hunt_direction;  
-    int hunt_hits[10][2]; 
-    int hunt_hit_count;
-} AIState;
+    GameReplay replay;
+    ReplayWriter* stream;
+    int encrypted;
+    char filename[512];
+    const char* error;
+    int catalog_failed;
+} SaveJob;
 
-Player player1, player2;
-GameReplay current_replay;
-AIState ai_state;
-int last_row = -1, last_col = -1; 
+static Saver* saver;
 
 void clear_screen();
-void print_board(CellState board[BOARD_SIZE][BOARD_SIZE], int show_ships);
+void print_board(Bitboard ships, Bitboard hits, Bitboard misses, int show_ships);
 void print_attacks_with_ships_found(Player* attacker, Player* defender);
 int coord_to_row(char c);
 int coord_to_col(int n);
 char row_to_coord(int row);
-int is_valid_position(Player* player, int row, int col, int length, Direction dir);
-int place_ship(Player* player, int row, int col, int length, Direction dir);
 void setup_player_ships(Player* player);
 void setup_player_ships_enhanced(Player* player);
 int load_ships_from_file(Player* player, const char* filename);
 int save_ships_to_file(Player* player, const char* filename);
 void edit_ship_position(Player* player, int ship_index);
 void review_current_board(Player* player);
-void play_game();
-void play_single_player();
-int make_attack(Player* attacker, Player* defender, int row, int col);
-void ai_make_move(Player* ai_player, Player* human_player);
-int get_attack_coordinates(Player* current_player, int* row, int* col);
-int game_over();
+void play_game(GameContext* ctx);
+void play_single_player(GameContext* ctx);
+void print_fire_result(FireResult* result);
+FireResult play_ai_turn(GameContext* ctx);
+int get_attack_coordinates(GameContext* ctx, Player* current_player, int* row, int* col);
 
-void get_current_time(char* buffer);
-void init_replay();
-void add_move_to_replay(const char* player_name, int row, int col, int hit, int ship_sunk, int ship_length);
-void save_replay(void);
-void save_encrypted_replay(void);
+int start_replay_stream(GameContext* ctx, int encrypted);
+int open_sealed_stream(GameContext* ctx, const char* filename);
+void save_replay(GameContext* ctx);
+int save_replay_job(void* data);
+int save_replay_to_pack(SaveJob* job);
+void save_encrypted_replay(GameContext* ctx);
+int save_encrypted_job(void* data);
+SaveJob* new_save_job(GameContext* ctx);
+void submit_save(SaverJob run, SaveJob* job);
+void save_done(void* data, int ok);
 void load_and_play_replay();
 void load_and_play_encrypted_replay();
+int load_cbc_replay(const char* filename, const char* password, GameReplay* replay);
+int load_sealed_replay(SealedFile* sealed, GameReplay* replay);
 void replay_menu();
+void calibrate_encryption();
+int add_replay_to_catalog(const GameReplay* replay, const char* filename, int encrypted);
+void list_replays(const char* filter);
+void print_ai_settings(const Player* first, const Player* second, const AISettings ai[2]);
 
 int derive_key_from_password(const char* password, unsigned char* salt, unsigned char* key);
-int encrypt_data(unsigned char* plaintext, int plaintext_len, unsigned char* key, 
-                unsigned char* iv, unsigned char* ciphertext);
 int decrypt_data(unsigned char* ciphertext, int ciphertext_len, unsigned char* key,
                 unsigned char* iv, unsigned char* plaintext);
 
-int main() {
-    srand(time(NULL)); 
-    
-    memset(&player1, 0, sizeof(Player));
-    memset(&player2, 0, sizeof(Player));
-    memset(&ai_state, 0, sizeof(AIState));
-    
-    for(int i = 0; i < BOARD_SIZE; i++) {
-        for(int j = 0; j < BOARD_SIZE; j++) {
-            player1.board[i][j] = EMPTY;
-            player1.attacks[i][j] = EMPTY;
-            player2.board[i][j] = EMPTY;
-            player2.attacks[i][j] = EMPTY;
-        }
+int main(int argc, char** argv) {
+    // Seed от записана игра повтаря разположението и изстрелите на компютъра
+    unsigned long long seed = (unsigned long long)time(NULL) ^ ((unsigned long long)clock() << 32);
+    if(argc > 1) {
+        seed = strtoull(argv[1], NULL, 10);
     }
     
-    printf("=== ИГРА БОЙНИ КОРАБИ ===\n\n");
-    printf("1. Игра с двама играчи\n");
-    printf("2. Игра срещу компютър\n");
-    printf("3. Преглед на запис\n");
-    printf("Изберете опция: ");
-    
-    int choice;
-    scanf("%d", &choice);
-    
-    if(choice == 3) {
-        replay_menu();
-        return 0;
-    }
-
-    init_replay();
+    // Записите се запазват във фонова нишка, докато започва следващата игра
+    saver = saver_start();
     
-    if(choice == 2) {
-        printf("Въведете вашето име: ");
-        scanf("%s", player1.name);
-        strcpy(player2.name, "Компютър");
-        player2.is_ai = 1;
+    int playing = 1;
+    while(playing) {
+        GameContext game;
+        init_game_context(&game);
+        engine_seed(&game, seed);
         
-        printf("\n%s ще разположи корабите си първо.\n", player1.name);
-        setup_player_ships_enhanced(&player1);
+        // Съобщават се записите, които фоновата нишка вече е завършила
+        saver_poll(saver);
         
-        printf("\nКомпютърът располага корабите си...\n");
-        for(int attempt = 0; attempt < 1000; attempt++) {
-            memset(&player2, 0, sizeof(Player));
-            strcpy(player2.name, "Компютър");
-            player2.is_ai = 1;
-            for(int i = 0; i < BOARD_SIZE; i++) {
-                for(int j = 0; j < BOARD_SIZE; j++) {
-                    player2.board[i][j] = EMPTY;
-                    player2.attacks[i][j] = EMPTY;
-                }
+        printf("=== ИГРА БОЙНИ КОРАБИ ===\n\n");
+        printf("1. Игра с двама играчи\n");
+        printf("2. Игра срещу компютър\n");
+        printf("3. Преглед на запис\n");
+        printf("Изберете опция: ");
+        
+        int choice = 3;
+        scanf("%d", &choice);
+        
+        if(choice == 3) {
+            // Прегледът вижда и записите на току-що изиграните игри
+            saver_flush(saver);
+            replay_menu();
+            break;
+        }
+        
+        // Начинът на запазване се избира преди играта - криптираният запис се пише криптиран
+        // ход по ход и на диска никога няма некриптирано копие
+        printf("Желаете ли историята на играта да се пази криптирана? (y/n): ");
+        char save_choice;
+        scanf(" %c", &save_choice);
+        int encrypted = save_choice == 'y' || save_choice == 'Y';
+        
+        init_replay(&game);
+        if(!start_replay_stream(&game, encrypted) && encrypted) {
+            printf("Играта няма да бъде записана.\n");
+        }
+        
+        if(choice == 2) {
+            printf("Въведете вашето име: ");
+            scanf("%s", game.player1.name);
+            strcpy(game.player2.name, "Компютър");
+            game.player2.is_ai = 1;
+            
+            printf("Трудност на компютъра:\n");
+            printf("1. Лесна (случайни изстрели)\n");
+            printf("2. Трудна (стреля по най-вероятните клетки)\n");
+            printf("3. Експертна (симулира хиляди възможни флоти на всички ядра)\n");
+            printf("Изберете опция: ");
+            int level;
+            if(scanf("%d", &level) == 1 && level == 2) {
+                game.ai_state[1].strategy = AI_DENSITY;
+            } else if(level == 3) {
+                game.ai_state[1].strategy = AI_MONTE_CARLO;
+                game.ai_state[1].sample_workers = pool_default_workers();
+                game.ai_state[1].sample_pool = pool_create(game.ai_state[1].sample_workers);
+                game.ai_state[1].move_samples = 4 * MONTE_CARLO_SAMPLES;
             }
             
-            int ship_sizes[] = {2, 2, 2, 2, 3, 3, 3, 4, 4, 6};
-            int all_placed = 1;
+            printf("\n%s ще разположи корабите си първо.\n", game.player1.name);
+            setup_player_ships_enhanced(&game.player1);
             
-            for(int i = 0; i < MAX_SHIPS; i++) {
-                int placed = 0;
-                for(int tries = 0; tries < 100; tries++) {
-                    int row = rand() % BOARD_SIZE;
-                    int col = rand() % BOARD_SIZE;
-                    Direction dir = rand() % 4;
-                    
-                    if(place_ship(&player2, row, col, ship_sizes[i], dir)) {
-                        placed = 1;
-                        break;
-                    }
-                }
-                if(!placed) {
-                    all_placed = 0;
-                    break;
-                }
-            }
+            printf("\nКомпютърът располага корабите си...\n");
+            engine_random_fleet(&game.player2, &game.rng);
+            
+            play_single_player(&game);
+            pool_destroy(game.ai_state[1].sample_pool);
+            game.ai_state[1].sample_pool = NULL;
+        } else {
+            printf("Въведете име на Играч 1: ");
+            scanf("%s", game.player1.name);
+            printf("Въведете име на Играч 2: ");
+            scanf("%s", game.player2.name);
+            
+            printf("\n%s ще разположи корабите си първо.\n", game.player1.name);
+            setup_player_ships_enhanced(&game.player1);
             
-            if(all_placed) break;
+            printf("\nНатиснете Enter за да продължите...");
+            getchar();
+            getchar();
+            clear_screen();
+            
+            printf("%s сега ще разположи корабите си.\n", game.player2.name);
+            setup_player_ships_enhanced(&game.player2);
+            
+            play_game(&game);
         }
         
-        play_single_player();
-    } else {
-        printf("Въведете име на Играч 1: ");
-        scanf("%s", player1.name);
-        printf("Въведете име на Играч 2: ");
-        scanf("%s", player2.name);
-        
-        printf("\n%s ще разположи корабите си първо.\n", player1.name);
-        setup_player_ships_enhanced(&player1);
+        if(encrypted) {
+            save_encrypted_replay(&game);
+        } else {
+            printf("\nИскате ли да запазите записа на играта? (y/n): ");
+            scanf(" %c", &save_choice);
+            if(save_choice == 'y' || save_choice == 'Y') {
+                save_replay(&game);
+            }
+        }
         
-        printf("\nНатиснете Enter за да продължите...");
-        getchar();
-        getchar();
-        clear_screen();
+        // Незапазеният поточен запис се изтрива
+        if(game.stream) {
+            replay_writer_close(game.stream, 0);
+        }
+        free_replay(&game.replay);
         
-        printf("%s сега ще разположи корабите си.\n", player2.name);
-        setup_player_ships_enhanced(&player2);
+        saver_poll(saver);
+        printf("\nНова игра? (y/n): ");
+        char again = 'n';
+        scanf(" %c", &again);
+        playing = again == 'y' || again == 'Y';
         
-        play_game();
-    }
-
-    printf("\nЖелаете ли да запазите историята на играта криптирана? (y/n): ");
-    char save_choice;
-    scanf(" %c", &save_choice);
-    
-    if(save_choice == 'y' || save_choice == 'Y') {
-        save_encrypted_replay();
-    } else {
-        printf("\nИскате ли да запазите записа на играта некриптиран? (y/n): ");
-        scanf(" %c", &save_choice);
-        if(save_choice == 'y' || save_choice == 'Y') {
-            save_replay();
-        }
+        // Следващата игра получава seed от тази - цялата поредица се повтаря от първия seed
+        seed = rng_next(&game.rng);
     }
     
+    // Изчакват се записите, подадени на фоновата нишка
+    saver_stop(saver);
     return 0;
 }
 
+// Старите записи са с PBKDF2-SHA256 и фиксиран брой итерации
 int derive_key_from_password(const char* password, unsigned char* salt, unsigned char* key) {
-    return PKCS5_PBKDF2_HMAC(password, strlen(password), salt, SALT_SIZE, 
-                             PBKDF2_ITERATIONS, EVP_sha256(), KEY_SIZE, key);
-}
-
-int encrypt_data(unsigned char* plaintext, int plaintext_len, unsigned char* key, 
-                unsigned char* iv, unsigned char* ciphertext) {
-    EVP_CIPHER_CTX* ctx;
-    int len;
-    int ciphertext_len;
-    
-    if(!(ctx = EVP_CIPHER_CTX_new())) {
-        return -1;
-    }
-    
-    if(1 != EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv)) {
-        EVP_CIPHER_CTX_free(ctx);
-        return -1;
-    }
-    
-    if(1 != EVP_EncryptUpdate(ctx, ciphertext, &len, plaintext, plaintext_len)) {
-        EVP_CIPHER_CTX_free(ctx);
-        return -1;
-    }
-    ciphertext_len = len;
-    
-    if(1 != EVP_EncryptFinal_ex(ctx, ciphertext + len, &len)) {
-        EVP_CIPHER_CTX_free(ctx);
-        return -1;
-    }
-    ciphertext_len += len;
-    
-    EVP_CIPHER_CTX_free(ctx);
-    return ciphertext_len;
+    SealKdf kdf = {SEAL_KDF_PBKDF2_SHA256, SEAL_LEGACY_ITERATIONS, {0}};
+    memcpy(kdf.salt, salt, SALT_SIZE);
+    return keyring_derive(password, &kdf, key);
 }
 
 int decrypt_data(unsigned char* ciphertext, int ciphertext_len, unsigned char* key,
@@ -300,107 +246,39 @@ int decrypt_data(unsigned char* ciphertext, int ciphertext_len, unsigned char* k
     return plaintext_len;
 }
 
-void save_encrypted_replay(void) {
-    char password[256];
-    char confirm_password[256];
-    
-    printf("Въведете парола за криптиране: ");
-    scanf("%s", password);
-    
-    printf("Потвърдете паролата: ");
-    scanf("%s", confirm_password);
-    
-    if(strcmp(password, confirm_password) != 0) {
-        printf("Паролите не съвпадат! Записът не е запазен.\n");
-        return;
-    }
-    
-    #ifdef _WIN32
-        system("mkdir replays 2>nul");
-    #else
-        system("mkdir -p replays");
-    #endif
-    
-    unsigned char salt[SALT_SIZE];
-    unsigned char iv[IV_SIZE];
-    unsigned char key[KEY_SIZE];
-    
-    if(RAND_bytes(salt, SALT_SIZE) != 1) {
-        printf("Грешка при генериране на salt!\n");
-        return;
-    }
-    
-    if(RAND_bytes(iv, IV_SIZE) != 1) {
-        printf("Грешка при генериране на IV!\n");
-        return;
-    }
-
-    if(derive_key_from_password(password, salt, key) != 1) {
-        printf("Грешка при генериране на ключ!\n");
+// Криптираният поточен запис е готов - остава да се допише и преименува от .part,
+// което става във фоновата нишка (save_encrypted_job)
+void save_encrypted_replay(GameContext* ctx) {
+    if(!ctx->stream) {
         return;
     }
     
-    get_current_time(current_replay.end_time);
-    
-    unsigned char* plaintext = (unsigned char*)&current_replay;
-    int plaintext_len = sizeof(GameReplay);
-
-    unsigned char* ciphertext = malloc(plaintext_len + EVP_CIPHER_block_size(EVP_aes_256_cbc()));
-    if(!ciphertext) {
-        printf("Грешка при алокиране на памет!\n");
-        return;
+    SaveJob* job = new_save_job(ctx);
+    if(job) {
+        job->encrypted = 1;
     }
+    submit_save(save_encrypted_job, job);
+}
 
-    int ciphertext_len = encrypt_data(plaintext, plaintext_len, key, iv, ciphertext);
-    if(ciphertext_len == -1) {
-        printf("Грешка при криптиране на данните!\n");
-        free(ciphertext);
-        return;
-    }
-    
-    char filename[100];
-    time_t rawtime;
-    struct tm* timeinfo;
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);
-    
-    strftime(filename, sizeof(filename), "replays/game_%Y%m%d_%H%M%S.encrypted", timeinfo);
-    
-    FILE* file = fopen(filename, "wb");
-    if(!file) {
-        printf("Грешка при създаване на криптиран файл!\n");
-        free(ciphertext);
-        return;
+int save_encrypted_job(void* data) {
+    SaveJob* job = data;
+    snprintf(job->filename, sizeof(job->filename), "%s", replay_writer_path(job->stream));
+    int ok = replay_writer_close(job->stream, 1);
+    job->stream = NULL;
+    if(!ok) {
+        return 0;
     }
     
-    fwrite(salt, 1, SALT_SIZE, file);
-    fwrite(iv, 1, IV_SIZE, file);
-    fwrite(ciphertext, 1, ciphertext_len, file);
-    
-    fclose(file);
-    free(ciphertext);
-    
-    printf("Криптираният запис на играта е запазен като: %s\n", filename);
-    
-    memset(password, 0, sizeof(password));
-    memset(confirm_password, 0, sizeof(confirm_password));
-    memset(key, 0, sizeof(key));
+    job->catalog_failed = !add_replay_to_catalog(&job->replay, job->filename, 1);
+    return 1;
 }
 
-void load_and_play_encrypted_replay() {
-    char filename[100];
-    char password[256];
-    
-    printf("Въведете име на криптирания файл с записа: ");
-    scanf("%s", filename);
-    
-    printf("Въведете парола за декриптиране: ");
-    scanf("%s", password);
-    
+// Записите, запазени преди криптирането на парчета - цял файл AES-256-CBC
+int load_cbc_replay(const char* filename, const char* password, GameReplay* replay) {
     FILE* file = fopen(filename, "rb");
     if(!file) {
         printf("Не може да се отвори криптираният файл!\n");
-        return;
+        return 0;
     }
     
     unsigned char salt[SALT_SIZE];
@@ -410,46 +288,51 @@ void load_and_play_encrypted_replay() {
     if(fread(salt, 1, SALT_SIZE, file) != SALT_SIZE) {
         printf("Грешка при четене на salt!\n");
         fclose(file);
-        return;
+        return 0;
     }
     
     if(fread(iv, 1, IV_SIZE, file) != IV_SIZE) {
         printf("Грешка при четене на IV!\n");
         fclose(file);
-        return;
+        return 0;
     }
 
     if(derive_key_from_password(password, salt, key) != 1) {
         printf("Грешка при генериране на ключ!\n");
         fclose(file);
-        return;
+        return 0;
     }
     
     fseek(file, 0, SEEK_END);
     long file_size = ftell(file);
+    if(file_size < SALT_SIZE + IV_SIZE || file_size - SALT_SIZE - IV_SIZE > INT_MAX) {
+        printf("Невалиден размер на криптирания файл!\n");
+        fclose(file);
+        return 0;
+    }
     int ciphertext_len = file_size - SALT_SIZE - IV_SIZE;
     fseek(file, SALT_SIZE + IV_SIZE, SEEK_SET);
     
-    unsigned char* ciphertext = malloc(ciphertext_len);
+    unsigned char* ciphertext = malloc(ciphertext_len > 0 ? ciphertext_len : 1);
     if(!ciphertext) {
         printf("Грешка при алокиране на памет!\n");
         fclose(file);
-        return;
+        return 0;
     }
     
-    if(fread(ciphertext, 1, ciphertext_len, file) != ciphertext_len) {
+    if(fread(ciphertext, 1, (size_t)ciphertext_len, file) != (size_t)ciphertext_len) {
         printf("Грешка при четене на криптираните данни!\n");
         free(ciphertext);
         fclose(file);
-        return;
+        return 0;
     }
     fclose(file);
     
-    unsigned char* plaintext = malloc(sizeof(GameReplay) + EVP_CIPHER_block_size(EVP_aes_256_cbc()));
+    unsigned char* plaintext = malloc(ciphertext_len + EVP_CIPHER_block_size(EVP_aes_256_cbc()));
     if(!plaintext) {
         printf("Грешка при алокиране на памет за декриптиране!\n");
         free(ciphertext);
-        return;
+        return 0;
     }
     
     int plaintext_len = decrypt_data(ciphertext, ciphertext_len, key, iv, plaintext);
@@ -457,17 +340,85 @@ void load_and_play_encrypted_replay() {
         printf("Грешка при декриптиране! Възможно е паролата да е грешна.\n");
         free(ciphertext);
         free(plaintext);
-        return;
+        return 0;
     }
     
-    GameReplay replay;
-    memcpy(&replay, plaintext, sizeof(GameReplay));
+    int decoded = replay_decode(plaintext, plaintext_len, replay);
     
     free(ciphertext);
     free(plaintext);
     
-    memset(password, 0, sizeof(password));
     memset(key, 0, sizeof(key));
+    
+    if(!decoded) {
+        printf("Повреден запис на игра!\n");
+    }
+    return decoded;
+}
+
+// Парчетата се разкриптират и проверяват едно по едно направо в буфера на записа.
+// Паролата се иска само ако главният ключ на файла още не е в кеша на сесията.
+int load_sealed_replay(SealedFile* sealed, GameReplay* replay) {
+    unsigned char key[SEAL_KEY_SIZE];
+    int found = keyring_open_key(sealed, NULL, key);
+    if(!found) {
+        char password[256];
+        printf("Въведете парола за декриптиране: ");
+        scanf("%s", password);
+        found = keyring_open_key(sealed, password, key);
+        memset(password, 0, sizeof(password));
+    }
+    int unlocked = found && seal_unlock(sealed, key);
+    memset(key, 0, sizeof(key));
+    if(!unlocked) {
+        printf("Грешка при декриптиране! Възможно е паролата да е грешна.\n");
+        seal_close(sealed);
+        return 0;
+    }
+    
+    size_t size = (size_t)sealed->size;
+    unsigned char* plaintext = malloc(size ? size : 1);
+    if(!plaintext) {
+        printf("Грешка при алокиране на памет за декриптиране!\n");
+        seal_close(sealed);
+        return 0;
+    }
+    
+    int decoded = seal_read(sealed, 0, plaintext, size) == size && replay_decode(plaintext, size, replay);
+    if(!sealed->complete) {
+        printf("Криптираният запис е незавършен.\n");
+    }
+    seal_close(sealed);
+    memset(plaintext, 0, size);
+    free(plaintext);
+    
+    if(!decoded) {
+        printf("Повреден запис на игра!\n");
+    }
+    return decoded;
+}
+
+void load_and_play_encrypted_replay() {
+    char filename[100];
+    char password[256];
+    
+    printf("Въведете име на криптирания файл с записа: ");
+    scanf("%s", filename);
+    
+    GameReplay replay;
+    int decoded;
+    SealedFile sealed;
+    if(seal_open(&sealed, filename)) {
+        decoded = load_sealed_replay(&sealed, &replay);
+    } else {
+        printf("Въведете парола за декриптиране: ");
+        scanf("%s", password);
+        decoded = load_cbc_replay(filename, password, &replay);
+        memset(password, 0, sizeof(password));
+    }
+    if(!decoded) {
+        return;
+    }
 
     printf("\n=== ДЕКРИПТИРАН GAME REPLAY ===\n");
     printf("Играч 1: %s\n", replay.player1_initial.name);
@@ -476,6 +427,8 @@ void load_and_play_encrypted_replay() {
     printf("Край: %s\n", replay.end_time);
     printf("Победител: %s\n", replay.winner);
     printf("Общо ходове: %d\n", replay.move_count);
+    printf("Seed: %llu\n", replay.seed);
+    print_ai_settings(&replay.player1_initial, &replay.player2_initial, replay.ai);
     printf("===============================\n\n");
     
     printf("Натиснете Enter за да започне възпроизвеждането...");
@@ -484,42 +437,36 @@ void load_and_play_encrypted_replay() {
     Player p1 = replay.player1_initial;
     Player p2 = replay.player2_initial;
     
-    for(int i = 0; i < BOARD_SIZE; i++) {
-        for(int j = 0; j < BOARD_SIZE; j++) {
-            p1.attacks[i][j] = EMPTY;
-            p2.attacks[i][j] = EMPTY;
-            if(p1.board[i][j] == HIT) p1.board[i][j] = SHIP;
-            if(p2.board[i][j] == HIT) p2.board[i][j] = SHIP;
-        }
-    }
+    p1.hit_mask = p1.miss_mask = p1.damage_mask = 0;
+    p2.hit_mask = p2.miss_mask = p2.damage_mask = 0;
     
     for(int i = 0; i < replay.move_count; i++) {
         clear_screen();
-        Move* move = &replay.moves[i];
+        Move* move = replay_move(&replay, i);
         
         printf("=== ХОД %d ===\n", i + 1);
         printf("Играч: %s\n", move->player_name);
         printf("Цел: %c%d\n", row_to_coord(move->row), move->col + 1);
         printf("Време: %s\n", move->timestamp);
         
-        Player* attacker = (strcmp(move->player_name, p1.name) == 0) ? &p1 : &p2;
-        Player* defender = (strcmp(move->player_name, p1.name) == 0) ? &p2 : &p1;
+        Player* attacker = move->player ? &p2 : &p1;
+        Player* defender = move->player ? &p1 : &p2;
         
         if(move->hit) {
-            attacker->attacks[move->row][move->col] = HIT;
-            defender->board[move->row][move->col] = HIT;
+            attacker->hit_mask |= CELL_BIT(move->row, move->col);
+            defender->damage_mask |= CELL_BIT(move->row, move->col);
             printf("Резултат: ПОПАДЕНИЕ!\n");
             
             if(move->ship_sunk) {
                 printf("КОРАБ ПОТОПЕН! (Дължина: %d)\n", move->ship_length);
             }
         } else {
-            attacker->attacks[move->row][move->col] = MISS;
+            attacker->miss_mask |= CELL_BIT(move->row, move->col);
             printf("Резултат: ПРОПУСК!\n");
         }
         
         printf("\nДъска с атаки на %s:\n", move->player_name);
-        print_board(attacker->attacks, 0);
+        print_board(0, attacker->hit_mask, attacker->miss_mask, 0);
         
         printf("\nНатиснете Enter за следващия ход...");
         getchar();
@@ -530,9 +477,11 @@ void load_and_play_encrypted_replay() {
     
     printf("\nФинални дъски:\n");
     printf("\nДъска на %s:\n", replay.player1_initial.name);
-    print_board(replay.player1_initial.board, 1);
+    print_board(replay.player1_initial.ship_mask, replay.player1_initial.damage_mask, 0, 1);
     printf("\nДъска на %s:\n", replay.player2_initial.name);
-    print_board(replay.player2_initial.board, 1);
+    print_board(replay.player2_initial.ship_mask, replay.player2_initial.damage_mask, 0, 1);
+    
+    free_replay(&replay);
 }
 
 int load_ships_from_file(Player* player, const char* filename) {
@@ -542,12 +491,7 @@ int load_ships_from_file(Player* player, const char* filename) {
         return 0;
     }
     
-    for(int i = 0; i < BOARD_SIZE; i++) {
-        for(int j = 0; j < BOARD_SIZE; j++) {
-            player->board[i][j] = EMPTY;
-        }
-    }
-    player->ship_count = 0;
+    engine_clear_fleet(player);
     
     int ship_sizes[] = {2, 2, 2, 2, 3, 3, 3, 4, 4, 6};
     
@@ -572,7 +516,7 @@ int load_ships_from_file(Player* player, const char* filename) {
                 continue;
             }
             
-            if(place_ship(player, row, col, ship_sizes[ships_loaded], (Direction)dir)) {
+            if(engine_place(player, row, col, ship_sizes[ships_loaded], (Direction)dir) == PLACE_OK) {
                 ships_loaded++;
             } else {
                 printf("Невъзможно поставяне на кораб в позиция %s посока %d\n", pos, dir);
@@ -616,26 +560,9 @@ void edit_ship_position(Player* player, int ship_index) {
         return;
     }
     
-    Ship* ship = &player->ships[ship_index];
-    int old_length = ship->length;
+    int old_length = player->ships[ship_index].length;
     
-    for(int i = 0; i < ship->length; i++) {
-        int curr_row = ship->row, curr_col = ship->col;
-        
-        switch(ship->direction) {
-            case UP: curr_row = ship->row - i; break;
-            case DOWN: curr_row = ship->row + i; break;
-            case LEFT: curr_col = ship->col - i; break;
-            case RIGHT: curr_col = ship->col + i; break;
-        }
-        
-        player->board[curr_row][curr_col] = EMPTY;
-    }
-    
-    for(int i = ship_index; i < player->ship_count - 1; i++) {
-        player->ships[i] = player->ships[i + 1];
-    }
-    player->ship_count--;
+    engine_remove(player, ship_index);
     
     printf("\nРедактиране на кораб с дължина %d:\n", old_length);
     printf("Въведете нова позиция и посока: ");
@@ -656,7 +583,7 @@ void edit_ship_position(Player* player, int ship_index) {
         return;
     }
     
-    if(place_ship(player, row, col, old_length, (Direction)dir)) {
+    if(engine_place(player, row, col, old_length, (Direction)dir) == PLACE_OK) {
         printf("Корабът е редактиран успешно!\n");
     } else {
         printf("Невалидна позиция за кораба!\n");
@@ -665,7 +592,7 @@ void edit_ship_position(Player* player, int ship_index) {
 
 void review_current_board(Player* player) {
     printf("\n=== Текуща дъска на %s ===\n", player->name);
-    print_board(player->board, 1);
+    print_board(player->ship_mask, player->damage_mask, 0, 1);
     printf("\nПоставени кораби: %d/10\n", player->ship_count);
     
     if(player->ship_count > 0) {
@@ -700,7 +627,7 @@ void setup_player_ships_enhanced(Player* player) {
         
         if(load_ships_from_file(player, filename)) {
             printf("Заредена конфигурация:\n");
-            print_board(player->board, 1);
+            print_board(player->ship_mask, player->damage_mask, 0, 1);
             printf("Запазване завършено!\n");
             return;
         } else {
@@ -740,7 +667,7 @@ void setup_player_ships_enhanced(Player* player) {
                 
                 while(!placed) {
                     printf("\nТекуща дъска:\n");
-                    print_board(player->board, 1);
+                    print_board(player->ship_mask, player->damage_mask, 0, 1);
                     
                     printf("\nПостави %s кораб (дължина %d) - Кораб %d/10\n", 
                            ship_names[current_ship], ship_sizes[current_ship], current_ship + 1);
@@ -768,9 +695,12 @@ void setup_player_ships_enhanced(Player* player) {
                         continue;
                     }
                     
-                    if(place_ship(player, row, col, ship_sizes[current_ship], (Direction)dir)) {
+                    PlaceResult result = engine_place(player, row, col, ship_sizes[current_ship], (Direction)dir);
+                    if(result == PLACE_OK) {
                         printf("Корабът е поставен успешно!\n");
                         placed = 1;
+                    } else if(result == PLACE_OUT_OF_BOUNDS) {
+                        printf("Невалидна позиция! Корабът излиза извън дъската.\n");
                     } else {
                         printf("Невалидна позиция! Корабите не могат да се докосват.\n");
                     }
@@ -813,49 +743,41 @@ void setup_player_ships_enhanced(Player* player) {
     }
     
     printf("\nВсички кораби са поставени за %s!\n", player->name);
-    print_board(player->board, 1);
+    print_board(player->ship_mask, player->damage_mask, 0, 1);
 }
 
 void print_attacks_with_ships_found(Player* attacker, Player* defender) {
     printf("\n=== Вашите атаки и намерени кораби ===\n");
     printf("Дъска с атаки:\n");
-    print_board(attacker->attacks, 0);
+    print_board(0, attacker->hit_mask, attacker->miss_mask, 0);
     
     printf("\nНамерени кораби: %d/10\n", defender->ships_sunk);
     printf("Успешни попадения: ");
-    int hit_count = 0;
-    for(int i = 0; i < BOARD_SIZE; i++) {
-        for(int j = 0; j < BOARD_SIZE; j++) {
-            if(attacker->attacks[i][j] == HIT) {
-                if(hit_count > 0) printf(", ");
-                printf("%c%d", row_to_coord(i), j + 1);
-                hit_count++;
-            }
-        }
+    Bitboard hits = attacker->hit_mask;
+    if(!hits) printf("няма");
+    while(hits) {
+        int cell = bitboard_first(hits);
+        hits &= hits - 1;
+        printf("%c%d%s", row_to_coord(cell / BOARD_SIZE), cell % BOARD_SIZE + 1, hits ? ", " : "");
     }
-    if(hit_count == 0) printf("няма");
     
     printf("\nНеуспешни опити: ");
-    int miss_count = 0;
-    for(int i = 0; i < BOARD_SIZE; i++) {
-        for(int j = 0; j < BOARD_SIZE; j++) {
-            if(attacker->attacks[i][j] == MISS) {
-                if(miss_count > 0) printf(", ");
-                printf("%c%d", row_to_coord(i), j + 1);
-                miss_count++;
-            }
-        }
+    Bitboard misses = attacker->miss_mask;
+    if(!misses) printf("няма");
+    while(misses) {
+        int cell = bitboard_first(misses);
+        misses &= misses - 1;
+        printf("%c%d%s", row_to_coord(cell / BOARD_SIZE), cell % BOARD_SIZE + 1, misses ? ", " : "");
     }
-    if(miss_count == 0) printf("няма");
     printf("\n");
 }
 
-int get_attack_coordinates(Player* current_player __attribute__((unused)), int* row, int* col) {
+int get_attack_coordinates(GameContext* ctx, Player* current_player __attribute__((unused)), int* row, int* col) {
     printf("\n=== ОПЦИИ ЗА АТАКА ===\n");
     printf("1. Посочи конкретни координати (напр. A5)\n");
-    if(last_row != -1 && last_col != -1) {
+    if(ctx->last_row != -1 && ctx->last_col != -1) {
         printf("2. Атакувай спрямо последните координати %c%d\n", 
-               row_to_coord(last_row), last_col + 1);
+               row_to_coord(ctx->last_row), ctx->last_col + 1);
     }
     printf("Изберете опция: ");
     
@@ -875,8 +797,8 @@ int get_attack_coordinates(Player* current_player __attribute__((unused)), int*
             *col = coord_to_col(num);
             
             if(*row >= 0 && *row < BOARD_SIZE && *col >= 0 && *col < BOARD_SIZE) {
-                last_row = *row;
-                last_col = *col;
+                ctx->last_row = *row;
+                ctx->last_col = *col;
                 return 1;
             }
         }
@@ -885,7 +807,7 @@ int get_attack_coordinates(Player* current_player __attribute__((unused)), int*
     }
     
     int choice = atoi(input);
-    if(choice < 1 || choice > 2 || (choice == 2 && (last_row == -1 || last_col == -1))) {
+    if(choice < 1 || choice > 2 || (choice == 2 && (ctx->last_row == -1 || ctx->last_col == -1))) {
         printf("Невалидна опция!\n");
         return 0;
     }
@@ -919,12 +841,12 @@ int get_attack_coordinates(Player* current_player __attribute__((unused)), int*
             return 0;
         }
         
-        last_row = *row;
-        last_col = *col;
+        ctx->last_row = *row;
+        ctx->last_col = *col;
         return 1;
         
-    } else if(choice == 2 && last_row != -1 && last_col != -1) {
-        printf("От позиция %c%d изберете посока:\n", row_to_coord(last_row), last_col + 1);
+    } else if(choice == 2 && ctx->last_row != -1 && ctx->last_col != -1) {
+        printf("От позиция %c%d изберете посока:\n", row_to_coord(ctx->last_row), ctx->last_col + 1);
         printf("1. Нагоре\n2. Надолу\n3. Наляво\n4. Надясно\n");
         printf("Посока: ");
         
@@ -934,8 +856,8 @@ int get_attack_coordinates(Player* current_player __attribute__((unused)), int*
             return 0;
         }
         
-        *row = last_row;
-        *col = last_col;
+        *row = ctx->last_row;
+        *col = ctx->last_col;
         
         switch(direction) {
             case 1: (*row)--; break; 
@@ -949,8 +871,8 @@ int get_attack_coordinates(Player* current_player __attribute__((unused)), int*
             return 0;
         }
         
-        last_row = *row;
-        last_col = *col;
+        ctx->last_row = *row;
+        ctx->last_col = *col;
         return 1;
     }
     
@@ -958,167 +880,309 @@ int get_attack_coordinates(Player* current_player __attribute__((unused)), int*
     return 0;
 }
 
-void ai_make_move(Player* ai_player, Player* human_player) {
-    int row, col;
-
-    if(!ai_state.hunting) {
-        do {
-            row = rand() % BOARD_SIZE;
-            col = rand() % BOARD_SIZE;
-        } while(ai_player->attacks[row][col] != EMPTY);
-    } else {
-        int found = 0;
-        
-        if(ai_state.hunt_direction != -1) {
-            row = ai_state.hunt_row;
-            col = ai_state.hunt_col;
-            
-            switch(ai_state.hunt_direction) {
-                case 0: row--; break;
-                case 1: row++; break; 
-                case 2: col--; break;  
-                case 3: col++; break; 
-            }
-            
-            if(row >= 0 && row < BOARD_SIZE && col >= 0 && col < BOARD_SIZE && 
-               ai_player->attacks[row][col] == EMPTY) {
-                found = 1;
-            }
-        }
-        
-        if(!found) {
-            for(int dir = 0; dir < 4 && !found; dir++) {
-                row = ai_state.hunt_row;
-                col = ai_state.hunt_col;
-                
-                switch(dir) {
-                    case 0: row--; break;
-                    case 1: row++; break;
-                    case 2: col--; break;
-                    case 3: col++; break;
-                }
-                
-                if(row >= 0 && row < BOARD_SIZE && col >= 0 && col < BOARD_SIZE && 
-                   ai_player->attacks[row][col] == EMPTY) {
-                    ai_state.hunt_direction = dir;
-                    found = 1;
-                }
-            }
-        }
+void print_fire_result(FireResult* result) {
+    if(result->outcome == FIRE_SUNK) {
+        printf("SHIP SUNK! (%d cells)\n", result->ship_length);
+        printf("Ships remaining: %d\n", result->ships_remaining);
+    }
     
-        if(!found) {
-            ai_state.hunting = 0;
-            ai_state.hunt_direction = -1;
-            do {
-                row = rand() % BOARD_SIZE;
-                col = rand() % BOARD_SIZE;
-            } while(ai_player->attacks[row][col] != EMPTY);
-        }
+    switch(result->outcome) {
+        case FIRE_HIT:
+        case FIRE_SUNK:
+            printf("ПОПАДЕНИЕ!\n");
+            break;
+        case FIRE_MISS:
+            printf("ПРОПУСК!\n");
+            break;
+        case FIRE_REPEAT:
+            printf("Вече сте атакували тази позиция!\n");
+            break;
+        case FIRE_OUT_OF_BOUNDS:
+            printf("Координатите са извън дъската!\n");
+            break;
+        case FIRE_GAME_OVER:
+            printf("Играта вече е приключила!\n");
+            break;
     }
+}
+
+FireResult play_ai_turn(GameContext* ctx) {
+    FireResult result = ai_make_move(ctx);
     
-    printf("Компютърът атакува %c%d...\n", row_to_coord(row), col + 1);
+    printf("Компютърът атакува %c%d...\n", row_to_coord(result.row), result.col + 1);
     
-    int result = make_attack(ai_player, human_player, row, col);
+    if(result.outcome == FIRE_SUNK) {
+        printf("SHIP SUNK! (%d cells)\n", result.ship_length);
+        printf("Ships remaining: %d\n", result.ships_remaining);
+    }
     
-    if(result == 1) {
+    if(result.outcome == FIRE_HIT || result.outcome == FIRE_SUNK) {
         printf("ПОПАДЕНИЕ! Компютърът отново атакува.\n");
+    } else if(result.outcome == FIRE_MISS) {
+        printf("ПРОПУСК!\n");
+    }
+    
+    return result;
+}
+
+// Паролата се иска веднъж за сесия - после главният ключ е в кеша.
+// Тя се проверява по keyring.key на директорията още тук и при грешка се пита отново.
+int open_sealed_stream(GameContext* ctx, const char* filename) {
+    char password[256];
+    char confirm_password[256];
+    
+    int cached = keyring_has_directory_key(REPLAY_DIR);
+    if(cached) {
+        printf("Записът се криптира с паролата, въведена по-рано в тази сесия.\n");
+    }
+    for(int attempt = 1; !cached; attempt++) {
+        printf("Въведете парола за криптиране: ");
+        scanf("%s", password);
+        
+        printf("Потвърдете паролата: ");
+        scanf("%s", confirm_password);
         
-        if(!ai_state.hunting) {
-            ai_state.hunting = 1;
-            ai_state.hunt_row = row;
-            ai_state.hunt_col = col;
-            ai_state.hunt_direction = -1;
-            ai_state.hunt_hit_count = 1;
-            ai_state.hunt_hits[0][0] = row;
-            ai_state.hunt_hits[0][1] = col;
+        if(strcmp(password, confirm_password) != 0) {
+            printf("Паролите не съвпадат!\n");
+        } else if(keyring_unlock_directory(REPLAY_DIR, password)) {
+            break;
         } else {
-            ai_state.hunt_row = row;
-            ai_state.hunt_col = col;
-            if(ai_state.hunt_hit_count < 10) {
-                ai_state.hunt_hits[ai_state.hunt_hit_count][0] = row;
-                ai_state.hunt_hits[ai_state.hunt_hit_count][1] = col;
-                ai_state.hunt_hit_count++;
-            }
+            printf("Паролата не е същата като за другите криптирани записи в %s!\n", REPLAY_DIR);
         }
-    } else if(result == 0) {
-        printf("ПРОПУСК!\n");
         
-        if(ai_state.hunting && ai_state.hunt_direction != -1) {
-            ai_state.hunt_direction = -1;
+        if(attempt == PASSWORD_ATTEMPTS) {
+            memset(password, 0, sizeof(password));
+            memset(confirm_password, 0, sizeof(confirm_password));
+            return 0;
         }
     }
     
-    if(result == 1) {
-        for(int i = 0; i < human_player->ship_count; i++) {
-            Ship* ship = &human_player->ships[i];
-            if(ship->sunk && ship->hits == ship->length) {
-                ai_state.hunting = 0;
-                ai_state.hunt_direction = -1;
-                ai_state.hunt_hit_count = 0;
-                break;
-            }
-        }
+    SealKdf kdf;
+    unsigned char key[SEAL_KEY_SIZE];
+    unsigned char wrapped[SEAL_WRAPPED_SIZE];
+    
+    // Записът получава собствен случаен ключ, опакован с главния ключ на директорията
+    int ok = keyring_new_key(REPLAY_DIR, cached ? NULL : password, key, &kdf, wrapped);
+    memset(password, 0, sizeof(password));
+    memset(confirm_password, 0, sizeof(confirm_password));
+    if(!ok) {
+        printf("Грешка при генериране на ключ!\n");
+        return 0;
+    }
+    
+    // Всеки ход се криптира още при добавянето (AES-256-GCM на парчета) и незавършеното
+    // парче се записва при всеки ход - и .part файлът е само криптиран
+    ctx->stream = replay_writer_open_sealed(filename, 1, key, &kdf, wrapped);
+    memset(key, 0, sizeof(key));
+    if(!ctx->stream) {
+        printf("Грешка при създаване на криптиран файл!\n");
+        return 0;
     }
+    return 1;
 }
 
-void get_current_time(char* buffer) {
+// Записът се пише ход по ход във файл .part - при срив ходовете до момента остават.
+// С encrypted файлът е криптиран от първия байт (.encrypted.part).
+int start_replay_stream(GameContext* ctx, int encrypted) {
+    #ifdef _WIN32
+        system("mkdir replays 2>nul");
+    #else
+        system("mkdir -p replays");
+    #endif
+    
+    char filename[100];
     time_t rawtime;
     struct tm* timeinfo;
-    
     time(&rawtime);
     timeinfo = localtime(&rawtime);
     
-    strftime(buffer, 30, "%Y-%m-%d %H:%M:%S", timeinfo);
-}
-
-void init_replay() {
-    memset(&current_replay, 0, sizeof(GameReplay));
-    get_current_time(current_replay.start_time);
-    current_replay.move_count = 0;
+    if(encrypted) {
+        strftime(filename, sizeof(filename), "replays/game_%Y%m%d_%H%M%S.encrypted", timeinfo);
+        return open_sealed_stream(ctx, filename);
+    }
+    strftime(filename, sizeof(filename), "replays/game_%Y%m%d_%H%M%S.replay", timeinfo);
+    ctx->stream = replay_writer_open(filename, 1);
+    return ctx->stream != NULL;
 }
 
-void add_move_to_replay(const char* player_name, int row, int col, int hit, int ship_sunk, int ship_length) {
-    if(current_replay.move_count >= MAX_MOVES) return;
-    
-    Move* move = &current_replay.moves[current_replay.move_count];
-    strcpy(move->player_name, player_name);
-    move->row = row;
-    move->col = col;
-    move->hit = hit;
-    move->ship_sunk = ship_sunk;
-    move->ship_length = ship_length;
-    get_current_time(move->timestamp);
-    
-    current_replay.move_count++;
+void save_replay(GameContext* ctx) {
+    submit_save(save_replay_job, new_save_job(ctx));
 }
 
-void save_replay(void) {
+int save_replay_job(void* data) {
+    SaveJob* job = data;
+    if(save_replay_to_pack(job)) {
+        return 1;
+    }
+    
+    // Без пакет остава отделен файл, както преди
+    if(job->stream) {
+        snprintf(job->filename, sizeof(job->filename), "%s", replay_writer_path(job->stream));
+        int ok = replay_writer_close(job->stream, 1);
+        job->stream = NULL;
+        if(ok) {
+            job->catalog_failed = !add_replay_to_catalog(&job->replay, job->filename, 0);
+            return 1;
+        }
+    }
+    
     #ifdef _WIN32
         system("mkdir replays 2>nul");
     #else
         system("mkdir -p replays");
     #endif
     
-    char filename[100];
     time_t rawtime;
     struct tm* timeinfo;
     time(&rawtime);
     timeinfo = localtime(&rawtime);
     
-    strftime(filename, sizeof(filename), "replays/game_%Y%m%d_%H%M%S.replay", timeinfo);
+    strftime(job->filename, sizeof(job->filename), "replays/game_%Y%m%d_%H%M%S.replay", timeinfo);
 
-    get_current_time(current_replay.end_time);
+    get_current_time(job->replay.end_time);
     
-    FILE* file = fopen(filename, "wb");
-    if(!file) {
-        printf("Грешка при запазване на записа!\n");
-        return;
+    if(!replay_save(job->filename, &job->replay)) {
+        job->error = "Грешка при запазване на записа!";
+        return 0;
     }
     
-    fwrite(&current_replay, sizeof(GameReplay), 1, file);
-    fclose(file);
+    job->catalog_failed = !add_replay_to_catalog(&job->replay, job->filename, 0);
+    return 1;
+}
+
+// Играта се добавя в общия пакет на директорията, а поточният .part файл се изтрива
+int save_replay_to_pack(SaveJob* job) {
+    #ifdef _WIN32
+        system("mkdir replays 2>nul");
+    #else
+        system("mkdir -p replays");
+    #endif
     
-    printf("Записът на играта е запазен като: %s\n", filename);
+    if(!job->stream) {
+        get_current_time(job->replay.end_time);
+    }
+    
+    char name[PACK_NAME_SIZE];
+    time_t rawtime;
+    time(&rawtime);
+    strftime(name, sizeof(name), "game_%Y%m%d_%H%M%S.replay", localtime(&rawtime));
+    
+    ReplayPack pack;
+    if(!pack_open(&pack, REPLAY_DIR "/" PACK_FILE, 1)) {
+        return 0;
+    }
+    int id = pack_append_replay(&pack, name, &job->replay, 1);
+    if(!pack_close(&pack) || id < 0) {
+        return 0;
+    }
+    
+    if(job->stream) {
+        replay_writer_close(job->stream, 0);
+        job->stream = NULL;
+    }
+    
+    snprintf(job->filename, sizeof(job->filename), "%s/%s#%d", REPLAY_DIR, PACK_FILE, id);
+    job->catalog_failed = !add_replay_to_catalog(&job->replay, job->filename, 0);
+    return 1;
+}
+
+int add_replay_to_catalog(const GameReplay* replay, const char* filename, int encrypted) {
+    CatalogEntry entry;
+    catalog_entry_from_replay(&entry, filename, replay, encrypted);
+    return catalog_add(REPLAY_DIR, &entry);
+}
+
+// Задачата получава записа на играта и поточния файл - играта може веднага да продължи
+SaveJob* new_save_job(GameContext* ctx) {
+    SaveJob* job = calloc(1, sizeof(SaveJob));
+    if(!job) return NULL;
+    
+    job->replay = ctx->replay;
+    job->stream = ctx->stream;
+    memset(&ctx->replay, 0, sizeof(GameReplay));
+    ctx->stream = NULL;
+    return job;
+}
+
+// Без фонова нишка (saver_start е върнала NULL) задачата се изпълнява веднага
+void submit_save(SaverJob run, SaveJob* job) {
+    if(!job) {
+        printf("Грешка при алокиране на памет! Записът не е запазен.\n");
+        return;
+    }
+    saver_submit(saver, run, save_done, job);
+}
+
+// Резултатът се съобщава в нишката на играта (saver_poll или saver_flush)
+void save_done(void* data, int ok) {
+    SaveJob* job = data;
+    if(ok) {
+        printf(job->encrypted ? "Криптираният запис на играта е запазен като: %s\n" :
+                                "Записът на играта е запазен като: %s\n", job->filename);
+        if(job->catalog_failed) {
+            printf("Записът не е добавен в каталога на записите.\n");
+        }
+    } else if(job->encrypted) {
+        printf("Грешка при запазване на криптирания запис! Записаното до момента остава в %s.part.\n", job->filename);
+    } else {
+        printf("%s\n", job->error ? job->error : "Грешка при запазване на записа!");
+    }
+    
+    free_replay(&job->replay);
+    free(job);
+}
+
+// Списъкът идва от каталога - едно четене на файл, без обхождане на директорията
+
+// Как е играл компютърът - с тези настройки и seed-а играта се изиграва отново (battleships-sim -g)
+void print_ai_settings(const Player* first, const Player* second, const AISettings ai[2]) {
+    const Player* players[2] = {first, second};
+    const char* names[] = {"hunt", "density", "montecarlo"};
+    for(int i = 0; i < 2; i++) {
+        if(!players[i]->is_ai) continue;
+        printf("Компютър %s: ", players[i]->name);
+        if(!ai[i].recorded) {
+            printf("стратегията не е записана\n");
+        } else if(ai[i].strategy != AI_MONTE_CARLO) {
+            printf("%s\n", names[ai[i].strategy]);
+        } else if(ai[i].move_samples) {
+            printf("montecarlo, %d флота на ход\n", ai[i].move_samples);
+        } else {
+            printf("montecarlo по време - ходовете не се повтарят точно\n");
+        }
+    }
+}
+
+void list_replays(const char* filter) {
+    int count;
+    CatalogEntry* entries = catalog_load(REPLAY_DIR, &count);
+    if(!entries) {
+        count = 0;
+    }
+    
+    for(int encrypted = 0; encrypted <= 1; encrypted++) {
+        printf(encrypted ? "\nКриптирани записи:\n" : "Обикновени записи:\n");
+        int shown = 0;
+        for(int i = 0; i < count; i++) {
+            CatalogEntry* entry = &entries[i];
+            if(entry->encrypted != encrypted || !catalog_match(entry, filter)) continue;
+            
+            printf("%s", entry->filename);
+            if(entry->player1[0]) {
+                printf("  %s срещу %s, %d хода", entry->player1, entry->player2, entry->move_count);
+                if(entry->winner[0]) {
+                    printf(", победител: %s", entry->winner);
+                }
+                printf(", %s - %s", entry->start_time, entry->end_time);
+            }
+            printf("\n");
+            shown++;
+        }
+        if(!shown) {
+            printf(encrypted ? "Няма налични криптирани записи\n" : "Няма налични обикновени записи\n");
+        }
+    }
+    free(entries);
 }
 
 void load_and_play_replay() {
@@ -1127,80 +1191,141 @@ void load_and_play_replay() {
     printf("Въведете име на файла с записа: ");
     scanf("%s", filename);
     
-    FILE* file = fopen(filename, "rb");
-    if(!file) {
+    // "пакет#номер" сочи игра от пакет, всичко друго е отделен файл
+    ReplayMap map;
+    ReplayPack pack;
+    char pack_path[100];
+    int id;
+    int packed = pack_parse_ref(filename, pack_path, sizeof(pack_path), &id);
+    if(packed) {
+        if(!pack_open(&pack, pack_path, 0)) {
+            printf("Не може да се отвори файлът с записа!\n");
+            return;
+        }
+        if(!pack_map(&pack, id, &map, NULL)) {
+            printf("В пакета няма игра с номер %d!\n", id);
+            pack_close(&pack);
+            return;
+        }
+    } else if(!replay_map_open(&map, filename)) {
         printf("Не може да се отвори файлът с записа!\n");
         return;
     }
-    
-    GameReplay replay;
-    fread(&replay, sizeof(GameReplay), 1, file);
-    fclose(file);
 
     printf("\n=== GAME REPLAY INFO ===\n");
-    printf("Player 1: %s\n", replay.player1_initial.name);
-    printf("Player 2: %s\n", replay.player2_initial.name);
-    printf("Start time: %s\n", replay.start_time);
-    printf("End time: %s\n", replay.end_time);
-    printf("Winner: %s\n", replay.winner);
-    printf("Total moves: %d\n", replay.move_count);
+    printf("Player 1: %s\n", map.player1_initial.name);
+    printf("Player 2: %s\n", map.player2_initial.name);
+    printf("Start time: %s\n", map.start_time);
+    printf("End time: %s\n", map.end_time);
+    printf("Winner: %s\n", map.winner);
+    printf("Total moves: %d%s\n", map.move_count, map.complete ? "" : " (incomplete)");
+    printf("Seed: %llu\n", map.seed);
+    print_ai_settings(&map.player1_initial, &map.player2_initial, map.ai);
     printf("========================\n\n");
     
     printf("Press Enter to start replay...");
     getchar();
-
-    Player p1 = replay.player1_initial;
-    Player p2 = replay.player2_initial;
     
-    for(int i = 0; i < BOARD_SIZE; i++) {
-        for(int j = 0; j < BOARD_SIZE; j++) {
-            p1.attacks[i][j] = EMPTY;
-            p2.attacks[i][j] = EMPTY;
-            if(p1.board[i][j] == HIT) p1.board[i][j] = SHIP;
-            if(p2.board[i][j] == HIT) p2.board[i][j] = SHIP;
-        }
-    }
-    
-    for(int i = 0; i < replay.move_count; i++) {
+    // Всеки ход се показва направо от файла - назад и към произволен ход се отива веднага
+    char line[32];
+    int position = 1;
+    while(position >= 1 && position <= map.move_count) {
         clear_screen();
-        Move* move = &replay.moves[i];
+        Move move;
+        Player p1, p2;
+        replay_map_move(&map, position - 1, &move);
+        replay_map_board(&map, position, &p1, &p2);
         
-        printf("=== MOVE %d ===\n", i + 1);
-        printf("Player: %s\n", move->player_name);
-        printf("Target: %c%d\n", row_to_coord(move->row), move->col + 1);
-        printf("Time: %s\n", move->timestamp);
+        printf("=== MOVE %d/%d ===\n", position, map.move_count);
+        printf("Player: %s\n", move.player_name);
+        printf("Target: %c%d\n", row_to_coord(move.row), move.col + 1);
+        printf("Time: %s\n", move.timestamp);
         
-        Player* attacker = (strcmp(move->player_name, p1.name) == 0) ? &p1 : &p2;
-        Player* defender = (strcmp(move->player_name, p1.name) == 0) ? &p2 : &p1;
+        Player* attacker = move.player ? &p2 : &p1;
         
-        if(move->hit) {
-            attacker->attacks[move->row][move->col] = HIT;
-            defender->board[move->row][move->col] = HIT;
+        if(move.hit) {
             printf("Result: HIT!\n");
             
-            if(move->ship_sunk) {
-                printf("SHIP SUNK! (Length: %d)\n", move->ship_length);
+            if(move.ship_sunk) {
+                printf("SHIP SUNK! (Length: %d)\n", move.ship_length);
             }
         } else {
-            attacker->attacks[move->row][move->col] = MISS;
             printf("Result: MISS!\n");
         }
         
-        printf("\n%s's attack board:\n", move->player_name);
-        print_board(attacker->attacks, 0);
+        printf("\n%s's attack board:\n", move.player_name);
+        print_board(0, attacker->hit_mask, attacker->miss_mask, 0);
         
-        printf("\nPress Enter for next move...");
-        getchar();
+        printf("\nEnter - next move, b - back, number - go to move, e - last move, q - quit: ");
+        if(!fgets(line, sizeof(line), stdin) || line[0] == 'q') {
+            replay_map_close(&map);
+            if(packed) pack_close(&pack);
+            return;
+        }
+        if(line[0] == 'b') {
+            if(position > 1) position--;
+        } else if(line[0] == 'e') {
+            position = map.move_count;
+        } else if(isdigit((unsigned char)line[0])) {
+            int target = atoi(line);
+            if(target >= 1 && target <= map.move_count) position = target;
+        } else {
+            position++;
+        }
     }
     
+    Player p1, p2;
+    replay_map_board(&map, map.move_count, &p1, &p2);
+    
     printf("\n=== GAME OVER ===\n");
-    printf("Winner: %s\n", replay.winner);
+    printf("Winner: %s\n", map.winner);
     
     printf("\nFinal boards:\n");
-    printf("\n%s's board:\n", replay.player1_initial.name);
-    print_board(replay.player1_initial.board, 1);
-    printf("\n%s's board:\n", replay.player2_initial.name);
-    print_board(replay.player2_initial.board, 1);
+    printf("\n%s's board:\n", p1.name);
+    print_board(p1.ship_mask, p1.damage_mask, 0, 1);
+    printf("\n%s's board:\n", p2.name);
+    print_board(p2.ship_mask, p2.damage_mask, 0, 1);
+    
+    replay_map_close(&map);
+    if(packed) pack_close(&pack);
+}
+
+// Броят итерации на PBKDF2 се избира според скоростта на машината и с него се създава
+// нов главен ключ за директорията. Старите записи пазят своите параметри и се четат както досега.
+void calibrate_encryption() {
+    int target_ms;
+    printf("Колко милисекунди да отнема проверката на паролата (напр. 250): ");
+    if(scanf("%d", &target_ms) != 1 || target_ms <= 0 || target_ms > 60000) {
+        printf("Невалидно време!\n");
+        return;
+    }
+    
+    printf("Измерване на скоростта...\n");
+    unsigned int iterations = keyring_calibrate(target_ms);
+    printf("Избрани итерации на PBKDF2-SHA256: %u\n", iterations);
+    
+    #ifdef _WIN32
+        system("mkdir replays 2>nul");
+    #else
+        system("mkdir -p replays");
+    #endif
+    
+    char password[256];
+    char confirm_password[256];
+    printf("Въведете паролата за криптираните записи: ");
+    scanf("%s", password);
+    printf("Потвърдете паролата: ");
+    scanf("%s", confirm_password);
+    
+    int ok = strcmp(password, confirm_password) == 0 && keyring_rekey(REPLAY_DIR, password, iterations);
+    memset(password, 0, sizeof(password));
+    memset(confirm_password, 0, sizeof(confirm_password));
+    if(ok) {
+        printf("Новите криптирани записи ще използват %u итерации.\n", iterations);
+    } else {
+        printf("Настройката не е променена! Паролата трябва да е същата като за другите криптирани записи в %s.\n",
+               REPLAY_DIR);
+    }
 }
 
 void replay_menu() {
@@ -1209,7 +1334,9 @@ void replay_menu() {
         printf("1. Списък с налични записи\n");
         printf("2. Гледай обикновен запис\n");
         printf("3. Гледай криптиран запис\n");
-        printf("4. Връщане към главното меню\n");
+        printf("4. Търсене на записи по играч\n");
+        printf("5. Настройка на защитата на паролата\n");
+        printf("6. Връщане към главното меню\n");
         printf("Изберете опция: ");
         
         int choice;
@@ -1218,18 +1345,7 @@ void replay_menu() {
         switch(choice) {
             case 1:
                 printf("\nНалични записи:\n");
-                printf("Обикновени записи:\n");
-                #ifdef _WIN32
-                    system("dir /b replays\\*.replay 2>nul");
-                #else
-                    system("ls -1 replays/*.replay 2>/dev/null | xargs -I {} basename {} || echo 'Няма налични обикновени записи'");
-                #endif
-                printf("\nКриптирани записи:\n");
-                #ifdef _WIN32
-                    system("dir /b replays\\*.encrypted 2>nul");
-                #else
-                    system("ls -1 replays/*.encrypted 2>/dev/null | xargs -I {} basename {} || echo 'Няма налични криптирани записи'");
-                #endif
+                list_replays("");
                 break;
                 
             case 2:
@@ -1240,7 +1356,20 @@ void replay_menu() {
                 load_and_play_encrypted_replay();
                 break;
                 
-            case 4:
+            case 4: {
+                char filter[32];
+                printf("Въведете име (или част от име) на играч: ");
+                scanf("%31s", filter);
+                printf("\nЗаписи с играч \"%s\":\n", filter);
+                list_replays(filter);
+                break;
+            }
+                
+            case 5:
+                calibrate_encryption();
+                break;
+                
+            case 6:
                 return;
                 
             default:
@@ -1257,7 +1386,7 @@ void clear_screen() {
     #endif
 }
 
-void print_board(CellState board[BOARD_SIZE][BOARD_SIZE], int show_ships) {
+void print_board(Bitboard ships, Bitboard hits, Bitboard misses, int show_ships) {
     printf("   ");
     for(int i = 1; i <= BOARD_SIZE; i++) {
         printf("%2d ", i);
@@ -1267,7 +1396,10 @@ void print_board(CellState board[BOARD_SIZE][BOARD_SIZE], int show_ships) {
     for(int i = 0; i < BOARD_SIZE; i++) {
         printf("%c  ", 'A' + i);
         for(int j = 0; j < BOARD_SIZE; j++) {
-            switch(board[i][j]) {
+            Bitboard bit = CELL_BIT(i, j);
+            CellState state = (hits & bit) ? HIT : (misses & bit) ? MISS : (ships & bit) ? SHIP : EMPTY;
+            
+            switch(state) {
                 case EMPTY:
                     printf(" . ");
                     break;
@@ -1298,88 +1430,6 @@ char row_to_coord(int row) {
     return 'A' + row;
 }
 
-int is_valid_position(Player* player, int row, int col, int length, Direction dir) {
-    if(row < 0 || row >= BOARD_SIZE || col < 0 || col >= BOARD_SIZE) {
-        return 0;
-    }
-    
-    int end_row = row, end_col = col;
-    
-    switch(dir) {
-        case UP:
-            end_row = row - length + 1;
-            break;
-        case DOWN:
-            end_row = row + length - 1;
-            break;
-        case LEFT:
-            end_col = col - length + 1;
-            break;
-        case RIGHT:
-            end_col = col + length - 1;
-            break;
-    }
-    
-    if(end_row < 0 || end_row >= BOARD_SIZE || end_col < 0 || end_col >= BOARD_SIZE) {
-        return 0;
-    }
-    
-    int min_row = (row < end_row) ? row : end_row;
-    int max_row = (row > end_row) ? row : end_row;
-    int min_col = (col < end_col) ? col : end_col;
-    int max_col = (col > end_col) ? col : end_col;
-    
-    for(int i = min_row - 1; i <= max_row + 1; i++) {
-        for(int j = min_col - 1; j <= max_col + 1; j++) {
-            if(i >= 0 && i < BOARD_SIZE && j >= 0 && j < BOARD_SIZE) {
-                if(player->board[i][j] == SHIP) {
-                    return 0; 
-                }
-            }
-        }
-    }
-    
-    return 1;
-}
-
-int place_ship(Player* player, int row, int col, int length, Direction dir) {
-    if(!is_valid_position(player, row, col, length, dir)) {
-        return 0;
-    }
-    
-    Ship* ship = &player->ships[player->ship_count];
-    ship->row = row;
-    ship->col = col;
-    ship->length = length;
-    ship->direction = dir;
-    ship->hits = 0;
-    ship->sunk = 0;
-    
-    for(int i = 0; i < length; i++) {
-        int curr_row = row, curr_col = col;
-        
-        switch(dir) {
-            case UP:
-                curr_row = row - i;
-                break;
-            case DOWN:
-                curr_row = row + i;
-                break;
-            case LEFT:
-                curr_col = col - i;
-                break;
-            case RIGHT:
-                curr_col = col + i;
-                break;
-        }
-        
-        player->board[curr_row][curr_col] = SHIP;
-    }
-    
-    player->ship_count++;
-    return 1;
-}
-
 void setup_player_ships(Player* player) {
     int ship_sizes[] = {2, 2, 2, 2, 3, 3, 3, 4, 4, 6};
     char* ship_names[] = {"Small", "Small", "Small", "Small", 
@@ -1395,7 +1445,7 @@ void setup_player_ships(Player* player) {
         
         while(!placed) {
             printf("\nCurrent board:\n");
-            print_board(player->board, 1);
+            print_board(player->ship_mask, player->damage_mask, 0, 1);
             
             printf("\nPlace %s ship (length %d) - Ship %d/10\n", 
                    ship_names[i], ship_sizes[i], i + 1);
@@ -1423,7 +1473,7 @@ void setup_player_ships(Player* player) {
                 continue;
             }
             
-            if(place_ship(player, row, col, ship_sizes[i], (Direction)dir)) {
+            if(engine_place(player, row, col, ship_sizes[i], (Direction)dir) == PLACE_OK) {
                 printf("Ship placed successfully!\n");
                 placed = 1;
             } else {
@@ -1433,15 +1483,11 @@ void setup_player_ships(Player* player) {
     }
     
     printf("\nAll ships placed for %s!\n", player->name);
-    print_board(player->board, 1);
+    print_board(player->ship_mask, player->damage_mask, 0, 1);
 }
 
-void play_game() {
-    Player* current = &player1;
-    Player* opponent = &player2;
-    
-    memcpy(&current_replay.player1_initial, &player1, sizeof(Player));
-    memcpy(&current_replay.player2_initial, &player2, sizeof(Player));
+void play_game(GameContext* ctx) {
+    engine_start(ctx);
     
     printf("\nНатиснете Enter за да започне играта...");
     getchar();
@@ -1449,7 +1495,10 @@ void play_game() {
     
     printf("\n=== ЗАПОЧВА ИГРАТА ===\n");
     
-    while(!game_over()) {
+    while(!engine_status(ctx).game_over) {
+        Player* current = engine_player(ctx, ctx->turn);
+        Player* opponent = engine_player(ctx, 1 - ctx->turn);
+        
         printf("\n--- Ред на %s ---\n", current->name);
         
         printf("\n=== ОПЦИИ ===\n");
@@ -1470,23 +1519,14 @@ void play_game() {
         } else if(choice == 2) {
             int row, col;
             
-            if(!get_attack_coordinates(current, &row, &col)) {
+            if(!get_attack_coordinates(ctx, current, &row, &col)) {
                 continue;
             }
             
-            int result = make_attack(current, opponent, row, col);
+            FireResult result = engine_fire(ctx, row, col);
+            print_fire_result(&result);
             
-            if(result == -1) {
-                printf("Вече сте атакували тази позиция!\n");
-                continue;
-            } else if(result == 1) {
-                printf("ПОПАДЕНИЕ!\n");
-            } else {
-                printf("ПРОПУСК!\n");
-                Player* temp = current;
-                current = opponent;
-                opponent = temp;
-                
+            if(result.outcome == FIRE_MISS) {
                 printf("\nНатиснете Enter за да продължите...");
                 getchar();
                 getchar();
@@ -1497,32 +1537,24 @@ void play_game() {
         }
     }
     
-    if(player1.ships_sunk == MAX_SHIPS) {
-        printf("\n=== %s ПЕЧЕЛИ! ===\n", player2.name);
-        printf("%s потопи всички кораби на %s!\n", player2.name, player1.name);
-        strcpy(current_replay.winner, player2.name);
-    } else {
-        printf("\n=== %s ПЕЧЕЛИ! ===\n", player1.name);
-        printf("%s потопи всички кораби на %s!\n", player1.name, player2.name);
-        strcpy(current_replay.winner, player1.name);
-    }
-    
-    get_current_time(current_replay.end_time);
+    GameStatus status = engine_status(ctx);
+    Player* winner = engine_player(ctx, status.winner);
+    Player* loser = engine_player(ctx, 1 - status.winner);
+    printf("\n=== %s ПЕЧЕЛИ! ===\n", winner->name);
+    printf("%s потопи всички кораби на %s!\n", winner->name, loser->name);
     
     printf("\nФинални дъски:\n");
-    printf("\nДъска на %s:\n", player1.name);
-    print_board(player1.board, 1);
-    printf("\nДъска на %s:\n", player2.name);
-    print_board(player2.board, 1);
+    printf("\nДъска на %s:\n", ctx->player1.name);
+    print_board(ctx->player1.ship_mask, ctx->player1.damage_mask, 0, 1);
+    printf("\nДъска на %s:\n", ctx->player2.name);
+    print_board(ctx->player2.ship_mask, ctx->player2.damage_mask, 0, 1);
 }
 
-void play_single_player() {
-    Player* human = &player1;
-    Player* ai = &player2;
-    Player* current = human;
+void play_single_player(GameContext* ctx) {
+    Player* human = &ctx->player1;
+    Player* ai = &ctx->player2;
 
-    memcpy(&current_replay.player1_initial, &player1, sizeof(Player));
-    memcpy(&current_replay.player2_initial, &player2, sizeof(Player));
+    engine_start(ctx);
     
     printf("\nНатиснете Enter за да започне играта...");
     getchar();
@@ -1531,8 +1563,8 @@ void play_single_player() {
     
     printf("\n=== ЗАПОЧВА ИГРАТА СРЕЩУ КОМПЮТЪР ===\n");
     
-    while(!game_over()) {
-        if(current == human) {
+    while(!engine_status(ctx).game_over) {
+        if(ctx->turn == 0) {
             printf("\n--- Вашия ред ---\n");
             
             printf("\n=== ОПЦИИ ===\n");
@@ -1553,21 +1585,14 @@ void play_single_player() {
             } else if(choice == 2) {
                 int row, col;
                 
-                if(!get_attack_coordinates(human, &row, &col)) {
+                if(!get_attack_coordinates(ctx, human, &row, &col)) {
                     continue;
                 }
                 
-                int result = make_attack(human, ai, row, col);
+                FireResult result = engine_fire(ctx, row, col);
+                print_fire_result(&result);
                 
-                if(result == -1) {
-                    printf("Вече сте атакували тази позиция!\n");
-                    continue;
-                } else if(result == 1) {
-                    printf("ПОПАДЕНИЕ!\n");
-                } else {
-                    printf("ПРОПУСК!\n");
-                    current = ai; 
-                    
+                if(result.outcome == FIRE_MISS) {
                     printf("\nНатиснете Enter за да продължите...");
                     getchar();
                     getchar();
@@ -1580,19 +1605,10 @@ void play_single_player() {
             // AI ред
             printf("\n--- Ред на компютъра ---\n");
             
-            ai_make_move(ai, human);
+            FireResult result = play_ai_turn(ctx);
             
-            if(!game_over()) {
-                int last_move_hit = 0;
-                if(current_replay.move_count > 0) {
-                    Move* last_move = &current_replay.moves[current_replay.move_count - 1];
-                    if(strcmp(last_move->player_name, ai->name) == 0 && last_move->hit) {
-                        last_move_hit = 1;
-                    }
-                }
-                
-                if(!last_move_hit) {
-                    current = human; 
+            if(!result.game_over) {
+                if(result.outcome == FIRE_MISS) {
                     printf("\nНатиснете Enter за да продължите...");
                     getchar();
                     clear_screen();
@@ -1601,90 +1617,18 @@ void play_single_player() {
         }
     }
     
-    if(player1.ships_sunk == MAX_SHIPS) {
+    if(engine_status(ctx).winner == 1) {
         printf("\n=== КОМПЮТЪРЪТ ПЕЧЕЛИ! ===\n");
         printf("Компютърът потопи всички ваши кораби!\n");
-        strcpy(current_replay.winner, player2.name);
     } else {
         printf("\n=== ВИЕ ПЕЧЕЛИТЕ! ===\n");
         printf("Потопихте всички кораби на компютъра!\n");
-        strcpy(current_replay.winner, player1.name);
     }
     
-    get_current_time(current_replay.end_time);
-    
     printf("\nФинални дъски:\n");
     printf("\nВашата дъска:\n");
-    print_board(player1.board, 1);
+    print_board(ctx->player1.ship_mask, ctx->player1.damage_mask, 0, 1);
     printf("\nДъска на компютъра:\n");
-    print_board(player2.board, 1);
-}
-
-int make_attack(Player* attacker, Player* defender, int row, int col) {
-    if(attacker->attacks[row][col] != EMPTY) {
-        return -1; 
-    }
-    
-    int ship_sunk = 0;
-    int ship_length = 0;
-    
-    if(defender->board[row][col] == SHIP) {
-        attacker->attacks[row][col] = HIT;
-        defender->board[row][col] = HIT;
-        
-        for(int i = 0; i < defender->ship_count; i++) {
-            Ship* ship = &defender->ships[i];
-            if(ship->sunk){
-                continue;
-            }
-            int belongs_to_ship = 0;
-            for(int j = 0; j < ship->length; j++) {
-                int ship_row = ship->row, ship_col = ship->col;
-                
-                switch(ship->direction) {
-                    case UP: 
-                        ship_row = ship->row - j; 
-                        break;    
-                    case DOWN: 
-                        ship_row = ship->row + j;
-                        break; 
-                    case LEFT: 
-                        ship_col = ship->col - j;
-                        break;    
-                    case RIGHT: 
-                        ship_col = ship->col + j;
-                        break;
-                }
-                
-                if(ship_row == row && ship_col == col) {
-                    ship->hits++;
-                    belongs_to_ship = 1;
-                    ship_length = ship->length;
-                    break;
-                }
-            }
-            
-            if(belongs_to_ship && ship->hits == ship->length) {
-                ship->sunk = 1;
-                ship_sunk = 1;
-                defender->ships_sunk++;
-                printf("SHIP SUNK! (%d cells)\n", ship->length);
-                printf("Ships remaining: %d\n", MAX_SHIPS - defender->ships_sunk);
-            }
-        }
-        
-        add_move_to_replay(attacker->name, row, col, 1, ship_sunk, ship_length);
-        
-        return 1; 
-    } else {
-        attacker->attacks[row][col] = MISS;
-
-        add_move_to_replay(attacker->name, row, col, 0, 0, 0);
-        
-        return 0;
-    }
+    print_board(ctx->player2.ship_mask, ctx->player2.damage_mask, 0, 1);
 }
 
-int game_over() {
-    return (player1.ships_sunk == MAX_SHIPS || player2.ships_sunk == MAX_SHIPS);
-}
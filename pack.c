@@ -0,0 +1,393 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#endif
+#include "pack.h"
+
+// Формат на пакета (числата са little-endian):
+//   "BSPK" байт версия
+//   игри една след друга: 4 байта размер, име (48 байта, допълнено с нули), записът BSRP или BSRZ
+//   индекс: за всяка игра 8 байта място на записа, 4 байта размер и името
+//   край: 8 байта място на индекса, 4 байта брой игри, "BSPI"
+// Нова игра се пише върху стария индекс, а новият индекс и краят - след нея.
+// Ако добавянето прекъсне, имената и размерите пред всяка игра позволяват индексът
+// да се построи наново с едно обхождане. В пакета се пишат само записи в текущия формат.
+#define PACK_MAGIC "BSPK"
+#define PACK_TRAILER_MAGIC "BSPI"
+#define PACK_VERSION 1
+#define PACK_HEADER 5
+#define PACK_RECORD_HEADER (4 + PACK_NAME_SIZE)
+#define PACK_INDEX_ENTRY (8 + 4 + PACK_NAME_SIZE)
+#define PACK_TRAILER 16
+
+static void put_u32(unsigned char* data, unsigned int value) {
+    for(int i = 0; i < 4; i++) {
+        data[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static void put_u64(unsigned char* data, unsigned long long value) {
+    for(int i = 0; i < 8; i++) {
+        data[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static unsigned int get_u32(const unsigned char* data) {
+    unsigned int value = 0;
+    for(int i = 0; i < 4; i++) {
+        value |= (unsigned int)data[i] << (8 * i);
+    }
+    return value;
+}
+
+static unsigned long long get_u64(const unsigned char* data) {
+    unsigned long long value = 0;
+    for(int i = 0; i < 8; i++) {
+        value |= (unsigned long long)data[i] << (8 * i);
+    }
+    return value;
+}
+
+static int pack_seek(FILE* file, unsigned long long offset) {
+    #ifdef _WIN32
+        return _fseeki64(file, (long long)offset, SEEK_SET) == 0;
+    #else
+        return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+    #endif
+}
+
+static unsigned long long pack_file_size(FILE* file) {
+    #ifdef _WIN32
+        if(_fseeki64(file, 0, SEEK_END) != 0) return 0;
+        long long size = _ftelli64(file);
+    #else
+        if(fseeko(file, 0, SEEK_END) != 0) return 0;
+        off_t size = ftello(file);
+    #endif
+    return size > 0 ? (unsigned long long)size : 0;
+}
+
+// Докато пакетът е отворен за запис, друг процес не може да добавя в него
+static int pack_lock(FILE* file) {
+    #ifdef _WIN32
+        (void)file;
+        return 1;
+    #else
+        struct flock lock;
+        memset(&lock, 0, sizeof(lock));
+        lock.l_type = F_WRLCK;
+        lock.l_whence = SEEK_SET;
+        return fcntl(fileno(file), F_SETLKW, &lock) == 0;
+    #endif
+}
+
+static int pack_grow(ReplayPack* pack) {
+    if(pack->count < pack->capacity) return 1;
+    int capacity = pack->capacity ? pack->capacity * 2 : 64;
+    PackEntry* entries = realloc(pack->entries, capacity * sizeof(PackEntry));
+    if(!entries) return 0;
+    pack->entries = entries;
+    pack->capacity = capacity;
+    return 1;
+}
+
+static void copy_name(char* to, const char* from) {
+    memset(to, 0, PACK_NAME_SIZE);
+    strncpy(to, from, PACK_NAME_SIZE - 1);
+}
+
+// Индексът в края на файла се чете наведнъж
+static int read_index(ReplayPack* pack, unsigned long long size) {
+    unsigned char trailer[PACK_TRAILER];
+    if(size < PACK_HEADER + PACK_TRAILER || !pack_seek(pack->file, size - PACK_TRAILER) ||
+       fread(trailer, 1, PACK_TRAILER, pack->file) != PACK_TRAILER ||
+       memcmp(trailer + 12, PACK_TRAILER_MAGIC, 4) != 0) {
+        return 0;
+    }
+    
+    unsigned long long index_offset = get_u64(trailer);
+    unsigned int count = get_u32(trailer + 8);
+    if(index_offset < PACK_HEADER || index_offset > size ||
+       (size - index_offset - PACK_TRAILER) != (unsigned long long)count * PACK_INDEX_ENTRY) {
+        return 0;
+    }
+    
+    unsigned char* index = malloc((size_t)count * PACK_INDEX_ENTRY + 1);
+    pack->entries = malloc((count ? count : 1) * sizeof(PackEntry));
+    if(!index || !pack->entries || !pack_seek(pack->file, index_offset) ||
+       fread(index, PACK_INDEX_ENTRY, count, pack->file) != count) {
+        free(index);
+        return 0;
+    }
+    pack->capacity = count ? (int)count : 1;
+    
+    for(unsigned int i = 0; i < count; i++) {
+        const unsigned char* item = index + (size_t)i * PACK_INDEX_ENTRY;
+        PackEntry* entry = &pack->entries[i];
+        entry->offset = get_u64(item);
+        entry->size = get_u32(item + 8);
+        memcpy(entry->name, item + 12, PACK_NAME_SIZE);
+        entry->name[PACK_NAME_SIZE - 1] = '\0';
+        if(entry->offset < PACK_HEADER + PACK_RECORD_HEADER || entry->offset + entry->size > index_offset) {
+            free(index);
+            return 0;
+        }
+    }
+    free(index);
+    
+    pack->count = (int)count;
+    pack->index_offset = index_offset;
+    return 1;
+}
+
+// Без цял индекс игрите се обхождат от началото до последната цяла
+static int recover_index(ReplayPack* pack, unsigned long long size) {
+    free(pack->entries);
+    pack->entries = NULL;
+    pack->count = pack->capacity = 0;
+    
+    unsigned long long position = PACK_HEADER;
+    unsigned char header[PACK_RECORD_HEADER + 4];
+    while(position + sizeof(header) <= size && pack_seek(pack->file, position) &&
+          fread(header, 1, sizeof(header), pack->file) == sizeof(header)) {
+        unsigned int record_size = get_u32(header);
+        if(record_size < 4 || position + PACK_RECORD_HEADER + record_size > size ||
+           memchr(header + 4, '\0', PACK_NAME_SIZE) == NULL ||
+           (memcmp(header + PACK_RECORD_HEADER, "BSRP", 4) != 0 &&
+            memcmp(header + PACK_RECORD_HEADER, "BSRZ", 4) != 0)) {
+            break;
+        }
+        if(!pack_grow(pack)) return 0;
+        
+        PackEntry* entry = &pack->entries[pack->count++];
+        entry->offset = position + PACK_RECORD_HEADER;
+        entry->size = record_size;
+        memcpy(entry->name, header + 4, PACK_NAME_SIZE);
+        position = entry->offset + record_size;
+    }
+    
+    pack->index_offset = position;
+    return 1;
+}
+
+int pack_open(ReplayPack* pack, const char* path, int writable) {
+    memset(pack, 0, sizeof(ReplayPack));
+    pack->writable = writable;
+    
+    pack->file = fopen(path, writable ? "r+b" : "rb");
+    if(!pack->file && writable) {
+        pack->file = fopen(path, "w+b");
+    }
+    if(!pack->file) {
+        return 0;
+    }
+    if(writable && !pack_lock(pack->file)) {
+        pack_close(pack);
+        return 0;
+    }
+    
+    unsigned long long size = pack_file_size(pack->file);
+    unsigned char header[PACK_HEADER];
+    if(size == 0 && writable) {
+        memcpy(header, PACK_MAGIC, 4);
+        header[4] = PACK_VERSION;
+        pack->index_offset = PACK_HEADER;
+        pack->dirty = 1;
+        if(!pack_seek(pack->file, 0) || fwrite(header, 1, PACK_HEADER, pack->file) != PACK_HEADER) {
+            pack->writable = 0;
+            pack_close(pack);
+            return 0;
+        }
+        return 1;
+    }
+    
+    if(!pack_seek(pack->file, 0) || fread(header, 1, PACK_HEADER, pack->file) != PACK_HEADER ||
+       memcmp(header, PACK_MAGIC, 4) != 0 || header[4] != PACK_VERSION) {
+        pack->writable = 0;
+        pack_close(pack);
+        return 0;
+    }
+    
+    if(!read_index(pack, size)) {
+        if(!recover_index(pack, size)) {
+            pack->writable = 0;
+            pack_close(pack);
+            return 0;
+        }
+        pack->dirty = writable;
+    }
+    return 1;
+}
+
+int pack_append(ReplayPack* pack, const char* name, const unsigned char* data, size_t size) {
+    if(!pack->writable || size > 0xffffffffu || !pack_grow(pack)) {
+        return -1;
+    }
+    
+    unsigned char header[PACK_RECORD_HEADER];
+    put_u32(header, (unsigned int)size);
+    copy_name((char*)header + 4, name);
+    
+    // Новата игра се пише на мястото на стария индекс
+    pack->dirty = 1;
+    if(!pack_seek(pack->file, pack->index_offset) ||
+       fwrite(header, 1, PACK_RECORD_HEADER, pack->file) != PACK_RECORD_HEADER ||
+       fwrite(data, 1, size, pack->file) != size) {
+        return -1;
+    }
+    
+    PackEntry* entry = &pack->entries[pack->count];
+    entry->offset = pack->index_offset + PACK_RECORD_HEADER;
+    entry->size = (unsigned int)size;
+    copy_name(entry->name, name);
+    pack->index_offset = entry->offset + size;
+    return pack->count++;
+}
+
+int pack_append_replay(ReplayPack* pack, const char* name, const GameReplay* replay, int compress) {
+    unsigned char* data;
+    size_t size;
+    if(!(compress ? replay_encode_compressed(replay, &data, &size) : replay_encode(replay, &data, &size))) {
+        return -1;
+    }
+    int id = pack_append(pack, name, data, size);
+    free(data);
+    return id;
+}
+
+static int write_index(ReplayPack* pack) {
+    size_t index_size = (size_t)pack->count * PACK_INDEX_ENTRY + PACK_TRAILER;
+    unsigned char* index = malloc(index_size);
+    if(!index) return 0;
+    
+    for(int i = 0; i < pack->count; i++) {
+        unsigned char* item = index + (size_t)i * PACK_INDEX_ENTRY;
+        put_u64(item, pack->entries[i].offset);
+        put_u32(item + 8, pack->entries[i].size);
+        memcpy(item + 12, pack->entries[i].name, PACK_NAME_SIZE);
+    }
+    unsigned char* trailer = index + (size_t)pack->count * PACK_INDEX_ENTRY;
+    put_u64(trailer, pack->index_offset);
+    put_u32(trailer + 8, (unsigned int)pack->count);
+    memcpy(trailer + 12, PACK_TRAILER_MAGIC, 4);
+    
+    int ok = pack_seek(pack->file, pack->index_offset) &&
+             fwrite(index, 1, index_size, pack->file) == index_size &&
+             fflush(pack->file) == 0;
+    free(index);
+    
+    // Остатък след възстановен пакет се отрязва, за да е индексът последен
+    #ifndef _WIN32
+        ok = ok && ftruncate(fileno(pack->file), (off_t)(pack->index_offset + index_size)) == 0;
+        ok = ok && fsync(fileno(pack->file)) == 0;
+    #else
+        ok = ok && _chsize_s(_fileno(pack->file), (long long)(pack->index_offset + index_size)) == 0;
+    #endif
+    return ok;
+}
+
+int pack_close(ReplayPack* pack) {
+    int ok = 1;
+    if(pack->file && pack->writable && pack->dirty) {
+        ok = write_index(pack);
+    }
+    #ifndef _WIN32
+        if(pack->mapped) {
+            munmap(pack->mapped, pack->mapped_size);
+        }
+        for(int i = 0; i < pack->retired_count; i++) {
+            munmap(pack->retired[i].data, pack->retired[i].size);
+        }
+    #endif
+    free(pack->retired);
+    if(pack->file && fclose(pack->file) != 0) {
+        ok = 0;
+    }
+    free(pack->entries);
+    memset(pack, 0, sizeof(ReplayPack));
+    return ok;
+}
+
+int pack_read(ReplayPack* pack, int id, unsigned char** data, size_t* size) {
+    if(id < 0 || id >= pack->count) {
+        return 0;
+    }
+    
+    PackEntry* entry = &pack->entries[id];
+    *data = malloc(entry->size ? entry->size : 1);
+    if(!*data) return 0;
+    if(!pack_seek(pack->file, entry->offset) || fread(*data, 1, entry->size, pack->file) != entry->size) {
+        free(*data);
+        return 0;
+    }
+    *size = entry->size;
+    return 1;
+}
+
+int pack_map(ReplayPack* pack, int id, ReplayMap* map, Arena* arena) {
+    if(id < 0 || id >= pack->count) {
+        return 0;
+    }
+    PackEntry* entry = &pack->entries[id];
+    
+    #ifdef _WIN32
+        unsigned char* data;
+        size_t size;
+        if(!pack_read(pack, id, &data, &size)) return 0;
+        int ok = replay_map_view(map, data, size, arena);
+        if(ok && !map->owned) {
+            map->owned = data;
+        } else {
+            free(data);
+        }
+        return ok;
+    #else
+        // Целият пакет се показва веднъж; нови игри след това налагат ново показване.
+        // Старото показване не се освобождава, защото върнатите по-рано map сочат в него
+        if(!pack->mapped || entry->offset + entry->size > pack->mapped_size) {
+            if(pack->writable && fflush(pack->file) != 0) return 0;
+            size_t size = (size_t)pack->index_offset;
+            void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(pack->file), 0);
+            if(data == MAP_FAILED) return 0;
+            if(pack->mapped) {
+                PackMapping* retired = realloc(pack->retired, (pack->retired_count + 1) * sizeof(PackMapping));
+                if(!retired) {
+                    munmap(data, size);
+                    return 0;
+                }
+                pack->retired = retired;
+                pack->retired[pack->retired_count].data = pack->mapped;
+                pack->retired[pack->retired_count].size = pack->mapped_size;
+                pack->retired_count++;
+            }
+            pack->mapped = data;
+            pack->mapped_size = size;
+        }
+        return replay_map_view(map, (const unsigned char*)pack->mapped + entry->offset, entry->size, arena);
+    #endif
+}
+
+int pack_parse_ref(const char* ref, char* path, size_t path_size, int* id) {
+    const char* mark = strrchr(ref, '#');
+    if(!mark || !isdigit((unsigned char)mark[1]) || (size_t)(mark - ref) >= path_size) {
+        return 0;
+    }
+    for(const char* p = mark + 1; *p; p++) {
+        if(!isdigit((unsigned char)*p)) return 0;
+    }
+    
+    memcpy(path, ref, mark - ref);
+    path[mark - ref] = '\0';
+    *id = atoi(mark + 1);
+    return 1;
+}
@@ -0,0 +1,59 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "replay.h"
+
+// Пакет от записи (.pack): много игри в един файл, който само расте.
+// Всяка игра е отделен запис BSRP (или компресиран BSRZ), а в края на файла стои индекс с мястото,
+// размера и името на всяка игра. Игра се намира по номера си (id) в индекса
+// и се чете с едно преместване във файла.
+#define PACK_FILE "games.pack"
+#define PACK_NAME_SIZE 48
+
+typedef struct {
+    unsigned long long offset;
+    unsigned int size;
+    char name[PACK_NAME_SIZE];
+} PackEntry;
+
+// Старо показване на пакета, заменено след добавяне на игри - пази се до pack_close
+typedef struct {
+    void* data;
+    size_t size;
+} PackMapping;
+
+typedef struct {
+    FILE* file;
+    int writable;
+    int dirty;
+    unsigned long long index_offset;
+    PackEntry* entries;
+    int count;
+    int capacity;
+    void* mapped;
+    size_t mapped_size;
+    PackMapping* retired;
+    int retired_count;
+} ReplayPack;
+
+// С writable пакетът се създава, ако липсва, и се заключва за запис.
+// Пакет без цял индекс в края (прекъснато добавяне) се чете до последната цяла игра.
+int pack_open(ReplayPack* pack, const char* path, int writable);
+// Индексът се записва при pack_close, затова много добавяния струват едно записване на индекса
+int pack_append(ReplayPack* pack, const char* name, const unsigned char* data, size_t size);
+// С compress играта се записва компресирана (BSRZ), ако форматът позволява
+int pack_append_replay(ReplayPack* pack, const char* name, const GameReplay* replay, int compress);
+int pack_close(ReplayPack* pack);
+
+// Чете игра id в паметта (data се освобождава с free)
+int pack_read(ReplayPack* pack, int id, unsigned char** data, size_t* size);
+// Показва игра id направо от пакета, отворен с mmap - map е валиден до pack_close,
+// дори ако междувременно в пакета са добавени игри
+int pack_map(ReplayPack* pack, int id, ReplayMap* map, Arena* arena);
+
+// Разделя "пакет#id" на път и номер; връща 0, ако името не сочи игра в пакет
+int pack_parse_ref(const char* ref, char* path, size_t path_size, int* id);
+
+#endif
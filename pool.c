@@ -0,0 +1,252 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "pool.h"
+
+// Всяка нишка държи собствен интервал от задачи [begin, end).
+// Взима задачи от началото му, а когато свърши - краде половината от чужд интервал.
+typedef struct {
+    pthread_mutex_t lock;
+    int begin, end;
+    char padding[64];
+} PoolQueue;
+
+typedef struct {
+    PoolQueue* queues;
+    int workers;
+    PoolTask fn;
+    void* arg;
+} Pool;
+
+typedef struct {
+    Pool* pool;
+    int id;
+    int started;
+    pthread_t thread;
+} PoolWorker;
+
+static int pool_take(PoolQueue* queue, int* task) {
+    int taken = 0;
+    
+    pthread_mutex_lock(&queue->lock);
+    if(queue->begin < queue->end) {
+        *task = queue->begin++;
+        taken = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    
+    return taken;
+}
+
+static int pool_steal(Pool* pool, int thief) {
+    for(int i = 1; i < pool->workers; i++) {
+        PoolQueue* victim = &pool->queues[(thief + i) % pool->workers];
+        int begin = 0, end = 0;
+        
+        pthread_mutex_lock(&victim->lock);
+        int remaining = victim->end - victim->begin;
+        if(remaining > 0) {
+            end = victim->end;
+            begin = end - (remaining + 1) / 2;
+            victim->end = begin;
+        }
+        pthread_mutex_unlock(&victim->lock);
+        
+        if(end > begin) {
+            PoolQueue* own = &pool->queues[thief];
+            pthread_mutex_lock(&own->lock);
+            own->begin = begin;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            return 1;
+        }
+    }
+    
+    return 0;
+}
+
+static void* pool_worker(void* data) {
+    PoolWorker* worker = data;
+    Pool* pool = worker->pool;
+    int task;
+    
+    do {
+        while(pool_take(&pool->queues[worker->id], &task)) {
+            pool->fn(task, worker->id, pool->arg);
+        }
+    } while(pool_steal(pool, worker->id));
+    
+    return NULL;
+}
+
+int pool_default_workers(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+void pool_run(int workers, int tasks, PoolTask fn, void* arg) {
+    if(workers < 1) workers = 1;
+    if(workers > tasks) workers = tasks > 0 ? tasks : 1;
+    
+    Pool pool;
+    pool.workers = workers;
+    pool.fn = fn;
+    pool.arg = arg;
+    pool.queues = calloc(workers, sizeof(PoolQueue));
+    PoolWorker* state = calloc(workers, sizeof(PoolWorker));
+    
+    if(!pool.queues || !state) {
+        free(pool.queues);
+        free(state);
+        for(int i = 0; i < tasks; i++) {
+            fn(i, 0, arg);
+        }
+        return;
+    }
+    
+    for(int i = 0; i < workers; i++) {
+        pthread_mutex_init(&pool.queues[i].lock, NULL);
+        pool.queues[i].begin = (int)((long long)tasks * i / workers);
+        pool.queues[i].end = (int)((long long)tasks * (i + 1) / workers);
+        state[i].pool = &pool;
+        state[i].id = i;
+    }
+    
+    for(int i = 1; i < workers; i++) {
+        state[i].started = pthread_create(&state[i].thread, NULL, pool_worker, &state[i]) == 0;
+    }
+    pool_worker(&state[0]);
+    
+    for(int i = 1; i < workers; i++) {
+        if(state[i].started) pthread_join(state[i].thread, NULL);
+    }
+    
+    for(int i = 0; i < workers; i++) {
+        pthread_mutex_destroy(&pool.queues[i].lock);
+    }
+    free(pool.queues);
+    free(state);
+}
+
+// Нишките 1..workers-1 чакат ново поколение задачи; нишка 0 е тази, която вика pool_dispatch
+struct WorkerPool {
+    Pool pool;
+    PoolWorker* state;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    long long generation;
+    int running;
+    int stopping;
+};
+
+static void* pool_idle(void* data) {
+    PoolWorker* worker = data;
+    WorkerPool* owner = (WorkerPool*)worker->pool;
+    long long seen = 0;
+    
+    pthread_mutex_lock(&owner->lock);
+    while(1) {
+        while(owner->generation == seen && !owner->stopping) {
+            pthread_cond_wait(&owner->changed, &owner->lock);
+        }
+        if(owner->stopping) break;
+        seen = owner->generation;
+        pthread_mutex_unlock(&owner->lock);
+        
+        pool_worker(worker);
+        
+        pthread_mutex_lock(&owner->lock);
+        if(--owner->running == 0) {
+            pthread_cond_broadcast(&owner->changed);
+        }
+    }
+    pthread_mutex_unlock(&owner->lock);
+    return NULL;
+}
+
+WorkerPool* pool_create(int workers) {
+    if(workers < 1) workers = 1;
+    
+    WorkerPool* owner = calloc(1, sizeof(WorkerPool));
+    if(!owner) return NULL;
+    owner->pool.workers = workers;
+    owner->pool.queues = calloc(workers, sizeof(PoolQueue));
+    owner->state = calloc(workers, sizeof(PoolWorker));
+    if(!owner->pool.queues || !owner->state) {
+        free(owner->pool.queues);
+        free(owner->state);
+        free(owner);
+        return NULL;
+    }
+    
+    pthread_mutex_init(&owner->lock, NULL);
+    pthread_cond_init(&owner->changed, NULL);
+    for(int i = 0; i < workers; i++) {
+        pthread_mutex_init(&owner->pool.queues[i].lock, NULL);
+        // Pool е първото поле, затова нишките стигат до WorkerPool през същия указател
+        owner->state[i].pool = &owner->pool;
+        owner->state[i].id = i;
+    }
+    for(int i = 1; i < workers; i++) {
+        owner->state[i].started = pthread_create(&owner->state[i].thread, NULL, pool_idle, &owner->state[i]) == 0;
+    }
+    return owner;
+}
+
+void pool_dispatch(WorkerPool* owner, int tasks, PoolTask fn, void* arg) {
+    if(!owner) {
+        for(int i = 0; i < tasks; i++) {
+            fn(i, 0, arg);
+        }
+        return;
+    }
+    
+    Pool* pool = &owner->pool;
+    pool->fn = fn;
+    pool->arg = arg;
+    for(int i = 0; i < pool->workers; i++) {
+        pool->queues[i].begin = (int)((long long)tasks * i / pool->workers);
+        pool->queues[i].end = (int)((long long)tasks * (i + 1) / pool->workers);
+    }
+    
+    // Нишка, която не е стартирала, не взима задачи - нейният интервал се открадва от другите
+    pthread_mutex_lock(&owner->lock);
+    owner->running = 0;
+    for(int i = 1; i < pool->workers; i++) {
+        owner->running += owner->state[i].started;
+    }
+    owner->generation++;
+    pthread_cond_broadcast(&owner->changed);
+    pthread_mutex_unlock(&owner->lock);
+    
+    pool_worker(&owner->state[0]);
+    
+    pthread_mutex_lock(&owner->lock);
+    while(owner->running > 0) {
+        pthread_cond_wait(&owner->changed, &owner->lock);
+    }
+    pthread_mutex_unlock(&owner->lock);
+}
+
+void pool_destroy(WorkerPool* owner) {
+    if(!owner) return;
+    
+    pthread_mutex_lock(&owner->lock);
+    owner->stopping = 1;
+    pthread_cond_broadcast(&owner->changed);
+    pthread_mutex_unlock(&owner->lock);
+    
+    for(int i = 1; i < owner->pool.workers; i++) {
+        if(owner->state[i].started) pthread_join(owner->state[i].thread, NULL);
+    }
+    for(int i = 0; i < owner->pool.workers; i++) {
+        pthread_mutex_destroy(&owner->pool.queues[i].lock);
+    }
+    pthread_cond_destroy(&owner->changed);
+    pthread_mutex_destroy(&owner->lock);
+    free(owner->pool.queues);
+    free(owner->state);
+    free(owner);
+}
@@ -0,0 +1,20 @@
+#ifndef POOL_H
+#define POOL_H
+
+// Задача от пула - получава номера на задачата и номера на нишката, която я изпълнява
+typedef void (*PoolTask)(int task, int worker, void* arg);
+
+int pool_default_workers(void);
+void pool_run(int workers, int tasks, PoolTask fn, void* arg);
+
+// Пул с постоянни нишки - за много кратки извиквания подред (например по едно на ход),
+// без да се създават и спират нишки всеки път. pool_dispatch е като pool_run с нишките
+// на пула и се вика само от една нишка наведнъж.
+typedef struct WorkerPool WorkerPool;
+
+// NULL, ако няма памет - тогава pool_dispatch изпълнява задачите в извикващата нишка
+WorkerPool* pool_create(int workers);
+void pool_dispatch(WorkerPool* pool, int tasks, PoolTask fn, void* arg);
+void pool_destroy(WorkerPool* pool);
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef RANGECODER_H
+#define RANGECODER_H
+
+#include <stdlib.h>
+#include <stddef.h>
+
+// Малък двоичен аритметичен кодер (range coder) с адаптивни вероятности.
+// Всяка вероятност е 11-битово число за нулев бит, което след всеки бит се
+// приближава към наблюдаваното с крачка 1/16 - бързо се учи и върху малки записи.
+#define RC_PROB_BITS 11
+#define RC_PROB_ONE (1u << RC_PROB_BITS)
+#define RC_PROB_INIT (RC_PROB_ONE / 2)
+#define RC_MOVE_BITS 4
+#define RC_TOP (1u << 24)
+
+typedef unsigned short RcProb;
+
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+    int failed;
+    unsigned long long low;
+    unsigned int range;
+    unsigned char cache;
+    unsigned long long cache_size;
+} RcEncoder;
+
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    size_t pos;
+    int failed;
+    unsigned int range;
+    unsigned int code;
+} RcDecoder;
+
+static inline void rc_probs_init(RcProb* probs, int count) {
+    for(int i = 0; i < count; i++) {
+        probs[i] = RC_PROB_INIT;
+    }
+}
+
+static inline void rc_put(RcEncoder* rc, unsigned char byte) {
+    if(rc->size == rc->capacity) {
+        size_t capacity = rc->capacity ? rc->capacity * 2 : 256;
+        unsigned char* data = realloc(rc->data, capacity);
+        if(!data) {
+            rc->failed = 1;
+            return;
+        }
+        rc->data = data;
+        rc->capacity = capacity;
+    }
+    rc->data[rc->size++] = byte;
+}
+
+static inline void rc_encoder_init(RcEncoder* rc) {
+    rc->data = NULL;
+    rc->size = rc->capacity = 0;
+    rc->failed = 0;
+    rc->low = 0;
+    rc->range = 0xffffffffu;
+    rc->cache = 0;
+    rc->cache_size = 1;
+}
+
+// Пренасянето от low се отлага, докато не стане ясно дали ще промени вече изведените байтове
+static inline void rc_shift_low(RcEncoder* rc) {
+    if((unsigned int)rc->low < 0xff000000u || (rc->low >> 32) != 0) {
+        unsigned char carry = (unsigned char)(rc->low >> 32);
+        unsigned char temp = rc->cache;
+        do {
+            rc_put(rc, (unsigned char)(temp + carry));
+            temp = 0xff;
+        } while(--rc->cache_size != 0);
+        rc->cache = (unsigned char)(rc->low >> 24);
+    }
+    rc->cache_size++;
+    rc->low = (rc->low & 0x00ffffffu) << 8;
+}
+
+static inline void rc_encode_bit(RcEncoder* rc, RcProb* prob, int bit) {
+    unsigned int bound = (rc->range >> RC_PROB_BITS) * *prob;
+    if(!bit) {
+        rc->range = bound;
+        *prob += (RC_PROB_ONE - *prob) >> RC_MOVE_BITS;
+    } else {
+        rc->low += bound;
+        rc->range -= bound;
+        *prob -= *prob >> RC_MOVE_BITS;
+    }
+    while(rc->range < RC_TOP) {
+        rc->range <<= 8;
+        rc_shift_low(rc);
+    }
+}
+
+// Равномерно число в [0, count) - за count до 2^16
+static inline void rc_encode_uniform(RcEncoder* rc, unsigned int value, unsigned int count) {
+    rc->range /= count;
+    rc->low += (unsigned long long)value * rc->range;
+    while(rc->range < RC_TOP) {
+        rc->range <<= 8;
+        rc_shift_low(rc);
+    }
+}
+
+// Извежда последните байтове; data се освобождава с free
+static inline int rc_encoder_finish(RcEncoder* rc) {
+    for(int i = 0; i < 5; i++) {
+        rc_shift_low(rc);
+    }
+    return !rc->failed;
+}
+
+static inline unsigned char rc_next(RcDecoder* rc) {
+    if(rc->pos >= rc->size) {
+        rc->failed = 1;
+        return 0;
+    }
+    return rc->data[rc->pos++];
+}
+
+static inline void rc_decoder_init(RcDecoder* rc, const unsigned char* data, size_t size) {
+    rc->data = data;
+    rc->size = size;
+    rc->pos = 0;
+    rc->failed = 0;
+    rc->range = 0xffffffffu;
+    rc->code = 0;
+    for(int i = 0; i < 5; i++) {
+        rc->code = rc->code << 8 | rc_next(rc);
+    }
+}
+
+static inline int rc_decode_bit(RcDecoder* rc, RcProb* prob) {
+    unsigned int bound = (rc->range >> RC_PROB_BITS) * *prob;
+    int bit;
+    if(rc->code < bound) {
+        rc->range = bound;
+        *prob += (RC_PROB_ONE - *prob) >> RC_MOVE_BITS;
+        bit = 0;
+    } else {
+        rc->code -= bound;
+        rc->range -= bound;
+        *prob -= *prob >> RC_MOVE_BITS;
+        bit = 1;
+    }
+    while(rc->range < RC_TOP) {
+        rc->range <<= 8;
+        rc->code = rc->code << 8 | rc_next(rc);
+    }
+    return bit;
+}
+
+static inline unsigned int rc_decode_uniform(RcDecoder* rc, unsigned int count) {
+    rc->range /= count;
+    unsigned int value = rc->code / rc->range;
+    if(value >= count) {
+        rc->failed = 1;
+        value = count - 1;
+    }
+    rc->code -= value * rc->range;
+    while(rc->range < RC_TOP) {
+        rc->range <<= 8;
+        rc->code = rc->code << 8 | rc_next(rc);
+    }
+    return value;
+}
+
+// Число от bits бита, старшият бит първи; probs има 1 << bits елемента
+static inline void rc_encode_tree(RcEncoder* rc, RcProb* probs, int bits, unsigned int value) {
+    unsigned int node = 1;
+    for(int i = bits - 1; i >= 0; i--) {
+        int bit = (value >> i) & 1;
+        rc_encode_bit(rc, &probs[node], bit);
+        node = node << 1 | bit;
+    }
+}
+
+static inline unsigned int rc_decode_tree(RcDecoder* rc, RcProb* probs, int bits) {
+    unsigned int node = 1;
+    for(int i = 0; i < bits; i++) {
+        node = node << 1 | rc_decode_bit(rc, &probs[node]);
+    }
+    return node - (1u << bits);
+}
+
+#endif
@@ -0,0 +1,168 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/crypto.h>
+#include "engine.h"
+#include "keyring.h"
+#include "replay.h"
+
+#define PASSWORD_SIZE 256
+
+// Възстановява прекъснати поточни записи (.part) до последния цял ход
+static void output_path(const char* path, char* output, size_t size) {
+    size_t length = strlen(path);
+    if(length > 5 && strcmp(path + length - 5, ".part") == 0) {
+        snprintf(output, size, "%.*s", (int)(length - 5), path);
+    } else {
+        snprintf(output, size, "%s.recovered", path);
+    }
+}
+
+static int is_sealed(const char* path) {
+    char magic[4];
+    FILE* file = fopen(path, "rb");
+    if(!file) return 0;
+    int sealed = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, SEAL_MAGIC, 4) == 0;
+    fclose(file);
+    return sealed;
+}
+
+// Криптиран .part: разкриптира се с паролата на директорията си и се записва отново
+// криптиран с нов ключ - некриптираното копие е само в паметта
+static int recover_sealed(const char* path, const char* output, const char* password, GameReplay* replay,
+                          int* complete) {
+    char directory[1024];
+    snprintf(directory, sizeof(directory), "%s", path);
+    char* slash = strrchr(directory, '/');
+    if(slash) {
+        *slash = '\0';
+    } else {
+        strcpy(directory, ".");
+    }
+    
+    KeyringReader reader;
+    const unsigned char* data;
+    size_t size;
+    int ok = keyring_reader_init(&reader) && keyring_read_file(&reader, path, password, &data, &size) &&
+             replay_recover_data(data, size, replay, complete);
+    keyring_reader_free(&reader);
+    if(!ok) {
+        printf("%s: грешна парола или повреден криптиран запис\n", path);
+        return 0;
+    }
+    
+    SealKdf kdf;
+    unsigned char key[SEAL_KEY_SIZE];
+    unsigned char wrapped[SEAL_WRAPPED_SIZE];
+    ReplayWriter* writer = NULL;
+    if(keyring_new_key(directory, password, key, &kdf, wrapped)) {
+        writer = replay_writer_open_sealed(output, 0, key, &kdf, wrapped);
+    }
+    OPENSSL_cleanse(key, sizeof(key));
+    
+    // finish попълва броя ходове, иначе close оставя записа като .part
+    if(writer) {
+        replay_writer_begin(writer, replay);
+        for(int i = 0; i < replay->move_count; i++) {
+            replay_writer_append(writer, replay_move(replay, i));
+        }
+        replay_writer_finish(writer, replay);
+    }
+    if(!writer || !replay_writer_close(writer, 1)) {
+        printf("%s: грешка при запис в %s\n", path, output);
+        free_replay(replay);
+        return 0;
+    }
+    return 1;
+}
+
+static int recover_file(const char* path, int keep, const char* password) {
+    GameReplay replay;
+    int complete;
+    char output[1024];
+    char temporary[1040];
+    output_path(path, output, sizeof(output));
+    
+    if(is_sealed(path)) {
+        if(!password) {
+            printf("%s: записът е криптиран - паролата се дава с -p\n", path);
+            return 0;
+        }
+        // Записва се под друго име, защото output.part е самият входен файл
+        snprintf(temporary, sizeof(temporary), "%s.recovering", output);
+        if(!recover_sealed(path, temporary, password, &replay, &complete)) return 0;
+        if(rename(temporary, output) != 0) {
+            printf("%s: грешка при запис в %s\n", path, output);
+            remove(temporary);
+            free_replay(&replay);
+            return 0;
+        }
+    } else {
+        if(!replay_recover(path, &replay, &complete)) {
+            printf("%s: не е запис на игра или заглавната част е повредена\n", path);
+            return 0;
+        }
+        if(!replay_save(output, &replay)) {
+            printf("%s: грешка при запис в %s\n", path, output);
+            free_replay(&replay);
+            return 0;
+        }
+    }
+    
+    printf("%s: %d хода, %s -> %s\n", path, replay.move_count,
+           complete ? "играта е завършена" : "играта е прекъсната", output);
+    if(!keep) {
+        remove(path);
+    }
+    free_replay(&replay);
+    return 1;
+}
+
+static void print_usage(const char* program) {
+    printf("Употреба: %s [-k] [-p файл_с_парола] файл.part...\n", program);
+    printf("  Чете прекъснат запис до последния цял ход и го записва без .part\n");
+    printf("  -k  запазва и оригиналния .part файл\n");
+    printf("  -p  паролата за криптираните записи (.encrypted.part) е на първия ред на файла\n");
+    printf("      (- за стандартния вход); те се записват отново криптирани\n");
+}
+
+int main(int argc, char** argv) {
+    int keep = 0;
+    int first = 1;
+    const char* password_source = NULL;
+    char password[PASSWORD_SIZE];
+    
+    while(first < argc && argv[first][0] == '-') {
+        if(strcmp(argv[first], "-k") == 0) {
+            keep = 1;
+            first++;
+        } else if(strcmp(argv[first], "-p") == 0 && first + 1 < argc) {
+            password_source = argv[first + 1];
+            first += 2;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if(first >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if(password_source && !keyring_read_password(password_source, password, sizeof(password))) {
+        printf("Не може да се прочете паролата от %s!\n", password_source);
+        return 1;
+    }
+    
+    int failed = 0;
+    for(int i = first; i < argc; i++) {
+        if(!recover_file(argv[i], keep, password_source ? password : NULL)) {
+            failed++;
+        }
+    }
+    if(password_source) {
+        OPENSSL_cleanse(password, sizeof(password));
+    }
+    return failed ? 1 : 0;
+}
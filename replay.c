@@ -0,0 +1,1446 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "montecarlo.h"
+#include "rangecoder.h"
+#include "replay.h"
+#include "seal.h"
+
+// Компактен формат (всички числа са varint, знаковите - zigzag):
+//   "BSRP" байт версия, 4 байта брой ходове (0xffffffff - играта не е завършена),
+//   байт победител (0 - няма, 1 или 2), seed
+//   за всеки играч: дължина на името, име, байт компютър (виж encode_player), брой кораби,
+//                   за всеки кораб байт дължина|посока<<3 и разлика на клетката спрямо предишния
+//   начало (секунди + 1, 0 - липсва)
+//   записи до края на файла:
+//     ход - байт клетка|играч<<7 и разлика във времето спрямо предишния ход
+//     ключов кадър - байт 0xff и изстрелите на двамата играчи (по 13 байта), след всеки 64 хода
+//     край - байт 0xfe, байт дали има време на края и разлика спрямо последния ход
+// Броят ходове и победителят са с фиксирана ширина, за да се попълнят в края на поточния запис.
+// Попадения и потопени кораби не се пазят - извеждат се от корабите на противника.
+// Версия 1 държеше победителя и броя ходове след корабите, а версия 2 нямаше ключови кадри.
+#define REPLAY_MAGIC "BSRP"
+#define REPLAY_VERSION 3
+#define REPLAY_OPEN_COUNT 0xffffffffu
+#define COUNT_OFFSET 5
+#define RECORD_END 0xfe
+#define RECORD_KEYFRAME 0xff
+#define KEYFRAME_INTERVAL 64
+#define BITBOARD_BYTES ((BOARD_CELLS + 7) / 8)
+#define BATCH_SIZE 4096
+#define LEGACY_MAX_MOVES 200
+
+// Старият формат - структурата от първата версия на играта, записвана директно с fwrite.
+// Дъските там са масиви от CellState, а не битови маски, затова се превежда поле по поле.
+typedef struct {
+    int row, col;
+    int length;
+    Direction direction;
+    int hits;
+    int sunk;
+} LegacyShip;
+
+typedef struct {
+    CellState board[BOARD_SIZE][BOARD_SIZE];
+    CellState attacks[BOARD_SIZE][BOARD_SIZE];
+    LegacyShip ships[MAX_SHIPS];
+    int ship_count;
+    int ships_sunk;
+    char name[32];
+    int is_ai;
+} LegacyPlayer;
+
+typedef struct {
+    char player_name[32];
+    int row, col;
+    int hit;
+    int ship_sunk;
+    int ship_length;
+    char timestamp[30];
+} LegacyMove;
+
+typedef struct {
+    LegacyPlayer player1_initial;
+    LegacyPlayer player2_initial;
+    LegacyMove moves[LEGACY_MAX_MOVES];
+    int move_count;
+    char winner[32];
+    char start_time[30];
+    char end_time[30];
+} LegacyReplay;
+
+// fixed - буфер с предварително заделена памет, който не расте
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+    int failed;
+    int fixed;
+} Buffer;
+
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    size_t pos;
+    int failed;
+} Reader;
+
+static void put_byte(Buffer* buffer, unsigned char byte) {
+    if(buffer->size == buffer->capacity) {
+        if(buffer->fixed) {
+            buffer->failed = 1;
+            return;
+        }
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : 256;
+        unsigned char* data = realloc(buffer->data, capacity);
+        if(!data) {
+            buffer->failed = 1;
+            return;
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    buffer->data[buffer->size++] = byte;
+}
+
+static void put_varint(Buffer* buffer, unsigned long long value) {
+    while(value >= 0x80) {
+        put_byte(buffer, (unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    put_byte(buffer, (unsigned char)value);
+}
+
+static void put_signed(Buffer* buffer, long long value) {
+    put_varint(buffer, ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63));
+}
+
+static unsigned char get_byte(Reader* reader) {
+    if(reader->pos >= reader->size) {
+        reader->failed = 1;
+        return 0;
+    }
+    return reader->data[reader->pos++];
+}
+
+static unsigned long long get_varint(Reader* reader) {
+    unsigned long long value = 0;
+    
+    for(int shift = 0; shift < 64; shift += 7) {
+        unsigned char byte = get_byte(reader);
+        value |= (unsigned long long)(byte & 0x7f) << shift;
+        if(!(byte & 0x80)) return value;
+    }
+    reader->failed = 1;
+    return 0;
+}
+
+static long long get_signed(Reader* reader) {
+    unsigned long long value = get_varint(reader);
+    return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+long long replay_parse_time(const char* text) {
+    int year, month, day, hour, minute, second;
+    if(sscanf(text, "%d-%d-%d %d:%d:%d", &year, &month, &day, &hour, &minute, &second) != 6) {
+        return -1;
+    }
+    
+    year -= month <= 2;
+    long long era = (year >= 0 ? year : year - 399) / 400;
+    long long year_of_era = year - era * 400;
+    long long day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long long day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    long long days = era * 146097 + day_of_era - 719468;
+    
+    return days * 86400 + hour * 3600 + minute * 60 + second;
+}
+
+void replay_format_time(long long seconds, char* buffer) {
+    long long days = seconds / 86400;
+    long long rest = seconds % 86400;
+    if(rest < 0) {
+        rest += 86400;
+        days--;
+    }
+    
+    days += 719468;
+    long long era = (days >= 0 ? days : days - 146096) / 146097;
+    long long day_of_era = days - era * 146097;
+    long long year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    long long day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    long long mp = (5 * day_of_year + 2) / 153;
+    int day = (int)(day_of_year - (153 * mp + 2) / 5 + 1);
+    int month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    long long year = year_of_era + era * 400 + (month <= 2);
+    
+    snprintf(buffer, 30, "%04lld-%02d-%02d %02d:%02d:%02d", year, month, day,
+             (int)(rest / 3600), (int)(rest / 60 % 60), (int)(rest % 60));
+}
+
+// Байтът компютър: бит 0 - is_ai, битове 1-2 - стратегията + 1 (0 - не е записана),
+// битове 3-7 - log2 от флотите на ход при montecarlo (0 - по време). Старите записи имат
+// само 0 или 1 и се четат като компютър без записана стратегия.
+static unsigned char encode_ai(const Player* player, const AISettings* settings) {
+    unsigned char byte = (unsigned char)(player->is_ai != 0);
+    if(!player->is_ai || !settings->recorded) return byte;
+    
+    byte |= (unsigned char)((settings->strategy + 1) << 1);
+    int samples = settings->move_samples;
+    if(samples > 1 && samples <= MONTE_CARLO_MAX_SAMPLES && (samples & (samples - 1)) == 0) {
+        byte |= (unsigned char)(__builtin_ctz((unsigned int)samples) << 3);
+    }
+    return byte;
+}
+
+static void decode_ai(unsigned char byte, Player* player, AISettings* settings) {
+    player->is_ai = byte & 1;
+    memset(settings, 0, sizeof(AISettings));
+    int strategy = byte >> 1 & 3;
+    if(!player->is_ai || !strategy) return;
+    
+    settings->recorded = 1;
+    settings->strategy = (AIStrategy)(strategy - 1);
+    int shift = byte >> 3;
+    settings->move_samples = shift ? 1 << shift : 0;
+}
+
+static void encode_player(Buffer* buffer, const Player* player, const AISettings* settings) {
+    size_t name_length = strnlen(player->name, sizeof(player->name) - 1);
+    put_varint(buffer, name_length);
+    for(size_t i = 0; i < name_length; i++) {
+        put_byte(buffer, (unsigned char)player->name[i]);
+    }
+    put_byte(buffer, encode_ai(player, settings));
+    
+    put_byte(buffer, (unsigned char)player->ship_count);
+    int previous = 0;
+    for(int i = 0; i < player->ship_count; i++) {
+        const Ship* ship = &player->ships[i];
+        int cell = CELL_INDEX(ship->row, ship->col);
+        put_byte(buffer, (unsigned char)(ship->length | ship->direction << 3));
+        put_signed(buffer, cell - previous);
+        previous = cell;
+    }
+}
+
+// settings може да е NULL, когато трябват само корабите
+static int decode_player(Reader* reader, Player* player, AISettings* settings) {
+    AISettings ignored;
+    memset(player, 0, sizeof(Player));
+    
+    unsigned long long name_length = get_varint(reader);
+    if(name_length >= sizeof(player->name)) return 0;
+    for(unsigned long long i = 0; i < name_length; i++) {
+        player->name[i] = (char)get_byte(reader);
+    }
+    decode_ai(get_byte(reader), player, settings ? settings : &ignored);
+    
+    int ship_count = get_byte(reader);
+    if(ship_count > MAX_SHIPS) return 0;
+    int previous = 0;
+    for(int i = 0; i < ship_count; i++) {
+        unsigned char shape = get_byte(reader);
+        long long cell = previous + get_signed(reader);
+        if(reader->failed || cell < 0 || cell >= BOARD_CELLS) return 0;
+        
+        int length = shape & 7;
+        Direction dir = (Direction)(shape >> 3 & 3);
+        if(length < 1 || length > MAX_SHIP_LENGTH ||
+           engine_place(player, (int)cell / BOARD_SIZE, (int)cell % BOARD_SIZE, length, dir) != PLACE_OK) {
+            return 0;
+        }
+        previous = (int)cell;
+    }
+    return !reader->failed;
+}
+
+static void put_u32(Buffer* buffer, unsigned int value) {
+    for(int i = 0; i < 4; i++) {
+        put_byte(buffer, (unsigned char)(value >> (8 * i)));
+    }
+}
+
+static unsigned int get_u32(Reader* reader) {
+    unsigned int value = 0;
+    for(int i = 0; i < 4; i++) {
+        value |= (unsigned int)get_byte(reader) << (8 * i);
+    }
+    return value;
+}
+
+static void put_bitboard(Buffer* buffer, Bitboard board) {
+    for(int i = 0; i < BITBOARD_BYTES; i++) {
+        put_byte(buffer, (unsigned char)(board >> (8 * i)));
+    }
+}
+
+static Bitboard read_bitboard(const unsigned char* data) {
+    Bitboard board = 0;
+    for(int i = 0; i < BITBOARD_BYTES; i++) {
+        board |= (Bitboard)data[i] << (8 * i);
+    }
+    return board & FULL_BOARD;
+}
+
+// Заглавната част; връща времето на началото, спрямо което се броят ходовете
+static long long encode_header(Buffer* buffer, const GameReplay* replay, unsigned int move_count, int winner) {
+    for(int i = 0; i < 4; i++) {
+        put_byte(buffer, (unsigned char)REPLAY_MAGIC[i]);
+    }
+    put_byte(buffer, REPLAY_VERSION);
+    put_u32(buffer, move_count);
+    put_byte(buffer, (unsigned char)winner);
+    put_varint(buffer, replay->seed);
+    encode_player(buffer, &replay->player1_initial, &replay->ai[0]);
+    encode_player(buffer, &replay->player2_initial, &replay->ai[1]);
+    
+    long long start = replay_parse_time(replay->start_time);
+    put_varint(buffer, start >= 0 ? (unsigned long long)start + 1 : 0);
+    return start >= 0 ? start : 0;
+}
+
+// Състояние между ходовете при запис - време на последния ход и изстрелите за ключовите кадри
+typedef struct {
+    long long previous;
+    Bitboard shots[2];
+    int moves;
+} Encoder;
+
+static void encode_move(Buffer* buffer, Encoder* encoder, const Move* move) {
+    int player = move->player != 0;
+    put_byte(buffer, (unsigned char)(CELL_INDEX(move->row, move->col) | player << 7));
+    
+    // Ход без време получава времето на предишния
+    long long stamp = replay_parse_time(move->timestamp);
+    if(stamp < 0) stamp = encoder->previous;
+    put_signed(buffer, stamp - encoder->previous);
+    encoder->previous = stamp;
+    
+    encoder->shots[player] |= CELL_BIT(move->row, move->col);
+    if(++encoder->moves % KEYFRAME_INTERVAL == 0) {
+        put_byte(buffer, RECORD_KEYFRAME);
+        put_bitboard(buffer, encoder->shots[0]);
+        put_bitboard(buffer, encoder->shots[1]);
+    }
+}
+
+static void encode_end(Buffer* buffer, Encoder* encoder, const GameReplay* replay) {
+    long long end = replay_parse_time(replay->end_time);
+    put_byte(buffer, RECORD_END);
+    put_byte(buffer, (unsigned char)(end >= 0));
+    put_signed(buffer, end >= 0 ? end - encoder->previous : 0);
+}
+
+int replay_encode(const GameReplay* replay, unsigned char** data, size_t* size) {
+    Buffer buffer;
+    Encoder encoder;
+    memset(&buffer, 0, sizeof(buffer));
+    memset(&encoder, 0, sizeof(encoder));
+    
+    encoder.previous = encode_header(&buffer, replay, (unsigned int)replay->move_count, replay->winner_index);
+    for(int i = 0; i < replay->move_count; i++) {
+        encode_move(&buffer, &encoder, replay_move(replay, i));
+    }
+    encode_end(&buffer, &encoder, replay);
+    
+    if(buffer.failed) {
+        free(buffer.data);
+        return 0;
+    }
+    *data = buffer.data;
+    *size = buffer.size;
+    return 1;
+}
+
+typedef struct {
+    GameReplay* replay;
+    int damage[2][MAX_SHIPS];
+    long long previous;
+    int has_start;
+} Decoder;
+
+static void decode_start(Reader* reader, Decoder* decoder) {
+    unsigned long long start = get_varint(reader);
+    decoder->has_start = start != 0;
+    decoder->previous = start ? (long long)(start - 1) : 0;
+    if(start) {
+        replay_format_time(decoder->previous, decoder->replay->start_time);
+    }
+}
+
+// Един ход; при непълен запис не добавя нищо
+static int decode_move(Reader* reader, Decoder* decoder, unsigned char byte) {
+    int cell = byte & 0x7f;
+    int player = byte >> 7;
+    if(cell >= BOARD_CELLS) return 0;
+    
+    long long stamp = decoder->previous + get_signed(reader);
+    if(reader->failed) return 0;
+    decoder->previous = stamp;
+    
+    GameReplay* replay = decoder->replay;
+    Move* move = replay_new_move(replay);
+    if(!move) return 0;
+    
+    const Player* attacker = player ? &replay->player2_initial : &replay->player1_initial;
+    const Player* defender = player ? &replay->player1_initial : &replay->player2_initial;
+    strcpy(move->player_name, attacker->name);
+    move->player = player;
+    move->row = cell / BOARD_SIZE;
+    move->col = cell % BOARD_SIZE;
+    
+    // Щетите по корабите се натрупват, за да се разбере кой изстрел потапя кораб
+    int ship = defender->ship_at[cell];
+    if(ship) {
+        const Ship* target = &defender->ships[ship - 1];
+        move->hit = 1;
+        move->ship_length = target->length;
+        move->ship_sunk = ++decoder->damage[1 - player][ship - 1] == target->length;
+    }
+    
+    if(decoder->has_start) {
+        replay_format_time(stamp, move->timestamp);
+    }
+    return 1;
+}
+
+static int decode_end(Reader* reader, Decoder* decoder) {
+    int has_end = get_byte(reader);
+    long long end = decoder->previous + get_signed(reader);
+    if(has_end) {
+        replay_format_time(end, decoder->replay->end_time);
+    }
+    return !reader->failed;
+}
+
+static int decode_winner(GameReplay* replay, int winner) {
+    if(winner > 2) return 0;
+    replay->winner_index = winner;
+    if(winner) {
+        strcpy(replay->winner, winner == 1 ? replay->player1_initial.name : replay->player2_initial.name);
+    }
+    return 1;
+}
+
+static int decode_version1(Reader* reader, Decoder* decoder) {
+    GameReplay* replay = decoder->replay;
+    replay->seed = get_varint(reader);
+    if(!decode_player(reader, &replay->player1_initial, &replay->ai[0]) ||
+       !decode_player(reader, &replay->player2_initial, &replay->ai[1]) ||
+       !decode_winner(replay, get_byte(reader))) {
+        return 0;
+    }
+    decode_start(reader, decoder);
+    
+    // Всеки ход заема поне два байта - по-голям брой значи повреден файл
+    unsigned long long move_count = get_varint(reader);
+    if(move_count > (reader->size - reader->pos) / 2) return 0;
+    for(unsigned long long i = 0; i < move_count; i++) {
+        if(!decode_move(reader, decoder, get_byte(reader))) return 0;
+    }
+    return decode_end(reader, decoder);
+}
+
+// complete е 0 за незавършен поток - тогава се приемат ходовете до последния цял запис.
+// Ключовите кадри трябват само при прескачане и тук се пропускат.
+static int decode_stream(Reader* reader, Decoder* decoder, int recover, int* complete) {
+    GameReplay* replay = decoder->replay;
+    unsigned int move_count = get_u32(reader);
+    int winner = get_byte(reader);
+    replay->seed = get_varint(reader);
+    if(!decode_player(reader, &replay->player1_initial, &replay->ai[0]) ||
+       !decode_player(reader, &replay->player2_initial, &replay->ai[1]) ||
+       !decode_winner(replay, winner)) {
+        return 0;
+    }
+    decode_start(reader, decoder);
+    if(reader->failed) return 0;
+    
+    int finished = 0;
+    while(reader->pos < reader->size) {
+        unsigned char byte = get_byte(reader);
+        if(byte == RECORD_END) {
+            finished = decode_end(reader, decoder);
+            break;
+        }
+        if(byte == RECORD_KEYFRAME) {
+            if(reader->size - reader->pos < 2 * BITBOARD_BYTES) break;
+            reader->pos += 2 * BITBOARD_BYTES;
+            continue;
+        }
+        if(!decode_move(reader, decoder, byte)) break;
+    }
+    
+    *complete = finished && move_count == (unsigned int)replay->move_count;
+    return *complete || recover;
+}
+
+static int decode_compact(Reader* reader, GameReplay* replay, int recover, int* complete) {
+    Decoder decoder;
+    memset(&decoder, 0, sizeof(decoder));
+    decoder.replay = replay;
+    
+    int version = get_byte(reader);
+    *complete = 1;
+    if(version == 1) return decode_version1(reader, &decoder);
+    if(version == 2 || version == REPLAY_VERSION) return decode_stream(reader, &decoder, recover, complete);
+    return 0;
+}
+
+static void copy_text(char* target, const char* source, size_t size) {
+    memcpy(target, source, size);
+    target[size - 1] = '\0';
+}
+
+static int decode_legacy_player(const LegacyPlayer* legacy, Player* player) {
+    memset(player, 0, sizeof(Player));
+    copy_text(player->name, legacy->name, sizeof(player->name));
+    player->is_ai = legacy->is_ai != 0;
+    
+    if(legacy->ship_count < 0 || legacy->ship_count > MAX_SHIPS) return 0;
+    for(int i = 0; i < legacy->ship_count; i++) {
+        const LegacyShip* ship = &legacy->ships[i];
+        if(ship->length < 1 || ship->length > MAX_SHIP_LENGTH || ship->direction < UP || ship->direction > RIGHT ||
+           engine_place(player, ship->row, ship->col, ship->length, ship->direction) != PLACE_OK) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Старият запис не пази кой стреля - първият играч започва, а редът се сменя след всеки пропуск.
+// Победителят е стрелял последен. Имената не се сравняват, защото може да съвпадат.
+static int decode_legacy(const unsigned char* data, size_t size, GameReplay* replay) {
+    if(size != sizeof(LegacyReplay)) return 0;
+    
+    LegacyReplay* legacy = malloc(sizeof(LegacyReplay));
+    if(!legacy) return 0;
+    memcpy(legacy, data, sizeof(LegacyReplay));
+    
+    int ok = legacy->move_count >= 0 && legacy->move_count <= LEGACY_MAX_MOVES &&
+             decode_legacy_player(&legacy->player1_initial, &replay->player1_initial) &&
+             decode_legacy_player(&legacy->player2_initial, &replay->player2_initial);
+    copy_text(replay->winner, legacy->winner, sizeof(replay->winner));
+    copy_text(replay->start_time, legacy->start_time, sizeof(replay->start_time));
+    copy_text(replay->end_time, legacy->end_time, sizeof(replay->end_time));
+    
+    int player = 0;
+    for(int i = 0; ok && i < legacy->move_count; i++) {
+        const LegacyMove* old = &legacy->moves[i];
+        if(old->row < 0 || old->row >= BOARD_SIZE || old->col < 0 || old->col >= BOARD_SIZE) {
+            ok = 0;
+            break;
+        }
+        Move* move = replay_new_move(replay);
+        if(!move) {
+            ok = 0;
+            break;
+        }
+        copy_text(move->player_name, old->player_name, sizeof(move->player_name));
+        move->player = player;
+        move->row = old->row;
+        move->col = old->col;
+        move->hit = old->hit != 0;
+        move->ship_sunk = old->ship_sunk != 0;
+        move->ship_length = old->ship_length;
+        copy_text(move->timestamp, old->timestamp, sizeof(move->timestamp));
+        if(!move->hit) {
+            player = 1 - player;
+        }
+    }
+    if(ok && replay->winner[0]) {
+        replay->winner_index = replay->move_count ? replay_move(replay, replay->move_count - 1)->player + 1 : 0;
+        ok = replay->winner_index != 0;
+    }
+    
+    free(legacy);
+    return ok;
+}
+
+// Компресиран запис (BSRZ): "BSRZ", байт версия, размерът на записа BSRP като varint,
+// заглавната част на BSRP без промяна (varint размер и байтовете) и след това поток от
+// аритметичния кодер в rangecoder.h. Заглавната част е малка и се копира направо, за да
+// е бързо разкомпресирането. Всеки ход се кодира с модел, който знае корабите на противника:
+//   играчът на хода - спрямо играча и попадението на предишния ход (почти винаги се отгатва)
+//   клетката - дали е съседна на попадение по още непотопен кораб (зависи от предишния
+//              изстрел на играча) и номерът й сред възможните клетки, без вече обстреляните
+//   времето - броят битове на разликата адаптивно, самите битове равномерно
+// Ключовите кадри не се пазят - при разкомпресиране се добавят отново през 64 хода.
+#define COMPRESSED_MAGIC "BSRZ"
+#define COMPRESSED_VERSION 1
+#define NUMBER_CONTEXTS 4
+#define NUMBER_SIZE 0
+#define NUMBER_TIME 1
+#define NUMBER_END 3
+
+static void rc_put_varint(RcEncoder* rc, unsigned long long value) {
+    while(value >= 0x80) {
+        rc_put(rc, (unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    rc_put(rc, (unsigned char)value);
+}
+
+typedef struct {
+    RcProb zero[NUMBER_CONTEXTS];
+    RcProb length[NUMBER_CONTEXTS][64];
+    RcProb player[5];
+    RcProb near[2];
+    RcProb end[2];
+} ReplayModel;
+
+// Какво знаят и двете страни преди всеки ход
+typedef struct {
+    Player players[2];
+    Bitboard shots[2];
+    Bitboard open_hits[2];
+    int damage[2][MAX_SHIPS];
+    int last_hit[2];
+    int player_context;
+    int time_context;
+} MoveModel;
+
+static void model_init(ReplayModel* model, MoveModel* moves) {
+    rc_probs_init(model->zero, NUMBER_CONTEXTS);
+    rc_probs_init(&model->length[0][0], NUMBER_CONTEXTS * 64);
+    rc_probs_init(model->player, 5);
+    rc_probs_init(model->near, 2);
+    rc_probs_init(model->end, 2);
+    
+    memset(moves->shots, 0, sizeof(moves->shots));
+    memset(moves->open_hits, 0, sizeof(moves->open_hits));
+    memset(moves->damage, 0, sizeof(moves->damage));
+    memset(moves->last_hit, 0, sizeof(moves->last_hit));
+    moves->player_context = 4;
+    moves->time_context = NUMBER_TIME;
+}
+
+// Неизстреляните клетки до попадения по кораби, които още не са потопени
+static Bitboard model_candidates(const MoveModel* moves, int player) {
+    Bitboard hits = moves->open_hits[player];
+    Bitboard cross = (hits << BOARD_SIZE) | (hits >> BOARD_SIZE) |
+                     ((hits << 1) & ~FIRST_COLUMN) | ((hits >> 1) & ~LAST_COLUMN);
+    return cross & ~moves->shots[player] & FULL_BOARD;
+}
+
+static void model_apply(MoveModel* moves, int player, int cell) {
+    const Player* defender = &moves->players[!player];
+    int ship = defender->ship_at[cell];
+    
+    moves->shots[player] |= (Bitboard)1 << cell;
+    if(ship) {
+        moves->open_hits[player] |= (Bitboard)1 << cell;
+        if(++moves->damage[player][ship - 1] == defender->ships[ship - 1].length) {
+            moves->open_hits[player] &= ~defender->ships[ship - 1].mask;
+        }
+    }
+    moves->last_hit[player] = ship != 0;
+    moves->player_context = player * 2 + (ship != 0);
+}
+
+static void compress_number(RcEncoder* rc, ReplayModel* model, int context, unsigned long long value) {
+    rc_encode_bit(rc, &model->zero[context], value != 0);
+    if(!value) return;
+    
+    int bits = 64 - __builtin_clzll(value);
+    for(int i = 1; i < bits; i++) {
+        rc_encode_bit(rc, &model->length[context][i - 1], 1);
+    }
+    if(bits < 64) {
+        rc_encode_bit(rc, &model->length[context][bits - 1], 0);
+    }
+    // Старшият бит е ясен от дължината, останалите се пишат на порции до 16 бита
+    for(int low = bits - 1; low > 0; low -= 16) {
+        int chunk = low < 16 ? low : 16;
+        rc_encode_uniform(rc, (unsigned int)(value >> (low - chunk)) & ((1u << chunk) - 1), 1u << chunk);
+    }
+}
+
+static unsigned long long decompress_number(RcDecoder* rc, ReplayModel* model, int context) {
+    if(!rc_decode_bit(rc, &model->zero[context])) return 0;
+    
+    int bits = 1;
+    while(bits < 64 && rc_decode_bit(rc, &model->length[context][bits - 1])) {
+        bits++;
+    }
+    unsigned long long value = 1;
+    for(int low = bits - 1; low > 0; low -= 16) {
+        int chunk = low < 16 ? low : 16;
+        value = value << chunk | rc_decode_uniform(rc, 1u << chunk);
+    }
+    return value;
+}
+
+static int compress_move(RcEncoder* rc, ReplayModel* model, MoveModel* moves, int player, int cell,
+                         unsigned long long delta) {
+    Bitboard bit = (Bitboard)1 << cell;
+    Bitboard pool = ~moves->shots[player] & FULL_BOARD;
+    if(!(pool & bit)) return 0;
+    
+    rc_encode_bit(rc, &model->player[moves->player_context], player);
+    Bitboard candidates = model_candidates(moves, player);
+    if(candidates) {
+        int near = (candidates & bit) != 0;
+        rc_encode_bit(rc, &model->near[moves->last_hit[player]], near);
+        pool = near ? candidates : pool & ~candidates;
+    }
+    rc_encode_uniform(rc, (unsigned int)bitboard_count(pool & (bit - 1)), (unsigned int)bitboard_count(pool));
+    compress_number(rc, model, moves->time_context, delta);
+    
+    moves->time_context = delta ? NUMBER_TIME + 1 : NUMBER_TIME;
+    model_apply(moves, player, cell);
+    return 1;
+}
+
+// Клетката с номер rank (от 0) сред вдигнатите битове на board
+static int select_cell(Bitboard board, unsigned int rank) {
+    int base = 0;
+    unsigned long long word = (unsigned long long)board;
+    unsigned int low = (unsigned int)__builtin_popcountll(word);
+    if(rank >= low) {
+        rank -= low;
+        word = (unsigned long long)(board >> 64);
+        base = 64;
+    }
+    for(; rank > 0; rank--) {
+        word &= word - 1;
+    }
+    return base + __builtin_ctzll(word);
+}
+
+static int decompress_move(RcDecoder* rc, ReplayModel* model, MoveModel* moves, int* player, int* cell,
+                           unsigned long long* delta) {
+    *player = rc_decode_bit(rc, &model->player[moves->player_context]);
+    Bitboard pool = ~moves->shots[*player] & FULL_BOARD;
+    Bitboard candidates = model_candidates(moves, *player);
+    if(candidates) {
+        int near = rc_decode_bit(rc, &model->near[moves->last_hit[*player]]);
+        pool = near ? candidates : pool & ~candidates;
+    }
+    
+    int count = bitboard_count(pool);
+    if(count == 0) return 0;
+    *cell = select_cell(pool, rc_decode_uniform(rc, (unsigned int)count));
+    *delta = decompress_number(rc, model, moves->time_context);
+    
+    moves->time_context = *delta ? NUMBER_TIME + 1 : NUMBER_TIME;
+    model_apply(moves, *player, *cell);
+    return !rc->failed;
+}
+
+// Кодира записа BSRP в текущата версия; всичко извън формата (стари версии, повреден
+// или прекъснат запис) връща 0 и тогава записът се пази некомпресиран
+static int compress_stream(const unsigned char* data, size_t size, RcEncoder* rc) {
+    if(size < 5 || memcmp(data, REPLAY_MAGIC, 4) != 0 || data[4] != REPLAY_VERSION) return 0;
+    
+    ReplayModel model;
+    MoveModel moves;
+    model_init(&model, &moves);
+    
+    Reader reader = {data, size, 5, 0};
+    get_u32(&reader);
+    get_byte(&reader);
+    get_varint(&reader);
+    if(!decode_player(&reader, &moves.players[0], NULL) || !decode_player(&reader, &moves.players[1], NULL)) return 0;
+    get_varint(&reader);
+    if(reader.failed) return 0;
+    
+    size_t header_size = reader.pos - 5;
+    rc_put_varint(rc, header_size);
+    for(size_t i = 0; i < header_size; i++) {
+        rc_put(rc, data[5 + i]);
+    }
+    
+    // Броят ходове трябва предварително - първо се преброяват
+    unsigned long long move_count = 0;
+    size_t records = reader.pos;
+    while(reader.pos < reader.size) {
+        unsigned char byte = get_byte(&reader);
+        if(byte == RECORD_END) break;
+        if(byte == RECORD_KEYFRAME) {
+            if(move_count == 0 || move_count % KEYFRAME_INTERVAL != 0) return 0;
+            reader.pos += 2 * BITBOARD_BYTES;
+            continue;
+        }
+        get_varint(&reader);
+        move_count++;
+    }
+    if(reader.failed || reader.pos > reader.size) return 0;
+    compress_number(rc, &model, NUMBER_SIZE, move_count);
+    
+    reader.pos = records;
+    int finished = 0;
+    while(reader.pos < reader.size) {
+        unsigned char byte = get_byte(&reader);
+        if(byte == RECORD_END) {
+            int has_end = get_byte(&reader);
+            unsigned long long delta = get_varint(&reader);
+            if(has_end > 1 || reader.failed || reader.pos != reader.size) return 0;
+            rc_encode_bit(rc, &model.end[0], 1);
+            rc_encode_bit(rc, &model.end[1], has_end);
+            compress_number(rc, &model, NUMBER_END, delta);
+            finished = 1;
+            break;
+        }
+        if(byte == RECORD_KEYFRAME) {
+            reader.pos += 2 * BITBOARD_BYTES;
+            continue;
+        }
+        unsigned long long delta = get_varint(&reader);
+        if((byte & 0x7f) >= BOARD_CELLS || !compress_move(rc, &model, &moves, byte >> 7, byte & 0x7f, delta)) {
+            return 0;
+        }
+    }
+    if(!finished) {
+        rc_encode_bit(rc, &model.end[0], 0);
+    }
+    return rc_encoder_finish(rc);
+}
+
+// Разкомпресира в buffer - точно същите байтове като оригиналния запис BSRP
+static int decompress_stream(const unsigned char* data, size_t size, Buffer* buffer) {
+    ReplayModel model;
+    MoveModel moves;
+    model_init(&model, &moves);
+    
+    Reader input = {data, size, 0, 0};
+    unsigned long long header_size = get_varint(&input);
+    if(input.failed || header_size > size - input.pos) return 0;
+    for(int i = 0; i < 4; i++) {
+        put_byte(buffer, (unsigned char)REPLAY_MAGIC[i]);
+    }
+    put_byte(buffer, REPLAY_VERSION);
+    for(unsigned long long i = 0; i < header_size; i++) {
+        put_byte(buffer, data[input.pos + i]);
+    }
+    if(buffer->failed) return 0;
+    
+    // Корабите трябват на модела, за да знае кой изстрел е попадение
+    Reader reader = {buffer->data, buffer->size, 5, 0};
+    get_u32(&reader);
+    get_byte(&reader);
+    get_varint(&reader);
+    if(!decode_player(&reader, &moves.players[0], NULL) || !decode_player(&reader, &moves.players[1], NULL)) return 0;
+    get_varint(&reader);
+    if(reader.failed || reader.pos != reader.size) return 0;
+    
+    RcDecoder rc;
+    rc_decoder_init(&rc, data + input.pos + header_size, size - input.pos - header_size);
+    
+    unsigned long long move_count = decompress_number(&rc, &model, NUMBER_SIZE);
+    if(move_count > 2 * BOARD_CELLS) return 0;
+    for(unsigned long long i = 0; i < move_count; i++) {
+        int player, cell;
+        unsigned long long delta;
+        if(!decompress_move(&rc, &model, &moves, &player, &cell, &delta)) return 0;
+        put_byte(buffer, (unsigned char)(cell | player << 7));
+        put_varint(buffer, delta);
+        if((i + 1) % KEYFRAME_INTERVAL == 0) {
+            put_byte(buffer, RECORD_KEYFRAME);
+            put_bitboard(buffer, moves.shots[0]);
+            put_bitboard(buffer, moves.shots[1]);
+        }
+    }
+    
+    if(rc_decode_bit(&rc, &model.end[0])) {
+        put_byte(buffer, RECORD_END);
+        put_byte(buffer, (unsigned char)rc_decode_bit(&rc, &model.end[1]));
+        put_varint(buffer, decompress_number(&rc, &model, NUMBER_END));
+    }
+    return !rc.failed && !buffer->failed;
+}
+
+int replay_compress(const unsigned char* data, size_t size, unsigned char** compressed, size_t* compressed_size) {
+    RcEncoder rc;
+    rc_encoder_init(&rc);
+    for(int i = 0; i < 4; i++) {
+        rc_put(&rc, (unsigned char)COMPRESSED_MAGIC[i]);
+    }
+    rc_put(&rc, COMPRESSED_VERSION);
+    rc_put_varint(&rc, size);
+    size_t prefix = rc.size;
+    
+    if(!compress_stream(data, size, &rc)) {
+        free(rc.data);
+        return 0;
+    }
+    
+    // Кодерът се проверява веднага - запис, който не се връща същият, остава некомпресиран
+    Buffer check;
+    memset(&check, 0, sizeof(check));
+    int ok = decompress_stream(rc.data + prefix, rc.size - prefix, &check) &&
+             check.size == size && memcmp(check.data, data, size) == 0;
+    free(check.data);
+    if(!ok) {
+        free(rc.data);
+        return 0;
+    }
+    
+    *compressed = rc.data;
+    *compressed_size = rc.size;
+    return 1;
+}
+
+// Размерът на разкомпресирания запис от заглавната част на контейнера (0 - не е BSRZ)
+static size_t compressed_original_size(const unsigned char* data, size_t size, size_t* payload) {
+    *payload = 0;
+    if(size < 6 || memcmp(data, COMPRESSED_MAGIC, 4) != 0 || data[4] != COMPRESSED_VERSION) return 0;
+    Reader reader = {data, size, 5, 0};
+    unsigned long long original = get_varint(&reader);
+    if(reader.failed || original < 5 || original > (unsigned long long)size * 64 + 4096) return 0;
+    *payload = reader.pos;
+    return (size_t)original;
+}
+
+// into трябва да събере точно original байта - иначе разкомпресирането е неуспешно
+static int decompress_into(const unsigned char* data, size_t size, unsigned char* into, size_t original) {
+    size_t payload;
+    if(compressed_original_size(data, size, &payload) != original) return 0;
+    
+    Buffer buffer = {into, 0, original, 0, 1};
+    return decompress_stream(data + payload, size - payload, &buffer) && buffer.size == original;
+}
+
+int replay_encode_compressed(const GameReplay* replay, unsigned char** data, size_t* size) {
+    unsigned char* plain;
+    size_t plain_size;
+    if(!replay_encode(replay, &plain, &plain_size)) {
+        return 0;
+    }
+    
+    if(replay_compress(plain, plain_size, data, size)) {
+        free(plain);
+    } else {
+        *data = plain;
+        *size = plain_size;
+    }
+    return 1;
+}
+
+static int decode(const unsigned char* data, size_t size, GameReplay* replay, int recover, int* complete) {
+    memset(replay, 0, sizeof(GameReplay));
+    
+    int ok;
+    *complete = 1;
+    size_t payload;
+    size_t original = compressed_original_size(data, size, &payload);
+    if(original) {
+        unsigned char* plain = malloc(original);
+        ok = plain && decompress_into(data, size, plain, original);
+        if(ok) {
+            Reader reader = {plain, original, 4, 0};
+            ok = decode_compact(&reader, replay, recover, complete);
+        }
+        free(plain);
+    } else if(size >= 4 && memcmp(data, REPLAY_MAGIC, 4) == 0) {
+        Reader reader = {data, size, 4, 0};
+        ok = decode_compact(&reader, replay, recover, complete);
+    } else {
+        ok = decode_legacy(data, size, replay);
+    }
+    
+    if(!ok) {
+        free_replay(replay);
+    }
+    return ok;
+}
+
+int replay_decode(const unsigned char* data, size_t size, GameReplay* replay) {
+    int complete;
+    return decode(data, size, replay, 0, &complete);
+}
+
+int replay_save(const char* filename, const GameReplay* replay) {
+    unsigned char* data;
+    size_t size;
+    if(!replay_encode(replay, &data, &size)) {
+        return 0;
+    }
+    
+    FILE* file = fopen(filename, "wb");
+    if(!file) {
+        free(data);
+        return 0;
+    }
+    
+    int ok = fwrite(data, 1, size, file) == size;
+    if(fclose(file) != 0) {
+        ok = 0;
+    }
+    free(data);
+    return ok;
+}
+
+// Записите са малки - четат се наведнъж
+static unsigned char* read_file(const char* filename, size_t* size) {
+    FILE* file = fopen(filename, "rb");
+    if(!file) {
+        return NULL;
+    }
+    
+    long length = -1;
+    if(fseek(file, 0, SEEK_END) == 0) {
+        length = ftell(file);
+        rewind(file);
+    }
+    unsigned char* data = length >= 0 ? malloc(length ? length : 1) : NULL;
+    if(data && fread(data, 1, length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    
+    *size = (size_t)length;
+    return data;
+}
+
+int replay_load(const char* filename, GameReplay* replay) {
+    size_t size;
+    unsigned char* data = read_file(filename, &size);
+    if(!data) {
+        return 0;
+    }
+    
+    int ok = replay_decode(data, size, replay);
+    free(data);
+    return ok;
+}
+
+int replay_recover(const char* filename, GameReplay* replay, int* complete) {
+    size_t size;
+    unsigned char* data = read_file(filename, &size);
+    if(!data) {
+        return 0;
+    }
+    
+    int ok = replay_recover_data(data, size, replay, complete);
+    free(data);
+    return ok;
+}
+
+int replay_recover_data(const unsigned char* data, size_t size, GameReplay* replay, int* complete) {
+    return decode(data, size, replay, 1, complete);
+}
+
+// Поточният запис: ходовете се събират в batch и се изпращат към файла на порции.
+// На всеки sync_every хода (0 - никога) данните се изпращат и към диска с fdatasync.
+struct ReplayWriter {
+    FILE* file;
+    Buffer batch;
+    char path[512];
+    char part_path[520];
+    Encoder encoder;
+    SealedFile* sealed;
+    int sync_every;
+    int unsynced;
+    int started;
+    int finished;
+    int failed;
+};
+
+static void writer_flush(ReplayWriter* writer) {
+    if(writer->batch.failed) {
+        writer->failed = 1;
+    }
+    if(writer->sealed) {
+        if(writer->batch.size && !seal_write(writer->sealed, writer->batch.data, writer->batch.size)) {
+            writer->failed = 1;
+        }
+    } else if(writer->batch.size && fwrite(writer->batch.data, 1, writer->batch.size, writer->file) != writer->batch.size) {
+        writer->failed = 1;
+    }
+    writer->batch.size = 0;
+    writer->batch.failed = 0;
+}
+
+static void writer_sync(ReplayWriter* writer) {
+    writer_flush(writer);
+    if(writer->sealed && !seal_flush(writer->sealed)) {
+        writer->failed = 1;
+    }
+    if(fflush(writer->file) != 0) {
+        writer->failed = 1;
+    }
+    #ifdef _WIN32
+        if(_commit(_fileno(writer->file)) != 0) writer->failed = 1;
+    #else
+        if(fdatasync(fileno(writer->file)) != 0) writer->failed = 1;
+    #endif
+    writer->unsynced = 0;
+}
+
+ReplayWriter* replay_writer_open(const char* filename, int sync_every) {
+    ReplayWriter* writer = calloc(1, sizeof(ReplayWriter));
+    if(!writer) {
+        return NULL;
+    }
+    snprintf(writer->path, sizeof(writer->path), "%s", filename);
+    snprintf(writer->part_path, sizeof(writer->part_path), "%s.part", filename);
+    writer->sync_every = sync_every;
+    
+    // Буферът на stdio се изключва - порциите се събират в batch
+    writer->file = fopen(writer->part_path, "wb");
+    if(!writer->file) {
+        free(writer);
+        return NULL;
+    }
+    setvbuf(writer->file, NULL, _IONBF, 0);
+    return writer;
+}
+
+ReplayWriter* replay_writer_open_sealed(const char* filename, int sync_every, const unsigned char* key,
+                                       const SealKdf* kdf, const unsigned char* wrapped) {
+    ReplayWriter* writer = calloc(1, sizeof(ReplayWriter));
+    SealedFile* sealed = malloc(sizeof(SealedFile));
+    if(!writer || !sealed) {
+        free(writer);
+        free(sealed);
+        return NULL;
+    }
+    snprintf(writer->path, sizeof(writer->path), "%s", filename);
+    snprintf(writer->part_path, sizeof(writer->part_path), "%s.part", filename);
+    writer->sync_every = sync_every;
+    
+    if(!seal_create(sealed, writer->part_path, key, kdf, wrapped)) {
+        free(sealed);
+        free(writer);
+        return NULL;
+    }
+    writer->sealed = sealed;
+    writer->file = sealed->file;
+    return writer;
+}
+
+const char* replay_writer_path(const ReplayWriter* writer) {
+    return writer->path;
+}
+
+void replay_writer_begin(ReplayWriter* writer, const GameReplay* replay) {
+    if(writer->started) return;
+    writer->encoder.previous = encode_header(&writer->batch, replay, REPLAY_OPEN_COUNT, 0);
+    writer->started = 1;
+    writer_flush(writer);
+}
+
+void replay_writer_append(ReplayWriter* writer, const Move* move) {
+    if(!writer->started || writer->finished) return;
+    
+    encode_move(&writer->batch, &writer->encoder, move);
+    if(writer->batch.size >= BATCH_SIZE) {
+        writer_flush(writer);
+    }
+    if(writer->sync_every && ++writer->unsynced >= writer->sync_every) {
+        writer_sync(writer);
+    }
+}
+
+// Последен запис и попълване на броя ходове и победителя в заглавната част
+void replay_writer_finish(ReplayWriter* writer, const GameReplay* replay) {
+    if(!writer->started || writer->finished) return;
+    
+    encode_end(&writer->batch, &writer->encoder, replay);
+    writer_flush(writer);
+    
+    Buffer patch;
+    memset(&patch, 0, sizeof(patch));
+    put_u32(&patch, (unsigned int)replay->move_count);
+    put_byte(&patch, (unsigned char)replay->winner_index);
+    if(writer->sealed) {
+        if(patch.failed || !seal_patch(writer->sealed, COUNT_OFFSET, patch.data, patch.size)) {
+            writer->failed = 1;
+        }
+    } else if(patch.failed || fseek(writer->file, COUNT_OFFSET, SEEK_SET) != 0 ||
+              fwrite(patch.data, 1, patch.size, writer->file) != patch.size || fseek(writer->file, 0, SEEK_END) != 0) {
+        writer->failed = 1;
+    }
+    free(patch.data);
+    
+    if(writer->sync_every) {
+        writer_sync(writer);
+    }
+    writer->finished = 1;
+}
+
+static int writer_close_file(ReplayWriter* writer) {
+    writer_flush(writer);
+    int ok;
+    if(writer->sealed) {
+        ok = seal_close(writer->sealed) && !writer->failed;
+        free(writer->sealed);
+    } else {
+        ok = fclose(writer->file) == 0 && !writer->failed;
+    }
+    return ok;
+}
+
+int replay_writer_close(ReplayWriter* writer, int keep) {
+    int ok = writer_close_file(writer);
+    
+    // Незавършен запис остава като .part, за да може да се възстанови
+    if(!keep) {
+        remove(writer->part_path);
+    } else if(writer->finished && ok) {
+        ok = rename(writer->part_path, writer->path) == 0;
+    } else {
+        ok = 0;
+    }
+    
+    free(writer->batch.data);
+    free(writer);
+    return ok;
+}
+
+int replay_writer_abandon(ReplayWriter* writer) {
+    int ok = writer_close_file(writer);
+    free(writer->batch.data);
+    free(writer);
+    return ok;
+}
+
+static void* map_alloc(ReplayMap* map, size_t size) {
+    return map->arena ? arena_alloc(map->arena, size) : malloc(size);
+}
+
+// Обхожда записите веднъж и запомня къде започва всеки ход и всеки ключов кадър
+static int map_index(ReplayMap* map) {
+    Reader reader = {map->data, map->size, 5, 0};
+    unsigned int move_count = get_u32(&reader);
+    int winner = get_byte(&reader);
+    map->seed = get_varint(&reader);
+    if(!decode_player(&reader, &map->player1_initial, &map->ai[0]) ||
+       !decode_player(&reader, &map->player2_initial, &map->ai[1]) || winner > 2) {
+        return 0;
+    }
+    map->winner_index = winner;
+    if(winner) {
+        strcpy(map->winner, winner == 1 ? map->player1_initial.name : map->player2_initial.name);
+    }
+    
+    unsigned long long start = get_varint(&reader);
+    if(reader.failed) return 0;
+    
+    // Всеки ход заема поне 2 байта, затова индексът се заделя наведнъж за най-лошия случай
+    size_t move_capacity = (reader.size - reader.pos) / 2 + 1;
+    map->moves = map_alloc(map, move_capacity * sizeof(MoveIndex));
+    map->keyframes = map_alloc(map, (move_capacity / KEYFRAME_INTERVAL + 1) * sizeof(size_t));
+    if(!map->moves || !map->keyframes) return 0;
+    
+    long long previous = start ? (long long)(start - 1) : 0;
+    map->has_start = start != 0;
+    if(start) {
+        replay_format_time(previous, map->start_time);
+    }
+    
+    int finished = 0;
+    while(reader.pos < reader.size) {
+        size_t offset = reader.pos;
+        unsigned char byte = get_byte(&reader);
+        
+        if(byte == RECORD_END) {
+            int has_end = get_byte(&reader);
+            long long end = previous + get_signed(&reader);
+            finished = !reader.failed;
+            if(finished && has_end) {
+                replay_format_time(end, map->end_time);
+            }
+            break;
+        }
+        if(byte == RECORD_KEYFRAME) {
+            if(reader.size - reader.pos < 2 * BITBOARD_BYTES ||
+               map->move_count != (map->keyframe_count + 1) * KEYFRAME_INTERVAL) {
+                break;
+            }
+            map->keyframes[map->keyframe_count++] = reader.pos;
+            reader.pos += 2 * BITBOARD_BYTES;
+            continue;
+        }
+        
+        long long stamp = previous + get_signed(&reader);
+        if((byte & 0x7f) >= BOARD_CELLS || reader.failed) break;
+        map->moves[map->move_count].offset = offset;
+        map->moves[map->move_count].time = stamp;
+        map->move_count++;
+        previous = stamp;
+    }
+    
+    map->complete = finished && move_count == (unsigned int)map->move_count;
+    return 1;
+}
+
+// Стари записи се превеждат в текущия формат в паметта
+static int map_convert(ReplayMap* map, const unsigned char* data, size_t size) {
+    GameReplay replay;
+    if(!replay_decode(data, size, &replay)) {
+        return 0;
+    }
+    
+    unsigned char* encoded;
+    size_t encoded_size;
+    int ok = replay_encode(&replay, &encoded, &encoded_size);
+    free_replay(&replay);
+    if(!ok) {
+        return 0;
+    }
+    
+    map->owned = encoded;
+    map->data = encoded;
+    map->size = encoded_size;
+    return 1;
+}
+
+static int map_setup(ReplayMap* map, const unsigned char* data, size_t size) {
+    map->data = data;
+    map->size = size;
+    
+    // Компресираният запис се разкомпресира в паметта (в арената, ако има такава)
+    int ok = 1;
+    size_t payload;
+    size_t original = compressed_original_size(data, size, &payload);
+    if(original) {
+        unsigned char* plain = map_alloc(map, original);
+        ok = plain && decompress_into(data, size, plain, original);
+        if(plain && !map->arena) {
+            map->owned = plain;
+        }
+        map->data = plain;
+        map->size = original;
+    } else if(size < 5 || memcmp(data, REPLAY_MAGIC, 4) != 0 || data[4] < 2 || data[4] > REPLAY_VERSION) {
+        ok = map_convert(map, data, size);
+    }
+    ok = ok && map_index(map);
+    
+    if(!ok) {
+        replay_map_close(map);
+    }
+    return ok;
+}
+
+int replay_map_open(ReplayMap* map, const char* filename) {
+    return replay_map_open_in(map, filename, NULL);
+}
+
+int replay_map_open_in(ReplayMap* map, const char* filename, Arena* arena) {
+    memset(map, 0, sizeof(ReplayMap));
+    map->arena = arena;
+    
+    #ifdef _WIN32
+        size_t size;
+        unsigned char* data = read_file(filename, &size);
+        if(!data) return 0;
+        map->owned = data;
+    #else
+        int fd = open(filename, O_RDONLY);
+        if(fd < 0) return 0;
+        struct stat info;
+        if(fstat(fd, &info) != 0 || info.st_size == 0) {
+            close(fd);
+            return 0;
+        }
+        size_t size = (size_t)info.st_size;
+        const unsigned char* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(data == MAP_FAILED) return 0;
+        map->mapped = (void*)data;
+        map->mapped_size = size;
+    #endif
+    
+    return map_setup(map, data, size);
+}
+
+int replay_map_view(ReplayMap* map, const unsigned char* data, size_t size, Arena* arena) {
+    memset(map, 0, sizeof(ReplayMap));
+    map->arena = arena;
+    return map_setup(map, data, size);
+}
+
+void replay_map_close(ReplayMap* map) {
+    #ifndef _WIN32
+        if(map->mapped) {
+            munmap(map->mapped, map->mapped_size);
+        }
+    #endif
+    free(map->owned);
+    if(!map->arena) {
+        free(map->moves);
+        free(map->keyframes);
+    }
+    memset(map, 0, sizeof(ReplayMap));
+}
+
+// Изстрелите на двамата играчи след първите count хода - от най-близкия ключов кадър нататък
+static void map_shots(const ReplayMap* map, int count, Bitboard shots[2]) {
+    int keyframe = count / KEYFRAME_INTERVAL;
+    if(keyframe > map->keyframe_count) keyframe = map->keyframe_count;
+    
+    shots[0] = shots[1] = 0;
+    if(keyframe > 0) {
+        const unsigned char* frame = map->data + map->keyframes[keyframe - 1];
+        shots[0] = read_bitboard(frame);
+        shots[1] = read_bitboard(frame + BITBOARD_BYTES);
+    }
+    for(int i = keyframe * KEYFRAME_INTERVAL; i < count; i++) {
+        unsigned char byte = map->data[map->moves[i].offset];
+        shots[byte >> 7] |= (Bitboard)1 << (byte & 0x7f);
+    }
+}
+
+void replay_map_move(const ReplayMap* map, int index, Move* move) {
+    unsigned char byte = map->data[map->moves[index].offset];
+    int cell = byte & 0x7f;
+    int player = byte >> 7;
+    const Player* attacker = player ? &map->player2_initial : &map->player1_initial;
+    const Player* defender = player ? &map->player1_initial : &map->player2_initial;
+    
+    memset(move, 0, sizeof(Move));
+    strcpy(move->player_name, attacker->name);
+    move->player = player;
+    move->row = cell / BOARD_SIZE;
+    move->col = cell % BOARD_SIZE;
+    if(map->has_start) {
+        replay_format_time(map->moves[index].time, move->timestamp);
+    }
+    
+    int ship = defender->ship_at[cell];
+    if(ship) {
+        Bitboard shots[2];
+        map_shots(map, index + 1, shots);
+        move->hit = 1;
+        move->ship_length = defender->ships[ship - 1].length;
+        move->ship_sunk = (defender->ships[ship - 1].mask & ~shots[player]) == 0;
+    }
+}
+
+static void map_apply(Player* player, Bitboard shots, Player* opponent) {
+    player->hit_mask = shots & opponent->ship_mask;
+    player->miss_mask = shots & ~opponent->ship_mask;
+    opponent->damage_mask = player->hit_mask;
+    
+    opponent->ships_sunk = 0;
+    for(int i = 0; i < opponent->ship_count; i++) {
+        Ship* ship = &opponent->ships[i];
+        ship->hits = bitboard_count(ship->mask & opponent->damage_mask);
+        ship->sunk = ship->hits == ship->length;
+        opponent->ships_sunk += ship->sunk;
+    }
+}
+
+void replay_map_board(const ReplayMap* map, int count, Player* first, Player* second) {
+    Bitboard shots[2];
+    map_shots(map, count, shots);
+    
+    *first = map->player1_initial;
+    *second = map->player2_initial;
+    map_apply(first, shots[0], second);
+    map_apply(second, shots[1], first);
+}
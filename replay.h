@@ -0,0 +1,103 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stddef.h>
+#include "engine.h"
+#include "arena.h"
+#include "seal.h"
+
+// Четене и запис на файл със запис на игра (.replay).
+// Записва се компактният формат BSRP, а се четат и старите записи със сурова структура.
+int replay_save(const char* filename, const GameReplay* replay);
+int replay_load(const char* filename, GameReplay* replay);
+
+// Успешно заредените записи се освобождават с free_replay.
+// Кодиране в паметта - за криптираните записи. data се освобождава с free.
+int replay_encode(const GameReplay* replay, unsigned char** data, size_t* size);
+int replay_decode(const unsigned char* data, size_t size, GameReplay* replay);
+
+// Компресиран запис (BSRZ) - за архивиране в пакети. Всички функции за четене го приемат.
+// replay_compress връща 0, ако записът не може да се компресира (стар или незавършен формат);
+// replay_encode_compressed тогава връща некомпресирания запис.
+int replay_compress(const unsigned char* data, size_t size, unsigned char** compressed, size_t* compressed_size);
+int replay_encode_compressed(const GameReplay* replay, unsigned char** data, size_t* size);
+
+// Чете и незавършен поточен запис (.part) до последния цял ход; complete е 0, ако играта не е завършила
+int replay_recover(const char* filename, GameReplay* replay, int* complete);
+// Същото за запис в паметта (например разкриптиран криптиран .part)
+int replay_recover_data(const unsigned char* data, size_t size, GameReplay* replay, int* complete);
+
+// Поточен запис: файлът filename.part се отваря преди играта, заглавната част се записва
+// при engine_start, всеки ход - при add_move_to_replay, а броят ходове и победителят се
+// попълват в края на играта. close с keep преименува завършения запис на filename,
+// без keep го изтрива. sync_every е през колко хода да се вика fdatasync (0 - само без sync).
+ReplayWriter* replay_writer_open(const char* filename, int sync_every);
+// Същото, но файлът е криптиран на парчета (seal.h) - всеки ход се криптира още при добавянето
+// kdf и wrapped са от keyring_new_key
+ReplayWriter* replay_writer_open_sealed(const char* filename, int sync_every, const unsigned char* key,
+                                       const SealKdf* kdf, const unsigned char* wrapped);
+const char* replay_writer_path(const ReplayWriter* writer);
+void replay_writer_begin(ReplayWriter* writer, const GameReplay* replay);
+void replay_writer_append(ReplayWriter* writer, const Move* move);
+void replay_writer_finish(ReplayWriter* writer, const GameReplay* replay);
+int replay_writer_close(ReplayWriter* writer, int keep);
+// Затваря файла и оставя filename.part на диска - за battleships-recover, когато записът
+// не може да се запази по друг начин
+int replay_writer_abandon(ReplayWriter* writer);
+
+// Запис, отворен с mmap: ходовете се четат направо от файла, без копиране.
+// Индексът пази мястото и времето на всеки ход, а ключовите кадри във файла - изстрелите
+// през 64 хода, затова дъската при произволен ход се възстановява от най-близкия кадър.
+// Стари записи се превеждат в паметта; незавършен поточен запис се чете до последния цял ход.
+typedef struct {
+    long long time;
+    size_t offset;
+} MoveIndex;
+
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    void* mapped;
+    size_t mapped_size;
+    void* owned;
+    Player player1_initial;
+    Player player2_initial;
+    unsigned long long seed;
+    AISettings ai[2];
+    char winner[32];
+    int winner_index;
+    char start_time[30];
+    char end_time[30];
+    int has_start;
+    int complete;
+    MoveIndex* moves;
+    int move_count;
+    size_t* keyframes;
+    int keyframe_count;
+    Arena* arena;
+} ReplayMap;
+
+int replay_map_open(ReplayMap* map, const char* filename);
+// Индексът се заделя в arena вместо с malloc - за обхождане на много записи от една нишка
+int replay_map_open_in(ReplayMap* map, const char* filename, Arena* arena);
+// Запис, който вече е в паметта (например част от пакет) - data трябва да живее до close
+int replay_map_view(ReplayMap* map, const unsigned char* data, size_t size, Arena* arena);
+void replay_map_close(ReplayMap* map);
+void replay_map_move(const ReplayMap* map, int index, Move* move);
+// Дъските на двамата играчи след първите count хода
+void replay_map_board(const ReplayMap* map, int count, Player* first, Player* second);
+
+// Клетката и играчът (0 или 1) на хода index, без да се изчислява попадението
+static inline int replay_map_cell(const ReplayMap* map, int index) {
+    return map->data[map->moves[index].offset] & 0x7f;
+}
+
+static inline int replay_map_player(const ReplayMap* map, int index) {
+    return map->data[map->moves[index].offset] >> 7;
+}
+
+// Време във вид "YYYY-MM-DD HH:MM:SS" като секунди от 1970 г. (-1 при грешка) и обратно
+long long replay_parse_time(const char* text);
+void replay_format_time(long long seconds, char* buffer);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef RNG_H
+#define RNG_H
+
+// Малък бърз генератор xoshiro256** - всяка нишка или игра държи собствено състояние
+typedef struct {
+    unsigned long long s[4];
+} Rng;
+
+static inline unsigned long long rng_splitmix(unsigned long long* x) {
+    unsigned long long z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Различните потоци се получават от един seed и номер на потока
+static inline void rng_seed(Rng* rng, unsigned long long seed, unsigned long long stream) {
+    unsigned long long x = seed ^ (stream * 0xd1342543de82ef95ULL);
+    for(int i = 0; i < 4; i++) {
+        rng->s[i] = rng_splitmix(&x);
+    }
+}
+
+static inline unsigned long long rng_next(Rng* rng) {
+    unsigned long long* s = rng->s;
+    unsigned long long x = s[1] * 5;
+    unsigned long long result = ((x << 7) | (x >> 57)) * 9;
+    unsigned long long t = s[1] << 17;
+    
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+    
+    return result;
+}
+
+// Равномерно число в [0, bound) без изместване (метод на Лемир)
+static inline unsigned int rng_below(Rng* rng, unsigned int bound) {
+    unsigned long long product = (rng_next(rng) >> 32) * bound;
+    unsigned int low = (unsigned int)product;
+    
+    if(low < bound) {
+        unsigned int threshold = -bound % bound;
+        while(low < threshold) {
+            product = (rng_next(rng) >> 32) * bound;
+            low = (unsigned int)product;
+        }
+    }
+    return (unsigned int)(product >> 32);
+}
+
+#endif
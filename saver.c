@@ -0,0 +1,132 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "saver.h"
+
+typedef struct {
+    SaverJob job;
+    SaverDone done;
+    void* data;
+    int ok;
+} SaverTask;
+
+// Задачите са в кръгов буфер по реда на подаване. Броячите само растат:
+// [delivered, finished) са готови за съобщаване, [finished, started) се изпълнява,
+// [started, submitted) чакат фоновата нишка.
+struct Saver {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_t thread;
+    SaverTask tasks[SAVER_CAPACITY];
+    long long submitted;
+    long long started;
+    long long finished;
+    long long delivered;
+    int stopping;
+};
+
+static void* saver_worker(void* arg) {
+    Saver* saver = arg;
+    
+    pthread_mutex_lock(&saver->lock);
+    while(1) {
+        while(saver->started == saver->submitted && !saver->stopping) {
+            pthread_cond_wait(&saver->changed, &saver->lock);
+        }
+        if(saver->started == saver->submitted) break;
+        
+        SaverTask* task = &saver->tasks[saver->started++ % SAVER_CAPACITY];
+        pthread_mutex_unlock(&saver->lock);
+        int ok = task->job(task->data);
+        pthread_mutex_lock(&saver->lock);
+        
+        task->ok = ok;
+        saver->finished++;
+        pthread_cond_broadcast(&saver->changed);
+    }
+    pthread_mutex_unlock(&saver->lock);
+    return NULL;
+}
+
+// Вика се с взета ключалка; done се изпълнява без нея, за да може да подаде нова задача
+static void saver_deliver(Saver* saver) {
+    while(saver->delivered < saver->finished) {
+        SaverTask task = saver->tasks[saver->delivered++ % SAVER_CAPACITY];
+        pthread_mutex_unlock(&saver->lock);
+        task.done(task.data, task.ok);
+        pthread_mutex_lock(&saver->lock);
+    }
+}
+
+Saver* saver_start(void) {
+    Saver* saver = calloc(1, sizeof(Saver));
+    if(!saver) return NULL;
+    
+    pthread_mutex_init(&saver->lock, NULL);
+    pthread_cond_init(&saver->changed, NULL);
+    if(pthread_create(&saver->thread, NULL, saver_worker, saver) != 0) {
+        pthread_cond_destroy(&saver->changed);
+        pthread_mutex_destroy(&saver->lock);
+        free(saver);
+        return NULL;
+    }
+    return saver;
+}
+
+void saver_submit(Saver* saver, SaverJob job, SaverDone done, void* data) {
+    if(!saver) {
+        done(data, job(data));
+        return;
+    }
+    
+    pthread_mutex_lock(&saver->lock);
+    saver_deliver(saver);
+    while(saver->submitted - saver->delivered == SAVER_CAPACITY) {
+        pthread_cond_wait(&saver->changed, &saver->lock);
+        saver_deliver(saver);
+    }
+    
+    SaverTask* task = &saver->tasks[saver->submitted++ % SAVER_CAPACITY];
+    task->job = job;
+    task->done = done;
+    task->data = data;
+    task->ok = 0;
+    pthread_cond_broadcast(&saver->changed);
+    pthread_mutex_unlock(&saver->lock);
+}
+
+void saver_poll(Saver* saver) {
+    if(!saver) return;
+    
+    pthread_mutex_lock(&saver->lock);
+    saver_deliver(saver);
+    pthread_mutex_unlock(&saver->lock);
+}
+
+void saver_flush(Saver* saver) {
+    if(!saver) return;
+    
+    pthread_mutex_lock(&saver->lock);
+    saver_deliver(saver);
+    while(saver->delivered < saver->submitted) {
+        pthread_cond_wait(&saver->changed, &saver->lock);
+        saver_deliver(saver);
+    }
+    pthread_mutex_unlock(&saver->lock);
+}
+
+void saver_stop(Saver* saver) {
+    if(!saver) return;
+    
+    saver_flush(saver);
+    pthread_mutex_lock(&saver->lock);
+    saver->stopping = 1;
+    pthread_cond_broadcast(&saver->changed);
+    pthread_mutex_unlock(&saver->lock);
+    
+    pthread_join(saver->thread, NULL);
+    pthread_cond_destroy(&saver->changed);
+    pthread_mutex_destroy(&saver->lock);
+    free(saver);
+}
@@ -0,0 +1,28 @@
+#ifndef SAVER_H
+#define SAVER_H
+
+// Фонова нишка за запазване: задачите (запис на диска, криптиране) се изпълняват една след
+// друга в отделна нишка, а нишката на играта само ги подава и продължава.
+// Опашката е ограничена - saver_submit чака само ако вече има SAVER_CAPACITY незавършени задачи.
+// Резултатът на всяка задача се съобщава с done в нишката, която вика saver_poll или
+// saver_flush, затова done може спокойно да печата и да освобождава данните на задачата.
+#define SAVER_CAPACITY 8
+
+typedef struct Saver Saver;
+
+// Изпълнява се във фоновата нишка; връща 0 при грешка
+typedef int (*SaverJob)(void* data);
+// Изпълнява се в нишката на играта с резултата на job
+typedef void (*SaverDone)(void* data, int ok);
+
+// NULL, ако нишката не може да се създаде - тогава задачите се изпълняват веднага при подаване
+Saver* saver_start(void);
+void saver_submit(Saver* saver, SaverJob job, SaverDone done, void* data);
+// Съобщава завършените задачи, без да чака останалите
+void saver_poll(Saver* saver);
+// Изчаква всички подадени задачи и съобщава резултатите им
+void saver_flush(Saver* saver);
+// saver_flush и спиране на нишката
+void saver_stop(Saver* saver);
+
+#endif
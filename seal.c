@@ -0,0 +1,334 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <openssl/rand.h>
+#include "seal.h"
+
+// Формат (числата са little-endian):
+//   "BSEC" байт версия, 4 байта размер на парче,
+//   алгоритъм (байт) и брой итерации (4 байта) - от версия 3,
+//   salt, опакованият ключ - от версия 2
+//   парчета: nonce (12 байта), криптираните данни, tag (16 байта)
+// Всички парчета без последното са пълни, затова парче i е на фиксирано място.
+// Допълнителните данни към всяко парче са заглавната част, номерът му (8 байта) и байт
+// дали е последно. Незавършеното парче се презаписва на мястото си с нов nonce.
+#define SEAL_RECORD_SIZE (SEAL_NONCE_SIZE + SEAL_CHUNK_SIZE + SEAL_TAG_SIZE)
+#define SEAL_AAD_SIZE (SEAL_HEADER_SIZE + 8 + 1)
+#define SEAL_HEADER_V1 (4 + 1 + 4 + SEAL_SALT_SIZE)
+#define SEAL_HEADER_V2 (SEAL_HEADER_V1 + SEAL_WRAPPED_SIZE)
+
+static void put_u32(unsigned char* data, unsigned int value) {
+    for(int i = 0; i < 4; i++) {
+        data[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static unsigned int get_u32(const unsigned char* data) {
+    unsigned int value = 0;
+    for(int i = 0; i < 4; i++) {
+        value |= (unsigned int)data[i] << (8 * i);
+    }
+    return value;
+}
+
+static int seal_seek(FILE* file, unsigned long long offset) {
+    #ifdef _WIN32
+        return _fseeki64(file, (long long)offset, SEEK_SET) == 0;
+    #else
+        return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+    #endif
+}
+
+static unsigned long long seal_file_size(FILE* file) {
+    #ifdef _WIN32
+        if(_fseeki64(file, 0, SEEK_END) != 0) return 0;
+        long long size = _ftelli64(file);
+    #else
+        if(fseeko(file, 0, SEEK_END) != 0) return 0;
+        off_t size = ftello(file);
+    #endif
+    return size > 0 ? (unsigned long long)size : 0;
+}
+
+static unsigned long long chunk_offset(const SealedFile* sealed, unsigned long long index) {
+    return sealed->header_size + index * SEAL_RECORD_SIZE;
+}
+
+// Връща размера на допълнителните данни - заглавната част, номерът и байтът за последно парче
+static int chunk_aad(const SealedFile* sealed, unsigned long long index, int final, unsigned char* aad) {
+    size_t size = sealed->header_size;
+    memcpy(aad, sealed->header, size);
+    for(int i = 0; i < 8; i++) {
+        aad[size + i] = (unsigned char)(index >> (8 * i));
+    }
+    aad[size + 8] = (unsigned char)(final != 0);
+    return (int)(size + 9);
+}
+
+// Ключът се задава веднъж - за всяко парче се сменя само nonce
+static int set_key(SealedFile* sealed, const unsigned char* key, EVP_CIPHER_CTX* cipher) {
+    sealed->shared_cipher = cipher != NULL;
+    sealed->cipher = cipher ? cipher : EVP_CIPHER_CTX_new();
+    return sealed->cipher && EVP_CipherInit_ex(sealed->cipher, EVP_aes_256_gcm(), NULL, key, NULL, 1) == 1;
+}
+
+static int write_chunk(SealedFile* sealed, unsigned long long index, const unsigned char* data, size_t size, int final) {
+    unsigned char record[SEAL_RECORD_SIZE];
+    unsigned char aad[SEAL_AAD_SIZE];
+    int len;
+    
+    int aad_size = chunk_aad(sealed, index, final, aad);
+    if(RAND_bytes(record, SEAL_NONCE_SIZE) != 1 ||
+       EVP_CipherInit_ex(sealed->cipher, NULL, NULL, NULL, record, 1) != 1 ||
+       EVP_CipherUpdate(sealed->cipher, NULL, &len, aad, aad_size) != 1 ||
+       EVP_CipherUpdate(sealed->cipher, record + SEAL_NONCE_SIZE, &len, data, (int)size) != 1 ||
+       EVP_CipherFinal_ex(sealed->cipher, record + SEAL_NONCE_SIZE + size, &len) != 1 ||
+       EVP_CIPHER_CTX_ctrl(sealed->cipher, EVP_CTRL_GCM_GET_TAG, SEAL_TAG_SIZE,
+                           record + SEAL_NONCE_SIZE + size) != 1) {
+        return 0;
+    }
+    
+    size_t record_size = SEAL_NONCE_SIZE + size + SEAL_TAG_SIZE;
+    return seal_seek(sealed->file, chunk_offset(sealed, index)) &&
+           fwrite(record, 1, record_size, sealed->file) == record_size;
+}
+
+// size е размерът на записа във файла; при успех out съдържа size - 28 байта
+static int decrypt_chunk(SealedFile* sealed, unsigned long long index, int final, size_t size, unsigned char* out) {
+    unsigned char record[SEAL_RECORD_SIZE];
+    unsigned char aad[SEAL_AAD_SIZE];
+    int len;
+    
+    if(size < SEAL_NONCE_SIZE + SEAL_TAG_SIZE || size > SEAL_RECORD_SIZE ||
+       !seal_seek(sealed->file, chunk_offset(sealed, index)) || fread(record, 1, size, sealed->file) != size) {
+        return 0;
+    }
+    
+    size_t data_size = size - SEAL_NONCE_SIZE - SEAL_TAG_SIZE;
+    int aad_size = chunk_aad(sealed, index, final, aad);
+    return EVP_CipherInit_ex(sealed->cipher, NULL, NULL, NULL, record, 0) == 1 &&
+           EVP_CipherUpdate(sealed->cipher, NULL, &len, aad, aad_size) == 1 &&
+           EVP_CipherUpdate(sealed->cipher, out, &len, record + SEAL_NONCE_SIZE, (int)data_size) == 1 &&
+           EVP_CIPHER_CTX_ctrl(sealed->cipher, EVP_CTRL_GCM_SET_TAG, SEAL_TAG_SIZE,
+                               record + SEAL_NONCE_SIZE + data_size) == 1 &&
+           EVP_CipherFinal_ex(sealed->cipher, out + len, &len) == 1;
+}
+
+int seal_create(SealedFile* sealed, const char* path, const unsigned char* key, const SealKdf* kdf,
+                const unsigned char* wrapped) {
+    memset(sealed, 0, sizeof(SealedFile));
+    sealed->writable = 1;
+    sealed->version = SEAL_VERSION;
+    sealed->header_size = SEAL_HEADER_SIZE;
+    sealed->kdf = *kdf;
+    memcpy(sealed->wrapped, wrapped, SEAL_WRAPPED_SIZE);
+    memcpy(sealed->header, SEAL_MAGIC, 4);
+    sealed->header[4] = SEAL_VERSION;
+    put_u32(sealed->header + 5, SEAL_CHUNK_SIZE);
+    sealed->header[9] = (unsigned char)kdf->algorithm;
+    put_u32(sealed->header + 10, kdf->iterations);
+    memcpy(sealed->header + 14, kdf->salt, SEAL_SALT_SIZE);
+    memcpy(sealed->header + 14 + SEAL_SALT_SIZE, wrapped, SEAL_WRAPPED_SIZE);
+    
+    // Записът на парчетата е на цели порции - буферът на stdio не трябва
+    sealed->file = fopen(path, "wb+");
+    if(!sealed->file) return 0;
+    setvbuf(sealed->file, NULL, _IONBF, 0);
+    if(!set_key(sealed, key, NULL) || fwrite(sealed->header, 1, SEAL_HEADER_SIZE, sealed->file) != SEAL_HEADER_SIZE) {
+        sealed->failed = 1;
+        seal_close(sealed);
+        return 0;
+    }
+    return 1;
+}
+
+int seal_write(SealedFile* sealed, const unsigned char* data, size_t size) {
+    while(size > 0 && !sealed->failed) {
+        size_t room = SEAL_CHUNK_SIZE - sealed->chunk_size;
+        size_t part = size < room ? size : room;
+        memcpy(sealed->chunk + sealed->chunk_size, data, part);
+        sealed->chunk_size += part;
+        sealed->size += part;
+        data += part;
+        size -= part;
+        
+        // Пълното парче вече не се променя освен при seal_patch
+        if(sealed->chunk_size == SEAL_CHUNK_SIZE) {
+            if(!write_chunk(sealed, sealed->chunk_index, sealed->chunk, SEAL_CHUNK_SIZE, 0)) {
+                sealed->failed = 1;
+            }
+            sealed->chunk_index++;
+            sealed->chunk_size = 0;
+        }
+    }
+    return !sealed->failed;
+}
+
+int seal_flush(SealedFile* sealed) {
+    if(sealed->chunk_size && !write_chunk(sealed, sealed->chunk_index, sealed->chunk, sealed->chunk_size, 0)) {
+        sealed->failed = 1;
+    }
+    return !sealed->failed;
+}
+
+int seal_patch(SealedFile* sealed, unsigned long long offset, const unsigned char* data, size_t size) {
+    if(offset + size > sealed->size) {
+        sealed->failed = 1;
+        return 0;
+    }
+    
+    while(size > 0 && !sealed->failed) {
+        unsigned long long index = offset / SEAL_CHUNK_SIZE;
+        size_t start = (size_t)(offset % SEAL_CHUNK_SIZE);
+        size_t part = SEAL_CHUNK_SIZE - start < size ? SEAL_CHUNK_SIZE - start : size;
+        
+        if(index == sealed->chunk_index) {
+            memcpy(sealed->chunk + start, data, part);
+        } else {
+            // Вече записано пълно парче - разкриптира се, променя се и се записва с нов nonce
+            unsigned char plain[SEAL_CHUNK_SIZE];
+            if(!decrypt_chunk(sealed, index, 0, SEAL_RECORD_SIZE, plain)) {
+                sealed->failed = 1;
+                break;
+            }
+            memcpy(plain + start, data, part);
+            if(!write_chunk(sealed, index, plain, SEAL_CHUNK_SIZE, 0)) {
+                sealed->failed = 1;
+            }
+            memset(plain, 0, sizeof(plain));
+        }
+        offset += part;
+        data += part;
+        size -= part;
+    }
+    return !sealed->failed;
+}
+
+int seal_open(SealedFile* sealed, const char* path) {
+    memset(sealed, 0, sizeof(SealedFile));
+    sealed->file = fopen(path, "rb");
+    if(!sealed->file) return 0;
+    
+    // Размерът на заглавната част зависи от версията: 1 е без опакован ключ, 2 - без параметри
+    unsigned char* header = sealed->header;
+    int version = 0;
+    if(fread(header, 1, 9, sealed->file) == 9 && memcmp(header, SEAL_MAGIC, 4) == 0 &&
+       get_u32(header + 5) == SEAL_CHUNK_SIZE) {
+        version = header[4];
+    }
+    sealed->header_size = version == 1 ? SEAL_HEADER_V1 : version == 2 ? SEAL_HEADER_V2 : SEAL_HEADER_SIZE;
+    if(version < 1 || version > SEAL_VERSION ||
+       fread(header + 9, 1, sealed->header_size - 9, sealed->file) != sealed->header_size - 9) {
+        fclose(sealed->file);
+        sealed->file = NULL;
+        return 0;
+    }
+    
+    sealed->version = version;
+    sealed->kdf.algorithm = SEAL_KDF_PBKDF2_SHA256;
+    sealed->kdf.iterations = SEAL_LEGACY_ITERATIONS;
+    const unsigned char* fields = header + 9;
+    if(version >= 3) {
+        sealed->kdf.algorithm = fields[0];
+        sealed->kdf.iterations = get_u32(fields + 1);
+        fields += 5;
+    }
+    memcpy(sealed->kdf.salt, fields, SEAL_SALT_SIZE);
+    if(version >= 2) {
+        memcpy(sealed->wrapped, fields + SEAL_SALT_SIZE, SEAL_WRAPPED_SIZE);
+    }
+    return 1;
+}
+
+// Размерът на записа на парче index във файл с дадения размер
+static size_t record_size(const SealedFile* sealed, unsigned long long file_size, unsigned long long index) {
+    unsigned long long rest = file_size - chunk_offset(sealed, index);
+    return rest < SEAL_RECORD_SIZE ? (size_t)rest : SEAL_RECORD_SIZE;
+}
+
+int seal_unlock(SealedFile* sealed, const unsigned char* key) {
+    return seal_unlock_with(sealed, key, NULL);
+}
+
+int seal_unlock_with(SealedFile* sealed, const unsigned char* key, EVP_CIPHER_CTX* cipher) {
+    if(!set_key(sealed, key, cipher)) return 0;
+    
+    unsigned long long file_size = seal_file_size(sealed->file);
+    if(file_size < sealed->header_size + SEAL_NONCE_SIZE + SEAL_TAG_SIZE) return 0;
+    unsigned long long count = (file_size - sealed->header_size + SEAL_RECORD_SIZE - 1) / SEAL_RECORD_SIZE;
+    
+    // Първото парче проверява паролата; последното - дали записът е завършен.
+    // Недописаното последно парче (срив по време на запис) се пропуска.
+    unsigned char* plain = sealed->chunk;
+    size_t last = record_size(sealed, file_size, count - 1);
+    if(decrypt_chunk(sealed, count - 1, 1, last, plain)) {
+        sealed->complete = 1;
+    } else if(!decrypt_chunk(sealed, count - 1, 0, last, plain)) {
+        if(count == 1) return 0;
+        count--;
+        last = SEAL_RECORD_SIZE;
+    }
+    if(count > 1 && !decrypt_chunk(sealed, 0, 0, SEAL_RECORD_SIZE, plain)) return 0;
+    
+    sealed->chunk_count = count;
+    sealed->size = (count - 1) * SEAL_CHUNK_SIZE + (last - SEAL_NONCE_SIZE - SEAL_TAG_SIZE);
+    return 1;
+}
+
+int seal_read_chunk(SealedFile* sealed, unsigned long long index, const unsigned char** data, size_t* size) {
+    if(!sealed->cipher || index >= sealed->chunk_count) return 0;
+    
+    if(!sealed->chunk_loaded || sealed->chunk_index != index) {
+        int final = sealed->complete && index == sealed->chunk_count - 1;
+        size_t chunk_size = index == sealed->chunk_count - 1 ?
+                            (size_t)(sealed->size - index * SEAL_CHUNK_SIZE) : SEAL_CHUNK_SIZE;
+        sealed->chunk_loaded = 0;
+        if(!decrypt_chunk(sealed, index, final, chunk_size + SEAL_NONCE_SIZE + SEAL_TAG_SIZE, sealed->chunk)) {
+            return 0;
+        }
+        sealed->chunk_index = index;
+        sealed->chunk_size = chunk_size;
+        sealed->chunk_loaded = 1;
+    }
+    *data = sealed->chunk;
+    *size = sealed->chunk_size;
+    return 1;
+}
+
+size_t seal_read(SealedFile* sealed, unsigned long long offset, unsigned char* out, size_t size) {
+    size_t done = 0;
+    while(done < size && offset < sealed->size) {
+        const unsigned char* data;
+        size_t chunk_size;
+        if(!seal_read_chunk(sealed, offset / SEAL_CHUNK_SIZE, &data, &chunk_size)) break;
+        
+        size_t start = (size_t)(offset % SEAL_CHUNK_SIZE);
+        size_t part = chunk_size - start < size - done ? chunk_size - start : size - done;
+        memcpy(out + done, data + start, part);
+        done += part;
+        offset += part;
+    }
+    return done;
+}
+
+int seal_close(SealedFile* sealed) {
+    int ok = !sealed->failed;
+    if(sealed->writable && ok && sealed->file) {
+        ok = write_chunk(sealed, sealed->chunk_index, sealed->chunk, sealed->chunk_size, 1);
+    }
+    if(sealed->file && fclose(sealed->file) != 0) {
+        ok = 0;
+    }
+    if(sealed->cipher && !sealed->shared_cipher) {
+        EVP_CIPHER_CTX_free(sealed->cipher);
+    }
+    
+    // Ключът е само в контекста на шифъра, но разкриптираното парче се изчиства
+    memset(sealed->chunk, 0, sizeof(sealed->chunk));
+    sealed->file = NULL;
+    sealed->cipher = NULL;
+    return ok;
+}
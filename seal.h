@@ -0,0 +1,84 @@
+#ifndef SEAL_H
+#define SEAL_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <openssl/evp.h>
+
+// Криптиран файл на парчета (AES-256-GCM). Данните се делят на парчета по 4 KB и всяко
+// се криптира отделно със собствен nonce и tag, затова парче се чете и проверява само,
+// без останалите - паметта е едно парче независимо от размера на файла.
+// Номерът на парчето и дали е последно са част от проверката, така че парчета не могат
+// да се разместят, а отрязаният файл се познава. Незавършен файл (прекъснат запис) се чете
+// до последното цяло парче.
+// Във версия 2 всеки файл има собствен случаен ключ, записан в заглавната част опакован
+// с главния ключ от паролата (keyring.h); във версия 1 ключът е изведен направо от паролата.
+// От версия 3 заглавната част пази и алгоритъма и броя итерации, с които ключът се извежда
+// от паролата - по-старите версии са с PBKDF2-SHA256 и SEAL_LEGACY_ITERATIONS.
+#define SEAL_MAGIC "BSEC"
+#define SEAL_VERSION 3
+#define SEAL_KEY_SIZE 32
+#define SEAL_SALT_SIZE 16
+#define SEAL_WRAPPED_SIZE (SEAL_KEY_SIZE + 8)
+#define SEAL_NONCE_SIZE 12
+#define SEAL_TAG_SIZE 16
+#define SEAL_CHUNK_SIZE 4096
+#define SEAL_HEADER_SIZE (4 + 1 + 4 + 1 + 4 + SEAL_SALT_SIZE + SEAL_WRAPPED_SIZE)
+
+#define SEAL_KDF_PBKDF2_SHA256 1
+#define SEAL_LEGACY_ITERATIONS 100000
+
+// Как ключът се извежда от паролата
+typedef struct {
+    int algorithm;
+    unsigned int iterations;
+    unsigned char salt[SEAL_SALT_SIZE];
+} SealKdf;
+
+typedef struct {
+    FILE* file;
+    EVP_CIPHER_CTX* cipher;
+    int shared_cipher;
+    int writable;
+    int failed;
+    int complete;
+    int version;
+    unsigned char header[SEAL_HEADER_SIZE];
+    size_t header_size;
+    SealKdf kdf;
+    unsigned char wrapped[SEAL_WRAPPED_SIZE];
+    // Текущото парче: при запис - още незавършеното, при четене - последното прочетено
+    unsigned char chunk[SEAL_CHUNK_SIZE];
+    size_t chunk_size;
+    unsigned long long chunk_index;
+    int chunk_loaded;
+    unsigned long long chunk_count;
+    unsigned long long size;
+} SealedFile;
+
+// Запис: файлът се създава наново с ключа key. Параметрите на главния ключ и опакованият key
+// (keyring_new_key) се пазят в заглавната част, за да може ключът да се получи при четене.
+int seal_create(SealedFile* sealed, const char* path, const unsigned char* key, const SealKdf* kdf,
+                const unsigned char* wrapped);
+int seal_write(SealedFile* sealed, const unsigned char* data, size_t size);
+// Записва и незавършеното парче - данните до момента остават във файла при срив
+int seal_flush(SealedFile* sealed);
+// Променя вече записани байтове (например броя ходове в заглавната част)
+int seal_patch(SealedFile* sealed, unsigned long long offset, const unsigned char* data, size_t size);
+
+// Четене: seal_open чете заглавната част (kdf и опакования ключ), seal_unlock проверява ключа и намира
+// последното цяло парче. Грешна парола или повреден файл връщат 0.
+int seal_open(SealedFile* sealed, const char* path);
+int seal_unlock(SealedFile* sealed, const unsigned char* key);
+// Като seal_unlock, но с контекста на шифъра на извикващия - нишка, която отваря много файлове,
+// го преизползва вместо да заделя нов за всеки. seal_close не го освобождава.
+int seal_unlock_with(SealedFile* sealed, const unsigned char* key, EVP_CIPHER_CTX* cipher);
+// Парче index; data сочи вътре в sealed и е валидно до следващото четене
+int seal_read_chunk(SealedFile* sealed, unsigned long long index, const unsigned char** data, size_t* size);
+// До size байта от място offset; връща колко са прочетени
+size_t seal_read(SealedFile* sealed, unsigned long long offset, unsigned char* out, size_t size);
+
+// При запис последното парче се отбелязва като последно. Връща 0 при грешка.
+int seal_close(SealedFile* sealed);
+
+#endif
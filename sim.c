@@ -0,0 +1,470 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "engine.h"
+#include "fleetcount.h"
+#include "montecarlo.h"
+#include "pool.h"
+#include "replay.h"
+
+#define MAX_SHOTS BOARD_CELLS
+
+typedef struct {
+    long long wins[2];
+    long long shots[MAX_SHOTS + 1];
+    long long failed;
+    long long fleets;
+    long long unsaved;
+    long long samples;
+    long long sampled_moves;
+    char padding[64];
+} SimStats;
+
+// pools - по един пул за Monte Carlo на всяка нишка с игри, създава се при първата й игра
+typedef struct {
+    SimStats* stats;
+    WorkerPool** pools;
+    FleetCounter* counter;
+    AIStrategy strategy[2];
+    int sample_workers;
+    int move_samples;
+    int move_budget_ms;
+    const char* replay_dir;
+    int sync_every;
+    unsigned long long seed;
+    int single;
+} SimJob;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Всяка игра има собствен seed, изведен от общия и номера й, затова резултатът
+// не зависи от броя нишки, а една игра може да се повтори сама с -g
+static unsigned long long game_seed(SimJob* job, int task) {
+    if(job->single) return job->seed;
+    
+    unsigned long long x = job->seed ^ ((unsigned long long)task * 0xd1342543de82ef95ULL);
+    return rng_splitmix(&x);
+}
+
+// С брояч флотите са точно равномерни сред всички допустими, иначе се строят кораб по кораб (не равномерно)
+static int make_fleet(SimJob* job, Player* player, Rng* rng) {
+    if(job->counter) {
+        return fleet_counter_sample(job->counter, player, rng);
+    }
+    return engine_random_fleet(player, rng);
+}
+
+static void play_one(int task, int worker, void* arg) {
+    SimJob* job = arg;
+    SimStats* stats = &job->stats[worker];
+    GameContext ctx;
+    
+    init_game_context(&ctx);
+    engine_seed(&ctx, game_seed(job, task));
+    strcpy(ctx.player1.name, "Компютър 1");
+    strcpy(ctx.player2.name, "Компютър 2");
+    ctx.player1.is_ai = 1;
+    ctx.player2.is_ai = 1;
+    ctx.ai_state[0].strategy = job->strategy[0];
+    ctx.ai_state[1].strategy = job->strategy[1];
+    if(job->pools && !job->pools[worker]) {
+        job->pools[worker] = pool_create(job->sample_workers);
+    }
+    for(int seat = 0; seat < 2; seat++) {
+        ctx.ai_state[seat].sample_workers = job->sample_workers;
+        ctx.ai_state[seat].move_samples = job->move_samples;
+        ctx.ai_state[seat].move_budget_ms = job->move_budget_ms;
+        ctx.ai_state[seat].sample_pool = job->pools ? job->pools[worker] : NULL;
+    }
+    if(job->replay_dir) {
+        char filename[512];
+        snprintf(filename, sizeof(filename), "%s/sim_%07d.replay", job->replay_dir, task);
+        init_replay(&ctx);
+        ctx.stream = replay_writer_open(filename, job->sync_every);
+        if(!ctx.stream) {
+            stats->unsaved++;
+        }
+    }
+    
+    if(!make_fleet(job, &ctx.player1, &ctx.rng) || !make_fleet(job, &ctx.player2, &ctx.rng)) {
+        stats->failed++;
+        if(ctx.stream) {
+            replay_writer_close(ctx.stream, 0);
+        }
+        return;
+    }
+    
+    engine_start(&ctx);
+    
+    GameStatus status = engine_status(&ctx);
+    while(!status.game_over) {
+        ai_make_move(&ctx);
+        status = engine_status(&ctx);
+    }
+    
+    Player* winner = engine_player(&ctx, status.winner);
+    stats->wins[status.winner]++;
+    stats->shots[bitboard_count(winner->hit_mask | winner->miss_mask)]++;
+    
+    for(int seat = 0; seat < 2; seat++) {
+        if(ctx.ai_state[seat].strategy != AI_MONTE_CARLO) continue;
+        Player* shooter = engine_player(&ctx, seat);
+        stats->samples += ctx.ai_state[seat].samples;
+        stats->sampled_moves += bitboard_count(shooter->hit_mask | shooter->miss_mask);
+    }
+    
+    if(job->single) {
+        printf("Игра със seed %llu: печели %s с %d изстрела, ходове: %d\n", ctx.seed, winner->name,
+               bitboard_count(winner->hit_mask | winner->miss_mask), ctx.replay.move_count);
+    }
+    
+    if(ctx.stream && !replay_writer_close(ctx.stream, 1)) {
+        stats->unsaved++;
+    }
+    free_replay(&ctx.replay);
+}
+
+static void build_fleet(int task, int worker, void* arg) {
+    SimJob* job = arg;
+    Player player;
+    Rng rng;
+    
+    memset(&player, 0, sizeof(player));
+    rng_seed(&rng, job->seed, task);
+    if(make_fleet(job, &player, &rng)) {
+        job->stats[worker].fleets++;
+    } else {
+        job->stats[worker].failed++;
+    }
+}
+
+static int benchmark_fleets(long long count, int workers, FleetCounter* counter, unsigned long long seed) {
+    SimJob job;
+    memset(&job, 0, sizeof(job));
+    job.counter = counter;
+    job.seed = seed;
+    job.stats = calloc(workers, sizeof(SimStats));
+    if(!job.stats) {
+        printf("Грешка при алокиране на памет!\n");
+        return 1;
+    }
+    
+    double start = now_seconds();
+    pool_run(workers, (int)count, build_fleet, &job);
+    double elapsed = now_seconds() - start;
+    
+    long long fleets = 0, failed = 0;
+    for(int w = 0; w < workers; w++) {
+        fleets += job.stats[w].fleets;
+        failed += job.stats[w].failed;
+    }
+    free(job.stats);
+    
+    printf("=== ГЕНЕРИРАНЕ НА ФЛОТИ (%s) ===\n", counter ? "равномерно" : "конструктивно");
+    printf("Флоти: %lld, неуспешни: %lld, нишки: %d\n", fleets, failed, workers);
+    printf("Време: %.3f s (%.0f флоти/сек)\n", elapsed, elapsed > 0 ? fleets / elapsed : 0.0);
+    return failed ? 1 : 0;
+}
+
+static void print_fleet_count(FleetCounter* counter, double setup) {
+    double probability[BOARD_CELLS];
+    
+    printf("=== БРОЙ НА ДОПУСТИМИТЕ ФЛОТИ ===\n");
+    printf("Флоти: %llu\n", fleet_counter_total(counter));
+    printf("Подготовка на брояча: %.3f s\n", setup);
+    
+    double start = now_seconds();
+    if(!fleet_counter_occupancy(counter, probability)) {
+        printf("Грешка при алокиране на памет!\n");
+        return;
+    }
+    printf("Вероятност клетката да е заета (%.3f s):\n\n", now_seconds() - start);
+    
+    printf("   ");
+    for(int j = 0; j < BOARD_SIZE; j++) {
+        printf("%5d", j);
+    }
+    printf("\n");
+    for(int i = 0; i < BOARD_SIZE; i++) {
+        printf("%2c ", 'A' + i);
+        for(int j = 0; j < BOARD_SIZE; j++) {
+            printf("%5.1f", 100.0 * probability[CELL_INDEX(i, j)]);
+        }
+        printf("\n");
+    }
+}
+
+static long long percentile(long long* shots, long long total, double fraction) {
+    long long target = (long long)(total * fraction);
+    long long seen = 0;
+    
+    for(int i = 0; i <= MAX_SHOTS; i++) {
+        seen += shots[i];
+        if(seen > target) return i;
+    }
+    return MAX_SHOTS;
+}
+
+static const char* strategy_name(AIStrategy strategy) {
+    switch(strategy) {
+        case AI_DENSITY:
+            return "density";
+        case AI_MONTE_CARLO:
+            return "montecarlo";
+        default:
+            return "hunt";
+    }
+}
+
+// Разчита "density" или "hunt,density" - второто име е за играч 2
+static int parse_strategies(const char* text, AIStrategy strategy[2]) {
+    char first[16], second[16];
+    int parsed = sscanf(text, "%15[^,],%15s", first, second);
+    if(parsed < 1) return 0;
+    if(parsed == 1) strcpy(second, first);
+    
+    const char* names[2] = {first, second};
+    for(int i = 0; i < 2; i++) {
+        if(strcmp(names[i], "density") == 0) {
+            strategy[i] = AI_DENSITY;
+        } else if(strcmp(names[i], "montecarlo") == 0) {
+            strategy[i] = AI_MONTE_CARLO;
+        } else if(strcmp(names[i], "hunt") == 0) {
+            strategy[i] = AI_HUNT;
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void print_usage(const char* program) {
+    printf("Употреба: %s [-n брой_игри] [-t нишки] [-s seed] [-g seed] [-f брой_флоти] [-u] [-c] [-a стратегия[,стратегия]] [-w нишки_за_ход] [-m флоти | -b ms] [-r директория [-y ходове]]\n", program);
+    printf("  -s  общ seed - всяка игра получава собствен seed, изведен от него\n");
+    printf("  -g  изиграва точно една игра с този seed (напр. взет от запис) и я повтаря бит по бит;\n");
+    printf("      -a, -m и -u трябва да са същите като при записа (прегледът на записа ги показва)\n");
+    printf("  -f  само измерва колко флоти в секунда се генерират\n");
+    printf("  -u  флотите се избират точно равномерно сред всички допустими\n");
+    printf("  -c  отпечатва точния брой допустими флоти и вероятността за всяка клетка\n");
+    printf("  -a  стратегия на компютъра: hunt (случайни изстрели), density (най-вероятната клетка)\n");
+    printf("      или montecarlo (клетката, заета в най-много случайни съвместими флоти)\n");
+    printf("  -w  нишки, които теглят флоти при всеки ход на montecarlo (по подразбиране 1);\n");
+    printf("      без -t нишките с игри са толкова, че общо да са колкото ядрата\n");
+    printf("  -m  флоти на ход на montecarlo, степен на 2 (по подразбиране %d); ходът зависи само\n",
+           MONTE_CARLO_SAMPLES);
+    printf("      от seed-а, не от -w и -t\n");
+    printf("  -b  вместо -m тегли флоти, докато изтекат толкова милисекунди на ход - по-силно при\n");
+    printf("      повече ядра, но играта вече не се повтаря с -g\n");
+    printf("  -r  записва всяка игра като .replay файл в директорията, ход по ход\n");
+    printf("  -y  fdatasync на записа през толкова хода (по подразбиране 0 - без)\n");
+}
+
+int main(int argc, char** argv) {
+    long long games = 100000;
+    int workers = pool_default_workers();
+    int workers_given = 0;
+    unsigned long long seed = (unsigned long long)time(NULL);
+    int single = 0;
+    long long fleets = 0;
+    int uniform = 0, count_only = 0;
+    AIStrategy strategy[2] = {AI_HUNT, AI_HUNT};
+    const char* replay_dir = NULL;
+    int sample_workers = 1, move_samples = MONTE_CARLO_SAMPLES, move_budget_ms = 0;
+    int sync_every = 0;
+    
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            games = atoll(argv[++i]);
+        } else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+            workers_given = 1;
+        } else if(strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            fleets = atoll(argv[++i]);
+        } else if(strcmp(argv[i], "-u") == 0) {
+            uniform = 1;
+        } else if(strcmp(argv[i], "-c") == 0) {
+            count_only = 1;
+        } else if(strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            if(!parse_strategies(argv[++i], strategy)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if(strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            sample_workers = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            move_samples = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            move_budget_ms = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            replay_dir = argv[++i];
+        } else if(strcmp(argv[i], "-y") == 0 && i + 1 < argc) {
+            sync_every = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+            single = 1;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if(single) {
+        games = 1;
+    }
+    
+    if(games < 1 || games > 2000000000LL || fleets < 0 || fleets > 2000000000LL || workers < 1 ||
+       sample_workers < 1 || move_samples < 2 || move_samples > MONTE_CARLO_MAX_SAMPLES ||
+       (move_samples & (move_samples - 1)) != 0 || move_budget_ms < 0 || sync_every < 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    
+    FleetCounter* counter = NULL;
+    if(uniform || count_only) {
+        double setup = now_seconds();
+        counter = fleet_counter_create();
+        if(!counter) {
+            printf("Грешка при алокиране на памет!\n");
+            return 1;
+        }
+        setup = now_seconds() - setup;
+        
+        if(count_only) {
+            print_fleet_count(counter, setup);
+            fleet_counter_free(counter);
+            return 0;
+        }
+    }
+    
+    if(fleets > 0) {
+        int result = benchmark_fleets(fleets, workers, counter, seed);
+        fleet_counter_free(counter);
+        return result;
+    }
+    
+    // Всяка нишка с игри тегли с още sample_workers нишки - без -t общият брой остава колкото ядрата
+    int sampling = (strategy[0] == AI_MONTE_CARLO || strategy[1] == AI_MONTE_CARLO) && sample_workers > 1;
+    if(sampling && !workers_given) {
+        workers = pool_default_workers() / sample_workers;
+        if(workers < 1) workers = 1;
+    }
+    
+    SimJob job;
+    job.pools = NULL;
+    job.counter = counter;
+    job.strategy[0] = strategy[0];
+    job.strategy[1] = strategy[1];
+    job.replay_dir = replay_dir;
+    job.sync_every = sync_every;
+    job.sample_workers = sample_workers;
+    job.move_samples = move_samples;
+    job.move_budget_ms = move_budget_ms;
+    job.seed = seed;
+    job.single = single;
+    if(replay_dir) {
+        mkdir(replay_dir, 0755);
+    }
+    job.stats = calloc(workers, sizeof(SimStats));
+    if(sampling) {
+        job.pools = calloc(workers, sizeof(WorkerPool*));
+    }
+    if(!job.stats || (sampling && !job.pools)) {
+        printf("Грешка при алокиране на памет!\n");
+        free(job.stats);
+        fleet_counter_free(counter);
+        return 1;
+    }
+    
+    double start = now_seconds();
+    pool_run(workers, (int)games, play_one, &job);
+    double elapsed = now_seconds() - start;
+    
+    SimStats total;
+    memset(&total, 0, sizeof(total));
+    for(int w = 0; w < workers; w++) {
+        total.wins[0] += job.stats[w].wins[0];
+        total.wins[1] += job.stats[w].wins[1];
+        total.failed += job.stats[w].failed;
+        total.unsaved += job.stats[w].unsaved;
+        total.samples += job.stats[w].samples;
+        total.sampled_moves += job.stats[w].sampled_moves;
+        for(int i = 0; i <= MAX_SHOTS; i++) {
+            total.shots[i] += job.stats[w].shots[i];
+        }
+    }
+    free(job.stats);
+    if(job.pools) {
+        for(int w = 0; w < workers; w++) {
+            pool_destroy(job.pools[w]);
+        }
+        free(job.pools);
+    }
+    fleet_counter_free(counter);
+    
+    long long played = total.wins[0] + total.wins[1];
+    long long shot_sum = 0;
+    int min_shots = MAX_SHOTS, max_shots = 0;
+    for(int i = 0; i <= MAX_SHOTS; i++) {
+        if(!total.shots[i]) continue;
+        shot_sum += total.shots[i] * i;
+        if(i < min_shots) min_shots = i;
+        if(i > max_shots) max_shots = i;
+    }
+    
+    printf("=== СИМУЛАЦИЯ КОМПЮТЪР СРЕЩУ КОМПЮТЪР ===\n");
+    printf("Игри: %lld, нишки: %d, seed: %llu\n", played, workers, seed);
+    printf("Стратегии: %s срещу %s\n", strategy_name(strategy[0]), strategy_name(strategy[1]));
+    if(total.sampled_moves && move_budget_ms) {
+        printf("Monte Carlo: %d нишки, %d ms на ход, средно %.0f флота на ход (не се повтаря с -g)\n",
+               sample_workers, move_budget_ms, (double)total.samples / total.sampled_moves);
+    } else if(total.sampled_moves) {
+        printf("Monte Carlo: %d нишки, %d флота на ход, средно %.0f съвместими\n",
+               sample_workers, move_samples, (double)total.samples / total.sampled_moves);
+    }
+    if(total.failed) {
+        printf("Неуспешно разположени флоти: %lld\n", total.failed);
+    }
+    if(replay_dir) {
+        printf("Записи в %s: %lld, неуспешни: %lld\n", replay_dir, played - total.unsaved, total.unsaved);
+    }
+    printf("Време: %.3f s (%.0f игри/сек)\n", elapsed, elapsed > 0 ? played / elapsed : 0.0);
+    
+    if(played == 0) {
+        return 1;
+    }
+    
+    printf("Победи на играч 1 (пръв ход): %lld (%.2f%%)\n", total.wins[0], 100.0 * total.wins[0] / played);
+    printf("Победи на играч 2: %lld (%.2f%%)\n", total.wins[1], 100.0 * total.wins[1] / played);
+    printf("Изстрели до победа: средно %.2f, мин %d, медиана %lld, p90 %lld, p99 %lld, макс %d\n",
+           (double)shot_sum / played, min_shots,
+           percentile(total.shots, played, 0.5), percentile(total.shots, played, 0.9),
+           percentile(total.shots, played, 0.99), max_shots);
+    
+    printf("\nРазпределение на изстрелите до победа:\n");
+    long long peak = 0;
+    for(int from = min_shots - min_shots % 5; from <= max_shots; from += 5) {
+        long long bucket = 0;
+        for(int i = from; i < from + 5 && i <= MAX_SHOTS; i++) bucket += total.shots[i];
+        if(bucket > peak) peak = bucket;
+    }
+    for(int from = min_shots - min_shots % 5; from <= max_shots; from += 5) {
+        long long bucket = 0;
+        for(int i = from; i < from + 5 && i <= MAX_SHOTS; i++) bucket += total.shots[i];
+        int width = peak ? (int)(50 * bucket / peak) : 0;
+        printf("%3d-%3d | ", from, from + 4);
+        for(int i = 0; i < width; i++) printf("#");
+        printf(" %lld\n", bucket);
+    }
+    
+    return 0;
+}
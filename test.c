@@ -0,0 +1,144 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "keyring.h"
+#include "test.h"
+
+// Проверките на отделните модули са в test_<модул>.c; тук са общите помощни функции
+// и редът, в който се пускат. Игрите са с фиксирани seed-ове, затова резултатът е повторим.
+
+int test_failures = 0;
+char test_dir[256];
+
+void test_path(char* path, size_t size, const char* name) {
+    snprintf(path, size, "%s/%s", test_dir, name);
+}
+
+void test_play_game(GameReplay* replay, unsigned long long seed, int same_names) {
+    GameContext ctx;
+    init_game_context(&ctx);
+    engine_seed(&ctx, seed);
+    strcpy(ctx.player1.name, "Иван");
+    strcpy(ctx.player2.name, same_names ? "Иван" : "Петър");
+    ctx.player1.is_ai = 1;
+    ctx.player2.is_ai = 1;
+    ctx.ai_state[0].strategy = seed % 2 ? AI_DENSITY : AI_HUNT;
+    ctx.ai_state[1].strategy = AI_HUNT;
+
+    engine_random_fleet(&ctx.player1, &ctx.rng);
+    engine_random_fleet(&ctx.player2, &ctx.rng);
+    init_replay(&ctx);
+    engine_start(&ctx);
+    while(!engine_status(&ctx).game_over) {
+        ai_make_move(&ctx);
+    }
+    *replay = ctx.replay;
+}
+
+static int same_player(const Player* a, const Player* b) {
+    if(strcmp(a->name, b->name) != 0 || a->is_ai != b->is_ai || a->ship_count != b->ship_count ||
+       a->ship_mask != b->ship_mask) {
+        return 0;
+    }
+    for(int i = 0; i < a->ship_count; i++) {
+        const Ship* x = &a->ships[i];
+        const Ship* y = &b->ships[i];
+        if(x->row != y->row || x->col != y->col || x->length != y->length || x->direction != y->direction) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int same_ai(const AISettings* a, const AISettings* b) {
+    return a->recorded == b->recorded && a->strategy == b->strategy && a->move_samples == b->move_samples;
+}
+
+int test_compare_replays(const GameReplay* a, const GameReplay* b) {
+    if(!same_player(&a->player1_initial, &b->player1_initial) ||
+       !same_player(&a->player2_initial, &b->player2_initial) ||
+       a->move_count != b->move_count || a->winner_index != b->winner_index || strcmp(a->winner, b->winner) != 0 ||
+       strcmp(a->start_time, b->start_time) != 0 || strcmp(a->end_time, b->end_time) != 0 || a->seed != b->seed ||
+       !same_ai(&a->ai[0], &b->ai[0]) || !same_ai(&a->ai[1], &b->ai[1])) {
+        return -2;
+    }
+    for(int i = 0; i < a->move_count; i++) {
+        const Move* x = replay_move(a, i);
+        const Move* y = replay_move(b, i);
+        if(x->player != y->player || x->row != y->row || x->col != y->col || x->hit != y->hit ||
+           x->ship_sunk != y->ship_sunk || x->ship_length != y->ship_length ||
+           strcmp(x->player_name, y->player_name) != 0 || strcmp(x->timestamp, y->timestamp) != 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int test_run(const char* command) {
+    int status = system(command);
+    if(status == -1 || !WIFEXITED(status)) return -1;
+    return WEXITSTATUS(status);
+}
+
+// Всеки модул отпечатва един ред: OK или броя на неуспешните проверки
+static void run_suite(const char* name, void (*suite)(void)) {
+    int before = test_failures;
+    suite();
+    if(test_failures == before) {
+        printf("%-12s OK\n", name);
+    } else {
+        printf("%-12s неуспешни проверки: %d\n", name, test_failures - before);
+    }
+}
+
+// Модулите пишат само файлове направо във временната директория
+static void remove_test_dir(void) {
+    DIR* dir = opendir(test_dir);
+    if(dir) {
+        struct dirent* item;
+        while((item = readdir(dir)) != NULL) {
+            if(strcmp(item->d_name, ".") == 0 || strcmp(item->d_name, "..") == 0) continue;
+            char path[512];
+            test_path(path, sizeof(path), item->d_name);
+            remove(path);
+        }
+        closedir(dir);
+    }
+    rmdir(test_dir);
+}
+
+int main(void) {
+    const char* tmp = getenv("TMPDIR");
+    snprintf(test_dir, sizeof(test_dir), "%s/battleships-test-XXXXXX", tmp && tmp[0] ? tmp : "/tmp");
+    if(!mkdtemp(test_dir)) {
+        printf("Не може да се създаде временна директория!\n");
+        return 1;
+    }
+
+    run_suite("replay", test_replay);
+    run_suite("rangecoder", test_rangecoder);
+    run_suite("seal", test_seal);
+    run_suite("keyring", test_keyring);
+    run_suite("catalog", test_catalog);
+    run_suite("pack", test_pack);
+    run_suite("ai", test_ai);
+    run_suite("fleetcount", test_fleetcount);
+    run_suite("saver", test_saver);
+    run_suite("pool", test_pool);
+    run_suite("export", test_export);
+    run_suite("analyze", test_analyze);
+    remove_test_dir();
+    keyring_clear();
+
+    if(test_failures) {
+        printf("Неуспешни проверки: %d\n", test_failures);
+        return 1;
+    }
+    printf("Всички проверки са успешни.\n");
+    return 0;
+}
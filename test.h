@@ -0,0 +1,44 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include "engine.h"
+
+// Проверки, които се пускат при всяко make (battleships-test). Всеки модул има своя
+// функция test_<модул> в test_<модул>.c; test.c ги вика подред във временна директория.
+extern int test_failures;
+extern char test_dir[256];
+
+#define CHECK(condition, ...) do { \
+    if(!(condition)) { \
+        printf("ГРЕШКА: "); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        test_failures++; \
+    } \
+} while(0)
+
+// Път на файл name във временната директория
+void test_path(char* path, size_t size, const char* name);
+// Игра компютър срещу компютър с фиксиран seed; с same_names двамата играчи са с едно име
+void test_play_game(GameReplay* replay, unsigned long long seed, int same_names);
+// Връща номера на първия различен ход, -1 при еднакви записи и -2 при разлика извън ходовете
+int test_compare_replays(const GameReplay* a, const GameReplay* b);
+// Пуска команда на обвивката (програмите на make са в текущата директория) и връща кода ѝ
+// на изход или -1, ако командата не е завършила нормално
+int test_run(const char* command);
+
+void test_replay(void);
+void test_rangecoder(void);
+void test_seal(void);
+void test_keyring(void);
+void test_catalog(void);
+void test_pack(void);
+void test_ai(void);
+void test_fleetcount(void);
+void test_saver(void);
+void test_pool(void);
+void test_export(void);
+void test_analyze(void);
+
+#endif
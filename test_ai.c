@@ -0,0 +1,190 @@
+#include <stdlib.h>
+#include <string.h>
+#include "montecarlo.h"
+#include "pool.h"
+#include "replay.h"
+#include "test.h"
+
+// Стратегиите на компютъра: случайните изстрели на hunt, картата на вероятностите и повторимост на Monte Carlo при различен брой нишки
+#define AI_TEST_SAMPLES 2048
+#define AI_TEST_GAMES 30
+
+// Двама компютъра с дадените стратегии и случайни флоти, преди първия ход
+static void start_game(GameContext* ctx, unsigned long long seed, AIStrategy first, AIStrategy second) {
+    init_game_context(ctx);
+    engine_seed(ctx, seed);
+    strcpy(ctx->player1.name, "Иван");
+    strcpy(ctx->player2.name, "Петър");
+    ctx->player1.is_ai = 1;
+    ctx->player2.is_ai = 1;
+    ctx->ai_state[0].strategy = first;
+    ctx->ai_state[1].strategy = second;
+    engine_random_fleet(&ctx->player1, &ctx->rng);
+    engine_random_fleet(&ctx->player2, &ctx->rng);
+}
+
+// Изстрелите на първия играч, докато потопи флота на втория (вторият не стреля)
+static int shots_to_win(unsigned long long seed, AIStrategy strategy) {
+    GameContext ctx;
+    start_game(&ctx, seed, strategy, AI_HUNT);
+    engine_start(&ctx);
+    int shots = 0;
+    while(!engine_status(&ctx).game_over && shots < BOARD_CELLS) {
+        ctx.turn = 0;
+        FireResult result = ai_make_move(&ctx);
+        if(result.outcome == FIRE_REPEAT || result.outcome == FIRE_OUT_OF_BOUNDS) return -1;
+        shots++;
+    }
+    return engine_status(&ctx).game_over ? shots : -1;
+}
+
+// Докато има ударен, но непотопен кораб, картата стреля само до него
+static void check_density_follows_hits(unsigned long long seed) {
+    GameContext ctx;
+    start_game(&ctx, seed, AI_DENSITY, AI_HUNT);
+    engine_start(&ctx);
+    int strays = 0;
+    for(int shots = 0; shots < BOARD_CELLS && !engine_status(&ctx).game_over; shots++) {
+        ctx.turn = 0;
+        Bitboard open_hits = ctx.player1.hit_mask & ~ctx.ai_state[0].sunk_mask;
+        FireResult result = ai_make_move(&ctx);
+        Bitboard shot = CELL_BIT(result.row, result.col);
+        if(open_hits && !(bitboard_halo(open_hits) & ~bitboard_diagonals(open_hits) & shot)) strays++;
+    }
+    CHECK(strays == 0, "density стреля далеч от ударен кораб %d пъти (seed %llu)", strays, seed);
+}
+
+// Масивът на неатакуваните клетки трябва да съвпада точно с дъската след всеки ход на hunt
+static int free_cells_match(const AIState* ai_state, const Player* ai_player) {
+    Bitboard shots = ai_player->hit_mask | ai_player->miss_mask;
+    Bitboard listed = 0;
+    if(ai_state->free_count != BOARD_CELLS - bitboard_count(shots)) return 0;
+    for(int i = 0; i < ai_state->free_count; i++) {
+        int cell = ai_state->free_cells[i];
+        if(ai_state->free_slot[cell] != i || (shots & ((Bitboard)1 << cell))) return 0;
+        listed |= (Bitboard)1 << cell;
+    }
+    return listed == (FULL_BOARD & ~shots);
+}
+
+static void check_free_cells(void) {
+    int broken = 0, unfinished = 0, first_shots[BOARD_CELLS] = {0};
+    for(int i = 0; i < AI_TEST_GAMES; i++) {
+        GameContext ctx;
+        start_game(&ctx, 8000 + i, AI_HUNT, AI_HUNT);
+        engine_start(&ctx);
+        int ok = 1;
+        for(int shots = 0; ok && shots < 2 * BOARD_CELLS && !engine_status(&ctx).game_over; shots++) {
+            int turn = ctx.turn;
+            FireResult result = ai_make_move(&ctx);
+            if(shots == 0) first_shots[CELL_INDEX(result.row, result.col)]++;
+            if(result.outcome == FIRE_REPEAT || !free_cells_match(&ctx.ai_state[turn], engine_player(&ctx, turn))) {
+                ok = 0;
+            }
+        }
+        broken += !ok;
+        unfinished += ok && !engine_status(&ctx).game_over;
+    }
+    CHECK(broken == 0, "масивът на неатакуваните клетки се разминава с дъската в %d игри", broken);
+    CHECK(unfinished == 0, "hunt не довършва %d игри", unfinished);
+
+    // Първият изстрел е случаен - 30 игри не трябва да стрелят все в една и съща клетка
+    int distinct = 0;
+    for(int cell = 0; cell < BOARD_CELLS; cell++) {
+        distinct += first_shots[cell] > 0;
+    }
+    CHECK(distinct > AI_TEST_GAMES / 2, "първите изстрели са само в %d клетки", distinct);
+}
+
+static void check_density(void) {
+    int density = 0, hunt = 0, failed = 0;
+    for(int i = 0; i < AI_TEST_GAMES; i++) {
+        int a = shots_to_win(7000 + i, AI_DENSITY);
+        int b = shots_to_win(7000 + i, AI_HUNT);
+        if(a < 0 || b < 0) failed++;
+        density += a;
+        hunt += b;
+    }
+    CHECK(failed == 0, "%d игри с повторен изстрел или без победа", failed);
+    CHECK(failed || density < hunt, "density е по-слаба от hunt: %d срещу %d изстрела за %d игри", density, hunt,
+          AI_TEST_GAMES);
+    check_density_follows_hits(7100);
+    check_density_follows_hits(7101);
+}
+
+// Monte Carlo (първият играч) срещу hunt с фиксиран seed
+static void play_montecarlo(GameReplay* replay, unsigned long long seed, int workers, WorkerPool* pool) {
+    GameContext ctx;
+    init_game_context(&ctx);
+    engine_seed(&ctx, seed);
+    strcpy(ctx.player1.name, "Иван");
+    strcpy(ctx.player2.name, "Петър");
+    ctx.player1.is_ai = 1;
+    ctx.player2.is_ai = 1;
+    ctx.ai_state[0].strategy = AI_MONTE_CARLO;
+    ctx.ai_state[0].sample_workers = workers;
+    ctx.ai_state[0].sample_pool = pool;
+    ctx.ai_state[0].move_samples = AI_TEST_SAMPLES;
+    ctx.ai_state[1].strategy = AI_HUNT;
+
+    engine_random_fleet(&ctx.player1, &ctx.rng);
+    engine_random_fleet(&ctx.player2, &ctx.rng);
+    init_replay(&ctx);
+    engine_start(&ctx);
+    while(!engine_status(&ctx).game_over) {
+        ai_make_move(&ctx);
+    }
+    *replay = ctx.replay;
+}
+
+// Часовете в записа зависят от това колко е траяла играта - сравняват се само изстрелите
+static int same_shots(const GameReplay* a, const GameReplay* b) {
+    if(a->move_count != b->move_count || a->winner_index != b->winner_index) return 0;
+    for(int i = 0; i < a->move_count; i++) {
+        const Move* x = replay_move(a, i);
+        const Move* y = replay_move(b, i);
+        if(x->player != y->player || x->row != y->row || x->col != y->col || x->hit != y->hit) return 0;
+    }
+    return 1;
+}
+
+// Една нишка, пул от 3 нишки и 3 нишки за всеки ход трябва да изиграят един и същ ход
+static void check_montecarlo_workers(unsigned long long seed) {
+    GameReplay single, pooled, spawned;
+    WorkerPool* pool = pool_create(3);
+    play_montecarlo(&single, seed, 1, NULL);
+    play_montecarlo(&pooled, seed, 3, pool);
+    play_montecarlo(&spawned, seed, 3, NULL);
+    pool_destroy(pool);
+
+    CHECK(same_shots(&single, &pooled), "Monte Carlo с пул от 3 нишки се различава от 1 нишка (seed %llu)", seed);
+    CHECK(same_shots(&single, &spawned), "Monte Carlo с pool_run се различава от 1 нишка (seed %llu)", seed);
+    CHECK(single.ai[0].recorded && single.ai[0].strategy == AI_MONTE_CARLO &&
+          single.ai[0].move_samples == AI_TEST_SAMPLES && single.ai[1].recorded &&
+          single.ai[1].strategy == AI_HUNT, "настройките на компютъра не са в записа");
+
+    // Настройките минават през файла, за да може battleships-sim -g да изиграе играта отново
+    unsigned char* data;
+    size_t size;
+    GameReplay loaded;
+    if(replay_encode(&single, &data, &size) && replay_decode(data, size, &loaded)) {
+        CHECK(test_compare_replays(&single, &loaded) == -1, "настройките на компютъра не се четат от записа");
+        free_replay(&loaded);
+        free(data);
+    } else {
+        CHECK(0, "replay_encode/replay_decode");
+    }
+
+    free_replay(&single);
+    free_replay(&pooled);
+    free_replay(&spawned);
+}
+
+void test_ai(void) {
+    check_free_cells();
+    check_density();
+    CHECK(montecarlo_move_samples(&(AIState){.move_samples = 0}) == MONTE_CARLO_SAMPLES &&
+          montecarlo_move_samples(&(AIState){.move_budget_ms = 50}) == 0, "montecarlo_move_samples");
+    check_montecarlo_workers(6000);
+    check_montecarlo_workers(6001);
+}
@@ -0,0 +1,215 @@
+#include <stdlib.h>
+#include <string.h>
+#include "keyring.h"
+#include "pack.h"
+#include "replay.h"
+#include "test.h"
+
+// battleships-analyze: отделни записи, пакет и криптирани записи с -p, еднакъв отчет при всеки
+// брой нишки и грешна парола, която спира анализа, преди да е прочетен какъвто и да е запис
+#define ANALYZE_PROGRAM "./battleships-analyze"
+#define ANALYZE_FILES 3
+#define ANALYZE_PACKED 4
+#define ANALYZE_ENCRYPTED 2
+#define ANALYZE_GAMES (ANALYZE_FILES + ANALYZE_PACKED + ANALYZE_ENCRYPTED)
+#define ANALYZE_PASSWORD "test-password"
+
+typedef struct {
+    long long files;
+    long long replays;
+    long long analyzed;
+    long long failed;
+    long long moves;
+    long long games;
+    long long wins;
+    long long shots;
+    long long hits;
+} AnalyzeTotals;
+
+static char* read_report(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if(!file) return NULL;
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* text = length >= 0 ? malloc((size_t)length + 1) : NULL;
+    if(text && fread(text, 1, (size_t)length, file) != (size_t)length) {
+        free(text);
+        text = NULL;
+    }
+    fclose(file);
+    if(text) text[length] = '\0';
+    return text;
+}
+
+// Първото число след "key": в text; -1, ако го няма
+static long long report_number(const char* text, const char* key) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+    const char* found = text ? strstr(text, pattern) : NULL;
+    return found ? strtoll(found + strlen(pattern), NULL, 10) : -1;
+}
+
+static int run_analyze(int workers, int with_password, const char* output) {
+    char command[1536], password[512];
+    test_path(password, sizeof(password), "password.txt");
+    snprintf(command, sizeof(command), "%s -i '%s' -t %d -o '%s'%s%s%s > /dev/null 2>&1", ANALYZE_PROGRAM, test_dir,
+             workers, output, with_password ? " -p '" : "", with_password ? password : "", with_password ? "'" : "");
+    return test_run(command);
+}
+
+static void add_expected(AnalyzeTotals* totals, const GameReplay* replay) {
+    totals->replays++;
+    totals->analyzed++;
+    totals->moves += replay->move_count;
+    totals->games += 2;
+    totals->wins++;
+    totals->shots += replay->move_count;
+    for(int i = 0; i < replay->move_count; i++) {
+        totals->hits += replay_move(replay, i)->hit != 0;
+    }
+}
+
+// Отчетът съвпада с очакваното; всички играчи в тестовите игри са компютри
+static void check_report(const char* text, const AnalyzeTotals* expected, const char* label) {
+    const char* computer = text ? strstr(text, "\"computer\"") : NULL;
+    CHECK(computer != NULL, "%s: няма отчет", label);
+    if(!computer) return;
+
+    CHECK(report_number(text, "files") == expected->files && report_number(text, "replays") == expected->replays,
+          "%s: %lld файла и %lld игри вместо %lld и %lld", label, report_number(text, "files"),
+          report_number(text, "replays"), expected->files, expected->replays);
+    CHECK(report_number(text, "analyzed") == expected->analyzed && report_number(text, "failed") == expected->failed,
+          "%s: анализирани %lld, неуспешни %lld", label, report_number(text, "analyzed"), report_number(text, "failed"));
+    CHECK(report_number(text, "moves") == expected->moves, "%s: %lld хода вместо %lld", label,
+          report_number(text, "moves"), expected->moves);
+    CHECK(report_number(computer, "games") == expected->games && report_number(computer, "wins") == expected->wins,
+          "%s: компютърът има %lld игри и %lld победи", label, report_number(computer, "games"),
+          report_number(computer, "wins"));
+    CHECK(report_number(computer, "shots") == expected->shots && report_number(computer, "hits") == expected->hits,
+          "%s: %lld изстрела и %lld попадения вместо %lld и %lld", label, report_number(computer, "shots"),
+          report_number(computer, "hits"), expected->shots, expected->hits);
+    CHECK(report_number(strstr(text, "\"human\""), "games") == 0, "%s: има игри на хора", label);
+}
+
+static int write_encrypted(const char* path, const GameReplay* replay) {
+    SealKdf kdf;
+    unsigned char key[SEAL_KEY_SIZE];
+    unsigned char wrapped[SEAL_WRAPPED_SIZE];
+    if(!keyring_new_key(test_dir, ANALYZE_PASSWORD, key, &kdf, wrapped)) return 0;
+
+    ReplayWriter* writer = replay_writer_open_sealed(path, 0, key, &kdf, wrapped);
+    memset(key, 0, sizeof(key));
+    if(!writer) return 0;
+    replay_writer_begin(writer, replay);
+    for(int i = 0; i < replay->move_count; i++) {
+        replay_writer_append(writer, replay_move(replay, i));
+    }
+    replay_writer_finish(writer, replay);
+    return replay_writer_close(writer, 1);
+}
+
+// Записите в директорията: отделни .replay, един пакет и криптирани .encrypted
+static void write_corpus(GameReplay* replays, AnalyzeTotals* plain, AnalyzeTotals* all) {
+    char path[512];
+    ReplayPack pack;
+    test_path(path, sizeof(path), PACK_FILE);
+    CHECK(pack_open(&pack, path, 1), "pack_open");
+
+    for(int i = 0; i < ANALYZE_GAMES; i++) {
+        char name[32];
+        test_play_game(&replays[i], 7000 + i, i % 2);
+        add_expected(all, &replays[i]);
+        if(i < ANALYZE_FILES) {
+            snprintf(name, sizeof(name), "game_%d.replay", i);
+            test_path(path, sizeof(path), name);
+            CHECK(replay_save(path, &replays[i]), "replay_save %d", i);
+        } else if(i < ANALYZE_FILES + ANALYZE_PACKED) {
+            snprintf(name, sizeof(name), "packed_%d.replay", i);
+            CHECK(pack_append_replay(&pack, name, &replays[i], 1) >= 0, "pack_append_replay %d", i);
+        } else {
+            snprintf(name, sizeof(name), "game_%d.encrypted", i);
+            test_path(path, sizeof(path), name);
+            CHECK(write_encrypted(path, &replays[i]), "криптиран запис %d", i);
+            continue;
+        }
+        add_expected(plain, &replays[i]);
+    }
+    CHECK(pack_close(&pack), "pack_close");
+    keyring_clear();
+
+    plain->files = ANALYZE_FILES + 1;
+    all->files = ANALYZE_FILES + 1 + ANALYZE_ENCRYPTED;
+
+    test_path(path, sizeof(path), "password.txt");
+    FILE* file = fopen(path, "w");
+    if(file) {
+        fputs(ANALYZE_PASSWORD "\n", file);
+        fclose(file);
+    }
+}
+
+static void remove_corpus(void) {
+    char path[512];
+    test_path(path, sizeof(path), PACK_FILE);
+    remove(path);
+    test_path(path, sizeof(path), "password.txt");
+    remove(path);
+    for(int i = 0; i < ANALYZE_GAMES; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), i < ANALYZE_FILES ? "game_%d.replay" : "game_%d.encrypted", i);
+        test_path(path, sizeof(path), name);
+        remove(path);
+    }
+}
+
+void test_analyze(void) {
+    GameReplay replays[ANALYZE_GAMES];
+    AnalyzeTotals plain, all;
+    memset(&plain, 0, sizeof(plain));
+    memset(&all, 0, sizeof(all));
+    write_corpus(replays, &plain, &all);
+
+    char first[512], second[512];
+    test_path(first, sizeof(first), "analyze_3.json");
+    test_path(second, sizeof(second), "analyze_1.json");
+
+    // Без -p криптираните записи не се четат изобщо
+    CHECK(run_analyze(3, 0, first) == 0, "%s без парола не завършва успешно", ANALYZE_PROGRAM);
+    char* report = read_report(first);
+    check_report(report, &plain, "без парола");
+    free(report);
+
+    // С паролата се добавят и криптираните; отчетът не зависи от броя на нишките
+    CHECK(run_analyze(3, 1, first) == 0, "%s с парола и 3 нишки не завършва успешно", ANALYZE_PROGRAM);
+    CHECK(run_analyze(1, 1, second) == 0, "%s с парола и 1 нишка не завършва успешно", ANALYZE_PROGRAM);
+    report = read_report(first);
+    char* single = read_report(second);
+    check_report(report, &all, "с парола");
+    const char* a = report ? strstr(report, "\"computer\"") : NULL;
+    const char* b = single ? strstr(single, "\"computer\"") : NULL;
+    CHECK(a && b && strcmp(a, b) == 0, "отчетът с 1 и с 3 нишки се различава");
+    free(report);
+    free(single);
+    remove(first);
+    remove(second);
+
+    // Грешната парола се отхвърля по keyring.key и отчет не се пише
+    test_path(first, sizeof(first), "password.txt");
+    FILE* file = fopen(first, "w");
+    if(file) {
+        fputs("wrong-password\n", file);
+        fclose(file);
+    }
+    test_path(first, sizeof(first), "analyze_wrong.json");
+    CHECK(run_analyze(2, 1, first) == 1, "грешната парола не спира анализа");
+    report = read_report(first);
+    CHECK(report == NULL, "с грешна парола е записан отчет");
+    free(report);
+    remove(first);
+
+    remove_corpus();
+    for(int i = 0; i < ANALYZE_GAMES; i++) {
+        free_replay(&replays[i]);
+    }
+}
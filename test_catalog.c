@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <string.h>
+#include "catalog.h"
+#include "replay.h"
+#include "test.h"
+
+// Каталогът catalog.idx: добавяне, прекъснат запис и построяване наново от файловете
+static void remove_catalog(void) {
+    char path[512];
+    test_path(path, sizeof(path), CATALOG_FILE);
+    remove(path);
+}
+
+static void check_torn_record(void) {
+    CatalogEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    strcpy(entry.player1, "Иван");
+
+    // Празна директория - каталогът се създава при първото добавяне
+    remove_catalog();
+    for(int i = 0; i < 3; i++) {
+        snprintf(entry.filename, sizeof(entry.filename), "game_%d.replay", i);
+        entry.move_count = i;
+        CHECK(catalog_add(test_dir, &entry), "catalog_add %d", i);
+
+        // Прекъснат запис оставя непълен ред в края - следващият трябва да го замести
+        if(i == 1) {
+            char path[512];
+            test_path(path, sizeof(path), CATALOG_FILE);
+            FILE* file = fopen(path, "ab");
+            if(file) {
+                fwrite("непълен", 1, 7, file);
+                fclose(file);
+            }
+        }
+    }
+
+    int count;
+    CatalogEntry* entries = catalog_load(test_dir, &count);
+    CHECK(entries && count == 3, "каталогът има %d реда вместо 3", entries ? count : -1);
+    for(int i = 0; entries && i < count; i++) {
+        char expected[64];
+        snprintf(expected, sizeof(expected), "game_%d.replay", i);
+        CHECK(strcmp(entries[i].filename, expected) == 0 && entries[i].move_count == i,
+              "ред %d на каталога е повреден", i);
+    }
+    free(entries);
+    remove_catalog();
+}
+
+// Без каталог (или с повреден) редовете се възстановяват от записите в директорията
+static void check_rebuild(void) {
+    char paths[3][512];
+    GameReplay replays[2];
+    test_path(paths[0], sizeof(paths[0]), "a.replay");
+    test_path(paths[1], sizeof(paths[1]), "b.replay");
+    test_path(paths[2], sizeof(paths[2]), "c.encrypted");
+    for(int i = 0; i < 2; i++) {
+        test_play_game(&replays[i], 4000 + i, 0);
+        CHECK(replay_save(paths[i], &replays[i]), "replay_save %d", i);
+    }
+    FILE* file = fopen(paths[2], "wb");
+    if(file) {
+        fputs("криптиран", file);
+        fclose(file);
+    }
+
+    CatalogEntry added;
+    catalog_entry_from_replay(&added, "d.replay", &replays[0], 0);
+    strcpy(added.player2, "Мария");
+    CHECK(catalog_add(test_dir, &added), "catalog_add без каталог");
+
+    int count;
+    CatalogEntry* entries = catalog_load(test_dir, &count);
+    CHECK(entries && count == 4, "построеният каталог има %d реда вместо 4", entries ? count : -1);
+    for(int i = 0; entries && i < count && i < 4; i++) {
+        const char* names[] = {"a.replay", "b.replay", "c.encrypted", "d.replay"};
+        CHECK(strcmp(entries[i].filename, names[i]) == 0, "ред %d е %s вместо %s", i, entries[i].filename, names[i]);
+    }
+    if(entries && count == 4) {
+        CHECK(entries[0].move_count == replays[0].move_count && strcmp(entries[1].winner, replays[1].winner) == 0 &&
+              strcmp(entries[0].player1, replays[0].player1_initial.name) == 0, "данните на записите не съвпадат");
+        CHECK(entries[2].encrypted && !entries[2].player1[0], "криптираният запис е описан грешно");
+        CHECK(catalog_match(&entries[3], "Мар") && !catalog_match(&entries[0], "Мар") && catalog_match(&entries[0], ""),
+              "catalog_match");
+    }
+    free(entries);
+
+    // Повредена заглавна част - каталогът се построява наново, вместо да се дописва
+    char path[512];
+    test_path(path, sizeof(path), CATALOG_FILE);
+    file = fopen(path, "r+b");
+    if(file) {
+        fputs("XXXX", file);
+        fclose(file);
+    }
+    catalog_entry_from_replay(&added, "e.replay", &replays[1], 0);
+    CHECK(catalog_add(test_dir, &added), "catalog_add върху повреден каталог");
+    entries = catalog_load(test_dir, &count);
+    CHECK(entries && count == 4 && strcmp(entries[3].filename, "e.replay") == 0,
+          "повреденият каталог не е построен наново (%d реда)", entries ? count : -1);
+    free(entries);
+
+    for(int i = 0; i < 3; i++) {
+        remove(paths[i]);
+    }
+    remove_catalog();
+    free_replay(&replays[0]);
+    free_replay(&replays[1]);
+}
+
+void test_catalog(void) {
+    check_torn_record();
+    check_rebuild();
+}
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <string.h>
+#include "replay.h"
+#include "test.h"
+
+// battleships-export: един .cast на запис, валиден asciicast v2 и еднакъв изход при всеки брой нишки
+#define EXPORT_PROGRAM "./battleships-export"
+#define EXPORT_GAMES 5
+#define EXPORT_IDLE_LIMIT 3.5
+#define EXPORT_NAME "Ив\"ан\\"
+
+static char* read_text(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if(!file) return NULL;
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* text = length >= 0 ? malloc((size_t)length + 1) : NULL;
+    if(text && fread(text, 1, (size_t)length, file) != (size_t)length) {
+        free(text);
+        text = NULL;
+    }
+    fclose(file);
+    if(text) {
+        text[length] = '\0';
+        *size = (size_t)length;
+    }
+    return text;
+}
+
+static int run_export(int workers) {
+    char command[1024];
+    snprintf(command, sizeof(command), "%s -i '%s' -t %d -l %.1f > /dev/null 2>&1", EXPORT_PROGRAM, test_dir,
+             workers, EXPORT_IDLE_LIMIT);
+    return test_run(command);
+}
+
+static void cast_path(char* path, size_t size, int game) {
+    char name[32];
+    snprintf(name, sizeof(name), "game_%d.cast", game);
+    test_path(path, size, name);
+}
+
+// Заглавен ред, по едно събитие за началото и за всеки ход и две за края, с растящи времена
+static void check_cast(const char* text, const GameReplay* replay, int game) {
+    CHECK(strncmp(text, "{\"version\": 2, ", 15) == 0, "игра %d: заглавният ред не е asciicast v2", game);
+    if(game == 0) {
+        const char* title = "\"title\": \"Ив\\\"ан\\\\ - Петър\"}\n";
+        CHECK(strstr(text, title) != NULL, "игра %d: заглавието не е екранирано за JSON", game);
+    }
+
+    int events = 0;
+    double previous = 0.0, last_gap = 0.0;
+    const char* line = strchr(text, '\n');
+    while(line && line[1]) {
+        line++;
+        const char* end = strchr(line, '\n');
+        char* after;
+        double time = strtod(line + 1, &after);
+        if(line[0] != '[' || strncmp(after, ", \"o\", \"", 7) != 0 || !end || strncmp(end - 2, "\"]", 2) != 0) {
+            CHECK(0, "игра %d: събитие %d не е [време, \"o\", текст]", game, events);
+            return;
+        }
+        if((events == 0 && time != 0.0) || time < previous) {
+            CHECK(0, "игра %d: времето на събитие %d е %.3f след %.3f", game, events, time, previous);
+            return;
+        }
+        last_gap = time - previous;
+        previous = time;
+        events++;
+        line = end;
+    }
+    CHECK(events == replay->move_count + 3, "игра %d: %d събития вместо %d", game, events, replay->move_count + 3);
+    CHECK(last_gap > EXPORT_IDLE_LIMIT - 0.001 && last_gap < EXPORT_IDLE_LIMIT + 0.001,
+          "игра %d: паузата преди края е %.3f вместо -l %.1f", game, last_gap, EXPORT_IDLE_LIMIT);
+}
+
+void test_export(void) {
+    char path[512];
+    GameReplay replays[EXPORT_GAMES];
+    for(int i = 0; i < EXPORT_GAMES; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "game_%d.replay", i);
+        test_path(path, sizeof(path), name);
+        test_play_game(&replays[i], 6000 + i, 0);
+        if(i == 0) {
+            strcpy(replays[i].player1_initial.name, EXPORT_NAME);
+        }
+        CHECK(replay_save(path, &replays[i]), "replay_save %d", i);
+    }
+
+    char* casts[EXPORT_GAMES] = {NULL};
+    size_t sizes[EXPORT_GAMES] = {0};
+    CHECK(run_export(3) == 0, "%s с 3 нишки не завършва успешно", EXPORT_PROGRAM);
+    for(int i = 0; i < EXPORT_GAMES; i++) {
+        cast_path(path, sizeof(path), i);
+        casts[i] = read_text(path, &sizes[i]);
+        CHECK(casts[i] != NULL, "игра %d няма .cast", i);
+        if(casts[i]) {
+            check_cast(casts[i], &replays[i], i);
+        }
+    }
+
+    // Една нишка дава същите файлове байт по байт
+    CHECK(run_export(1) == 0, "%s с 1 нишка не завършва успешно", EXPORT_PROGRAM);
+    for(int i = 0; i < EXPORT_GAMES; i++) {
+        size_t size;
+        cast_path(path, sizeof(path), i);
+        char* text = read_text(path, &size);
+        CHECK(text && casts[i] && size == sizes[i] && memcmp(text, casts[i], size) == 0,
+              "игра %d се експортира различно с 1 и с 3 нишки", i);
+        free(text);
+        free(casts[i]);
+        remove(path);
+    }
+
+    // Повреден запис не спира останалите, но програмата завършва с грешка
+    test_path(path, sizeof(path), "bad.replay");
+    FILE* file = fopen(path, "wb");
+    if(file) {
+        fputs("BSRP повреден", file);
+        fclose(file);
+    }
+    CHECK(run_export(2) == 1, "повреденият запис не е отчетен в кода на изход");
+    for(int i = 0; i < EXPORT_GAMES; i++) {
+        size_t size;
+        cast_path(path, sizeof(path), i);
+        char* text = read_text(path, &size);
+        CHECK(text != NULL, "игра %d не е експортирана заради повредения запис", i);
+        free(text);
+        remove(path);
+    }
+
+    test_path(path, sizeof(path), "bad.replay");
+    remove(path);
+    test_path(path, sizeof(path), "bad.cast");
+    remove(path);
+    for(int i = 0; i < EXPORT_GAMES; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "game_%d.replay", i);
+        test_path(path, sizeof(path), name);
+        remove(path);
+        free_replay(&replays[i]);
+    }
+}
@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <string.h>
+#include "fleetcount.h"
+#include "rng.h"
+#include "test.h"
+
+// Точният брой допустими флоти, номерирането им и равномерното теглене
+#define FLEET_TOTAL 11473425033160ULL
+#define FLEET_CELLS 31
+#define FLEET_SAMPLES 2000
+
+// Флотът е допустим, ако корабите му се поставят отново един по един по правилата на играта
+static int legal_fleet(const Player* player) {
+    static const int ship_sizes[MAX_SHIPS] = {2, 2, 2, 2, 3, 3, 3, 4, 4, 6};
+    Player copy;
+    memset(&copy, 0, sizeof(copy));
+    engine_clear_fleet(&copy);
+    if(player->ship_count != MAX_SHIPS) return 0;
+    for(int i = 0; i < MAX_SHIPS; i++) {
+        const Ship* ship = &player->ships[i];
+        if(ship->length != ship_sizes[i] ||
+           engine_place(&copy, ship->row, ship->col, ship->length, ship->direction) != PLACE_OK) {
+            return 0;
+        }
+    }
+    return copy.ship_mask == player->ship_mask;
+}
+
+static int round_trip(FleetCounter* counter, FleetCount index) {
+    Player player;
+    FleetCount ranked;
+    return fleet_counter_unrank(counter, index, &player) && legal_fleet(&player) &&
+           fleet_counter_rank(counter, &player, &ranked) && ranked == index;
+}
+
+static void check_ranks(FleetCounter* counter) {
+    FleetCount total = fleet_counter_total(counter);
+    FleetCount edges[] = {0, 1, 2, total / 3, total / 2, total - 2, total - 1};
+    for(size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        CHECK(round_trip(counter, edges[i]), "unrank/rank на флот %llu", edges[i]);
+    }
+    Player player;
+    CHECK(!fleet_counter_unrank(counter, total, &player), "unrank приема номер извън броя");
+
+    // Флотите от обикновения генератор също са сред преброените
+    Rng rng;
+    int failed = 0;
+    rng_seed(&rng, 9000, 0);
+    for(int i = 0; i < FLEET_SAMPLES; i++) {
+        FleetCount index;
+        Player sampled;
+        engine_random_fleet(&player, &rng);
+        if(!fleet_counter_rank(counter, &player, &index) || !fleet_counter_unrank(counter, index, &sampled) ||
+           sampled.ship_mask != player.ship_mask) {
+            failed++;
+        }
+        if(!round_trip(counter, rng_next(&rng) % total)) failed++;
+    }
+    CHECK(failed == 0, "%d от %d флота не минават rank/unrank", failed, 2 * FLEET_SAMPLES);
+}
+
+static void check_sample(FleetCounter* counter) {
+    Rng rng;
+    Player player;
+    int failed = 0;
+    rng_seed(&rng, 9001, 0);
+    for(int i = 0; i < FLEET_SAMPLES; i++) {
+        if(!fleet_counter_sample(counter, &player, &rng) || !legal_fleet(&player)) failed++;
+    }
+    CHECK(failed == 0, "%d недопустими флота от fleet_counter_sample", failed);
+
+    // Сумата от вероятностите за клетките е броят клетки на един флот
+    double probability[BOARD_CELLS], sum = 0;
+    CHECK(fleet_counter_occupancy(counter, probability), "fleet_counter_occupancy");
+    for(int cell = 0; cell < BOARD_CELLS; cell++) {
+        sum += probability[cell];
+    }
+    CHECK(sum > FLEET_CELLS - 1e-6 && sum < FLEET_CELLS + 1e-6, "флотът заема средно %f клетки вместо %d", sum,
+          FLEET_CELLS);
+    CHECK(probability[0] == probability[BOARD_CELLS - 1] && probability[BOARD_SIZE - 1] == probability[0],
+          "ъглите на дъската не са еднакво вероятни");
+}
+
+void test_fleetcount(void) {
+    FleetCounter* counter = fleet_counter_create();
+    CHECK(counter != NULL, "fleet_counter_create");
+    if(!counter) return;
+    CHECK(fleet_counter_total(counter) == FLEET_TOTAL, "броят на флотите е %llu вместо %llu",
+          fleet_counter_total(counter), FLEET_TOTAL);
+    check_ranks(counter);
+    check_sample(counter);
+    fleet_counter_free(counter);
+}
@@ -0,0 +1,79 @@
+#include <stdlib.h>
+#include <string.h>
+#include "keyring.h"
+#include "replay.h"
+#include "test.h"
+
+// Главният ключ на директорията, кешът и ключовете на отделните записи
+#define TEST_PASSWORD "test-password"
+#define WRONG_PASSWORD "wrong-password"
+
+static int write_sealed_replay(const char* path, const GameReplay* replay, const char* password) {
+    SealKdf kdf;
+    unsigned char key[SEAL_KEY_SIZE];
+    unsigned char wrapped[SEAL_WRAPPED_SIZE];
+    if(!keyring_new_key(test_dir, password, key, &kdf, wrapped)) return 0;
+
+    ReplayWriter* writer = replay_writer_open_sealed(path, 0, key, &kdf, wrapped);
+    memset(key, 0, sizeof(key));
+    if(!writer) return 0;
+    replay_writer_begin(writer, replay);
+    for(int i = 0; i < replay->move_count; i++) {
+        replay_writer_append(writer, replay_move(replay, i));
+    }
+    replay_writer_finish(writer, replay);
+    return replay_writer_close(writer, 1);
+}
+
+static int read_sealed_replay(KeyringReader* reader, const char* path, const char* password, GameReplay* replay) {
+    const unsigned char* data;
+    size_t size;
+    return keyring_read_file(reader, path, password, &data, &size) && replay_decode(data, size, replay);
+}
+
+void test_keyring(void) {
+    char first[512], second[512];
+    test_path(first, sizeof(first), "first.encrypted");
+    test_path(second, sizeof(second), "second.encrypted");
+
+    GameReplay replays[2];
+    test_play_game(&replays[0], 3000, 0);
+    test_play_game(&replays[1], 3001, 1);
+
+    // Първият запис създава keyring.key; вторият ползва кеша без парола
+    CHECK(write_sealed_replay(first, &replays[0], TEST_PASSWORD), "първи криптиран запис");
+    CHECK(keyring_has_directory_key(test_dir), "главният ключ не е в кеша");
+    CHECK(write_sealed_replay(second, &replays[1], NULL), "втори запис с ключа от кеша");
+
+    // Паролата се проверява по keyring.key, преди да се запише каквото и да е
+    keyring_clear();
+    CHECK(!keyring_has_directory_key(test_dir), "кешът не е изчистен");
+    CHECK(!keyring_unlock_directory(test_dir, WRONG_PASSWORD), "грешната парола е приета от keyring.key");
+    CHECK(!keyring_has_directory_key(test_dir), "грешната парола е сложила ключ в кеша");
+    CHECK(!write_sealed_replay(second, &replays[1], NULL), "запис без парола и без кеш");
+    CHECK(!write_sealed_replay(second, &replays[1], WRONG_PASSWORD), "запис с паролата на друга директория");
+
+    KeyringReader reader;
+    GameReplay loaded;
+    CHECK(keyring_reader_init(&reader), "keyring_reader_init");
+    CHECK(!read_sealed_replay(&reader, first, WRONG_PASSWORD, &loaded), "грешната парола отваря записа");
+    CHECK(!read_sealed_replay(&reader, first, NULL, &loaded), "записът се отваря без парола и без кеш");
+
+    // Една проверена парола отваря всички записи на директорията
+    CHECK(keyring_unlock_directory(test_dir, TEST_PASSWORD), "правилната парола е отхвърлена");
+    for(int i = 0; i < 2; i++) {
+        if(read_sealed_replay(&reader, i ? second : first, NULL, &loaded)) {
+            CHECK(test_compare_replays(&replays[i], &loaded) == -1, "криптираният запис %d се различава", i + 1);
+            free_replay(&loaded);
+        } else {
+            CHECK(0, "криптираният запис %d не се отваря с ключа от кеша", i + 1);
+        }
+    }
+    keyring_reader_free(&reader);
+    keyring_clear();
+
+    remove(first);
+    remove(second);
+    free_replay(&replays[0]);
+    free_replay(&replays[1]);
+}
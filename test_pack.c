@@ -0,0 +1,120 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pack.h"
+#include "test.h"
+
+// Пакетите от записи: добавяне, четене по номер, показване с mmap и прекъснато добавяне
+#define PACK_GAMES 12
+
+static int same_moves(const ReplayMap* map, const GameReplay* replay) {
+    if(map->move_count != replay->move_count) return 0;
+    for(int i = 0; i < map->move_count; i++) {
+        Move move;
+        const Move* expected = replay_move(replay, i);
+        replay_map_move(map, i, &move);
+        if(move.player != expected->player || move.row != expected->row || move.col != expected->col ||
+           move.hit != expected->hit) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// map, върнат преди добавянето на още игри, трябва да остане валиден до pack_close
+static void check_append_and_map(const char* path, GameReplay* replays) {
+    ReplayPack pack;
+    ReplayMap first;
+    CHECK(pack_open(&pack, path, 1), "pack_open за запис");
+    CHECK(pack_append_replay(&pack, "game_0.replay", &replays[0], 0) == 0, "pack_append_replay 0");
+    CHECK(pack_map(&pack, 0, &first, NULL), "pack_map 0");
+
+    for(int i = 1; i < PACK_GAMES; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "game_%d.replay", i);
+        CHECK(pack_append_replay(&pack, name, &replays[i], i % 2) == i, "pack_append_replay %d", i);
+
+        ReplayMap map;
+        CHECK(pack_map(&pack, i, &map, NULL) && same_moves(&map, &replays[i]), "pack_map %d след добавяне", i);
+        replay_map_close(&map);
+    }
+    CHECK(same_moves(&first, &replays[0]), "по-ранният map не е валиден след добавяне на игри");
+    replay_map_close(&first);
+    CHECK(pack_close(&pack), "pack_close");
+}
+
+static void check_read(const char* path, GameReplay* replays) {
+    ReplayPack pack;
+    CHECK(pack_open(&pack, path, 0) && pack.count == PACK_GAMES, "пакетът има %d игри вместо %d", pack.count,
+          PACK_GAMES);
+    for(int i = 0; i < pack.count && i < PACK_GAMES; i++) {
+        unsigned char* data;
+        size_t size;
+        GameReplay loaded;
+        char name[32];
+        snprintf(name, sizeof(name), "game_%d.replay", i);
+        CHECK(strcmp(pack.entries[i].name, name) == 0, "името на игра %d е %s", i, pack.entries[i].name);
+        if(pack_read(&pack, i, &data, &size) && replay_decode(data, size, &loaded)) {
+            CHECK(test_compare_replays(&replays[i], &loaded) == -1, "игра %d от пакета се различава", i);
+            free_replay(&loaded);
+            free(data);
+        } else {
+            CHECK(0, "игра %d не се чете от пакета", i);
+        }
+    }
+    pack_close(&pack);
+}
+
+// Без индекса в края пакетът се чете до последната цяла игра
+static void check_torn(const char* path, GameReplay* replays) {
+    ReplayPack pack;
+    unsigned long long index_offset = 0;
+    if(pack_open(&pack, path, 0)) {
+        index_offset = pack.index_offset;
+        pack_close(&pack);
+    }
+    CHECK(index_offset && truncate(path, (off_t)index_offset - 5) == 0, "truncate на пакета");
+
+    CHECK(pack_open(&pack, path, 1) && pack.count == PACK_GAMES - 1, "прекъснатият пакет има %d игри вместо %d",
+          pack.count, PACK_GAMES - 1);
+    CHECK(pack_append_replay(&pack, "again.replay", &replays[PACK_GAMES - 1], 1) == PACK_GAMES - 1,
+          "добавяне след прекъснат запис");
+    CHECK(pack_close(&pack), "pack_close");
+
+    ReplayMap map;
+    CHECK(pack_open(&pack, path, 0) && pack.count == PACK_GAMES, "поправеният пакет има %d игри", pack.count);
+    CHECK(pack_map(&pack, PACK_GAMES - 1, &map, NULL) && same_moves(&map, &replays[PACK_GAMES - 1]),
+          "добавената след прекъсването игра");
+    replay_map_close(&map);
+    pack_close(&pack);
+}
+
+static void check_refs(void) {
+    char path[64];
+    int id;
+    CHECK(pack_parse_ref("replays/games.pack#17", path, sizeof(path), &id) && id == 17 &&
+          strcmp(path, "replays/games.pack") == 0, "pack_parse_ref");
+    CHECK(!pack_parse_ref("replays/game.replay", path, sizeof(path), &id), "име без # е прието");
+    CHECK(!pack_parse_ref("games.pack#1x", path, sizeof(path), &id), "невалиден номер е приет");
+}
+
+void test_pack(void) {
+    char path[512];
+    test_path(path, sizeof(path), PACK_FILE);
+    GameReplay replays[PACK_GAMES];
+    for(int i = 0; i < PACK_GAMES; i++) {
+        test_play_game(&replays[i], 5000 + i, i % 3 == 0);
+    }
+
+    check_append_and_map(path, replays);
+    check_read(path, replays);
+    check_torn(path, replays);
+    check_refs();
+
+    remove(path);
+    for(int i = 0; i < PACK_GAMES; i++) {
+        free_replay(&replays[i]);
+    }
+}
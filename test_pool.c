@@ -0,0 +1,103 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pool.h"
+#include "test.h"
+
+// Пулът с крадене на задачи: всяка задача веднъж, номерата на нишките и постоянният пул
+#define POOL_TASKS 1000
+#define POOL_SLOW_TASKS 100
+#define POOL_DISPATCHES 200
+
+typedef struct {
+    int runs[POOL_TASKS];
+    int worker[POOL_TASKS];
+    int slow;
+} PoolTest;
+
+static void count_task(int task, int worker, void* arg) {
+    PoolTest* test = arg;
+    test->runs[task]++;
+    test->worker[task] = worker;
+
+    // Задачите от началото са бавни - нишката, на която се падат, трябва да бъде обрана
+    if(task < test->slow) {
+        struct timespec pause = {0, 1000000};
+        nanosleep(&pause, NULL);
+    }
+}
+
+// Всяка задача е изпълнена точно веднъж и от нишка с номер в [0, workers)
+static int check_runs(const PoolTest* test, int tasks, int workers, const char* label) {
+    for(int i = 0; i < tasks; i++) {
+        if(test->runs[i] != 1) {
+            CHECK(0, "%s: задача %d е изпълнена %d пъти", label, i, test->runs[i]);
+            return 0;
+        }
+        if(test->worker[i] < 0 || test->worker[i] >= workers) {
+            CHECK(0, "%s: задача %d е с нишка %d", label, i, test->worker[i]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void check_run(void) {
+    static PoolTest test;
+    int workers[] = {1, 3, 8};
+    int tasks[] = {0, 1, 7, POOL_TASKS};
+    for(int w = 0; w < 3; w++) {
+        for(int t = 0; t < 4; t++) {
+            char label[64];
+            snprintf(label, sizeof(label), "pool_run(%d нишки, %d задачи)", workers[w], tasks[t]);
+            memset(&test, 0, sizeof(test));
+            pool_run(workers[w], tasks[t], count_task, &test);
+            check_runs(&test, tasks[t], workers[w], label);
+        }
+    }
+}
+
+// Бавните задачи са в интервала на нишка 0 - останалите нишки трябва да откраднат от тях
+static void check_stealing(void) {
+    static PoolTest test;
+    int workers = 4;
+    memset(&test, 0, sizeof(test));
+    test.slow = POOL_SLOW_TASKS;
+    pool_run(workers, 4 * POOL_SLOW_TASKS, count_task, &test);
+    if(!check_runs(&test, 4 * POOL_SLOW_TASKS, workers, "крадене")) return;
+
+    int stolen = 0;
+    for(int i = 0; i < POOL_SLOW_TASKS; i++) {
+        stolen += test.worker[i] != 0;
+    }
+    CHECK(stolen > 0, "никоя от бавните задачи на нишка 0 не е открадната");
+}
+
+// Постоянният пул се ползва много пъти подред, както от компютъра по един път на ход
+static void check_dispatch(void) {
+    static PoolTest test;
+    int workers = 3;
+    WorkerPool* pool = pool_create(workers);
+    CHECK(pool != NULL, "pool_create");
+    for(int i = 0; i < POOL_DISPATCHES; i++) {
+        int tasks = i % 2 ? POOL_TASKS : i % 17;
+        memset(&test, 0, sizeof(test));
+        pool_dispatch(pool, tasks, count_task, &test);
+        if(!check_runs(&test, tasks, workers, "pool_dispatch")) break;
+    }
+    pool_destroy(pool);
+
+    // Без пул задачите се изпълняват в извикващата нишка като нишка 0
+    memset(&test, 0, sizeof(test));
+    pool_dispatch(NULL, POOL_TASKS, count_task, &test);
+    check_runs(&test, POOL_TASKS, 1, "pool_dispatch без пул");
+}
+
+void test_pool(void) {
+    CHECK(pool_default_workers() >= 1, "pool_default_workers");
+    check_run();
+    check_stealing();
+    check_dispatch();
+}
@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <string.h>
+#include "rangecoder.h"
+#include "replay.h"
+#include "test.h"
+
+// Аритметичният кодер и компресираният запис BSRZ
+#define COMPRESS_GAMES 40
+#define CODER_SYMBOLS 5000
+
+// Битове с изкривено разпределение, равномерни числа и дървета минават през кодера и обратно
+static void check_coder(void) {
+    Rng rng;
+    rng_seed(&rng, 7, 0);
+    unsigned int* values = malloc(CODER_SYMBOLS * 3 * sizeof(unsigned int));
+    if(!values) return;
+    for(int i = 0; i < CODER_SYMBOLS; i++) {
+        values[3 * i] = rng_below(&rng, 10) == 0;
+        values[3 * i + 1] = rng_below(&rng, 1000 + i);
+        values[3 * i + 2] = rng_below(&rng, 64);
+    }
+
+    RcEncoder encoder;
+    RcProb bit_prob[1], tree_probs[64];
+    rc_encoder_init(&encoder);
+    rc_probs_init(bit_prob, 1);
+    rc_probs_init(tree_probs, 64);
+    for(int i = 0; i < CODER_SYMBOLS; i++) {
+        rc_encode_bit(&encoder, bit_prob, (int)values[3 * i]);
+        rc_encode_uniform(&encoder, values[3 * i + 1], 1000 + i);
+        rc_encode_tree(&encoder, tree_probs, 6, values[3 * i + 2]);
+    }
+    CHECK(rc_encoder_finish(&encoder), "rc_encoder_finish");
+
+    RcDecoder decoder;
+    rc_decoder_init(&decoder, encoder.data, encoder.size);
+    rc_probs_init(bit_prob, 1);
+    rc_probs_init(tree_probs, 64);
+    int mismatch = -1;
+    for(int i = 0; i < CODER_SYMBOLS && mismatch < 0; i++) {
+        unsigned int bit = rc_decode_bit(&decoder, bit_prob);
+        unsigned int uniform = rc_decode_uniform(&decoder, 1000 + i);
+        unsigned int tree = rc_decode_tree(&decoder, tree_probs, 6);
+        if(bit != values[3 * i] || uniform != values[3 * i + 1] || tree != values[3 * i + 2]) {
+            mismatch = i;
+        }
+    }
+    CHECK(mismatch < 0 && !decoder.failed, "кодерът връща различно число на позиция %d", mismatch);
+    free(encoder.data);
+    free(values);
+}
+
+static void check_compressed(const GameReplay* replay, const char* label, size_t* plain_total, size_t* packed_total) {
+    unsigned char* data;
+    size_t size;
+    unsigned char* packed;
+    size_t packed_size;
+    GameReplay decoded;
+
+    CHECK(replay_encode(replay, &data, &size), "%s: replay_encode", label);
+    CHECK(replay_compress(data, size, &packed, &packed_size), "%s: replay_compress", label);
+    CHECK(packed_size < size, "%s: BSRZ (%zu байта) не е по-малък от BSRP (%zu байта)", label, packed_size, size);
+    CHECK(replay_decode(packed, packed_size, &decoded), "%s: BSRZ replay_decode", label);
+    CHECK(test_compare_replays(replay, &decoded) == -1, "%s: BSRZ се различава", label);
+    free_replay(&decoded);
+
+    // Отрязаният компресиран запис не трябва да се приема
+    CHECK(!replay_decode(packed, packed_size / 2, &decoded), "%s: отрязаният BSRZ е приет", label);
+    // Незавършеният запис не се компресира
+    unsigned char* rejected = NULL;
+    size_t rejected_size;
+    CHECK(!replay_compress(data, size - 2, &rejected, &rejected_size), "%s: незавършеният запис е компресиран", label);
+    free(rejected);
+
+    *plain_total += size;
+    *packed_total += packed_size;
+    free(packed);
+    free(data);
+}
+
+void test_rangecoder(void) {
+    check_coder();
+
+    size_t plain_total = 0, packed_total = 0;
+    for(int i = 0; i < COMPRESS_GAMES; i++) {
+        GameReplay replay;
+        char label[64];
+        snprintf(label, sizeof(label), "игра %d", i);
+        test_play_game(&replay, 1000 + i, i % 2);
+        check_compressed(&replay, label, &plain_total, &packed_total);
+        free_replay(&replay);
+    }
+
+    printf("BSRP: %.0f байта на игра, BSRZ: %.0f байта на игра (%.2fx)\n",
+           (double)plain_total / COMPRESS_GAMES, (double)packed_total / COMPRESS_GAMES,
+           packed_total ? (double)plain_total / packed_total : 0.0);
+}
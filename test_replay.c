@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <string.h>
+#include "replay.h"
+#include "test.h"
+
+// Компактният формат BSRP, поточният запис (.part) и четенето на старата сурова структура
+#define REPLAY_GAMES 40
+
+// Стара структура от първата версия на играта - така, както е записвана с fwrite
+typedef struct {
+    int row, col;
+    int length;
+    Direction direction;
+    int hits;
+    int sunk;
+} BaselineShip;
+
+typedef struct {
+    CellState board[BOARD_SIZE][BOARD_SIZE];
+    CellState attacks[BOARD_SIZE][BOARD_SIZE];
+    BaselineShip ships[MAX_SHIPS];
+    int ship_count;
+    int ships_sunk;
+    char name[32];
+    int is_ai;
+} BaselinePlayer;
+
+typedef struct {
+    char player_name[32];
+    int row, col;
+    int hit;
+    int ship_sunk;
+    int ship_length;
+    char timestamp[30];
+} BaselineMove;
+
+typedef struct {
+    BaselinePlayer player1_initial;
+    BaselinePlayer player2_initial;
+    BaselineMove moves[200];
+    int move_count;
+    char winner[32];
+    char start_time[30];
+    char end_time[30];
+} BaselineReplay;
+
+static void to_baseline(const GameReplay* replay, BaselineReplay* baseline) {
+    memset(baseline, 0, sizeof(BaselineReplay));
+    const Player* players[2] = {&replay->player1_initial, &replay->player2_initial};
+    BaselinePlayer* targets[2] = {&baseline->player1_initial, &baseline->player2_initial};
+
+    for(int p = 0; p < 2; p++) {
+        strcpy(targets[p]->name, players[p]->name);
+        targets[p]->is_ai = players[p]->is_ai;
+        targets[p]->ship_count = players[p]->ship_count;
+        for(int i = 0; i < players[p]->ship_count; i++) {
+            const Ship* ship = &players[p]->ships[i];
+            BaselineShip* old = &targets[p]->ships[i];
+            old->row = ship->row;
+            old->col = ship->col;
+            old->length = ship->length;
+            old->direction = ship->direction;
+        }
+        for(int cell = 0; cell < BOARD_CELLS; cell++) {
+            if(players[p]->ship_mask & ((Bitboard)1 << cell)) {
+                targets[p]->board[cell / BOARD_SIZE][cell % BOARD_SIZE] = SHIP;
+            }
+        }
+    }
+
+    baseline->move_count = replay->move_count < 200 ? replay->move_count : 200;
+    for(int i = 0; i < baseline->move_count; i++) {
+        const Move* move = replay_move(replay, i);
+        BaselineMove* old = &baseline->moves[i];
+        strcpy(old->player_name, move->player_name);
+        old->row = move->row;
+        old->col = move->col;
+        old->hit = move->hit;
+        old->ship_sunk = move->ship_sunk;
+        old->ship_length = move->ship_length;
+        strcpy(old->timestamp, move->timestamp);
+    }
+    strcpy(baseline->winner, replay->winner);
+    strcpy(baseline->start_time, replay->start_time);
+    strcpy(baseline->end_time, replay->end_time);
+}
+
+static void check_encoding(const GameReplay* replay, const char* label) {
+    unsigned char* data;
+    size_t size;
+    GameReplay decoded;
+
+    CHECK(replay_encode(replay, &data, &size), "%s: replay_encode", label);
+    CHECK(replay_decode(data, size, &decoded), "%s: replay_decode", label);
+    int diff = test_compare_replays(replay, &decoded);
+    CHECK(diff == -1, "%s: BSRP се различава (ход %d)", label, diff);
+    free_replay(&decoded);
+
+    // Повреденият край не трябва да се приема като завършен запис
+    CHECK(size < 2 || !replay_decode(data, size - 2, &decoded), "%s: отрязаният запис е приет", label);
+    free(data);
+}
+
+static void check_baseline(const GameReplay* replay, const char* label) {
+    BaselineReplay* baseline = malloc(sizeof(BaselineReplay));
+    if(!baseline) return;
+    to_baseline(replay, baseline);
+
+    GameReplay loaded;
+    CHECK(replay_decode((const unsigned char*)baseline, sizeof(BaselineReplay), &loaded),
+          "%s: старата структура не се чете", label);
+    if(replay->move_count <= 200) {
+        // Старият формат няма seed и настройки на компютъра - всичко останало трябва да съвпада
+        loaded.seed = replay->seed;
+        memcpy(loaded.ai, replay->ai, sizeof(loaded.ai));
+        CHECK(test_compare_replays(replay, &loaded) == -1, "%s: старата структура се различава", label);
+    }
+    free_replay(&loaded);
+
+    CHECK(!replay_decode((const unsigned char*)baseline, sizeof(BaselineReplay) - 8, &loaded),
+          "%s: непознат размер на старата структура е приет", label);
+    baseline->player1_initial.ship_count = 1000;
+    CHECK(!replay_decode((const unsigned char*)baseline, sizeof(BaselineReplay), &loaded),
+          "%s: невалиден брой кораби е приет", label);
+    free(baseline);
+}
+
+static void check_stream(const GameReplay* replay, const char* label) {
+    char path[512];
+    test_path(path, sizeof(path), "stream.replay");
+
+    ReplayWriter* writer = replay_writer_open(path, 0);
+    CHECK(writer != NULL, "%s: replay_writer_open", label);
+    if(!writer) return;
+    replay_writer_begin(writer, replay);
+    for(int i = 0; i < replay->move_count; i++) {
+        replay_writer_append(writer, replay_move(replay, i));
+    }
+    replay_writer_finish(writer, replay);
+    CHECK(replay_writer_close(writer, 1), "%s: replay_writer_close", label);
+
+    GameReplay loaded;
+    CHECK(replay_load(path, &loaded), "%s: replay_load на поточния запис", label);
+    CHECK(test_compare_replays(replay, &loaded) == -1, "%s: поточният запис се различава", label);
+    free_replay(&loaded);
+    remove(path);
+}
+
+// Прекъсната игра: .part остава на диска и се чете до последния записан ход
+static void check_recover(const GameReplay* replay, const char* label) {
+    char path[512], part_path[520];
+    test_path(path, sizeof(path), "crash.replay");
+    snprintf(part_path, sizeof(part_path), "%s.part", path);
+
+    int written = replay->move_count / 2;
+    ReplayWriter* writer = replay_writer_open(path, 1);
+    CHECK(writer != NULL, "%s: replay_writer_open", label);
+    if(!writer) return;
+    replay_writer_begin(writer, replay);
+    for(int i = 0; i < written; i++) {
+        replay_writer_append(writer, replay_move(replay, i));
+    }
+    CHECK(replay_writer_abandon(writer), "%s: replay_writer_abandon", label);
+
+    GameReplay recovered;
+    int complete = 1;
+    CHECK(replay_recover(part_path, &recovered, &complete), "%s: replay_recover", label);
+    CHECK(!complete && recovered.move_count == written, "%s: възстановени %d хода вместо %d", label,
+          recovered.move_count, written);
+    for(int i = 0; i < written && i < recovered.move_count; i++) {
+        const Move* a = replay_move(replay, i);
+        const Move* b = replay_move(&recovered, i);
+        if(a->player != b->player || a->row != b->row || a->col != b->col || a->hit != b->hit) {
+            CHECK(0, "%s: възстановеният ход %d се различава", label, i);
+            break;
+        }
+    }
+    free_replay(&recovered);
+    remove(part_path);
+}
+
+void test_replay(void) {
+    for(int i = 0; i < REPLAY_GAMES; i++) {
+        GameReplay replay;
+        char label[64];
+        int same_names = i % 2;
+        snprintf(label, sizeof(label), "игра %d%s", i, same_names ? " (еднакви имена)" : "");
+
+        test_play_game(&replay, 1000 + i, same_names);
+        check_encoding(&replay, label);
+        check_stream(&replay, label);
+        check_recover(&replay, label);
+        check_baseline(&replay, label);
+        free_replay(&replay);
+    }
+}
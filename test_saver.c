@@ -0,0 +1,139 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include "saver.h"
+#include "test.h"
+
+// Фоновата нишка за запазване: редът на задачите, ограничената опашка и къде се вика done
+#define SAVER_TEST_JOBS (3 * SAVER_CAPACITY + 1)
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t opened;
+    int open;
+    int ran;
+    int delivered;
+    int order_broken;
+    int wrong_thread;
+    pthread_t game_thread;
+} SaverTest;
+
+typedef struct {
+    SaverTest* test;
+    int index;
+    int wait;
+} SaverTestJob;
+
+// Задачите с wait чакат, докато проверката "отвори" - така опашката остава пълна
+static int test_job(void* data) {
+    SaverTestJob* job = data;
+    SaverTest* test = job->test;
+    pthread_mutex_lock(&test->lock);
+    while(job->wait && !test->open) {
+        pthread_cond_wait(&test->opened, &test->lock);
+    }
+    test->ran++;
+    pthread_mutex_unlock(&test->lock);
+    return job->index % 2;
+}
+
+static void test_done(void* data, int ok) {
+    SaverTestJob* job = data;
+    SaverTest* test = job->test;
+    if(job->index != test->delivered || ok != job->index % 2) test->order_broken = 1;
+    if(!pthread_equal(pthread_self(), test->game_thread)) test->wrong_thread = 1;
+    test->delivered++;
+}
+
+static void open_gate(SaverTest* test) {
+    pthread_mutex_lock(&test->lock);
+    test->open = 1;
+    pthread_cond_broadcast(&test->opened);
+    pthread_mutex_unlock(&test->lock);
+}
+
+static void init_test(SaverTest* test, SaverTestJob* jobs) {
+    pthread_mutex_init(&test->lock, NULL);
+    pthread_cond_init(&test->opened, NULL);
+    test->open = test->ran = test->delivered = 0;
+    test->order_broken = test->wrong_thread = 0;
+    test->game_thread = pthread_self();
+    for(int i = 0; i < SAVER_TEST_JOBS; i++) {
+        jobs[i].test = test;
+        jobs[i].index = i;
+        jobs[i].wait = 0;
+    }
+}
+
+static void destroy_test(SaverTest* test) {
+    pthread_cond_destroy(&test->opened);
+    pthread_mutex_destroy(&test->lock);
+}
+
+// saver_poll не чака незавършени задачи, saver_flush ги изчаква всички
+static void check_poll_and_flush(void) {
+    SaverTest test;
+    SaverTestJob jobs[SAVER_TEST_JOBS];
+    init_test(&test, jobs);
+    Saver* saver = saver_start();
+    CHECK(saver != NULL, "saver_start");
+    if(!saver) return;
+
+    jobs[0].wait = 1;
+    for(int i = 0; i < SAVER_CAPACITY; i++) {
+        saver_submit(saver, test_job, test_done, &jobs[i]);
+    }
+    saver_poll(saver);
+    CHECK(test.delivered == 0, "saver_poll съобщава незавършена задача");
+
+    open_gate(&test);
+    saver_flush(saver);
+    CHECK(test.ran == SAVER_CAPACITY && test.delivered == SAVER_CAPACITY,
+          "saver_flush съобщи %d от %d задачи", test.delivered, SAVER_CAPACITY);
+    CHECK(!test.order_broken, "задачите са съобщени в друг ред или с друг резултат");
+    CHECK(!test.wrong_thread, "done се вика извън нишката, която вика saver_flush");
+
+    saver_stop(saver);
+    destroy_test(&test);
+}
+
+// Повече задачи от размера на опашката: saver_submit изчаква място, а saver_stop
+// съобщава всички подадени задачи, преди да спре нишката
+static void check_full_queue(void) {
+    SaverTest test;
+    SaverTestJob jobs[SAVER_TEST_JOBS];
+    init_test(&test, jobs);
+    Saver* saver = saver_start();
+    CHECK(saver != NULL, "saver_start");
+    if(!saver) return;
+
+    open_gate(&test);
+    for(int i = 0; i < SAVER_TEST_JOBS; i++) {
+        saver_submit(saver, test_job, test_done, &jobs[i]);
+    }
+    CHECK(test.delivered >= SAVER_TEST_JOBS - SAVER_CAPACITY,
+          "опашката държи %d незавършени задачи (най-много %d)", SAVER_TEST_JOBS - test.delivered, SAVER_CAPACITY);
+    saver_stop(saver);
+    CHECK(test.delivered == SAVER_TEST_JOBS && !test.order_broken && !test.wrong_thread,
+          "saver_stop съобщи %d от %d задачи", test.delivered, SAVER_TEST_JOBS);
+    destroy_test(&test);
+}
+
+// Без нишка задачата се изпълнява и съобщава веднага при подаването
+static void check_without_thread(void) {
+    SaverTest test;
+    SaverTestJob jobs[SAVER_TEST_JOBS];
+    init_test(&test, jobs);
+    saver_submit(NULL, test_job, test_done, &jobs[0]);
+    saver_submit(NULL, test_job, test_done, &jobs[1]);
+    CHECK(test.ran == 2 && test.delivered == 2 && !test.order_broken, "saver_submit без нишка");
+    saver_flush(NULL);
+    saver_stop(NULL);
+    destroy_test(&test);
+}
+
+void test_saver(void) {
+    check_poll_and_flush();
+    check_full_queue();
+    check_without_thread();
+}
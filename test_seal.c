@@ -0,0 +1,229 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <openssl/rand.h>
+#include "replay.h"
+#include "seal.h"
+#include "test.h"
+
+// Криптираните файлове на парчета (AES-256-GCM) - без keyring, с ключ, даден направо
+#define SEAL_TEST_SIZE (5 * SEAL_CHUNK_SIZE + 123)
+#define SEAL_RECORD (SEAL_NONCE_SIZE + SEAL_CHUNK_SIZE + SEAL_TAG_SIZE)
+
+static unsigned char test_key[SEAL_KEY_SIZE];
+static SealKdf test_kdf;
+static unsigned char test_wrapped[SEAL_WRAPPED_SIZE];
+
+// Записва data на парчета с неравен размер, за да минат и границите между парчетата
+static int write_sealed(const char* path, const unsigned char* data, size_t size) {
+    SealedFile sealed;
+    if(!seal_create(&sealed, path, test_key, &test_kdf, test_wrapped)) return 0;
+    size_t done = 0, step = 1;
+    while(done < size) {
+        size_t part = size - done < step ? size - done : step;
+        seal_write(&sealed, data + done, part);
+        done += part;
+        step = step * 3 + 1;
+    }
+    return seal_close(&sealed);
+}
+
+// Отваря файла и чете всичко; complete получава дали последното парче е отбелязано
+static int read_sealed(const char* path, const unsigned char* key, unsigned char* out, size_t size,
+                       size_t* read, int* complete) {
+    SealedFile sealed;
+    if(!seal_open(&sealed, path)) return 0;
+    if(!seal_unlock(&sealed, key)) {
+        seal_close(&sealed);
+        return 0;
+    }
+    *complete = sealed.complete;
+    *read = seal_read(&sealed, 0, out, size);
+    int ok = *read == sealed.size;
+    seal_close(&sealed);
+    return ok;
+}
+
+static void swap_records(const char* path, int first, int second) {
+    unsigned char a[SEAL_RECORD], b[SEAL_RECORD];
+    FILE* file = fopen(path, "r+b");
+    if(!file) return;
+    long offset_a = SEAL_HEADER_SIZE + (long)first * SEAL_RECORD;
+    long offset_b = SEAL_HEADER_SIZE + (long)second * SEAL_RECORD;
+    fseek(file, offset_a, SEEK_SET);
+    size_t ok = fread(a, 1, SEAL_RECORD, file);
+    fseek(file, offset_b, SEEK_SET);
+    ok += fread(b, 1, SEAL_RECORD, file);
+    if(ok == 2 * SEAL_RECORD) {
+        fseek(file, offset_a, SEEK_SET);
+        fwrite(b, 1, SEAL_RECORD, file);
+        fseek(file, offset_b, SEEK_SET);
+        fwrite(a, 1, SEAL_RECORD, file);
+    }
+    fclose(file);
+}
+
+static void flip_byte(const char* path, long offset) {
+    FILE* file = fopen(path, "r+b");
+    if(!file) return;
+    fseek(file, offset, SEEK_SET);
+    int byte = fgetc(file);
+    fseek(file, offset, SEEK_SET);
+    fputc(byte ^ 1, file);
+    fclose(file);
+}
+
+static void check_chunks(void) {
+    char path[512];
+    test_path(path, sizeof(path), "chunks.sealed");
+    unsigned char* data = malloc(SEAL_TEST_SIZE);
+    unsigned char* out = malloc(SEAL_TEST_SIZE);
+    if(!data || !out) {
+        free(data);
+        free(out);
+        return;
+    }
+    for(int i = 0; i < SEAL_TEST_SIZE; i++) {
+        data[i] = (unsigned char)(i * 7 + i / 300);
+    }
+
+    size_t read;
+    int complete;
+    CHECK(write_sealed(path, data, SEAL_TEST_SIZE), "seal_create/seal_write/seal_close");
+    CHECK(read_sealed(path, test_key, out, SEAL_TEST_SIZE, &read, &complete) && read == SEAL_TEST_SIZE &&
+          complete && memcmp(data, out, SEAL_TEST_SIZE) == 0, "криптираният файл не се чете обратно");
+
+    // Четене от средата, през границата на две парчета
+    SealedFile sealed;
+    unsigned char middle[100];
+    if(seal_open(&sealed, path) && seal_unlock(&sealed, test_key)) {
+        CHECK(seal_read(&sealed, 2 * SEAL_CHUNK_SIZE - 50, middle, 100) == 100 &&
+              memcmp(middle, data + 2 * SEAL_CHUNK_SIZE - 50, 100) == 0, "seal_read през границата на парчета");
+    } else {
+        CHECK(0, "seal_open/seal_unlock");
+    }
+    seal_close(&sealed);
+
+    unsigned char wrong_key[SEAL_KEY_SIZE];
+    memcpy(wrong_key, test_key, SEAL_KEY_SIZE);
+    wrong_key[0] ^= 1;
+    CHECK(!read_sealed(path, wrong_key, out, SEAL_TEST_SIZE, &read, &complete), "грешният ключ е приет");
+
+    // Парчета, разменени на място, не минават проверката
+    swap_records(path, 1, 2);
+    CHECK(!read_sealed(path, test_key, out, SEAL_TEST_SIZE, &read, &complete), "разменените парчета са приети");
+
+    // Променен байт в едно парче: останалите се четат, а то - не
+    CHECK(write_sealed(path, data, SEAL_TEST_SIZE), "повторен запис");
+    flip_byte(path, SEAL_HEADER_SIZE + 3 * SEAL_RECORD + 40);
+    CHECK(!read_sealed(path, test_key, out, SEAL_TEST_SIZE, &read, &complete) && read == 3 * SEAL_CHUNK_SIZE,
+          "промененото парче е прието (прочетени %zu байта)", read);
+
+    // Отрязаният файл се чете до последното цяло парче, но не е завършен
+    CHECK(write_sealed(path, data, SEAL_TEST_SIZE), "повторен запис");
+    CHECK(truncate(path, SEAL_HEADER_SIZE + 2 * SEAL_RECORD + 10) == 0, "truncate");
+    CHECK(read_sealed(path, test_key, out, SEAL_TEST_SIZE, &read, &complete) && !complete &&
+          read == 2 * SEAL_CHUNK_SIZE && memcmp(data, out, read) == 0, "отрязаният файл не се чете до цяло парче");
+
+    remove(path);
+    free(data);
+    free(out);
+}
+
+// Поточният криптиран запис на игра - ходовете се криптират при добавянето
+static void check_sealed_replay(unsigned long long seed) {
+    char path[512];
+    test_path(path, sizeof(path), "sealed.encrypted");
+    GameReplay replay;
+    test_play_game(&replay, seed, 1);
+
+    ReplayWriter* writer = replay_writer_open_sealed(path, 0, test_key, &test_kdf, test_wrapped);
+    CHECK(writer != NULL, "replay_writer_open_sealed");
+    if(!writer) {
+        free_replay(&replay);
+        return;
+    }
+    replay_writer_begin(writer, &replay);
+    for(int i = 0; i < replay.move_count; i++) {
+        replay_writer_append(writer, replay_move(&replay, i));
+    }
+    replay_writer_finish(writer, &replay);
+    CHECK(replay_writer_close(writer, 1), "криптираният replay_writer_close");
+
+    SealedFile sealed;
+    GameReplay loaded;
+    if(seal_open(&sealed, path) && seal_unlock(&sealed, test_key)) {
+        unsigned char* data = malloc(sealed.size ? sealed.size : 1);
+        if(data && seal_read(&sealed, 0, data, sealed.size) == sealed.size) {
+            CHECK(sealed.complete && replay_decode(data, sealed.size, &loaded), "криптираният replay_decode");
+            CHECK(test_compare_replays(&replay, &loaded) == -1, "криптираният запис се различава");
+            free_replay(&loaded);
+        } else {
+            CHECK(0, "криптираният запис не се чете");
+        }
+        free(data);
+    } else {
+        CHECK(0, "криптираният запис не се отваря");
+    }
+    seal_close(&sealed);
+    remove(path);
+    free_replay(&replay);
+}
+
+// Прекъснатата криптирана игра: .part се пише криптиран от първия ход и се възстановява
+static void check_sealed_recover(unsigned long long seed) {
+    char path[512], part_path[520];
+    test_path(path, sizeof(path), "crash.encrypted");
+    snprintf(part_path, sizeof(part_path), "%s.part", path);
+    GameReplay replay;
+    test_play_game(&replay, seed, 0);
+
+    int written = replay.move_count / 2;
+    ReplayWriter* writer = replay_writer_open_sealed(path, 1, test_key, &test_kdf, test_wrapped);
+    CHECK(writer != NULL, "replay_writer_open_sealed за прекъсната игра");
+    if(!writer) {
+        free_replay(&replay);
+        return;
+    }
+    replay_writer_begin(writer, &replay);
+    for(int i = 0; i < written; i++) {
+        replay_writer_append(writer, replay_move(&replay, i));
+    }
+    CHECK(replay_writer_abandon(writer), "криптираният replay_writer_abandon");
+
+    SealedFile sealed;
+    GameReplay recovered;
+    int complete = 1;
+    if(seal_open(&sealed, part_path) && seal_unlock(&sealed, test_key)) {
+        unsigned char* data = malloc(sealed.size ? sealed.size : 1);
+        if(data && seal_read(&sealed, 0, data, sealed.size) == sealed.size &&
+           replay_recover_data(data, sealed.size, &recovered, &complete)) {
+            CHECK(!complete && recovered.move_count == written, "от криптирания .part са възстановени %d хода вместо %d",
+                  recovered.move_count, written);
+            free_replay(&recovered);
+        } else {
+            CHECK(0, "криптираният .part не се възстановява");
+        }
+        free(data);
+    } else {
+        CHECK(0, "криптираният .part не се отваря");
+    }
+    seal_close(&sealed);
+    remove(part_path);
+    free_replay(&replay);
+}
+
+void test_seal(void) {
+    RAND_bytes(test_key, sizeof(test_key));
+    memset(&test_kdf, 0, sizeof(test_kdf));
+    test_kdf.algorithm = SEAL_KDF_PBKDF2_SHA256;
+    test_kdf.iterations = SEAL_LEGACY_ITERATIONS;
+    memset(test_wrapped, 0, sizeof(test_wrapped));
+
+    check_chunks();
+    check_sealed_replay(2000);
+    check_sealed_replay(2001);
+    check_sealed_recover(2002);
+}